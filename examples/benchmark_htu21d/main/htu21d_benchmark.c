@@ -0,0 +1,279 @@
+/**
+ * @file htu21d_benchmark.c
+ * @brief Benchmark of this HTU21D sensor ESP-IDF component: latency,
+ * throughput and CPU time per sample.
+ *
+ * Sweeps the resolution, the I2C clock, the way the end of a conversion is
+ * awaited and what is sampled, and prints one JSON line per combination. On
+ * the linux target, the sensor is simulated (see htu21d_sim.h) and the time
+ * each transaction would take on the wire is added.
+ * @author Rob4226 <Rob4226@yahoo.com>
+ * @version 0.1
+ * @date 10.18.2026
+ * @copyright MIT License 2023
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "htu21d.h"
+#include "htu21d_port.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "htu21d_sim.h"
+#elif !defined(HTU21D_I2C_LEGACY)
+#error "The benchmark uses the legacy I2C driver, see HTU21D -> I2C driver in menuconfig."
+#endif
+
+#define I2C_SDA_PIN 1
+#define I2C_SCL_PIN 2
+
+#define BENCH_SAMPLES       50  /**< Samples measured per combination. */
+#define POLL_TIMEOUT_MS     100 /**< Gives up polling a conversion after this long. */
+
+static const char *TAG = "BENCHMARK";
+
+/** How the end of a conversion is awaited. */
+typedef enum {
+    COMPLETION_FIXED,       /**< #HTU21D_CONVERSION_TIME_MS, whatever the resolution, as htu21d_read_*() do. */
+    COMPLETION_DATASHEET,   /**< The datasheet maximum for the resolution. */
+    COMPLETION_POLL,        /**< Read every tick until the sensor acknowledges. */
+    COMPLETION_COUNT,
+} completion_t;
+
+/** What a sample is made of. */
+typedef enum {
+    SAMPLE_TEMPERATURE,     /**< Temperature only. */
+    SAMPLE_HUMIDITY,        /**< Relative humidity only. */
+    SAMPLE_BOTH,            /**< Temperature then relative humidity, as htu21d_read_sample(). */
+    SAMPLE_MODE_COUNT,
+} sample_mode_t;
+
+static const char *const completion_names[COMPLETION_COUNT] = {"fixed", "datasheet", "poll"};
+static const char *const sample_mode_names[SAMPLE_MODE_COUNT] = {"temperature", "humidity", "both"};
+
+/** User register resolution bits, and their names. */
+static const uint8_t resolutions[] = {0x00, 0x01, 0x80, 0x81};
+static const char *const resolution_names[] = {"T14/RH12", "T12/RH8", "T13/RH10", "T11/RH11"};
+
+/** Maximum conversion times in milliseconds per datasheet, indexed by `b7 << 1 | b0`. */
+static const uint32_t temperature_max_ms[4] = {50, 13, 25, 7};
+static const uint32_t humidity_max_ms[4] = {16, 3, 5, 8};
+
+static const uint32_t clocks_hz[] = {100000, 400000};
+
+static int64_t latencies_us[BENCH_SAMPLES];
+
+#if CONFIG_IDF_TARGET_LINUX
+static htu21d_sim_t sim;
+static uint32_t wire_clock_hz;
+
+/**
+ * @brief Busy waits for the time `bytes` (address included) take on the wire:
+ * 9 clocks per byte with the acknowledge, plus the start and stop conditions.
+ */
+static void wire_wait(size_t bytes)
+{
+    int64_t end_us = htu21d_port_time_us() + ((int64_t) bytes * 9 + 2) * 1000000 / wire_clock_hz;
+    while (htu21d_port_time_us() < end_us) {
+    }
+}
+
+static int wire_write(void *bus, uint8_t address, const uint8_t *data, size_t len)
+{
+    int ret = htu21d_sim_transport.write(bus, address, data, len);
+    wire_wait((ret == HTU21D_ERR_OK) ? 1 + len : 1);
+    return ret;
+}
+
+static int wire_read(void *bus, uint8_t address, uint8_t *data, size_t len)
+{
+    int ret = htu21d_sim_transport.read(bus, address, data, len);
+    wire_wait((ret == HTU21D_ERR_OK) ? 1 + len : 1);
+    return ret;
+}
+
+static int wire_write_read(void *bus, uint8_t address, const uint8_t *write_data, size_t write_len,
+                           uint8_t *read_data, size_t read_len)
+{
+    int ret = htu21d_sim_transport.write_read(bus, address, write_data, write_len, read_data, read_len);
+    wire_wait((ret == HTU21D_ERR_OK) ? 2 + write_len + read_len : 1);
+    return ret;
+}
+
+/** The simulated sensor, with the wire time of each transaction added. */
+static const htu21d_transport_t wire_transport = {
+    .write = wire_write,
+    .read = wire_read,
+    .write_read = wire_write_read,
+};
+
+static int bench_bus_init(htu21d_dev_t *dev)
+{
+    wire_clock_hz = clocks_hz[0];
+    htu21d_sim_init(&sim, 21.5F, 48.0F);
+    sim.noise_raw = 8;
+    return htu21d_dev_attach(dev, &wire_transport, &sim);
+}
+
+static int bench_set_clock(uint32_t clock_hz)
+{
+    wire_clock_hz = clock_hz;
+    return HTU21D_ERR_OK;
+}
+#else
+static i2c_config_t i2c_config = {
+    .mode = I2C_MODE_MASTER,
+    .sda_io_num = I2C_SDA_PIN,
+    .scl_io_num = I2C_SCL_PIN,
+    .sda_pullup_en = GPIO_PULLUP_ENABLE,
+    .scl_pullup_en = GPIO_PULLUP_ENABLE,
+};
+
+static int bench_bus_init(htu21d_dev_t *dev)
+{
+    i2c_config.master.clk_speed = clocks_hz[0];
+    if (i2c_param_config(I2C_NUM_0, &i2c_config) != ESP_OK) {
+        return HTU21D_ERR_CONFIG;
+    }
+    if (i2c_driver_install(I2C_NUM_0, I2C_MODE_MASTER, 0, 0, 0) != ESP_OK) {
+        return HTU21D_ERR_INSTALL;
+    }
+    return htu21d_dev_init(dev, I2C_NUM_0);
+}
+
+static int bench_set_clock(uint32_t clock_hz)
+{
+    i2c_config.master.clk_speed = clock_hz;
+    return (i2c_param_config(I2C_NUM_0, &i2c_config) == ESP_OK) ? HTU21D_ERR_OK : HTU21D_ERR_CONFIG;
+}
+#endif
+
+/**
+ * @brief Runs one conversion and reads its result.
+ * @param wait_ms Time to wait before reading, unless polling.
+ * @param[in,out] wait_us Receives the time spent waiting, added to its value.
+ * @return Returns the result of the last transaction, an `HTU21D_ERR_*` code.
+ */
+static int convert(htu21d_dev_t *dev, uint8_t command, completion_t completion, uint32_t wait_ms,
+                   int64_t *wait_us)
+{
+    uint16_t raw_value;
+    int64_t start_us;
+
+    int ret = htu21d_dev_trigger(dev, command, NULL);
+    if (ret != HTU21D_ERR_OK) {
+        return ret;
+    }
+
+    if (completion != COMPLETION_POLL) {
+        start_us = htu21d_port_time_us();
+        // vTaskDelay() ends at the n-th tick boundary, which can be up to a
+        // tick early: one more tick makes it at least wait_ms.
+        vTaskDelay(pdMS_TO_TICKS(wait_ms) + 1);
+        *wait_us += htu21d_port_time_us() - start_us;
+        return htu21d_dev_fetch(dev, &raw_value, NULL);
+    }
+
+    // The sensor does not acknowledge its address until the conversion is done.
+    for (TickType_t ticks = 0; ticks < pdMS_TO_TICKS(POLL_TIMEOUT_MS); ticks++) {
+        start_us = htu21d_port_time_us();
+        vTaskDelay(1);
+        *wait_us += htu21d_port_time_us() - start_us;
+        ret = htu21d_dev_fetch(dev, &raw_value, NULL);
+        if (ret != HTU21D_ERR_FAIL) {
+            break;
+        }
+    }
+    return ret;
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Measures #BENCH_SAMPLES back-to-back samples, and prints the summary
+ * as one line of JSON.
+ *
+ * The CPU time of a sample is its latency minus the time spent waiting for
+ * the conversions, i.e. the time spent in the driver and on the bus.
+ */
+static void bench_run(htu21d_dev_t *dev, size_t resolution, uint32_t clock_hz, completion_t completion,
+                      sample_mode_t mode)
+{
+    size_t count = 0;
+    unsigned int failed = 0;
+    int64_t cpu_us = 0;
+    uint32_t temperature_wait_ms = HTU21D_CONVERSION_TIME_MS, humidity_wait_ms = HTU21D_CONVERSION_TIME_MS;
+
+    if (completion == COMPLETION_DATASHEET) {
+        temperature_wait_ms = temperature_max_ms[resolution];
+        humidity_wait_ms = humidity_max_ms[resolution];
+    }
+
+    int64_t start_us = htu21d_port_time_us();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        int64_t begin_us = htu21d_port_time_us(), wait_us = 0;
+        int ret = HTU21D_ERR_OK;
+
+        if (mode != SAMPLE_HUMIDITY) {
+            ret = convert(dev, TRIGGER_TEMP_MEASURE_NOHOLD, completion, temperature_wait_ms, &wait_us);
+        }
+        if (ret == HTU21D_ERR_OK && mode != SAMPLE_TEMPERATURE) {
+            ret = convert(dev, TRIGGER_HUMD_MEASURE_NOHOLD, completion, humidity_wait_ms, &wait_us);
+        }
+        int64_t latency_us = htu21d_port_time_us() - begin_us;
+
+        if (ret != HTU21D_ERR_OK) {
+            failed++;
+            continue;
+        }
+        latencies_us[count++] = latency_us;
+        cpu_us += latency_us - wait_us;
+    }
+    int64_t elapsed_us = htu21d_port_time_us() - start_us;
+
+    int64_t p50_us = 0, p99_us = 0;
+    if (count > 0) {
+        qsort(latencies_us, count, sizeof(latencies_us[0]), compare_int64);
+        p50_us = latencies_us[count / 2];
+        p99_us = latencies_us[count * 99 / 100];
+    }
+    printf("{\"resolution\":\"%s\",\"clock_hz\":%" PRIu32 ",\"completion\":\"%s\",\"mode\":\"%s\","
+           "\"samples\":%u,\"failed\":%u,\"samples_per_s\":%.2f,\"p50_us\":%" PRId64 ",\"p99_us\":%" PRId64
+           ",\"cpu_us\":%.1f}\n",
+           resolution_names[resolution], clock_hz, completion_names[completion], sample_mode_names[mode],
+           (unsigned int) count, failed, (double) count * 1e6 / (double) elapsed_us, p50_us, p99_us,
+           count ? (double) cpu_us / (double) count : 0.0);
+}
+
+void app_main(void)
+{
+    static htu21d_dev_t dev;
+
+    ESP_ERROR_CHECK(bench_bus_init(&dev));
+    ESP_LOGI(TAG, "Sensor found, running the benchmark (%d samples per line).", BENCH_SAMPLES);
+
+    for (size_t resolution = 0; resolution < sizeof(resolutions); resolution++) {
+        ESP_ERROR_CHECK(htu21d_dev_set_resolution(&dev, resolutions[resolution]));
+        for (size_t clock = 0; clock < sizeof(clocks_hz) / sizeof(clocks_hz[0]); clock++) {
+            ESP_ERROR_CHECK(bench_set_clock(clocks_hz[clock]));
+            for (int completion = 0; completion < COMPLETION_COUNT; completion++) {
+                for (int mode = 0; mode < SAMPLE_MODE_COUNT; mode++) {
+                    bench_run(&dev, resolution, clocks_hz[clock], completion, mode);
+                }
+            }
+        }
+    }
+
+    ESP_LOGI(TAG, "Benchmark done.");
+#if CONFIG_IDF_TARGET_LINUX
+    exit(EXIT_SUCCESS);
+#endif
+}
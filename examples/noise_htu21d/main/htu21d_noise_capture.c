@@ -0,0 +1,118 @@
+/**
+ * @file htu21d_noise_capture.c
+ * @brief Captures back-to-back raw samples of the HTU21D sensor at each
+ * resolution, for the noise analysis of `htu21d-noise` (see linux/).
+ *
+ * Prints one CSV line per sample, prefixed with `N,` to tell it from the log:
+ *
+ *     N,<user register resolution bits>,<timestamp_us>,<raw_temperature>,<raw_humidity>
+ *
+ * and one gap marker per failed sample, so that the analysis does not average
+ * across the missing time:
+ *
+ *     G,<user register resolution bits>,<timestamp_us>
+ *
+ * On the linux target, the sensor is simulated (see htu21d_sim.h) with uniform
+ * noise.
+ * @author Rob4226 <Rob4226@yahoo.com>
+ * @version 0.1
+ * @date 10.18.2026
+ * @copyright MIT License 2023
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "htu21d.h"
+#include "htu21d_port.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "htu21d_sim.h"
+#elif !defined(HTU21D_I2C_LEGACY)
+#error "The capture uses the legacy I2C driver, see HTU21D -> I2C driver in menuconfig."
+#endif
+
+#define I2C_SDA_PIN 1
+#define I2C_SCL_PIN 2
+
+/**
+ * Samples captured per resolution. With 0, the first resolution of
+ * `resolutions` is captured until the board is reset, for captures of
+ * several days.
+ */
+#define CAPTURE_SAMPLES     20000
+#define CALIBRATION_ROUNDS  3
+
+static const char *TAG = "NOISE";
+
+/** User register resolution bits captured, in order. */
+static const uint8_t resolutions[] = {0x00, 0x01, 0x80, 0x81};
+
+#if CONFIG_IDF_TARGET_LINUX
+static htu21d_sim_t sim;
+
+static int capture_bus_init(htu21d_dev_t *dev)
+{
+    htu21d_sim_init(&sim, 21.5F, 48.0F);
+    sim.noise_raw = 12;
+    return htu21d_dev_attach(dev, &htu21d_sim_transport, &sim);
+}
+#else
+static int capture_bus_init(htu21d_dev_t *dev)
+{
+    int ret = htu21d_init(I2C_NUM_0, I2C_SDA_PIN, I2C_SCL_PIN, GPIO_PULLUP_ENABLE, GPIO_PULLUP_ENABLE);
+    if (ret != HTU21D_ERR_OK) {
+        return ret;
+    }
+    return htu21d_dev_init(dev, I2C_NUM_0);
+}
+#endif
+
+/**
+ * @brief Captures `samples` samples back to back at one resolution, or
+ * forever if `samples` is 0.
+ */
+static void capture(htu21d_dev_t *dev, uint8_t resolution, uint32_t samples)
+{
+    htu21d_sample_t sample;
+    uint32_t failed = 0;
+
+    ESP_ERROR_CHECK(htu21d_dev_set_resolution(dev, resolution));
+    for (uint32_t i = 0; samples == 0 || i < samples; i++) {
+        if (htu21d_dev_read_sample(dev, &sample) != HTU21D_ERR_OK) {
+            printf("G,0x%02x,%" PRId64 "\n", resolution, htu21d_port_time_us());
+            failed++;
+            continue;
+        }
+        printf("N,0x%02x,%" PRId64 ",%u,%u\n", resolution, sample.timestamp_us, sample.raw_temperature,
+               sample.raw_humidity);
+    }
+    ESP_LOGI(TAG, "Resolution 0x%02x: %" PRIu32 " samples, %" PRIu32 " failed.", resolution, samples - failed,
+             failed);
+}
+
+void app_main(void)
+{
+    static htu21d_dev_t dev;
+
+    ESP_ERROR_CHECK(capture_bus_init(&dev));
+    // Waits for the measured conversion times rather than 50 ms, for the
+    // highest sample rate at each resolution.
+    ESP_ERROR_CHECK(htu21d_dev_calibrate(&dev, CALIBRATION_ROUNDS));
+    ESP_LOGI(TAG, "Capturing, keep the sensor in a stable environment.");
+
+    if (CAPTURE_SAMPLES == 0) {
+        capture(&dev, resolutions[0], 0);
+    }
+    for (size_t i = 0; i < sizeof(resolutions); i++) {
+        capture(&dev, resolutions[i], CAPTURE_SAMPLES);
+    }
+
+    ESP_LOGI(TAG, "Capture done.");
+#if CONFIG_IDF_TARGET_LINUX
+    exit(EXIT_SUCCESS);
+#endif
+}
@@ -10,9 +10,14 @@
  * @date 10.8.2017, 11.29.2023
  */
 
+#include <inttypes.h>
 #include <math.h>
-#include "esp_log.h"
+#include <string.h>
 #include "htu21d.h"
+#include "htu21d_port.h"
+#if CONFIG_HTU21D_CALIBRATION_NVS
+#include "nvs.h"
+#endif
 
 #define HTU21_TEMPERATURE_COEFFICIENT   (-0.15F)   /**< Used in equation to convert Measured Relative Humidity to Temperature Compensated Relative Humidity. */
 #define HTU21_CONSTANT_A                (8.1332F)  /**< Constant `A` used in Partial Pressure from Ambient Temperature formula. */
@@ -22,12 +27,63 @@
 
 static const char* TAG = "htu21d_driver";
 
-static i2c_port_t _port = 0; /**< The I2C port that the HTU21D sensor is connected to. */
+/**
+ * @brief Maximum conversion times in microseconds per datasheet, indexed by the
+ * resolution bits as `b7 << 1 | b0`.
+ */
+static const uint16_t temperature_max_us[4] = {50000, 13000, 25000, 7000};
+static const uint16_t humidity_max_us[4] = {16000, 3000, 5000, 8000};
+
+/**
+ * @brief Maximum HTU31D conversion times in microseconds per datasheet,
+ * temperature and humidity together, indexed by the oversampling ratio (OSR).
+ */
+static const uint16_t htu31d_conversion_max_us[4] = {2600, 4800, 9100, 17700};
+
+/**
+ * @brief OSR of both HTU31D quantities, indexed by the resolution bits as
+ * `b7 << 1 | b0`: the HTU21D resolutions ranked by temperature bits.
+ */
+static const uint8_t htu31d_osr[4] = {3, 1, 2, 0};
+
+/** SCL frequencies tried by #htu21d_dev_probe_clock, slowest first; 400 kHz is the sensor's maximum. */
+static const uint32_t clock_steps_hz[] = {50000, 100000, 200000, 400000};
+
+/**
+ * The sensor used by the functions that do not take a device handle, set up by
+ * #htu21d_init.
+ */
+static htu21d_dev_t _dev = {
+    .address = HTU21D_ADDR,
+};
+
+static int dev_probe(htu21d_dev_t *dev);
+static uint8_t dev_detect_model(htu21d_dev_t *dev);
+static uint8_t dev_trigger_command(htu21d_dev_t *dev, uint8_t command);
+static size_t resolution_index(uint8_t resolution);
+static uint8_t crc8(const uint8_t *data, size_t len);
+static void dev_clear_errors(htu21d_dev_t *dev);
+static void dev_clear_calibration(htu21d_dev_t *dev);
+static void dev_track_clock(htu21d_dev_t *dev, bool failed);
+static int dev_count_error(htu21d_dev_t *dev, int ret);
+static int dev_count_result(htu21d_dev_t *dev, int ret);
+static int dev_fetch(htu21d_dev_t *dev, uint16_t *raw_value, htu21d_timing_t *timing, bool count_nack);
+static int bus_write(htu21d_dev_t *dev, const uint8_t *data, size_t len);
+static int bus_read(htu21d_dev_t *dev, uint8_t *data, size_t len);
+static int bus_command_read(htu21d_dev_t *dev, uint8_t command, uint8_t *data, size_t len);
+static int bus_write_read(htu21d_dev_t *dev, const uint8_t *write_data, size_t write_len,
+                          uint8_t *read_data, size_t read_len);
+
+#ifdef HTU21D_I2C_LEGACY
+/** Configuration of the ports set up by #htu21d_init, kept to change their SCL frequency. */
+static i2c_config_t port_configs[I2C_NUM_MAX];
+#endif
 
 /**
  * @brief Initializes the HTU21D temperature/humidity sensor and the I2C bus.
  *
- * I2C bus runs in master mode @ 100,000.
+ * I2C bus runs in master mode @ 100,000, until #htu21d_dev_probe_clock
+ * changes it.
  * @param port I2C port number to use, can be `I2C_NUM_0` ~ (`I2C_NUM_MAX` - 1).
  * @param sda_pin The GPIO pin number to use for the I2C sda (data) signal.
  * @param scl_pin The GPIO pin number to use for the I2C scl (clock) signal.
@@ -40,10 +96,10 @@ static i2c_port_t _port = 0; /**< The I2C port that the HTU21D sensor is connect
  * found on the I2C bus. Also, a soft reset command is sent, so any error that
  * #htu21d_soft_reset returns is also possible.
  */
+#ifdef HTU21D_I2C_LEGACY
 int htu21d_init(i2c_port_t port, int sda_pin, int scl_pin,  gpio_pullup_t sda_internal_pullup,  gpio_pullup_t scl_internal_pullup)
 {
     esp_err_t ret;
-    _port = port;
 
     // setup i2c controller
     i2c_config_t conf = {0};
@@ -65,26 +121,144 @@ int htu21d_init(i2c_port_t port, int sda_pin, int scl_pin,  gpio_pullup_t sda_in
         ESP_LOGE(TAG, "Failed to install I2C driver: %s", esp_err_to_name(ret));
         return HTU21D_ERR_INSTALL;
     }
+    port_configs[port] = conf;
 
-    // verify if a sensor is present
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    if (cmd == NULL) {
-        ESP_LOGE(TAG, "Not enough dynamic memory");
-        return HTU21D_ERR_FAIL;
+    return htu21d_dev_init(&_dev, port);
+}
+
+/**
+ * @brief Initializes an HTU21D sensor on an I2C bus that is already set up.
+ *
+ * Use it, instead of #htu21d_init, to drive several sensors: each one gets its
+ * own handle, in storage owned by the caller. As the HTU21D has a fixed
+ * address, sensors sharing a port must sit behind a PCA9548A multiplexer:
+ * attach those with #htu21d_dev_attach_mux instead.
+ * @param[out] dev The device handle to initialize.
+ * @param port I2C port the sensor is connected to. The I2C driver must already
+ * be installed on it in master mode.
+ * @return Returns the same error codes as #htu21d_dev_attach.
+ */
+int htu21d_dev_init(htu21d_dev_t *dev, i2c_port_t port)
+{
+    return htu21d_dev_attach(dev, &htu21d_i2c_transport, (void *)(intptr_t) port);
+}
+#endif  // HTU21D_I2C_LEGACY
+
+/**
+ * @brief Initializes an HTU21D sensor reached through any I2C transport.
+ *
+ * All the logic of the driver (commands, conversions, CRC) works through the
+ * transport, so the same code drives the sensor on ESP-IDF (see
+ * #htu21d_dev_init) and, for example, on Linux through `/dev/i2c-N`.
+ *
+ * An HTU31D at the same address is detected and driven through the same
+ * functions, see `htu21d_dev_t.model`: sensors of both generations can be
+ * mixed.
+ * @param[out] dev The device handle to initialize.
+ * @param transport The operations used to reach the bus.
+ * @param bus The bus, passed as-is to the transport operations.
+ * @return Returns #HTU21D_ERR_OK if the sensor is found and reset. Returns
+ * #HTU21D_ERR_INVALID_ARG if an argument is `NULL`, #HTU21D_ERR_NOTFOUND if
+ * the sensor could not be found on the I2C bus, or any error that
+ * #htu21d_dev_soft_reset returns.
+ */
+int htu21d_dev_attach(htu21d_dev_t *dev, const htu21d_transport_t *transport, void *bus)
+{
+    if (dev == NULL || transport == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
     }
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_start(cmd));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_write_byte(
-                                      cmd, (HTU21D_ADDR << 1) | I2C_MASTER_WRITE, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_stop(cmd));
-    ret = i2c_master_cmd_begin(port, cmd, 1000 / portTICK_PERIOD_MS);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "HTU21D sensor not found on bus: %s", esp_err_to_name(ret));
+    dev->transport = transport;
+    dev->bus = bus;
+    dev->address = HTU21D_ADDR;
+    dev->mux = NULL;
+    dev->mux_channel = 0;
+    dev_clear_errors(dev);
+    dev_clear_calibration(dev);
+    dev->clock = (htu21d_clock_t) {
+        0
+    };
+
+    return dev_probe(dev);
+}
+
+/**
+ * @brief Initializes an HTU21D sensor behind an I2C multiplexer channel.
+ *
+ * As the HTU21D has a fixed address, a multiplexer (PCA9548A or compatible)
+ * is the way to put several of them on one bus. Before each transaction with
+ * the sensor, its channel is selected if it is not already.
+ * @param[out] dev The device handle to initialize.
+ * @param mux The multiplexer the sensor is behind, see #htu21d_mux_init. It
+ * must outlive the handle.
+ * @param channel The multiplexer channel the sensor is on, 0 to 7.
+ * @return Returns the same error codes as #htu21d_dev_attach.
+ */
+int htu21d_dev_attach_mux(htu21d_dev_t *dev, htu21d_mux_t *mux, uint8_t channel)
+{
+    if (dev == NULL || mux == NULL || mux->transport == NULL || channel > 7) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+    dev->transport = mux->transport;
+    dev->bus = mux->bus;
+    dev->address = HTU21D_ADDR;
+    dev->mux = mux;
+    dev->mux_channel = channel;
+    dev_clear_errors(dev);
+    dev_clear_calibration(dev);
+    dev->clock = (htu21d_clock_t) {
+        0
+    };
+
+    return dev_probe(dev);
+}
+
+/**
+ * @brief Initializes the handle of an I2C multiplexer (PCA9548A or
+ * compatible: one control byte, one bit per channel).
+ * @param[out] mux The multiplexer handle to initialize.
+ * @param transport The operations used to reach the bus of the multiplexer.
+ * @param bus The bus, passed as-is to the transport operations.
+ * @param address I2C address of the multiplexer, e.g. `0x70`.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is `NULL`.
+ */
+int htu21d_mux_init(htu21d_mux_t *mux, const htu21d_transport_t *transport, void *bus, uint8_t address)
+{
+    if (mux == NULL || transport == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *mux = (htu21d_mux_t) {
+        .transport = transport,
+        .bus = bus,
+        .address = address,
+        .selected = -1,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Checks that the sensor answers, detects its model, then soft resets
+ * it.
+ */
+static int dev_probe(htu21d_dev_t *dev)
+{
+    int ret;
+
+    // verify if a sensor is present
+    ret = bus_write(dev, NULL, 0);
+    if (ret != HTU21D_ERR_OK) {
+        ESP_LOGE(TAG, "HTU21D sensor not found on bus, error: 0x%02X", ret);
         return HTU21D_ERR_NOTFOUND;
     }
-    ESP_LOGI(TAG, "HTU21D sensor initialized successfully.");
+    dev->model = dev_detect_model(dev);
+    dev->pending = HTU31D_READ_T_RH;
+    ESP_LOGI(TAG, "%s sensor initialized successfully.",
+             (dev->model == HTU21D_MODEL_HTU31D) ? "HTU31D" : "HTU21D");
 
     // Per datasheet, it is recommended to soft reset the HTU21D sensor on start:
-    ret = htu21d_soft_reset();
+    ret = htu21d_dev_soft_reset(dev);
     if (ret != HTU21D_ERR_OK) {
         ESP_LOGE(TAG, "Failed to soft reset the HTU21D sensor after initializing it, error: 0x%02X", ret);
         return ret;
@@ -93,21 +267,53 @@ int htu21d_init(i2c_port_t port, int sda_pin, int scl_pin,  gpio_pullup_t sda_in
     return HTU21D_ERR_OK;
 }
 
+/**
+ * @brief Tells an HTU31D from an HTU21D by reading its serial number, a
+ * command the HTU21D does not acknowledge.
+ *
+ * The errors of the attempt are not counted, as it is expected to fail on an
+ * HTU21D.
+ */
+static uint8_t dev_detect_model(htu21d_dev_t *dev)
+{
+    const htu21d_errors_t errors = dev->errors;
+    uint8_t data[4];
+
+    int ret = bus_command_read(dev, HTU31D_READ_SERIAL, data, sizeof(data));
+    dev->errors = errors;
+    // A serial number of zeros has a valid CRC too, as has a bus stuck low.
+    if (ret != HTU21D_ERR_OK || crc8(data, 3) != data[3] || (data[0] | data[1] | data[2]) == 0) {
+        return HTU21D_MODEL_HTU21D;
+    }
+    return HTU21D_MODEL_HTU31D;
+}
+
 /**
  * @brief Read the temperature from the HTU21D sensor.
  * @return Returns the temperature read from the HTU21D sensor in degrees
  * Celsius. Returns `-999` if it fails to read the temperature from the sensor.
  */
 float htu21d_read_temperature()
+{
+    return htu21d_dev_read_temperature(&_dev);
+}
+
+/**
+ * @brief Read the temperature from an HTU21D sensor.
+ * @param dev The sensor to read.
+ * @return Returns the temperature in degrees Celsius, or `-999` if it fails to
+ * read the temperature from the sensor.
+ */
+float htu21d_dev_read_temperature(htu21d_dev_t *dev)
 {
     // get the raw value from the sensor
-    uint16_t raw_temperature = read_value(TRIGGER_TEMP_MEASURE_NOHOLD);
+    uint16_t raw_temperature = htu21d_dev_read_value(dev, TRIGGER_TEMP_MEASURE_NOHOLD, NULL);
     if (raw_temperature == 0) {
         return -999;
     }
 
-    // return the real value, formula in datasheet
-    return (raw_temperature * 175.72 / 65536.0) - 46.85;
+    return (dev->model == HTU21D_MODEL_HTU31D) ?
+           htu31d_raw_to_temperature(raw_temperature) : htu21d_raw_to_temperature(raw_temperature);
 }
 
 /**
@@ -138,17 +344,281 @@ float htu21d_read_temperature()
  * sensor. Returns `-999` if it fails to read the humidity from the sensor.
  */
 float htu21d_read_humidity()
+{
+    return htu21d_dev_read_humidity(&_dev);
+}
+
+/**
+ * @brief Read the relative humidity from an HTU21D sensor.
+ *
+ * See #htu21d_read_humidity.
+ * @param dev The sensor to read.
+ * @return Returns the relative humidity in %RH, or `-999` if it fails to read
+ * the humidity from the sensor.
+ */
+float htu21d_dev_read_humidity(htu21d_dev_t *dev)
 {
     // get the raw value from the sensor
-    uint16_t raw_humidity = read_value(TRIGGER_HUMD_MEASURE_NOHOLD);
+    uint16_t raw_humidity = htu21d_dev_read_value(dev, TRIGGER_HUMD_MEASURE_NOHOLD, NULL);
     if (raw_humidity == 0) {
         return -999;
     }
 
-    // return the real value, formula in datasheet
+    return (dev->model == HTU21D_MODEL_HTU31D) ?
+           htu31d_raw_to_humidity(raw_humidity) : htu21d_raw_to_humidity(raw_humidity);
+}
+
+/**
+ * @brief Read both the temperature and the relative humidity, along with the
+ * time each conversion happened.
+ *
+ * Each conversion is stamped with the monotonic `esp_timer` time at which it
+ * was triggered and at which its result was read back. The midpoints of both
+ * conversions are averaged into `sample->timestamp_us`, which is when the
+ * sample physically happened. This stays accurate even when the read-back is
+ * delayed by bus load, which matters when fusing or resampling the samples of
+ * several sensors.
+ * @param[out] sample Where to store the sample.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if
+ * `sample` is `NULL`, or #HTU21D_ERR_FAIL if either value could not be read
+ * from the sensor.
+ */
+int htu21d_read_sample(htu21d_sample_t *sample)
+{
+    return htu21d_dev_read_sample(&_dev, sample);
+}
+
+/**
+ * @brief Read both the temperature and the relative humidity from an HTU21D
+ * sensor, along with the time each conversion happened.
+ *
+ * See #htu21d_read_sample.
+ * @param dev The sensor to read.
+ * @param[out] sample Where to store the sample.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if
+ * `sample` is `NULL`, or #HTU21D_ERR_FAIL if either value could not be read
+ * from the sensor.
+ */
+int htu21d_dev_read_sample(htu21d_dev_t *dev, htu21d_sample_t *sample)
+{
+    int ret = htu21d_dev_read_raw_sample(dev, sample);
+    if (ret != HTU21D_ERR_OK) {
+        return ret;
+    }
+
+    htu21d_dev_convert_sample(dev, sample);
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Waits until at least `wait_ms` milliseconds have passed since
+ * `start_us`, as measured by #htu21d_port_time_us.
+ *
+ * An HTU21D NACKs a read-back that comes too early, but an HTU31D answers it
+ * with the previous conversion, so a wait cut short by the tick rounding of
+ * the port goes unnoticed there. The delay is checked against the clock and
+ * extended until the conversion is over.
+ */
+static void wait_since(int64_t start_us, uint32_t wait_ms)
+{
+    htu21d_port_delay_ms(wait_ms);
+    while (htu21d_port_time_us() - start_us < (int64_t) wait_ms * 1000) {
+        htu21d_port_delay_ms(1);
+    }
+}
+
+/**
+ * @brief Reads the raw temperature and relative humidity of a sensor, with
+ * the timing of their conversions, without converting them.
+ *
+ * On an HTU21D, each quantity is converted and read back in turn. On an
+ * HTU31D, one conversion measures both and one transaction reads both back,
+ * so both timings are the same. Convert the values with
+ * #htu21d_dev_convert_sample, which knows the formulas of each model.
+ * @param dev The sensor to read.
+ * @param[out] sample Receives the raw values and the timings, the other
+ * members are left untouched.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if
+ * `sample` is `NULL`, or #HTU21D_ERR_FAIL if either value could not be read
+ * from the sensor.
+ */
+int htu21d_dev_read_raw_sample(htu21d_dev_t *dev, htu21d_sample_t *sample)
+{
+    if (sample == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    if (dev->model == HTU21D_MODEL_HTU31D) {
+        uint8_t data[6];
+        if (htu21d_dev_trigger(dev, TRIGGER_TEMP_MEASURE_NOHOLD, &sample->temperature_timing) != HTU21D_ERR_OK) {
+            return HTU21D_ERR_FAIL;
+        }
+        // The sensor answers during a conversion, with the previous result: wait it out.
+        wait_since(sample->temperature_timing.trigger_us,
+                   htu21d_dev_conversion_time_ms(dev, TRIGGER_TEMP_MEASURE_NOHOLD));
+        sample->temperature_timing.read_us = htu21d_port_time_us();
+        int ret = bus_command_read(dev, HTU31D_READ_T_RH, data, sizeof(data));
+        if (ret != HTU21D_ERR_OK) {
+            dev_count_error(dev, ret);
+            return HTU21D_ERR_FAIL;
+        }
+        sample->humidity_timing = sample->temperature_timing;
+        sample->raw_temperature = ((uint16_t) data[0] << 8) | data[1];
+        sample->raw_humidity = ((uint16_t) data[3] << 8) | data[4];
+        // as in htu21d_dev_read_value, values with an invalid CRC are counted and still returned
+        dev_count_error(dev, (is_crc_valid(sample->raw_temperature, data[2]) &&
+                              is_crc_valid(sample->raw_humidity, data[5])) ? HTU21D_ERR_OK : HTU21D_ERR_CRC);
+        return HTU21D_ERR_OK;
+    }
+
+    sample->raw_temperature = htu21d_dev_read_value(dev, TRIGGER_TEMP_MEASURE_NOHOLD, &sample->temperature_timing);
+    if (sample->raw_temperature == 0) {
+        return HTU21D_ERR_FAIL;
+    }
+    sample->raw_humidity = htu21d_dev_read_value(dev, TRIGGER_HUMD_MEASURE_NOHOLD, &sample->humidity_timing);
+    if (sample->raw_humidity == 0) {
+        return HTU21D_ERR_FAIL;
+    }
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Converts the raw values of a sample read from a sensor, and stamps
+ * it with the midpoint of its conversions.
+ * @param dev The sensor the sample was read from, for its model.
+ * @param[in,out] sample A sample whose raw values and timings are set, e.g.
+ * by #htu21d_dev_read_raw_sample.
+ */
+void htu21d_dev_convert_sample(const htu21d_dev_t *dev, htu21d_sample_t *sample)
+{
+    if (dev->model == HTU21D_MODEL_HTU31D) {
+        sample->temperature = htu31d_raw_to_temperature(sample->raw_temperature);
+        sample->humidity = htu31d_raw_to_humidity(sample->raw_humidity);
+    } else {
+        sample->temperature = htu21d_raw_to_temperature(sample->raw_temperature);
+        sample->humidity = htu21d_raw_to_humidity(sample->raw_humidity);
+    }
+    sample->timestamp_us = (htu21d_timing_midpoint(&sample->temperature_timing) +
+                            htu21d_timing_midpoint(&sample->humidity_timing)) / 2;
+}
+
+/**
+ * @brief Converts a raw temperature value to degrees Celsius.
+ * @param raw_temperature Raw value as read from the sensor, status bits
+ * cleared.
+ * @return Returns the temperature in degrees Celsius, formula in datasheet.
+ */
+float htu21d_raw_to_temperature(uint16_t raw_temperature)
+{
+#if CONFIG_HTU21D_CONVERSION_FIXED
+    return htu21d_raw_to_temperature_centi(raw_temperature) / 100.0F;
+#else
+    return (raw_temperature * 175.72 / 65536.0) - 46.85;
+#endif
+}
+
+/**
+ * @brief Converts a raw relative humidity value to %RH.
+ * @param raw_humidity Raw value as read from the sensor, status bits cleared.
+ * @return Returns the relative humidity in %RH, formula in datasheet.
+ */
+float htu21d_raw_to_humidity(uint16_t raw_humidity)
+{
+#if CONFIG_HTU21D_CONVERSION_FIXED
+    return htu21d_raw_to_humidity_centi(raw_humidity) / 100.0F;
+#else
     return (raw_humidity * 125.0 / 65536.0) - 6.0;
+#endif
+}
+
+/**
+ * @brief Converts a raw temperature value to hundredths of a degree Celsius,
+ * in integer math only.
+ * @param raw_temperature Raw value as read from the sensor, status bits
+ * cleared.
+ * @return Returns the temperature in 0.01 degrees Celsius, rounded to nearest.
+ */
+int16_t htu21d_raw_to_temperature_centi(uint16_t raw_temperature)
+{
+    // 65535 * 17572 + 32768 still fits in 31 bits.
+    return (int16_t)((((int32_t) raw_temperature * 17572 + 32768) >> 16) - 4685);
+}
+
+/**
+ * @brief Converts a raw relative humidity value to hundredths of a %RH, in
+ * integer math only.
+ * @param raw_humidity Raw value as read from the sensor, status bits cleared.
+ * @return Returns the relative humidity in 0.01 %RH, rounded to nearest.
+ */
+int16_t htu21d_raw_to_humidity_centi(uint16_t raw_humidity)
+{
+    return (int16_t)((((int32_t) raw_humidity * 12500 + 32768) >> 16) - 600);
+}
+
+/**
+ * @brief Converts a raw HTU31D temperature value to degrees Celsius.
+ * @param raw_temperature Raw value as read from the sensor.
+ * @return Returns the temperature in degrees Celsius, formula in datasheet.
+ */
+float htu31d_raw_to_temperature(uint16_t raw_temperature)
+{
+#if CONFIG_HTU21D_CONVERSION_FIXED
+    return htu31d_raw_to_temperature_centi(raw_temperature) / 100.0F;
+#else
+    return (raw_temperature * 165.0 / 65535.0) - 40.0;
+#endif
+}
+
+/**
+ * @brief Converts a raw HTU31D relative humidity value to %RH.
+ * @param raw_humidity Raw value as read from the sensor.
+ * @return Returns the relative humidity in %RH, formula in datasheet.
+ */
+float htu31d_raw_to_humidity(uint16_t raw_humidity)
+{
+#if CONFIG_HTU21D_CONVERSION_FIXED
+    return htu31d_raw_to_humidity_centi(raw_humidity) / 100.0F;
+#else
+    return raw_humidity * 100.0 / 65535.0;
+#endif
 }
 
+/**
+ * @brief Converts a raw HTU31D temperature value to hundredths of a degree
+ * Celsius, in integer math only.
+ * @param raw_temperature Raw value as read from the sensor.
+ * @return Returns the temperature in 0.01 degrees Celsius, rounded to nearest.
+ */
+int16_t htu31d_raw_to_temperature_centi(uint16_t raw_temperature)
+{
+    // The full scale is 65535, not a power of two: divide, 65535 * 16500 fits in 31 bits.
+    return (int16_t)(((int32_t) raw_temperature * 16500 + 32767) / 65535 - 4000);
+}
+
+/**
+ * @brief Converts a raw HTU31D relative humidity value to hundredths of a
+ * %RH, in integer math only.
+ * @param raw_humidity Raw value as read from the sensor.
+ * @return Returns the relative humidity in 0.01 %RH, rounded to nearest.
+ */
+int16_t htu31d_raw_to_humidity_centi(uint16_t raw_humidity)
+{
+    return (int16_t)(((int32_t) raw_humidity * 10000 + 32767) / 65535);
+}
+
+/**
+ * @brief Computes the midpoint of a conversion, the best estimate of when the
+ * value was measured.
+ * @param timing Timing of the conversion.
+ * @return Returns the midpoint between trigger and read-back, in microseconds.
+ */
+int64_t htu21d_timing_midpoint(const htu21d_timing_t *timing)
+{
+    return timing->trigger_us + (timing->read_us - timing->trigger_us) / 2;
+}
+
+#ifdef HTU21D_DERIVED_MATH
 /**
  * @brief Calculates the Partial Pressure at ambient temperature, by using the
  * ambient temperature read from the HTU21D sensor.
@@ -191,25 +661,44 @@ float htu21d_compute_dew_point(float temperature, float relative_humidity)
            (log10(relative_humidity * partial_pressure / 100.0F) - HTU21_CONSTANT_A)
            - HTU21_CONSTANT_C;
 }
+#endif  // HTU21D_DERIVED_MATH
 
 uint8_t htu21d_get_resolution()
 {
-    uint8_t reg_value = htu21d_read_user_register();
+    return htu21d_dev_get_resolution(&_dev);
+}
+
+uint8_t htu21d_dev_get_resolution(htu21d_dev_t *dev)
+{
+    if (dev->model == HTU21D_MODEL_HTU31D) {
+        return dev->resolution;
+    }
+    uint8_t reg_value = htu21d_dev_read_user_register(dev);
     return reg_value & 0b10000001;
 }
 
 int htu21d_set_resolution(uint8_t resolution)
 {
+    return htu21d_dev_set_resolution(&_dev, resolution);
+}
+
+int htu21d_dev_set_resolution(htu21d_dev_t *dev, uint8_t resolution)
+{
+    if (dev->model == HTU21D_MODEL_HTU31D) {
+        // no user register: the resolution selects the OSR of the next conversions
+        dev->resolution = resolution & 0b10000001;
+        return HTU21D_ERR_OK;
+    }
 
-    // get the actual resolution
-    uint8_t reg_value = htu21d_read_user_register();
-    reg_value &= 0b10000001;
+    // keep the other bits of the register, clear the actual resolution
+    uint8_t reg_value = htu21d_dev_read_user_register(dev);
+    reg_value &= (uint8_t) ~0b10000001;
 
     // update the register value with the new resolution
     resolution &= 0b10000001;
     reg_value |= resolution;
 
-    return htu21d_write_user_register(reg_value);
+    return htu21d_dev_write_user_register(dev, reg_value);
 }
 
 /**
@@ -234,87 +723,67 @@ int htu21d_set_resolution(uint8_t resolution)
  */
 int htu21d_soft_reset()
 {
-    esp_err_t ret;
+    return htu21d_dev_soft_reset(&_dev);
+}
 
+/**
+ * @brief Sends a *Soft Reset* command to reboot an HTU21D sensor.
+ *
+ * See #htu21d_soft_reset.
+ * @param dev The sensor to reset.
+ * @return Returns the same error codes as #htu21d_soft_reset.
+ */
+int htu21d_dev_soft_reset(htu21d_dev_t *dev)
+{
     // send the command
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    if (cmd == NULL) {
-        ESP_LOGE(TAG, "Not enough dynamic memory");
-        return HTU21D_ERR_FAIL;
-    }
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_start(cmd));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_write_byte(
-                                      cmd, (HTU21D_ADDR << 1) | I2C_MASTER_WRITE, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_write_byte(cmd, SOFT_RESET, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_stop(cmd));
-    ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
-    i2c_cmd_link_delete(cmd);
+    const uint8_t command = (dev->model == HTU21D_MODEL_HTU31D) ? HTU31D_RESET : SOFT_RESET;
+    int ret = bus_write(dev, &command, 1);
 
     switch (ret) {
 
-    case ESP_ERR_INVALID_ARG:
+    case HTU21D_ERR_INVALID_ARG:
         ESP_LOGE(TAG, "Soft reset failed, parameter error.");
-        return HTU21D_ERR_INVALID_ARG;
+        return ret;
 
-    case ESP_FAIL:
+    case HTU21D_ERR_FAIL:
         ESP_LOGE(TAG, "Sending Soft Reset command error, the HTU21D slave hasn't ACK the transfer.");
-        return HTU21D_ERR_FAIL;
+        return ret;
 
-    case ESP_ERR_INVALID_STATE:
+    case HTU21D_ERR_INVALID_STATE:
         ESP_LOGE(TAG, "Soft reset failed,  I2C driver not installed or not in master mode.");
-        return HTU21D_ERR_INVALID_STATE;
+        return ret;
 
-    case ESP_ERR_TIMEOUT:
+    case HTU21D_ERR_TIMEOUT:
         ESP_LOGE(TAG, "Soft reset failed,  operation timeout because the I2C bus is busy.");
-        return HTU21D_ERR_TIMEOUT;
+        return ret;
     }
 
-    vTaskDelay(pdMS_TO_TICKS(HTU21_RESET_TIME));
+    htu21d_port_delay_ms(HTU21_RESET_TIME);
+    // the reset restores the default resolution, 14-bit temperature and 12-bit RH
+    dev->resolution = 0;
 
-    ESP_LOGI(TAG, "HTU21D sensor soft reset was successful.");
+    ESP_LOGI(TAG, "%s sensor soft reset was successful.", (dev->model == HTU21D_MODEL_HTU31D) ? "HTU31D" : "HTU21D");
 
     return HTU21D_ERR_OK;
 }
 
 uint8_t htu21d_read_user_register()
 {
-    esp_err_t ret;
-
-    // send the command
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    if (cmd == NULL) {
-        ESP_LOGE(TAG, "Not enough dynamic memory");
-        return 0;
-    }
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_start(cmd));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_write_byte(
-                                      cmd, (HTU21D_ADDR << 1) | I2C_MASTER_WRITE, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_write_byte(cmd, READ_USER_REG, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_stop(cmd));
-    ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
-    i2c_cmd_link_delete(cmd);
-    if (ret != ESP_OK) {
-        return 0;
-    }
+    return htu21d_dev_read_user_register(&_dev);
+}
 
-    // receive the answer
+/**
+ * @brief Reads the user register, in a single combined (repeated start)
+ * transaction.
+ * @param dev The sensor to read.
+ * @return Returns the value of the register, or `0` on error.
+ */
+uint8_t htu21d_dev_read_user_register(htu21d_dev_t *dev)
+{
+    const uint8_t command = READ_USER_REG;
     uint8_t reg_value;
-    cmd = i2c_cmd_link_create();
-    if (cmd == NULL) {
-        ESP_LOGE(TAG, "Not enough dynamic memory");
-        return 0;
-    }
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_start(cmd));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_write_byte(
-                                      cmd, (HTU21D_ADDR << 1) | I2C_MASTER_READ, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_read_byte(cmd, &reg_value, 0x01));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_stop(cmd));
-    ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
-    i2c_cmd_link_delete(cmd);
-    if (ret != ESP_OK) {
+
+    if (bus_write_read(dev, &command, 1, &reg_value, 1) != HTU21D_ERR_OK) {
         return 0;
     }
 
@@ -323,94 +792,1102 @@ uint8_t htu21d_read_user_register()
 
 int htu21d_write_user_register(uint8_t value)
 {
-    esp_err_t ret;
-
-    // send the command
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    if (cmd == NULL) {
-        ESP_LOGE(TAG, "Not enough dynamic memory");
-        return HTU21D_ERR_FAIL;
-    }
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_start(cmd));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(
-        i2c_master_write_byte(cmd, (HTU21D_ADDR << 1) | I2C_MASTER_WRITE, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_write_byte(cmd, WRITE_USER_REG, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_write_byte(cmd, value, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_stop(cmd));
-    ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
-    i2c_cmd_link_delete(cmd);
-
-    switch (ret) {
-
-    case ESP_ERR_INVALID_ARG:
-        return HTU21D_ERR_INVALID_ARG;
-
-    case ESP_FAIL:
-        return HTU21D_ERR_FAIL;
+    return htu21d_dev_write_user_register(&_dev, value);
+}
 
-    case ESP_ERR_INVALID_STATE:
-        return HTU21D_ERR_INVALID_STATE;
+int htu21d_dev_write_user_register(htu21d_dev_t *dev, uint8_t value)
+{
+    const uint8_t data[] = {WRITE_USER_REG, value};
 
-    case ESP_ERR_TIMEOUT:
-        return HTU21D_ERR_TIMEOUT;
+    int ret = bus_write(dev, data, sizeof(data));
+    if (ret == HTU21D_ERR_OK) {
+        dev->resolution = value & 0b10000001;
     }
-    return HTU21D_ERR_OK;
+    return ret;
 }
 
 uint16_t read_value(uint8_t command)
 {
-    esp_err_t ret;
+    return htu21d_dev_read_value(&_dev, command, NULL);
+}
 
-    // send the command
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    if (cmd == NULL) {
-        ESP_LOGE(TAG, "Not enough dynamic memory");
-        return 0;
+/**
+ * @brief Triggers a conversion, waits for it and reads back its raw result.
+ *
+ * The wait is #htu21d_dev_conversion_time_ms. If the sensor has not finished
+ * after a calibrated wait, the rest of #HTU21D_CONVERSION_TIME_MS is waited
+ * and the result read again. That first "still converting" NACK is expected
+ * and not counted as an error.
+ * @param dev The sensor to read.
+ * @param command The trigger command to send, one of the `*_NOHOLD` commands.
+ * @param[out] timing When not `NULL`, receives the trigger and read-back
+ * times.
+ * @return Returns the raw value with the status bits cleared, or `0` on error.
+ * A value with an invalid CRC is logged and still returned.
+ */
+uint16_t htu21d_dev_read_value(htu21d_dev_t *dev, uint8_t command, htu21d_timing_t *timing)
+{
+    uint16_t raw_value;
+    htu21d_timing_t local_timing;
+
+    if (timing == NULL) {
+        timing = &local_timing;
     }
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_start(cmd));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(
-        i2c_master_write_byte(cmd, (HTU21D_ADDR << 1) | I2C_MASTER_WRITE, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_write_byte(cmd, command, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_stop(cmd));
-    ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
-    i2c_cmd_link_delete(cmd);
-    if (ret != ESP_OK) {
+    if (htu21d_dev_trigger(dev, command, timing) != HTU21D_ERR_OK) {
         return 0;
     }
 
-    // wait for the sensor (50ms)
-    vTaskDelay(50 / portTICK_PERIOD_MS);
+    // wait for the sensor
+    uint32_t wait_ms = htu21d_dev_conversion_time_ms(dev, command);
+    wait_since(timing->trigger_us, wait_ms);
 
-    // receive the answer
-    uint8_t msb, lsb, crc;
-    cmd = i2c_cmd_link_create();
-    if (cmd == NULL) {
-        ESP_LOGE(TAG, "Not enough dynamic memory");
-        return 0;
+    bool shortened = wait_ms < HTU21D_CONVERSION_TIME_MS;
+    int ret = dev_fetch(dev, &raw_value, timing, !shortened);
+    if (ret == HTU21D_ERR_FAIL && shortened) {
+        htu21d_port_delay_ms(HTU21D_CONVERSION_TIME_MS - wait_ms);
+        ret = htu21d_dev_fetch(dev, &raw_value, timing);
     }
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_start(cmd));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(
-        i2c_master_write_byte(cmd, (HTU21D_ADDR << 1) | I2C_MASTER_READ, true));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_read_byte(cmd, &msb, 0x00));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_read_byte(cmd, &lsb, 0x00));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_read_byte(cmd, &crc, 0x01));
-    ESP_ERROR_CHECK_WITHOUT_ABORT(i2c_master_stop(cmd));
-    ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
-    ESP_ERROR_CHECK_WITHOUT_ABORT(ret);
-    i2c_cmd_link_delete(cmd);
-    if (ret != ESP_OK) {
+    if (ret != HTU21D_ERR_OK && ret != HTU21D_ERR_CRC) {
         return 0;
     }
+    return raw_value;
+}
 
-    uint16_t raw_value = ((uint16_t) msb << 8) | (uint16_t) lsb;
-    if (!is_crc_valid(raw_value, crc)) {
-        ESP_LOGE(TAG, "CRC is invalid.");
+/**
+ * @brief Sends a no-hold trigger command, which starts a conversion and returns
+ * right away.
+ *
+ * Fetch the result with #htu21d_dev_fetch once the conversion is done, after
+ * #htu21d_dev_conversion_time_ms. Splitting the two lets the caller start the
+ * conversions of several sensors and wait for all of them at once.
+ *
+ * On an HTU31D, the conversion measures both quantities, and the command only
+ * selects the one #htu21d_dev_fetch reads back. Use
+ * #htu21d_dev_read_raw_sample to get both from one conversion.
+ * @param dev The sensor to trigger.
+ * @param command The trigger command to send, one of the `*_NOHOLD` commands.
+ * @param[out] timing When not `NULL`, its `trigger_us` receives the time the
+ * conversion started.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_FAIL if the command
+ * could not be sent.
+ */
+int htu21d_dev_trigger(htu21d_dev_t *dev, uint8_t command, htu21d_timing_t *timing)
+{
+    // send the command
+    command = dev_trigger_command(dev, command);
+    if (bus_write(dev, &command, 1) != HTU21D_ERR_OK) {
+        return HTU21D_ERR_FAIL;
+    }
+    if (timing != NULL) {
+        timing->trigger_us = htu21d_port_time_us();
+    }
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Reads back the result of a conversion started by #htu21d_dev_trigger.
+ * @param dev The sensor to read.
+ * @param[out] raw_value Receives the raw value with the status bits cleared.
+ * @param[out] timing When not `NULL`, its `read_us` receives the time the
+ * read-back started.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_CRC if the value was
+ * read but its CRC is invalid, or #HTU21D_ERR_FAIL if it could not be read
+ * (e.g. the conversion is not done yet).
+ */
+int htu21d_dev_fetch(htu21d_dev_t *dev, uint16_t *raw_value, htu21d_timing_t *timing)
+{
+    return dev_fetch(dev, raw_value, timing, true);
+}
+
+/**
+ * @brief Reads back the result of a conversion, see #htu21d_dev_fetch.
+ *
+ * With `count_nack` false, a NACK is not counted, for a read that may come
+ * before the end of the conversion on purpose.
+ */
+static int dev_fetch(htu21d_dev_t *dev, uint16_t *raw_value, htu21d_timing_t *timing, bool count_nack)
+{
+    // receive the answer: msb, lsb, crc
+    uint8_t data[3];
+    if (timing != NULL) {
+        timing->read_us = htu21d_port_time_us();
+    }
+    bool htu31d = dev->model == HTU21D_MODEL_HTU31D;
+    int ret = htu31d ? bus_command_read(dev, dev->pending, data, sizeof(data)) : bus_read(dev, data, sizeof(data));
+    if (ret != HTU21D_ERR_OK) {
+        if (count_nack || ret != HTU21D_ERR_FAIL) {
+            dev_count_result(dev, ret);
+        }
+        return HTU21D_ERR_FAIL;
+    }
+
+    uint16_t value = ((uint16_t) data[0] << 8) | (uint16_t) data[1];
+    *raw_value = htu31d ? value : value & 0xFFFC;
+    return dev_count_result(dev, is_crc_valid(value, data[2]) ? HTU21D_ERR_OK : HTU21D_ERR_CRC);
+}
+
+/**
+ * @brief Returns the index of a resolution in the `htu21d_calibration_t`
+ * arrays, `b7 << 1 | b0`.
+ */
+static size_t resolution_index(uint8_t resolution)
+{
+    return ((resolution >> 6) & 0x02) | (resolution & 0x01);
+}
+
+/**
+ * @brief Returns the byte that starts a conversion on a sensor.
+ *
+ * On an HTU31D it converts both quantities at the OSR of the resolution; the
+ * trigger command selects the read command of #htu21d_dev_fetch, kept in
+ * `pending`.
+ */
+static uint8_t dev_trigger_command(htu21d_dev_t *dev, uint8_t command)
+{
+    if (dev->model != HTU21D_MODEL_HTU31D) {
+        return command;
+    }
+    uint8_t osr = htu31d_osr[resolution_index(dev->resolution)];
+    dev->pending = (command == TRIGGER_HUMD_MEASURE_NOHOLD || command == TRIGGER_HUMD_MEASURE_HOLD)
+                   ? HTU31D_READ_RH : HTU31D_READ_T_RH;
+    return HTU31D_CONVERSION | (osr << 3) | (osr << 1);
+}
+
+/**
+ * @brief Triggers a conversion and polls the sensor until it acknowledges a
+ * read, which it only does once the conversion is done.
+ *
+ * The polls the sensor does not acknowledge are expected, so they are not
+ * counted as errors.
+ * @param[out] conversion_us Receives the time from the trigger to the start of
+ * the first acknowledged read.
+ * @return Returns an `HTU21D_ERR_*` code, #HTU21D_ERR_TIMEOUT if the sensor
+ * has not answered after `timeout_us`.
+ */
+static int dev_measure_conversion(htu21d_dev_t *dev, uint8_t command, uint32_t timeout_us,
+                                  uint32_t *conversion_us)
+{
+    uint8_t data[3];
+    int64_t start_us, read_us;
+
+    int ret = bus_write(dev, &command, 1);
+    if (ret != HTU21D_ERR_OK) {
+        return ret;
+    }
+    start_us = htu21d_port_time_us();
+
+    do {
+        read_us = htu21d_port_time_us();
+        ret = dev->transport->read(dev->bus, dev->address, data, sizeof(data));
+    } while (ret == HTU21D_ERR_FAIL && read_us - start_us < timeout_us);
+
+    if (ret == HTU21D_ERR_FAIL) {
+        ret = HTU21D_ERR_TIMEOUT;
+    }
+    if (ret != HTU21D_ERR_OK) {
+        return dev_count_error(dev, ret);
+    }
+    *conversion_us = (uint32_t)(read_us - start_us);
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Measures how long the conversions of a sensor take, at every
+ * resolution, for later waits to be no longer than needed.
+ *
+ * The datasheet times, which #HTU21D_CONVERSION_TIME_MS covers, are
+ * worst-case maxima; a given sensor usually finishes much sooner. Each
+ * conversion is triggered and the sensor polled until it acknowledges a read,
+ * which it only does once the conversion is done. The longest of `rounds` conversions, plus
+ * #HTU21D_CALIBRATION_MARGIN_PERCENT, capped to the datasheet maximum, is
+ * stored in the handle, and waited by #htu21d_dev_read_value and returned by
+ * #htu21d_dev_conversion_time_ms from then on.
+ *
+ * The polling keeps the bus busy for the whole calibration, about
+ * `rounds` × 130 ms, so call it once at startup, after the handle is
+ * initialized. The calibration can then be kept across restarts, see
+ * #htu21d_dev_get_calibration. The resolution is restored on return.
+ *
+ * An HTU31D acknowledges its reads during a conversion, so its conversions
+ * cannot be timed this way: nothing is measured, and the datasheet times are
+ * waited.
+ * @param dev The sensor to calibrate.
+ * @param rounds Conversions measured per resolution and measurement, e.g. 3.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if `dev`
+ * is `NULL` or `rounds` is 0, or the error of the first transaction that
+ * failed, in which case the calibration of the handle is left unchanged.
+ */
+int htu21d_dev_calibrate(htu21d_dev_t *dev, unsigned int rounds)
+{
+    const uint8_t command = READ_USER_REG;
+    htu21d_calibration_t calibration;
+    uint8_t user_register;
+
+    if (dev == NULL || rounds == 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+    if (dev->model == HTU21D_MODEL_HTU31D) {
+        ESP_LOGI(TAG, "HTU31D conversion times cannot be measured, the datasheet times are waited.");
+        return HTU21D_ERR_OK;
+    }
+    int ret = bus_write_read(dev, &command, 1, &user_register, 1);
+    if (ret != HTU21D_ERR_OK) {
+        return ret;
+    }
+
+    for (uint8_t resolution = 0; resolution < 4 && ret == HTU21D_ERR_OK; resolution++) {
+        // resolution index b1 goes to the register bit 7
+        uint8_t bits = ((resolution & 0x02) << 6) | (resolution & 0x01);
+        ret = htu21d_dev_write_user_register(dev, (user_register & (uint8_t) ~0b10000001) | bits);
+
+        uint32_t temperature_us = 0, humidity_us = 0;
+        for (unsigned int i = 0; i < rounds && ret == HTU21D_ERR_OK; i++) {
+            uint32_t conversion_us;
+            ret = dev_measure_conversion(dev, TRIGGER_TEMP_MEASURE_NOHOLD, 2 * temperature_max_us[resolution],
+                                         &conversion_us);
+            if (ret != HTU21D_ERR_OK) {
+                break;
+            }
+            temperature_us = (conversion_us > temperature_us) ? conversion_us : temperature_us;
+            ret = dev_measure_conversion(dev, TRIGGER_HUMD_MEASURE_NOHOLD, 2 * humidity_max_us[resolution],
+                                         &conversion_us);
+            if (ret != HTU21D_ERR_OK) {
+                break;
+            }
+            humidity_us = (conversion_us > humidity_us) ? conversion_us : humidity_us;
+        }
+
+        temperature_us = temperature_us * (100 + HTU21D_CALIBRATION_MARGIN_PERCENT) / 100;
+        humidity_us = humidity_us * (100 + HTU21D_CALIBRATION_MARGIN_PERCENT) / 100;
+        calibration.temperature_us[resolution] = (temperature_us < temperature_max_us[resolution])
+                                                 ? temperature_us : temperature_max_us[resolution];
+        calibration.humidity_us[resolution] = (humidity_us < humidity_max_us[resolution])
+                                              ? humidity_us : humidity_max_us[resolution];
+    }
+
+    int restore_ret = htu21d_dev_write_user_register(dev, user_register);
+    if (ret != HTU21D_ERR_OK) {
+        ESP_LOGE(TAG, "Conversion time calibration failed, error: 0x%02X", ret);
+        return ret;
+    }
+    dev->calibration = calibration;
+    ESP_LOGI(TAG, "Conversion times calibrated, T14/RH12 %" PRIu16 "/%" PRIu16 " us.",
+             calibration.temperature_us[0], calibration.humidity_us[0]);
+    return restore_ret;
+}
+
+/**
+ * @brief Returns how long to wait for a conversion of a sensor, at its
+ * current resolution.
+ *
+ * Use it between #htu21d_dev_trigger and #htu21d_dev_fetch.
+ * @param dev The sensor.
+ * @param command The trigger command.
+ * @return Returns the calibrated time rounded up to a millisecond, or
+ * #HTU21D_CONVERSION_TIME_MS if the sensor was not calibrated. On an HTU31D,
+ * returns the datasheet time of the conversion of both quantities.
+ */
+uint32_t htu21d_dev_conversion_time_ms(const htu21d_dev_t *dev, uint8_t command)
+{
+    size_t index = resolution_index(dev->resolution);
+    if (dev->model == HTU21D_MODEL_HTU31D) {
+        return (htu31d_conversion_max_us[htu31d_osr[index]] + 999) / 1000;
+    }
+    uint32_t conversion_us = (command == TRIGGER_HUMD_MEASURE_NOHOLD || command == TRIGGER_HUMD_MEASURE_HOLD)
+                             ? dev->calibration.humidity_us[index] : dev->calibration.temperature_us[index];
+
+    if (conversion_us == 0) {
+        return HTU21D_CONVERSION_TIME_MS;
+    }
+    return (conversion_us + 999) / 1000;
+}
+
+/**
+ * @brief Returns how long an HTU21D conversion takes at a resolution, for code
+ * that waits without a #htu21d_dev_t, e.g. the asynchronous measurements of
+ * htu21d_i2c_master.h.
+ * @param resolution Resolution bits of the user register.
+ * @param command The trigger command.
+ * @param calibration Calibration of the sensor, see #htu21d_dev_calibrate, or
+ * `NULL`.
+ * @return Returns the calibrated time in microseconds, or the datasheet
+ * maximum when `calibration` is `NULL` or has no time for this resolution.
+ */
+uint32_t htu21d_conversion_time_us(uint8_t resolution, uint8_t command, const htu21d_calibration_t *calibration)
+{
+    size_t index = resolution_index(resolution);
+    bool humidity = (command == TRIGGER_HUMD_MEASURE_NOHOLD || command == TRIGGER_HUMD_MEASURE_HOLD);
+    uint32_t max_us = humidity ? humidity_max_us[index] : temperature_max_us[index];
+
+    if (calibration == NULL) {
+        return max_us;
+    }
+    uint32_t conversion_us = humidity ? calibration->humidity_us[index] : calibration->temperature_us[index];
+    return (conversion_us != 0 && conversion_us < max_us) ? conversion_us : max_us;
+}
+
+/**
+ * @brief Copies the calibration of a sensor, e.g. to store it, see
+ * #htu21d_dev_calibrate.
+ * @param dev The sensor.
+ * @param[out] calibration Receives its calibration.
+ */
+void htu21d_dev_get_calibration(const htu21d_dev_t *dev, htu21d_calibration_t *calibration)
+{
+    *calibration = dev->calibration;
+}
+
+/**
+ * @brief Sets the calibration of a sensor, e.g. one measured by
+ * #htu21d_dev_calibrate on a previous start and stored since.
+ *
+ * The calibration belongs to one sensor: do not apply it to another. Times
+ * above the datasheet maximum are capped to it, and a zeroed calibration
+ * restores the default #HTU21D_CONVERSION_TIME_MS.
+ * @param dev The sensor, already initialized.
+ * @param calibration The calibration to apply.
+ */
+void htu21d_dev_set_calibration(htu21d_dev_t *dev, const htu21d_calibration_t *calibration)
+{
+    for (size_t i = 0; i < 4; i++) {
+        dev->calibration.temperature_us[i] = (calibration->temperature_us[i] < temperature_max_us[i])
+                                             ? calibration->temperature_us[i] : temperature_max_us[i];
+        dev->calibration.humidity_us[i] = (calibration->humidity_us[i] < humidity_max_us[i])
+                                          ? calibration->humidity_us[i] : humidity_max_us[i];
+    }
+}
+
+#if CONFIG_HTU21D_CALIBRATION_NVS
+#define CALIBRATION_NVS_NAMESPACE   "htu21d"
+
+/**
+ * @brief Stores a calibration in NVS, in the `htu21d` namespace of the
+ * default partition, which must have been initialized with `nvs_flash_init()`.
+ * @param calibration The calibration, see #htu21d_dev_get_calibration.
+ * @param key NVS key, at most 15 characters, one per sensor.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_FAIL if NVS could
+ * not be opened or written.
+ */
+int htu21d_calibration_save_nvs(const htu21d_calibration_t *calibration, const char *key)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return HTU21D_ERR_FAIL;
+    }
+    esp_err_t ret = nvs_set_blob(handle, key, calibration, sizeof(*calibration));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    return (ret == ESP_OK) ? HTU21D_ERR_OK : HTU21D_ERR_FAIL;
+}
+
+/**
+ * @brief Loads a calibration stored by #htu21d_calibration_save_nvs.
+ * @param[out] calibration Receives the calibration, to apply with
+ * #htu21d_dev_set_calibration.
+ * @param key NVS key the calibration was stored under.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_NOTFOUND if no
+ * calibration of the expected size is stored under `key`, or
+ * #HTU21D_ERR_FAIL if NVS could not be read.
+ */
+int htu21d_calibration_load_nvs(htu21d_calibration_t *calibration, const char *key)
+{
+    nvs_handle_t handle;
+    size_t len = sizeof(*calibration);
+
+    esp_err_t ret = nvs_open(CALIBRATION_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_get_blob(handle, key, calibration, &len);
+        nvs_close(handle);
+    }
+
+    if (ret == ESP_ERR_NVS_NOT_FOUND || (ret == ESP_OK && len != sizeof(*calibration))
+            || ret == ESP_ERR_NVS_INVALID_LENGTH) {
+        return HTU21D_ERR_NOTFOUND;
+    }
+    return (ret == ESP_OK) ? HTU21D_ERR_OK : HTU21D_ERR_FAIL;
+}
+#endif  // CONFIG_HTU21D_CALIBRATION_NVS
+
+/**
+ * @brief Transactions collected by the `htu21d_batch_*` functions, sent as one
+ * submission when the transport supports it.
+ */
+typedef struct {
+    htu21d_dev_t *const *devs;
+    const htu21d_transport_t *transport;
+    void *bus;
+    size_t count;
+    htu21d_transfer_t transfers[HTU21D_BATCH_MAX_TRANSFERS];
+    size_t owners[HTU21D_BATCH_MAX_TRANSFERS];          /**< Index of the device of each transfer, `SIZE_MAX` for a multiplexer select. */
+    htu21d_mux_t *muxes[HTU21D_BATCH_MAX_TRANSFERS];    /**< Multiplexer of a select transfer. */
+    uint8_t commands[HTU21D_BATCH_MAX_TRANSFERS];       /**< Byte written by each transfer: select mask, trigger or read command. */
+    uint8_t data[HTU21D_BATCH_MAX_TRANSFERS][3];        /**< Read buffers. */
+    uint8_t command;                                    /**< Trigger command, for triggers. */
+    int *results;                                       /**< Result of each device. */
+    htu21d_timing_t *timings;                           /**< Timing of each device, or `NULL`. */
+    uint16_t *raw_values;                               /**< Read-back values, `NULL` for triggers. */
+} batch_t;
+
+/** Content of a read buffer before its batch is sent: 0x0000 has a CRC of 0x00, not 0xFF. */
+static const uint8_t batch_unread[3] = {0x00, 0x00, 0xFF};
+
+static int transfer_one(const htu21d_transport_t *transport, void *bus, const htu21d_transfer_t *transfer)
+{
+    if (transfer->read_len == 0) {
+        return transport->write(bus, transfer->address, transfer->write_data, transfer->write_len);
+    }
+    if (transfer->write_len == 0) {
+        return transport->read(bus, transfer->address, transfer->read_data, transfer->read_len);
+    }
+    return transport->write_read(bus, transfer->address, transfer->write_data, transfer->write_len,
+                                 transfer->read_data, transfer->read_len);
+}
+
+/**
+ * @brief Sends the collected transactions and stores the result of each device.
+ *
+ * When the transport has no batch operation, the transactions are sent one by
+ * one. When the batch failed, the transport cannot tell which transaction did
+ * not answer: the controller stopped there, so the ones before it ran and the
+ * ones after it did not. A read-back that ran is recognized by its buffer,
+ * filled beforehand with a value whose CRC is invalid, and kept: reading it
+ * again would fail, as the sensor hands a result out once. Every other
+ * transaction is resent alone and counted in `resent` of #htu21d_errors_t.
+ * That includes a trigger that did run: its conversion then restarts, or the
+ * busy sensor does not answer and the trigger is reported failed although the
+ * conversion goes on.
+ */
+static void batch_flush(batch_t *batch)
+{
+    int64_t start_us = htu21d_port_time_us();
+    int ret = HTU21D_ERR_FAIL;
+    int results[HTU21D_BATCH_MAX_TRANSFERS];
+
+    if (batch->count == 0) {
+        return;
+    }
+    if (batch->transport->batch != NULL) {
+        for (size_t i = 0; i < batch->count; i++) {
+            memcpy(batch->data[i], batch_unread, sizeof(batch_unread));
+        }
+        ret = batch->transport->batch(batch->bus, batch->transfers, batch->count);
+    }
+    for (size_t i = 0; i < batch->count; i++) {
+        size_t owner = batch->owners[i];
+        if (ret == HTU21D_ERR_OK) {
+            results[i] = ret;
+            continue;
+        }
+        if (batch->transport->batch != NULL) {
+            const uint8_t *data = batch->data[i];
+            if (batch->raw_values != NULL && owner != SIZE_MAX &&
+                    is_crc_valid(((uint16_t) data[0] << 8) | (uint16_t) data[1], data[2])) {
+                results[i] = HTU21D_ERR_OK;
+                continue;
+            }
+            if (owner != SIZE_MAX) {
+                batch->devs[owner]->errors.resent++;
+            }
+        }
+        results[i] = transfer_one(batch->transport, batch->bus, &batch->transfers[i]);
+    }
+    int64_t end_us = htu21d_port_time_us();
+
+    for (size_t i = 0; i < batch->count; i++) {
+        size_t owner = batch->owners[i];
+        if (owner == SIZE_MAX) {
+            batch->muxes[i]->selected = (results[i] == HTU21D_ERR_OK) ? batch->commands[i] : -1;
+            continue;
+        }
+
+        if (batch->raw_values == NULL) {
+            if (batch->timings != NULL) {
+                batch->timings[owner].trigger_us = end_us;
+            }
+        } else {
+            if (batch->timings != NULL) {
+                batch->timings[owner].read_us = start_us;
+            }
+            if (results[i] == HTU21D_ERR_OK) {
+                const uint8_t *data = batch->data[i];
+                uint16_t value = ((uint16_t) data[0] << 8) | (uint16_t) data[1];
+                batch->raw_values[owner] = (batch->devs[owner]->model == HTU21D_MODEL_HTU31D) ? value : value & 0xFFFC;
+                if (!is_crc_valid(value, data[2])) {
+                    results[i] = HTU21D_ERR_CRC;
+                }
+            }
+        }
+        if (batch->raw_values != NULL) {
+            dev_count_result(batch->devs[owner], results[i]);
+        } else {
+            dev_count_error(batch->devs[owner], results[i]);
+        }
+        batch->results[owner] = (results[i] == HTU21D_ERR_OK || results[i] == HTU21D_ERR_CRC) ?
+                                results[i] : HTU21D_ERR_FAIL;
+    }
+    batch->count = 0;
+}
+
+/**
+ * @brief Appends a transfer writing `command` unless it is negative, then
+ * reading `read_len` bytes.
+ */
+static void batch_append(batch_t *batch, size_t owner, uint8_t address, int command, size_t read_len)
+{
+    size_t i = batch->count++;
+    batch->owners[i] = owner;
+    batch->commands[i] = (uint8_t) command;
+    batch->transfers[i] = (htu21d_transfer_t) {
+        .address = address,
+        .write_data = &batch->commands[i],
+        .write_len = (command < 0) ? 0 : 1,
+        .read_data = batch->data[i],
+        .read_len = read_len,
+    };
+}
+
+/**
+ * @brief Adds the transaction of one device to the batch: its trigger, or the
+ * read-back of its conversion (a read command then a read on an HTU31D).
+ *
+ * A multiplexer only switches channels at the stop condition, so when the
+ * device is on another channel, the select is added last and the batch is
+ * sent before the device's transaction is added.
+ */
+static void batch_add(batch_t *batch, htu21d_dev_t *dev, size_t owner)
+{
+    if (dev == NULL || dev->transport == NULL) {
+        batch->results[owner] = HTU21D_ERR_INVALID_STATE;
+        return;
+    }
+    if (batch->count != 0 && (dev->transport != batch->transport || dev->bus != batch->bus)) {
+        batch_flush(batch);
+    }
+    batch->transport = dev->transport;
+    batch->bus = dev->bus;
+
+    if (dev->mux != NULL && dev->mux->selected != (1 << dev->mux_channel)) {
+        if (batch->count == HTU21D_BATCH_MAX_TRANSFERS) {
+            batch_flush(batch);
+        }
+        batch->muxes[batch->count] = dev->mux;
+        batch_append(batch, SIZE_MAX, dev->mux->address, 1 << dev->mux_channel, 0);
+        batch_flush(batch);
+        if (dev->mux->selected != (1 << dev->mux_channel)) {
+            batch->results[owner] = dev_count_error(dev, HTU21D_ERR_FAIL);
+            return;
+        }
+    }
+
+    if (batch->count == HTU21D_BATCH_MAX_TRANSFERS) {
+        batch_flush(batch);
+    }
+    if (batch->raw_values == NULL) {
+        batch_append(batch, owner, dev->address, dev_trigger_command(dev, batch->command), 0);
+    } else {
+        batch_append(batch, owner, dev->address, (dev->model == HTU21D_MODEL_HTU31D) ? dev->pending : -1, 3);
+    }
+}
+
+static int batch_result(const int *results, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] != HTU21D_ERR_OK) {
+            return HTU21D_ERR_FAIL;
+        }
+    }
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Sends the same no-hold trigger to several sensors, in as few bus
+ * submissions as possible.
+ *
+ * Consecutive sensors on the same bus are triggered in one submission (up to
+ * #HTU21D_BATCH_MAX_TRANSFERS transactions joined by repeated starts) when the
+ * transport supports it. Multiplexer channel selects are merged into the
+ * submissions too, each one ending its submission. Order the sensors by bus
+ * and channel to get the fewest submissions. HTU31D sensors can be mixed in,
+ * see #htu21d_dev_trigger.
+ *
+ * If a transaction of a submission fails, the transport cannot tell which
+ * one, so the whole submission is resent one transaction at a time and
+ * counted in `resent` of #htu21d_errors_t. A sensor whose trigger had gone
+ * through then restarts its conversion, or, busy converting, fails the
+ * resent trigger although its conversion completes.
+ * @param devs The sensors to trigger.
+ * @param count Number of sensors.
+ * @param command The trigger command to send, one of the `*_NOHOLD` commands.
+ * @param[out] timings When not `NULL`, one per sensor: `trigger_us` receives
+ * the time the conversion started.
+ * @param[out] results One per sensor, receives #HTU21D_ERR_OK or the error of
+ * that sensor, as #htu21d_dev_trigger would return it.
+ * @return Returns #HTU21D_ERR_OK if all sensors were triggered, #HTU21D_ERR_FAIL
+ * if any failed, or #HTU21D_ERR_INVALID_ARG if an argument is `NULL`.
+ */
+int htu21d_batch_trigger(htu21d_dev_t *const *devs, size_t count, uint8_t command,
+                         htu21d_timing_t *timings, int *results)
+{
+    if (devs == NULL || results == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    batch_t batch = {
+        .devs = devs,
+        .results = results,
+        .timings = timings,
+        .command = command,
+    };
+    for (size_t i = 0; i < count; i++) {
+        batch_add(&batch, devs[i], i);
+    }
+    batch_flush(&batch);
+
+    return batch_result(results, count);
+}
+
+/**
+ * @brief Reads back the conversions of several sensors started by
+ * #htu21d_batch_trigger (or #htu21d_dev_trigger), in as few bus submissions as
+ * possible.
+ *
+ * Submissions are formed as in #htu21d_batch_trigger. If a transaction of a
+ * submission fails, the transport cannot tell which one: the read-backs that
+ * completed before it are kept, and only the others are resent, one at a
+ * time, and counted in `resent` of #htu21d_errors_t.
+ * @param devs The sensors to read.
+ * @param count Number of sensors.
+ * @param[out] raw_values One per sensor, receives the raw value with the
+ * status bits cleared.
+ * @param[out] timings When not `NULL`, one per sensor: `read_us` receives the
+ * time the read-back started.
+ * @param[out] results One per sensor, receives #HTU21D_ERR_OK or the error of
+ * that sensor, as #htu21d_dev_fetch would return it.
+ * @return Returns #HTU21D_ERR_OK if all values were read with a valid CRC,
+ * #HTU21D_ERR_FAIL otherwise, or #HTU21D_ERR_INVALID_ARG if an argument is
+ * `NULL`.
+ */
+int htu21d_batch_fetch(htu21d_dev_t *const *devs, size_t count, uint16_t *raw_values,
+                       htu21d_timing_t *timings, int *results)
+{
+    if (devs == NULL || raw_values == NULL || results == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    batch_t batch = {
+        .devs = devs,
+        .results = results,
+        .timings = timings,
+        .raw_values = raw_values,
+    };
+    for (size_t i = 0; i < count; i++) {
+        batch_add(&batch, devs[i], i);
+    }
+    batch_flush(&batch);
+
+    return batch_result(results, count);
+}
+
+bool htu21d_log_errors(uint32_t interval_ms)
+{
+    return htu21d_dev_log_errors(&_dev, NULL, interval_ms);
+}
+
+/**
+ * @brief Copies the errors counted on a sensor since its handle was
+ * initialized.
+ * @param dev The sensor.
+ * @param[out] errors Receives the counters.
+ */
+void htu21d_dev_get_errors(const htu21d_dev_t *dev, htu21d_errors_t *errors)
+{
+    *errors = dev->errors;
+}
+
+/**
+ * @brief Logs one line summing up the errors of a sensor since the last
+ * summary, at most once per interval.
+ *
+ * The driver never logs a failed transaction itself, it only counts it (see
+ * #htu21d_errors_t). Call this from the application loop or a housekeeping
+ * task to report them. The counters are read without locking, so it can run
+ * in another task than the one reading the sensor: an error counted during
+ * the call is then reported by the next summary.
+ * @param dev The sensor.
+ * @param name Name of the sensor in the message, `NULL` for "HTU21D".
+ * @param interval_ms Minimum time between two summaries of the sensor.
+ * @return Returns `true` if a summary was logged, `false` if the interval has
+ * not elapsed or there was no new error.
+ */
+bool htu21d_dev_log_errors(htu21d_dev_t *dev, const char *name, uint32_t interval_ms)
+{
+    int64_t now_us = htu21d_port_time_us();
+    if (now_us - dev->errors_logged_us < (int64_t) interval_ms * 1000) {
+        return false;
     }
-    return raw_value & 0xFFFC;
+
+    const htu21d_errors_t errors = dev->errors;
+    const htu21d_errors_t *last = &dev->errors_logged;
+    uint32_t nack = errors.nack - last->nack;
+    uint32_t timeout = errors.timeout - last->timeout;
+    uint32_t crc = errors.crc - last->crc;
+    uint32_t other = errors.other - last->other;
+    if (nack == 0 && timeout == 0 && crc == 0 && other == 0) {
+        return false;
+    }
+
+    ESP_LOGW(TAG, "%s: %" PRIu32 " NACK, %" PRIu32 " timeout, %" PRIu32 " CRC and %" PRIu32
+             " other errors in %" PRIu32 " transactions (%" PRIu32 " resent after a failed batch)"
+             " over the last %" PRId64 " ms",
+             (name != NULL) ? name : "HTU21D", nack, timeout, crc, other,
+             errors.transactions - last->transactions, errors.resent - last->resent,
+             (now_us - dev->errors_logged_us) / 1000);
+    dev->errors_logged = errors;
+    dev->errors_logged_us = now_us;
+    return true;
 }
 
+/**
+ * @brief Finds the highest SCL frequency at which a sensor reads reliably.
+ *
+ * Long cables do not work at the frequencies short ones do. The probe steps
+ * up through 50, 100, 200 and 400 kHz, up to `max_clock_hz`, and at each
+ * frequency reads `reads` humidity conversions, checking their CRC. It keeps
+ * the highest frequency at which all of them succeeded.
+ *
+ * From then on, the error rate of the sensor is measured over windows of
+ * #HTU21D_CLOCK_WINDOW transactions. When it goes above
+ * #HTU21D_CLOCK_ERROR_PERMILLE, the frequency is lowered by one step and a
+ * warning is logged, see #htu21d_dev_get_clock. A NACK of an HTU21D read-back,
+ * which only means the conversion had not ended, is not an error there. With
+ * the I2C master driver and `CONFIG_HTU21D_STATIC_ALLOCATION`, the frequency
+ * is never lowered after the probe (see #HTU21D_CLOCK_DOWNSHIFT): the driver
+ * would allocate new device handles.
+ *
+ * The frequency is set through the `set_clock` operation of the transport,
+ * for the whole bus. For several sensors on one bus, probe the first one,
+ * then pass its frequency as `max_clock_hz` for the next ones: the bus ends
+ * at the frequency every sensor supports. The errors caused by the probe
+ * itself are not counted.
+ * @param dev The sensor, already initialized.
+ * @param max_clock_hz Highest frequency to try, e.g. `400000`.
+ * @param reads Conversions read at each frequency, e.g. 4. Each one takes a
+ * humidity conversion time, see #htu21d_dev_conversion_time_ms.
+ * @return Returns #HTU21D_ERR_OK if a frequency was found,
+ * #HTU21D_ERR_INVALID_ARG if `dev` is `NULL` or `reads` is 0,
+ * #HTU21D_ERR_INVALID_STATE if the transport cannot set the frequency, or the
+ * error of the failed read if none worked, the bus being then left at the
+ * lowest frequency.
+ */
+int htu21d_dev_probe_clock(htu21d_dev_t *dev, uint32_t max_clock_hz, unsigned int reads)
+{
+    const size_t step_count = sizeof(clock_steps_hz) / sizeof(clock_steps_hz[0]);
+    int ret = HTU21D_ERR_OK;
+    size_t chosen = SIZE_MAX, step;
+
+    if (dev == NULL || reads == 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+    if (dev->transport == NULL || dev->transport->set_clock == NULL) {
+        return HTU21D_ERR_INVALID_STATE;
+    }
+
+    // Stop the downshifts and keep the counters out of the probe.
+    const htu21d_errors_t errors = dev->errors;
+    dev->clock.clock_hz = 0;
+
+    for (step = 0; step < step_count && clock_steps_hz[step] <= max_clock_hz; step++) {
+        ret = dev->transport->set_clock(dev->bus, clock_steps_hz[step]);
+        for (unsigned int i = 0; i < reads && ret == HTU21D_ERR_OK; i++) {
+            uint16_t raw_value;
+            ret = htu21d_dev_trigger(dev, TRIGGER_HUMD_MEASURE_NOHOLD, NULL);
+            if (ret == HTU21D_ERR_OK) {
+                htu21d_port_delay_ms(htu21d_dev_conversion_time_ms(dev, TRIGGER_HUMD_MEASURE_NOHOLD));
+                ret = htu21d_dev_fetch(dev, &raw_value, NULL);
+            }
+        }
+        if (ret != HTU21D_ERR_OK) {
+            break;
+        }
+        chosen = step;
+    }
+
+    if (chosen == SIZE_MAX) {
+        chosen = 0;
+        if (ret == HTU21D_ERR_OK) {
+            // max_clock_hz is below the lowest step
+            ret = HTU21D_ERR_INVALID_ARG;
+        }
+    } else {
+        ret = HTU21D_ERR_OK;
+    }
+    // the bus may have been left at the step that failed
+    dev->transport->set_clock(dev->bus, clock_steps_hz[chosen]);
+
+    dev->errors = errors;
+    dev->clock = (htu21d_clock_t) {
+        .clock_hz = clock_steps_hz[chosen],
+        .probed_hz = clock_steps_hz[chosen],
+        .downshifts = dev->clock.downshifts,
+    };
+    if (ret == HTU21D_ERR_OK) {
+        ESP_LOGI(TAG, "SCL frequency set to %" PRIu32 " Hz.", dev->clock.clock_hz);
+    } else {
+        ESP_LOGE(TAG, "No SCL frequency works, error: 0x%02X", ret);
+    }
+    return ret;
+}
+
+/**
+ * @brief Copies the SCL frequency of a sensor and how often it was lowered.
+ *
+ * The error rates it is based on are in #htu21d_dev_get_errors.
+ * @param dev The sensor.
+ * @param[out] clock Receives the frequency state.
+ */
+void htu21d_dev_get_clock(const htu21d_dev_t *dev, htu21d_clock_t *clock)
+{
+    *clock = dev->clock;
+}
+
+/**
+ * @brief Accounts a transaction in the error rate window of a sensor, and
+ * lowers its SCL frequency by one step if the window has too many errors.
+ *
+ * Only sensors whose frequency was set by #htu21d_dev_probe_clock are tracked.
+ */
+static void dev_track_clock(htu21d_dev_t *dev, bool failed)
+{
+    htu21d_clock_t *clock = &dev->clock;
+
+    if (clock->clock_hz == 0) {
+        return;
+    }
+    clock->window++;
+    clock->window_errors += failed;
+    if (clock->window < HTU21D_CLOCK_WINDOW) {
+        return;
+    }
+
+    bool too_many = (uint32_t) clock->window_errors * 1000 > (uint32_t) HTU21D_CLOCK_ERROR_PERMILLE * clock->window;
+    clock->window = 0;
+    clock->window_errors = 0;
+    if (!too_many || !HTU21D_CLOCK_DOWNSHIFT || clock->clock_hz <= clock_steps_hz[0]) {
+        return;
+    }
+
+    uint32_t lower_hz = clock_steps_hz[0];
+    for (size_t i = 0; i < sizeof(clock_steps_hz) / sizeof(clock_steps_hz[0]); i++) {
+        if (clock_steps_hz[i] < clock->clock_hz) {
+            lower_hz = clock_steps_hz[i];
+        }
+    }
+    if (dev->transport->set_clock(dev->bus, lower_hz) == HTU21D_ERR_OK) {
+        ESP_LOGW(TAG, "Error rate above %d/1000 at %" PRIu32 " Hz, SCL frequency lowered to %" PRIu32 " Hz.",
+                 HTU21D_CLOCK_ERROR_PERMILLE, clock->clock_hz, lower_hz);
+        clock->clock_hz = lower_hz;
+        clock->downshifts++;
+    }
+}
+
+/**
+ * @brief Resets the error counters of a handle being initialized.
+ */
+static void dev_clear_errors(htu21d_dev_t *dev)
+{
+    const htu21d_errors_t none = {0};
+    dev->errors = none;
+    dev->errors_logged = none;
+    dev->errors_logged_us = htu21d_port_time_us();
+}
+
+/**
+ * @brief Resets the resolution and the calibration of a handle being
+ * initialized.
+ */
+static void dev_clear_calibration(htu21d_dev_t *dev)
+{
+    const htu21d_calibration_t none = {0};
+    dev->resolution = 0;
+    dev->calibration = none;
+}
+
+/**
+ * @brief Counts a transaction of the sensor and its error, if any, in
+ * #htu21d_errors_t.
+ * @return Returns `ret`.
+ */
+static int dev_count_transaction(htu21d_dev_t *dev, int ret)
+{
+    dev->errors.transactions++;
+
+    switch (ret) {
+
+    case HTU21D_ERR_OK:
+        break;
+
+    case HTU21D_ERR_FAIL:
+        dev->errors.nack++;
+        break;
+
+    case HTU21D_ERR_TIMEOUT:
+        dev->errors.timeout++;
+        break;
+
+    case HTU21D_ERR_CRC:
+        dev->errors.crc++;
+        break;
+
+    default:
+        dev->errors.other++;
+        break;
+    }
+    return ret;
+}
+
+/**
+ * @brief Counts a transaction of the sensor and its error, if any, see
+ * #htu21d_errors_t, and accounts it in the error rate of the SCL frequency.
+ * @return Returns `ret`, so that a return statement can count its error.
+ */
+static int dev_count_error(htu21d_dev_t *dev, int ret)
+{
+    dev_track_clock(dev, ret != HTU21D_ERR_OK);
+    return dev_count_transaction(dev, ret);
+}
+
+/**
+ * @brief Counts the read-back of a conversion, as #dev_count_error does.
+ *
+ * An HTU21D NACKs its read address until the conversion ends. Such a NACK is
+ * counted in #htu21d_errors_t::nack, but not in the error rate of the SCL
+ * frequency: the read came early, the bus did not fail.
+ * @return Returns `ret`.
+ */
+static int dev_count_result(htu21d_dev_t *dev, int ret)
+{
+    bool early = ret == HTU21D_ERR_FAIL && dev->model != HTU21D_MODEL_HTU31D;
+    dev_track_clock(dev, ret != HTU21D_ERR_OK && !early);
+    return dev_count_transaction(dev, ret);
+}
+
+/**
+ * @brief Makes the sensor reachable: checks the handle is initialized and, when
+ * the sensor is behind a multiplexer, selects its channel if needed.
+ * @return Returns an `HTU21D_ERR_*` code, #HTU21D_ERR_INVALID_STATE if the
+ * handle was never initialized.
+ */
+static int bus_select(htu21d_dev_t *dev)
+{
+    if (dev->transport == NULL) {
+        return HTU21D_ERR_INVALID_STATE;
+    }
+    if (dev->mux == NULL) {
+        return HTU21D_ERR_OK;
+    }
+
+    htu21d_mux_t *mux = dev->mux;
+    const uint8_t mask = 1 << dev->mux_channel;
+    if (mux->selected == mask) {
+        return HTU21D_ERR_OK;
+    }
+    int ret = mux->transport->write(mux->bus, mux->address, &mask, 1);
+    mux->selected = (ret == HTU21D_ERR_OK) ? mask : -1;
+    return ret;
+}
+
+/**
+ * @brief Writes to the sensor through its transport.
+ * @return Returns an `HTU21D_ERR_*` code.
+ */
+static int bus_write(htu21d_dev_t *dev, const uint8_t *data, size_t len)
+{
+    int ret = bus_select(dev);
+    if (ret != HTU21D_ERR_OK) {
+        return dev_count_error(dev, ret);
+    }
+    return dev_count_error(dev, dev->transport->write(dev->bus, dev->address, data, len));
+}
+
+/**
+ * @brief Reads from the sensor through its transport.
+ *
+ * Unlike the other `bus_*` functions, the result is not counted: the caller
+ * counts it once the CRC of the data is checked.
+ * @return Returns an `HTU21D_ERR_*` code.
+ */
+static int bus_read(htu21d_dev_t *dev, uint8_t *data, size_t len)
+{
+    int ret = bus_select(dev);
+    if (ret != HTU21D_ERR_OK) {
+        return ret;
+    }
+    return dev->transport->read(dev->bus, dev->address, data, len);
+}
+
+/**
+ * @brief Sends a read command to the sensor then reads its answer, in one
+ * combined transaction. Not counted, like #bus_read.
+ * @return Returns an `HTU21D_ERR_*` code.
+ */
+static int bus_command_read(htu21d_dev_t *dev, uint8_t command, uint8_t *data, size_t len)
+{
+    int ret = bus_select(dev);
+    if (ret != HTU21D_ERR_OK) {
+        return ret;
+    }
+    return dev->transport->write_read(dev->bus, dev->address, &command, 1, data, len);
+}
+
+/**
+ * @brief Writes then reads the sensor in one combined transaction.
+ * @return Returns an `HTU21D_ERR_*` code.
+ */
+static int bus_write_read(htu21d_dev_t *dev, const uint8_t *write_data, size_t write_len,
+                          uint8_t *read_data, size_t read_len)
+{
+    int ret = bus_select(dev);
+    if (ret != HTU21D_ERR_OK) {
+        return dev_count_error(dev, ret);
+    }
+    return dev_count_error(dev, dev->transport->write_read(dev->bus, dev->address, write_data, write_len,
+                                                           read_data, read_len));
+}
+
+#if CONFIG_HTU21D_CRC_TABLE
+/** CRC of every byte for the polynomial x^8 + x^5 + x^4 + 1 (0x31), MSB first. */
+static const uint8_t crc_table[256] = {
+    0x00, 0x31, 0x62, 0x53, 0xC4, 0xF5, 0xA6, 0x97, 0xB9, 0x88, 0xDB, 0xEA, 0x7D, 0x4C, 0x1F, 0x2E,
+    0x43, 0x72, 0x21, 0x10, 0x87, 0xB6, 0xE5, 0xD4, 0xFA, 0xCB, 0x98, 0xA9, 0x3E, 0x0F, 0x5C, 0x6D,
+    0x86, 0xB7, 0xE4, 0xD5, 0x42, 0x73, 0x20, 0x11, 0x3F, 0x0E, 0x5D, 0x6C, 0xFB, 0xCA, 0x99, 0xA8,
+    0xC5, 0xF4, 0xA7, 0x96, 0x01, 0x30, 0x63, 0x52, 0x7C, 0x4D, 0x1E, 0x2F, 0xB8, 0x89, 0xDA, 0xEB,
+    0x3D, 0x0C, 0x5F, 0x6E, 0xF9, 0xC8, 0x9B, 0xAA, 0x84, 0xB5, 0xE6, 0xD7, 0x40, 0x71, 0x22, 0x13,
+    0x7E, 0x4F, 0x1C, 0x2D, 0xBA, 0x8B, 0xD8, 0xE9, 0xC7, 0xF6, 0xA5, 0x94, 0x03, 0x32, 0x61, 0x50,
+    0xBB, 0x8A, 0xD9, 0xE8, 0x7F, 0x4E, 0x1D, 0x2C, 0x02, 0x33, 0x60, 0x51, 0xC6, 0xF7, 0xA4, 0x95,
+    0xF8, 0xC9, 0x9A, 0xAB, 0x3C, 0x0D, 0x5E, 0x6F, 0x41, 0x70, 0x23, 0x12, 0x85, 0xB4, 0xE7, 0xD6,
+    0x7A, 0x4B, 0x18, 0x29, 0xBE, 0x8F, 0xDC, 0xED, 0xC3, 0xF2, 0xA1, 0x90, 0x07, 0x36, 0x65, 0x54,
+    0x39, 0x08, 0x5B, 0x6A, 0xFD, 0xCC, 0x9F, 0xAE, 0x80, 0xB1, 0xE2, 0xD3, 0x44, 0x75, 0x26, 0x17,
+    0xFC, 0xCD, 0x9E, 0xAF, 0x38, 0x09, 0x5A, 0x6B, 0x45, 0x74, 0x27, 0x16, 0x81, 0xB0, 0xE3, 0xD2,
+    0xBF, 0x8E, 0xDD, 0xEC, 0x7B, 0x4A, 0x19, 0x28, 0x06, 0x37, 0x64, 0x55, 0xC2, 0xF3, 0xA0, 0x91,
+    0x47, 0x76, 0x25, 0x14, 0x83, 0xB2, 0xE1, 0xD0, 0xFE, 0xCF, 0x9C, 0xAD, 0x3A, 0x0B, 0x58, 0x69,
+    0x04, 0x35, 0x66, 0x57, 0xC0, 0xF1, 0xA2, 0x93, 0xBD, 0x8C, 0xDF, 0xEE, 0x79, 0x48, 0x1B, 0x2A,
+    0xC1, 0xF0, 0xA3, 0x92, 0x05, 0x34, 0x67, 0x56, 0x78, 0x49, 0x1A, 0x2B, 0xBC, 0x8D, 0xDE, 0xEF,
+    0x82, 0xB3, 0xE0, 0xD1, 0x46, 0x77, 0x24, 0x15, 0x3B, 0x0A, 0x59, 0x68, 0xFF, 0xCE, 0x9D, 0xAC,
+};
+
+// verify the CRC, same result as the bitwise division of the datasheet
+bool is_crc_valid(uint16_t value, uint8_t crc)
+{
+    uint8_t remainder = crc_table[value >> 8];
+    remainder = crc_table[remainder ^ (value & 0xFF)];
+    return (remainder == crc);
+}
+#else
 // verify the CRC, algorithm in the datasheet (see comments below)
 bool is_crc_valid(uint16_t value, uint8_t crc)
 {
@@ -437,7 +1914,26 @@ bool is_crc_valid(uint16_t value, uint8_t crc)
     // the remainder should equal zero if there are no detectable errors
     return (row == 0);
 }
+#endif
+
+/**
+ * @brief Computes the CRC the sensors append to their data: polynomial
+ * x^8 + x^5 + x^4 + 1 (0x31), MSB first, initial value 0.
+ */
+static uint8_t crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
 
+#ifdef HTU21D_DERIVED_MATH
 /**
  * @brief Converts Celsius to Fahrenheit.
  * @param celsius_degrees The temperature in degrees Celsius.
@@ -466,3 +1962,172 @@ float htu21_compute_compensated_humidity(float temperature,
     return (relative_humidity +
             (25.0F - temperature) * HTU21_TEMPERATURE_COEFFICIENT);
 }
+#endif  // HTU21D_DERIVED_MATH
+
+#ifdef HTU21D_I2C_LEGACY
+#if CONFIG_HTU21D_STATIC_ALLOCATION
+// Command links live on the stack of the transport function, sized for the
+// given number of start-to-stop transactions.
+#define I2C_LINK_DECLARE(name, transactions)    uint8_t name[I2C_LINK_RECOMMENDED_SIZE(transactions)]
+#define I2C_LINK_CREATE(name)                   i2c_cmd_link_create_static(name, sizeof(name))
+#define I2C_LINK_DELETE(cmd)                    i2c_cmd_link_delete_static(cmd)
+#else
+#define I2C_LINK_DECLARE(name, transactions)    uint8_t *name = NULL
+#define I2C_LINK_CREATE(name)                   ((void) name, i2c_cmd_link_create())
+#define I2C_LINK_DELETE(cmd)                    i2c_cmd_link_delete(cmd)
+#endif
+
+// Appends a command to a link unless an earlier one failed. Appending only
+// fails when the link is out of memory; the error is returned by the transport
+// and counted, not logged, like a failed transaction.
+#define I2C_LINK_APPEND(ret, command)   do { if ((ret) == ESP_OK) { (ret) = (command); } } while (0)
+
+/**
+ * @brief Maps an ESP-IDF I2C driver error to an `HTU21D_ERR_*` code.
+ */
+static int i2c_error_to_htu21d(esp_err_t ret)
+{
+    switch (ret) {
+
+    case ESP_OK:
+        return HTU21D_ERR_OK;
+
+    case ESP_ERR_INVALID_ARG:
+        return HTU21D_ERR_INVALID_ARG;
+
+    case ESP_ERR_INVALID_STATE:
+        return HTU21D_ERR_INVALID_STATE;
+
+    case ESP_ERR_TIMEOUT:
+        return HTU21D_ERR_TIMEOUT;
+
+    case ESP_ERR_NO_MEM:
+        return HTU21D_ERR_NO_MEM;
+    }
+    return HTU21D_ERR_FAIL;
+}
+
+static int i2c_write(void *bus, uint8_t address, const uint8_t *data, size_t len)
+{
+    esp_err_t ret = ESP_OK;
+    I2C_LINK_DECLARE(link, 1);
+
+    i2c_cmd_handle_t cmd = I2C_LINK_CREATE(link);
+    if (cmd == NULL) {
+        return HTU21D_ERR_NO_MEM;
+    }
+    I2C_LINK_APPEND(ret, i2c_master_start(cmd));
+    I2C_LINK_APPEND(ret, i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_WRITE, true));
+    if (len > 0) {
+        I2C_LINK_APPEND(ret, i2c_master_write(cmd, data, len, true));
+    }
+    I2C_LINK_APPEND(ret, i2c_master_stop(cmd));
+    I2C_LINK_APPEND(ret, i2c_master_cmd_begin((i2c_port_t)(intptr_t) bus, cmd, 1000 / portTICK_PERIOD_MS));
+    I2C_LINK_DELETE(cmd);
+
+    return i2c_error_to_htu21d(ret);
+}
+
+static int i2c_read(void *bus, uint8_t address, uint8_t *data, size_t len)
+{
+    esp_err_t ret = ESP_OK;
+    I2C_LINK_DECLARE(link, 1);
+
+    i2c_cmd_handle_t cmd = I2C_LINK_CREATE(link);
+    if (cmd == NULL) {
+        return HTU21D_ERR_NO_MEM;
+    }
+    I2C_LINK_APPEND(ret, i2c_master_start(cmd));
+    I2C_LINK_APPEND(ret, i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_READ, true));
+    I2C_LINK_APPEND(ret, i2c_master_read(cmd, data, len, I2C_MASTER_LAST_NACK));
+    I2C_LINK_APPEND(ret, i2c_master_stop(cmd));
+    I2C_LINK_APPEND(ret, i2c_master_cmd_begin((i2c_port_t)(intptr_t) bus, cmd, 1000 / portTICK_PERIOD_MS));
+    I2C_LINK_DELETE(cmd);
+
+    return i2c_error_to_htu21d(ret);
+}
+
+static int i2c_write_read(void *bus, uint8_t address, const uint8_t *write_data, size_t write_len,
+                          uint8_t *read_data, size_t read_len)
+{
+    esp_err_t ret = ESP_OK;
+    I2C_LINK_DECLARE(link, 2);
+
+    i2c_cmd_handle_t cmd = I2C_LINK_CREATE(link);
+    if (cmd == NULL) {
+        return HTU21D_ERR_NO_MEM;
+    }
+    I2C_LINK_APPEND(ret, i2c_master_start(cmd));
+    I2C_LINK_APPEND(ret, i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_WRITE, true));
+    I2C_LINK_APPEND(ret, i2c_master_write(cmd, write_data, write_len, true));
+    I2C_LINK_APPEND(ret, i2c_master_start(cmd));
+    I2C_LINK_APPEND(ret, i2c_master_write_byte(cmd, (address << 1) | I2C_MASTER_READ, true));
+    I2C_LINK_APPEND(ret, i2c_master_read(cmd, read_data, read_len, I2C_MASTER_LAST_NACK));
+    I2C_LINK_APPEND(ret, i2c_master_stop(cmd));
+    I2C_LINK_APPEND(ret, i2c_master_cmd_begin((i2c_port_t)(intptr_t) bus, cmd, 1000 / portTICK_PERIOD_MS));
+    I2C_LINK_DELETE(cmd);
+
+    return i2c_error_to_htu21d(ret);
+}
+
+static int i2c_batch(void *bus, const htu21d_transfer_t *transfers, size_t count)
+{
+    esp_err_t ret = ESP_OK;
+    I2C_LINK_DECLARE(link, 2 * HTU21D_BATCH_MAX_TRANSFERS);
+
+    i2c_cmd_handle_t cmd = I2C_LINK_CREATE(link);
+    if (cmd == NULL) {
+        return HTU21D_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const htu21d_transfer_t *transfer = &transfers[i];
+        if (transfer->write_len != 0 || transfer->read_len == 0) {
+            I2C_LINK_APPEND(ret, i2c_master_start(cmd));
+            I2C_LINK_APPEND(ret, i2c_master_write_byte(cmd, (transfer->address << 1) | I2C_MASTER_WRITE, true));
+            if (transfer->write_len != 0) {
+                I2C_LINK_APPEND(ret, i2c_master_write(cmd, transfer->write_data, transfer->write_len, true));
+            }
+        }
+        if (transfer->read_len != 0) {
+            I2C_LINK_APPEND(ret, i2c_master_start(cmd));
+            I2C_LINK_APPEND(ret, i2c_master_write_byte(cmd, (transfer->address << 1) | I2C_MASTER_READ, true));
+            I2C_LINK_APPEND(ret, i2c_master_read(cmd, transfer->read_data, transfer->read_len, I2C_MASTER_LAST_NACK));
+        }
+    }
+    I2C_LINK_APPEND(ret, i2c_master_stop(cmd));
+    I2C_LINK_APPEND(ret, i2c_master_cmd_begin((i2c_port_t)(intptr_t) bus, cmd, 1000 / portTICK_PERIOD_MS));
+    I2C_LINK_DELETE(cmd);
+
+    return i2c_error_to_htu21d(ret);
+}
+
+/**
+ * @brief Changes the SCL frequency of a port set up by #htu21d_init.
+ *
+ * The ports the application set up itself cannot be changed, as their
+ * configuration (pins, pull-ups) is not known here.
+ */
+static int i2c_set_clock(void *bus, uint32_t clock_hz)
+{
+    i2c_port_t port = (i2c_port_t)(intptr_t) bus;
+
+    if (port < 0 || port >= I2C_NUM_MAX || port_configs[port].mode != I2C_MODE_MASTER) {
+        return HTU21D_ERR_INVALID_STATE;
+    }
+    port_configs[port].master.clk_speed = clock_hz;
+    return i2c_error_to_htu21d(i2c_param_config(port, &port_configs[port]));
+}
+
+/**
+ * Transport over the ESP-IDF I2C master driver (`driver/i2c.h`). The bus is
+ * the I2C port number, cast to a pointer. A batch is a single command link,
+ * so it costs one `i2c_master_cmd_begin()` call.
+ */
+const htu21d_transport_t htu21d_i2c_transport = {
+    .write = i2c_write,
+    .read = i2c_read,
+    .write_read = i2c_write_read,
+    .batch = i2c_batch,
+    .set_clock = i2c_set_clock,
+};
+#endif  // HTU21D_I2C_LEGACY
@@ -15,11 +15,59 @@
 #ifndef __ESP_HTU21D_H__
 #define __ESP_HTU21D_H__
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
 #include "esp_err.h"
-#include "driver/i2c.h"
 #include "freertos/task.h"
+#if !CONFIG_HTU21D_I2C_DRIVER_MASTER && !CONFIG_IDF_TARGET_LINUX
+#include "driver/i2c.h"
+/** Defined when the component uses the legacy I2C driver (`driver/i2c.h`), see Kconfig. */
+#define HTU21D_I2C_LEGACY   1
+#endif
+#endif
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_DERIVED_MATH
+/** Defined when the derived quantities (dew point, ...) are built, see Kconfig. Always built outside ESP-IDF. */
+#define HTU21D_DERIVED_MATH 1
+#endif
+
+#define HTU21D_ADDR     0x40 /**< I2C address of the HTU21D sensor, and of the HTU31D with its ADDR pin low. */
 
-#define HTU21D_ADDR     0x40 /**< I2C address of the HTU21D sensor. */
+// sensor models, see htu21d_dev_t.model
+#define HTU21D_MODEL_HTU21D 0 /**< HTU21D(F): one conversion per quantity, read back with a status bit pair. */
+#define HTU21D_MODEL_HTU31D 1 /**< HTU31D: one conversion for both quantities, read back in a single transaction. */
+
+#define HTU21D_CONVERSION_TIME_MS   50 /**< Time waited for a conversion to finish, covers the slowest (14-bit temperature) conversion. */
+
+#ifndef HTU21D_CALIBRATION_MARGIN_PERCENT
+#define HTU21D_CALIBRATION_MARGIN_PERCENT   10 /**< Margin added to the conversion times measured by #htu21d_dev_calibrate. */
+#endif
+
+#ifndef HTU21D_CLOCK_WINDOW
+#define HTU21D_CLOCK_WINDOW         64 /**< Transactions over which the error rate is measured, see #htu21d_dev_probe_clock. */
+#endif
+#ifndef HTU21D_CLOCK_ERROR_PERMILLE
+#define HTU21D_CLOCK_ERROR_PERMILLE 50 /**< Error rate of a window, in 1/1000, above which the SCL frequency is lowered. */
+#endif
+#ifndef HTU21D_CLOCK_DOWNSHIFT
+#if CONFIG_HTU21D_STATIC_ALLOCATION && CONFIG_HTU21D_I2C_DRIVER_MASTER
+#define HTU21D_CLOCK_DOWNSHIFT      0 /**< The error rate is only counted: the master driver would allocate new device handles at the lower frequency. */
+#else
+#define HTU21D_CLOCK_DOWNSHIFT      1 /**< Lower the SCL frequency when the error rate of a window is too high, see #htu21d_dev_probe_clock. */
+#endif
+#endif
+
+#ifndef HTU21D_BATCH_MAX_TRANSFERS
+#if CONFIG_HTU21D_STATIC_ALLOCATION
+#define HTU21D_BATCH_MAX_TRANSFERS  4  /**< Transactions sent in one submission by the `htu21d_batch_*` functions, kept small as the command link is then on the stack. */
+#else
+#define HTU21D_BATCH_MAX_TRANSFERS  16 /**< Transactions sent in one submission by the `htu21d_batch_*` functions. */
+#endif
+#endif
 
 // HTU21D commands
 #define TRIGGER_TEMP_MEASURE_HOLD       0xE3
@@ -30,6 +78,13 @@
 #define READ_USER_REG                   0xE7
 #define SOFT_RESET                      0xFE
 
+// HTU31D commands
+#define HTU31D_CONVERSION               0x40 /**< Converts both quantities, ORed with the RH OSR << 3 and the temperature OSR << 1. */
+#define HTU31D_READ_T_RH                0x00 /**< Reads temperature, CRC, humidity, CRC. */
+#define HTU31D_READ_RH                  0x10 /**< Reads humidity, CRC. */
+#define HTU31D_READ_SERIAL              0x0A /**< Reads the 24-bit serial number, CRC. */
+#define HTU31D_RESET                    0x1E
+
 // return values
 #define HTU21D_ERR_OK               0x00
 #define HTU21D_ERR_CONFIG           0x01
@@ -39,18 +94,209 @@
 #define HTU21D_ERR_FAIL             0x05
 #define HTU21D_ERR_INVALID_STATE    0x06
 #define HTU21D_ERR_TIMEOUT          0x07
+#define HTU21D_ERR_CRC              0x08
+#define HTU21D_ERR_NO_MEM           0x09
+
+/**
+ * @brief One transaction of a batch, see `htu21d_transport_t.batch`.
+ *
+ * A write when `read_len` is 0, a read when `write_len` is 0, otherwise a write
+ * then a read joined by a repeated start.
+ */
+typedef struct {
+    uint8_t address;            /**< I2C address of the device. */
+    const uint8_t *write_data;  /**< Bytes to write. */
+    size_t write_len;           /**< Number of bytes to write. */
+    uint8_t *read_data;         /**< Where to store the bytes read. */
+    size_t read_len;            /**< Number of bytes to read. */
+} htu21d_transfer_t;
+
+/**
+ * @brief Operations used by the driver to reach the I2C bus.
+ *
+ * Each operation is one complete I2C transaction, from start to stop
+ * condition, and returns an `HTU21D_ERR_*` code (#HTU21D_ERR_FAIL when the
+ * device does not acknowledge). `bus` is the value given to
+ * #htu21d_dev_attach.
+ */
+typedef struct {
+    /** Writes `len` bytes, `len` may be 0 to only probe the address. */
+    int (*write)(void *bus, uint8_t address, const uint8_t *data, size_t len);
+    /** Reads `len` bytes. */
+    int (*read)(void *bus, uint8_t address, uint8_t *data, size_t len);
+    /** Writes then reads, joined by a repeated start. */
+    int (*write_read)(void *bus, uint8_t address, const uint8_t *write_data, size_t write_len,
+                      uint8_t *read_data, size_t read_len);
+    /**
+     * Optional, may be `NULL`. Runs `count` transactions as one submission,
+     * joined by repeated starts with a single stop condition at the end. Fails
+     * as a whole if any of them fails.
+     */
+    int (*batch)(void *bus, const htu21d_transfer_t *transfers, size_t count);
+    /**
+     * Optional, may be `NULL`. Sets the SCL frequency of the bus, for every
+     * device on it. See #htu21d_dev_probe_clock.
+     */
+    int (*set_clock)(void *bus, uint32_t clock_hz);
+} htu21d_transport_t;
+
+/**
+ * @brief Handle of an I2C multiplexer (PCA9548A or compatible), shared by the
+ * sensors behind it. See #htu21d_mux_init.
+ */
+typedef struct {
+    const htu21d_transport_t *transport; /**< How the bus is reached. */
+    void *bus;                           /**< Bus the multiplexer is on, passed to the transport. */
+    uint8_t address;                     /**< I2C address of the multiplexer. */
+    int16_t selected;                    /**< Channel mask last written, `-1` when unknown. */
+} htu21d_mux_t;
+
+/**
+ * @brief Errors counted on a sensor, by kind.
+ *
+ * Failed transactions are counted, not logged where they happen: under a bus
+ * fault, printing a line per failure costs more time than the transactions
+ * themselves. #htu21d_dev_log_errors reports them from outside the
+ * transaction path, at a bounded rate.
+ */
+typedef struct {
+    uint32_t nack;      /**< Transactions not acknowledged (#HTU21D_ERR_FAIL), e.g. sensor absent or still converting. */
+    uint32_t timeout;   /**< Transactions that timed out (#HTU21D_ERR_TIMEOUT), e.g. SCL held low. */
+    uint32_t crc;       /**< Values read with an invalid CRC (#HTU21D_ERR_CRC). */
+    uint32_t other;     /**< Any other error, e.g. driver not installed or out of memory. */
+    uint32_t transactions; /**< Transactions, failed or not, the denominator of the error rates. */
+    uint32_t resent;    /**< Transactions sent again alone because the batch they were in failed, see #htu21d_batch_fetch. */
+} htu21d_errors_t;
+
+/**
+ * @brief SCL frequency of a sensor, see #htu21d_dev_probe_clock.
+ */
+typedef struct {
+    uint32_t clock_hz;      /**< Current frequency, 0 when never probed (the frequency the bus was set up with). */
+    uint32_t probed_hz;     /**< Frequency chosen by the last probe. */
+    uint32_t downshifts;    /**< Times the frequency was lowered because of the error rate. */
+    uint16_t window;        /**< Transactions in the current error rate window. */
+    uint16_t window_errors; /**< Failed transactions in the current error rate window. */
+} htu21d_clock_t;
+
+/**
+ * @brief Conversion times of one sensor, measured by #htu21d_dev_calibrate,
+ * margin included.
+ *
+ * Indexed by the resolution bits of the user register, as `b7 << 1 | b0`. A
+ * time of 0 is not calibrated: #HTU21D_CONVERSION_TIME_MS is waited instead.
+ */
+typedef struct {
+    uint16_t temperature_us[4]; /**< Temperature conversion times in microseconds. */
+    uint16_t humidity_us[4];    /**< Relative humidity conversion times in microseconds. */
+} htu21d_calibration_t;
+
+/**
+ * @brief Handle of one HTU21D or HTU31D sensor.
+ *
+ * The storage is owned by the caller, see #htu21d_dev_attach, which detects
+ * the model.
+ */
+typedef struct {
+    const htu21d_transport_t *transport; /**< How the bus is reached. */
+    void *bus;                           /**< Bus the sensor is on, passed to the transport. */
+    uint8_t address;                     /**< I2C address of the sensor. */
+    uint8_t model;                       /**< Sensor model, `HTU21D_MODEL_*`. */
+    uint8_t pending;                     /**< HTU31D: read command of the conversion last triggered. */
+    htu21d_mux_t *mux;                   /**< Multiplexer the sensor is behind, or `NULL`. */
+    uint8_t mux_channel;                 /**< Multiplexer channel of the sensor. */
+    htu21d_errors_t errors;              /**< Errors since the handle was initialized. */
+    htu21d_errors_t errors_logged;       /**< Value of `errors` at the last summary, see #htu21d_dev_log_errors. */
+    int64_t errors_logged_us;            /**< When the last summary was logged. */
+    uint8_t resolution;                  /**< Resolution bits of the user register as last written, or as last set on an HTU31D. */
+    htu21d_calibration_t calibration;    /**< Conversion times waited, see #htu21d_dev_calibrate. */
+    htu21d_clock_t clock;                /**< SCL frequency, see #htu21d_dev_probe_clock. */
+} htu21d_dev_t;
+
+/**
+ * @brief Timing of a single conversion, in monotonic microseconds
+ * (`esp_timer_get_time()` on ESP-IDF).
+ */
+typedef struct {
+    int64_t trigger_us; /**< When the trigger command was acknowledged, i.e. when the conversion started. */
+    int64_t read_us;    /**< When the read-back of the result started. */
+} htu21d_timing_t;
+
+/**
+ * @brief A temperature and relative humidity sample, with the timing of both
+ * conversions.
+ *
+ * `timestamp_us` is the canonical time of the sample: the mean of the
+ * midpoints of both conversions. Use it rather than the time the sample was
+ * returned, which depends on resolution and bus load.
+ */
+typedef struct {
+    float temperature;                  /**< Temperature in degrees Celsius. */
+    float humidity;                     /**< Relative humidity in %RH. */
+    uint16_t raw_temperature;           /**< Raw temperature value, status bits cleared. */
+    uint16_t raw_humidity;              /**< Raw relative humidity value, status bits cleared. */
+    htu21d_timing_t temperature_timing; /**< Timing of the temperature conversion. */
+    htu21d_timing_t humidity_timing;    /**< Timing of the humidity conversion. */
+    int64_t timestamp_us;               /**< Midpoint of the sample, see above. */
+} htu21d_sample_t;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifdef HTU21D_I2C_LEGACY
+extern const htu21d_transport_t htu21d_i2c_transport;
+#endif
+
 // functions
+#ifdef HTU21D_I2C_LEGACY
 int htu21d_init(i2c_port_t port, int sda_pin, int scl_pin, gpio_pullup_t sda_internal_pullup, gpio_pullup_t scl_internal_pullup);
+#endif
 float htu21d_read_temperature();
 float htu21d_read_humidity();
 uint8_t htu21d_get_resolution();
 int htu21d_set_resolution(uint8_t resolution);
 int htu21d_soft_reset();
+int htu21d_read_sample(htu21d_sample_t *sample);
+bool htu21d_log_errors(uint32_t interval_ms);
+
+// functions working on a device handle
+#ifdef HTU21D_I2C_LEGACY
+int htu21d_dev_init(htu21d_dev_t *dev, i2c_port_t port);
+#endif
+int htu21d_dev_attach(htu21d_dev_t *dev, const htu21d_transport_t *transport, void *bus);
+int htu21d_dev_attach_mux(htu21d_dev_t *dev, htu21d_mux_t *mux, uint8_t channel);
+int htu21d_mux_init(htu21d_mux_t *mux, const htu21d_transport_t *transport, void *bus, uint8_t address);
+float htu21d_dev_read_temperature(htu21d_dev_t *dev);
+float htu21d_dev_read_humidity(htu21d_dev_t *dev);
+int htu21d_dev_read_sample(htu21d_dev_t *dev, htu21d_sample_t *sample);
+int htu21d_dev_read_raw_sample(htu21d_dev_t *dev, htu21d_sample_t *sample);
+void htu21d_dev_convert_sample(const htu21d_dev_t *dev, htu21d_sample_t *sample);
+uint8_t htu21d_dev_get_resolution(htu21d_dev_t *dev);
+int htu21d_dev_set_resolution(htu21d_dev_t *dev, uint8_t resolution);
+int htu21d_dev_soft_reset(htu21d_dev_t *dev);
+uint8_t htu21d_dev_read_user_register(htu21d_dev_t *dev);
+int htu21d_dev_write_user_register(htu21d_dev_t *dev, uint8_t value);
+uint16_t htu21d_dev_read_value(htu21d_dev_t *dev, uint8_t command, htu21d_timing_t *timing);
+int htu21d_dev_trigger(htu21d_dev_t *dev, uint8_t command, htu21d_timing_t *timing);
+int htu21d_dev_fetch(htu21d_dev_t *dev, uint16_t *raw_value, htu21d_timing_t *timing);
+int htu21d_dev_calibrate(htu21d_dev_t *dev, unsigned int rounds);
+uint32_t htu21d_dev_conversion_time_ms(const htu21d_dev_t *dev, uint8_t command);
+uint32_t htu21d_conversion_time_us(uint8_t resolution, uint8_t command, const htu21d_calibration_t *calibration);
+void htu21d_dev_get_calibration(const htu21d_dev_t *dev, htu21d_calibration_t *calibration);
+void htu21d_dev_set_calibration(htu21d_dev_t *dev, const htu21d_calibration_t *calibration);
+#if CONFIG_HTU21D_CALIBRATION_NVS
+int htu21d_calibration_save_nvs(const htu21d_calibration_t *calibration, const char *key);
+int htu21d_calibration_load_nvs(htu21d_calibration_t *calibration, const char *key);
+#endif
+void htu21d_dev_get_errors(const htu21d_dev_t *dev, htu21d_errors_t *errors);
+int htu21d_dev_probe_clock(htu21d_dev_t *dev, uint32_t max_clock_hz, unsigned int reads);
+void htu21d_dev_get_clock(const htu21d_dev_t *dev, htu21d_clock_t *clock);
+bool htu21d_dev_log_errors(htu21d_dev_t *dev, const char *name, uint32_t interval_ms);
+int htu21d_batch_trigger(htu21d_dev_t *const *devs, size_t count, uint8_t command,
+                         htu21d_timing_t *timings, int *results);
+int htu21d_batch_fetch(htu21d_dev_t *const *devs, size_t count, uint16_t *raw_values,
+                       htu21d_timing_t *timings, int *results);
 
 // helper functions
 uint8_t htu21d_read_user_register();
@@ -58,11 +304,24 @@ int htu21d_write_user_register(uint8_t value);
 uint16_t read_value(uint8_t command);
 bool is_crc_valid(uint16_t value, uint8_t crc);
 
+// conversion functions
+float htu21d_raw_to_temperature(uint16_t raw_temperature);
+float htu21d_raw_to_humidity(uint16_t raw_humidity);
+int16_t htu21d_raw_to_temperature_centi(uint16_t raw_temperature);
+int16_t htu21d_raw_to_humidity_centi(uint16_t raw_humidity);
+float htu31d_raw_to_temperature(uint16_t raw_temperature);
+float htu31d_raw_to_humidity(uint16_t raw_humidity);
+int16_t htu31d_raw_to_temperature_centi(uint16_t raw_temperature);
+int16_t htu31d_raw_to_humidity_centi(uint16_t raw_humidity);
+int64_t htu21d_timing_midpoint(const htu21d_timing_t *timing);
+
+#ifdef HTU21D_DERIVED_MATH
 // Extra functions:
 float celsius_to_fahrenheit(float celsius_degrees);
 float htu21_compute_compensated_humidity(float temperature, float relative_humidity);
 float htu21d_compute_partial_pressure(float temperature);
 float htu21d_compute_dew_point(float temperature, float relative_humidity);
+#endif
 
 #ifdef __cplusplus
 }
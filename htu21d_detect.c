@@ -0,0 +1,439 @@
+/**
+ * @file htu21d_detect.c
+ * @brief Streaming detectors that raise events on the HTU21D sample stream.
+ *
+ * Per value, the z-score and CUSUM detectors cost a few integer additions,
+ * shifts and one 64-bit multiply: no division, no floating point and no
+ * memory beyond their state. Only raising an event (rare by design) costs a
+ * square root and the callback. The trend estimator keeps its window in its
+ * state and costs a few 64-bit multiplies and three divisions per value.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "htu21d.h"
+#include "htu21d_detect.h"
+
+/**
+ * @brief Integer square root, rounded down.
+ */
+static uint32_t isqrt64(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t) 1 << 62;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t) root;
+}
+
+static void raise_event(htu21d_event_cb_t callback, void *user_ctx, htu21d_event_type_t type,
+                        int64_t timestamp_us, int32_t value, int32_t statistic)
+{
+    if (callback == NULL) {
+        return;
+    }
+
+    htu21d_event_t event = {
+        .type = type,
+        .timestamp_us = timestamp_us,
+        .value = value,
+        .statistic = statistic,
+    };
+    callback(&event, user_ctx);
+}
+
+/**
+ * @brief Initializes an EWMA z-score detector.
+ *
+ * The detector tracks an exponentially weighted moving mean and variance, and
+ * raises an event when a value is more than `threshold_q4 / 16` standard
+ * deviations away from the mean. It reacts to sudden jumps (e.g. water
+ * ingress).
+ * @param[out] detector The detector to initialize.
+ * @param[in] config Its configuration.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_zscore_init(htu21d_zscore_t *detector, const htu21d_zscore_config_t *config)
+{
+    if (detector == NULL || config == NULL || config->alpha_shift == 0 ||
+            config->alpha_shift > 16 || config->min_deviation < 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *detector = (htu21d_zscore_t) {
+        .config = *config,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Feeds the next value to an EWMA z-score detector.
+ *
+ * The value is tested against the statistics learned so far, then included
+ * in them.
+ * @param detector An initialized detector.
+ * @param value The value, in the range of a raw 16-bit reading.
+ * @param timestamp_us Time of the value, copied into the event.
+ * @return Returns `true` if an event was raised.
+ */
+bool htu21d_zscore_update(htu21d_zscore_t *detector, int32_t value, int64_t timestamp_us)
+{
+    const htu21d_zscore_config_t *config = &detector->config;
+    bool raised = false;
+
+    if (detector->count == 0) {
+        detector->mean_q8 = value * 256;
+        detector->var_q16 = 0;
+        detector->count = 1;
+        return false;
+    }
+
+    int32_t deviation_q8 = value * 256 - detector->mean_q8;
+    uint64_t square_q16 = (uint64_t)((int64_t) deviation_q8 * deviation_q8);
+
+    if (detector->count >= config->warmup &&
+            (deviation_q8 >= config->min_deviation * 256 || -deviation_q8 >= config->min_deviation * 256) &&
+            square_q16 * 256 > (uint64_t) config->threshold_q4 * config->threshold_q4 * detector->var_q16) {
+        int32_t z_q4 = (detector->var_q16 == 0) ? INT32_MAX :
+                       (int32_t) isqrt64(square_q16 * 256 / detector->var_q16);
+        raise_event(config->callback, config->user_ctx,
+                    deviation_q8 > 0 ? HTU21D_EVENT_ZSCORE_HIGH : HTU21D_EVENT_ZSCORE_LOW,
+                    timestamp_us, value, z_q4);
+        raised = true;
+    }
+
+    detector->mean_q8 += deviation_q8 >> config->alpha_shift;
+    detector->var_q16 = (uint64_t)((int64_t) detector->var_q16 +
+                                   (((int64_t) square_q16 - (int64_t) detector->var_q16) >> config->alpha_shift));
+    if (detector->count < config->warmup) {
+        detector->count++;
+    }
+
+    return raised;
+}
+
+/**
+ * @brief Initializes a two-sided CUSUM detector.
+ *
+ * CUSUM accumulates the deviations from a target that exceed `slack`, and
+ * raises an event when the accumulated sum crosses `threshold`, then restarts.
+ * It detects small but sustained shifts that a z-score misses, such as slow
+ * sensor drift or an HVAC fault.
+ * @param[out] detector The detector to initialize.
+ * @param[in] config Its configuration.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_cusum_init(htu21d_cusum_t *detector, const htu21d_cusum_config_t *config)
+{
+    if (detector == NULL || config == NULL || config->slack < 0 || config->threshold <= 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *detector = (htu21d_cusum_t) {
+        .config = *config,
+        .target = config->target,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Feeds the next value to a two-sided CUSUM detector.
+ * @param detector An initialized detector.
+ * @param value The value, in the range of a raw 16-bit reading.
+ * @param timestamp_us Time of the value, copied into the event.
+ * @return Returns `true` if an event was raised.
+ */
+bool htu21d_cusum_update(htu21d_cusum_t *detector, int32_t value, int64_t timestamp_us)
+{
+    const htu21d_cusum_config_t *config = &detector->config;
+
+    if (detector->count < config->warmup) {
+        detector->warmup_sum += value;
+        if (++detector->count == config->warmup) {
+            detector->target = (int32_t)(detector->warmup_sum / config->warmup);
+        }
+        return false;
+    }
+
+    int32_t high = detector->high + (value - detector->target - config->slack);
+    int32_t low = detector->low + (detector->target - config->slack - value);
+    detector->high = high > 0 ? high : 0;
+    detector->low = low > 0 ? low : 0;
+
+    if (detector->high > config->threshold) {
+        raise_event(config->callback, config->user_ctx, HTU21D_EVENT_CUSUM_UP,
+                    timestamp_us, value, detector->high);
+        detector->high = 0;
+        return true;
+    }
+    if (detector->low > config->threshold) {
+        raise_event(config->callback, config->user_ctx, HTU21D_EVENT_CUSUM_DOWN,
+                    timestamp_us, value, detector->low);
+        detector->low = 0;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Initializes a trend estimator.
+ *
+ * The estimator fits a least-squares line through the last `window` values
+ * against their time, and predicts when the line crosses `threshold`. It
+ * raises an event when the crossing is due within `horizon_s`, so that an
+ * action (e.g. dehumidifying before the RH reaches the level where mold
+ * grows) starts before the threshold alarm would fire.
+ * @param[out] trend The estimator to initialize.
+ * @param[in] config Its configuration.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_trend_init(htu21d_trend_t *trend, const htu21d_trend_config_t *config)
+{
+    if (trend == NULL || config == NULL || config->window < 3 || config->window > HTU21D_TREND_WINDOW_MAX ||
+            config->horizon_s == 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *trend = (htu21d_trend_t) {
+        .config = *config,
+        .armed = true,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Removes the oldest value of the window from the sums.
+ */
+static void trend_drop_oldest(htu21d_trend_t *trend)
+{
+    int64_t x = trend->times[trend->first] - trend->origin;
+    int32_t y = trend->values[trend->first];
+
+    trend->sum_x -= x;
+    trend->sum_xx -= x * x;
+    trend->sum_y -= y;
+    trend->sum_xy -= x * y;
+    trend->first = (trend->first + 1) % HTU21D_TREND_WINDOW_MAX;
+    trend->count--;
+}
+
+/**
+ * @brief Moves the origin of the sums to the time of the oldest value, which
+ * keeps the times, and so the sums, small. The sums being integers, this is
+ * exact.
+ */
+static void trend_rebase(htu21d_trend_t *trend)
+{
+    int64_t shift = trend->times[trend->first] - trend->origin;
+
+    // sum of (x - shift)^2, from the sums over x
+    trend->sum_xx += trend->count * shift * shift - 2 * shift * trend->sum_x;
+    trend->sum_xy -= shift * trend->sum_y;
+    trend->sum_x -= trend->count * shift;
+    trend->origin += shift;
+}
+
+/**
+ * @brief Fits the line through the window and predicts the crossing, from the
+ * sums, in fixed point.
+ *
+ * With `n` values, the slope is `sxy / sxx`, where `sxy = n Σxy - Σx Σy` and
+ * `sxx = n Σxx - Σx²`. The times span at most #HTU21D_TREND_MAX_SPAN, and the
+ * values 16 bits, so every product fits in 64 bits.
+ * @param x_now Time of the latest value, from the origin.
+ * @return Returns `false` if all the values have the same time.
+ */
+static bool trend_fit(htu21d_trend_t *trend, int64_t x_now)
+{
+    const htu21d_trend_config_t *config = &trend->config;
+    htu21d_trend_estimate_t *estimate = &trend->estimate;
+    int64_t n = trend->count;
+    int64_t sxx = n * trend->sum_xx - trend->sum_x * trend->sum_x;
+    int64_t sxy = n * trend->sum_xy - trend->sum_x * trend->sum_y;
+
+    if (sxx == 0) {
+        return false;
+    }
+
+    // slope in value units per time unit, and fitted value, in 1/65536ths
+    int64_t slope_q16 = sxy * 65536 / sxx;
+    int64_t fitted_q16 = trend->sum_y * 65536 / n + slope_q16 * (n * x_now - trend->sum_x) / n;
+    // an hour is 3.6e9 / 2^16 = 3515625 / 64 time units
+    int64_t slope_per_hour = (slope_q16 * 3515625) >> 22;
+    estimate->value = (int32_t)((fitted_q16 + 32768) >> 16);
+    estimate->slope_per_hour = (slope_per_hour > INT32_MAX) ? INT32_MAX :
+                               (slope_per_hour < -INT32_MAX) ? -INT32_MAX : (int32_t) slope_per_hour;
+
+    int64_t distance_q16 = (int64_t) config->threshold * 65536 - fitted_q16;
+    if (config->falling) {
+        distance_q16 = -distance_q16;
+        slope_q16 = -slope_q16;
+    }
+    if (distance_q16 <= 0) {
+        estimate->seconds_to_threshold = 0;
+    } else if (slope_q16 <= 0) {
+        estimate->seconds_to_threshold = INT32_MAX;
+    } else {
+        // a time unit is 65536 / 1e6 s = 4096 / 62500 s
+        int64_t seconds = distance_q16 * 4096 / (slope_q16 * 62500);
+        estimate->seconds_to_threshold = (seconds >= INT32_MAX) ? INT32_MAX - 1 : (int32_t) seconds;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Feeds the next value to a trend estimator.
+ *
+ * The window moves by one value, in constant time: the oldest value is
+ * subtracted from running sums and the new one added. Values more than
+ * #HTU21D_TREND_MAX_SPAN older than the new one are dropped too, and a
+ * prediction is only made once the window is full again. A timestamp older
+ * than the previous one restarts the window.
+ *
+ * An event is raised when the crossing is predicted within `horizon_s`,
+ * including when the fitted value has already crossed. It is raised again
+ * only after the prediction has moved beyond twice the horizon, e.g. when the
+ * trend turned, so that noise around the horizon does not repeat it.
+ * @param trend An initialized estimator.
+ * @param value The value, in the range of a raw 16-bit reading, e.g. a
+ * relative humidity in hundredths.
+ * @param timestamp_us Time of the value, e.g. `htu21d_sample_t.timestamp_us`.
+ * @return Returns `true` if an event was raised.
+ */
+bool htu21d_trend_update(htu21d_trend_t *trend, int32_t value, int64_t timestamp_us)
+{
+    const htu21d_trend_config_t *config = &trend->config;
+    int64_t time = timestamp_us >> HTU21D_TREND_TIME_SHIFT;
+
+    if (trend->count > 0 &&
+            time < trend->times[(trend->first + trend->count - 1) % HTU21D_TREND_WINDOW_MAX]) {
+        trend->count = 0;
+        trend->sum_x = trend->sum_xx = trend->sum_y = trend->sum_xy = 0;
+    }
+    while (trend->count > 0 &&
+            (trend->count >= config->window || time - trend->times[trend->first] > HTU21D_TREND_MAX_SPAN)) {
+        trend_drop_oldest(trend);
+    }
+    if (trend->count > 0) {
+        trend_rebase(trend);
+    } else {
+        trend->origin = time;
+    }
+
+    int64_t x = time - trend->origin;
+    uint8_t last = (trend->first + trend->count) % HTU21D_TREND_WINDOW_MAX;
+    trend->times[last] = time;
+    trend->values[last] = value;
+    trend->count++;
+    trend->sum_x += x;
+    trend->sum_xx += x * x;
+    trend->sum_y += value;
+    trend->sum_xy += x * value;
+
+    trend->fitted = trend->count >= config->window && trend_fit(trend, x);
+    if (!trend->fitted) {
+        return false;
+    }
+
+    int32_t seconds = trend->estimate.seconds_to_threshold;
+    if (!trend->armed) {
+        trend->armed = seconds > 2 * (int64_t) config->horizon_s;
+        return false;
+    }
+    if (seconds > (int64_t) config->horizon_s) {
+        return false;
+    }
+
+    raise_event(config->callback, config->user_ctx,
+                config->falling ? HTU21D_EVENT_TREND_FALLING : HTU21D_EVENT_TREND_RISING,
+                timestamp_us, trend->estimate.value, seconds);
+    trend->armed = false;
+    return true;
+}
+
+/**
+ * @brief Copies the latest fit of a trend estimator, e.g. to display the
+ * trend or to scale an action with the time left.
+ * @param trend An initialized estimator.
+ * @param[out] estimate Receives the fit of the last full window.
+ * @return Returns `false`, leaving `estimate` untouched, if the window of the
+ * latest value was not full.
+ */
+bool htu21d_trend_get(const htu21d_trend_t *trend, htu21d_trend_estimate_t *estimate)
+{
+    if (!trend->fitted) {
+        return false;
+    }
+    *estimate = trend->estimate;
+    return true;
+}
+
+/**
+ * @brief Scales a converted value to hundredths, rounded to the nearest.
+ */
+static int32_t to_centi(float value)
+{
+    return (int32_t)(value * 100.0F + (value < 0.0F ? -0.5F : 0.5F));
+}
+
+/**
+ * @brief Feeds one sample to a group of detectors: the z-score detector, then
+ * the CUSUM detector, then the trend estimator, each only if set. The
+ * pipeline calls it for each sample read without error.
+ * @param detectors The detectors and the quantity they watch.
+ * @param sample A converted sample, see #htu21d_dev_convert_sample.
+ * @return Returns `true` if any detector raised an event.
+ */
+bool htu21d_detectors_update(const htu21d_detectors_t *detectors, const htu21d_sample_t *sample)
+{
+    int32_t value;
+    bool raised = false;
+
+    switch (detectors->quantity) {
+    case HTU21D_DETECT_TEMPERATURE:
+        value = to_centi(sample->temperature);
+        break;
+    case HTU21D_DETECT_RAW_HUMIDITY:
+        value = sample->raw_humidity;
+        break;
+    case HTU21D_DETECT_RAW_TEMPERATURE:
+        value = sample->raw_temperature;
+        break;
+    default:
+        value = to_centi(sample->humidity);
+        break;
+    }
+
+    if (detectors->zscore != NULL) {
+        raised |= htu21d_zscore_update(detectors->zscore, value, sample->timestamp_us);
+    }
+    if (detectors->cusum != NULL) {
+        raised |= htu21d_cusum_update(detectors->cusum, value, sample->timestamp_us);
+    }
+    if (detectors->trend != NULL) {
+        raised |= htu21d_trend_update(detectors->trend, value, sample->timestamp_us);
+    }
+    return raised;
+}
@@ -0,0 +1,187 @@
+/**
+ * @file htu21d_detect.h
+ * @brief Streaming detectors that raise events on the HTU21D sample stream.
+ *
+ * The detectors work on integer values, typically the raw 16-bit readings of
+ * htu21d_sample_t, keep a constant amount of state, and report through an
+ * #htu21d_event_cb_t callback. The trend estimator predicts when the values
+ * will cross a threshold, to act before they do.
+ *
+ * A #htu21d_detectors_t groups detectors fed from the same quantity of each
+ * sample, and is run by the processing stage of the pipeline when set in its
+ * configuration (see htu21d_pipeline.h).
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_DETECT_H__
+#define __ESP_HTU21D_DETECT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "htu21d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef HTU21D_TREND_WINDOW_MAX
+#define HTU21D_TREND_WINDOW_MAX     32 /**< Most values a trend estimator fits its line over, at most 32 for its sums to fit in 64 bits. */
+#endif
+#define HTU21D_TREND_TIME_SHIFT     16 /**< The trend estimator counts time in units of `2^16` µs (65.536 ms). */
+#define HTU21D_TREND_MAX_SPAN       (1 << 20) /**< Longest span of a trend window, in time units (about 19 hours): older values are dropped. */
+
+/**
+ * @brief Kinds of events raised by the detectors.
+ */
+typedef enum {
+    HTU21D_EVENT_ZSCORE_HIGH = 0, /**< Value far above the moving mean. */
+    HTU21D_EVENT_ZSCORE_LOW,      /**< Value far below the moving mean. */
+    HTU21D_EVENT_CUSUM_UP,        /**< Sustained upward shift from the target. */
+    HTU21D_EVENT_CUSUM_DOWN,      /**< Sustained downward shift from the target. */
+    HTU21D_EVENT_TREND_RISING,    /**< The trend will rise above the threshold within the horizon. */
+    HTU21D_EVENT_TREND_FALLING,   /**< The trend will fall below the threshold within the horizon. */
+} htu21d_event_type_t;
+
+/**
+ * @brief An event raised by a detector.
+ */
+typedef struct {
+    htu21d_event_type_t type; /**< What was detected. */
+    int64_t timestamp_us;     /**< Timestamp of the value that raised the event. */
+    int32_t value;            /**< The value that raised the event; for trend events, the fitted value at its time. */
+    int32_t statistic;        /**< |z| in 1/16ths for z-score events, the cumulative sum for CUSUM events, the predicted seconds to the crossing for trend events. */
+} htu21d_event_t;
+
+/**
+ * @brief Callback invoked by a detector when it raises an event.
+ * @param event The event, only valid during the call.
+ * @param user_ctx The `user_ctx` given in the detector configuration.
+ */
+typedef void (*htu21d_event_cb_t)(const htu21d_event_t *event, void *user_ctx);
+
+/**
+ * @brief Configuration of an EWMA z-score detector.
+ */
+typedef struct {
+    uint8_t alpha_shift;      /**< Weight of a new value in the moving mean and variance is `1 / 2^alpha_shift`, e.g. `5` averages over about 32 values. */
+    uint8_t threshold_q4;     /**< |z| above which an event is raised, in 1/16ths (e.g. `48` for 3.0). */
+    uint16_t warmup;          /**< Number of values used to learn the statistics before any event is raised. */
+    int32_t min_deviation;    /**< Smallest deviation from the mean that can raise an event, to ignore quantization noise. */
+    htu21d_event_cb_t callback; /**< Called for each event, may be `NULL`. */
+    void *user_ctx;           /**< Passed to `callback`. */
+} htu21d_zscore_config_t;
+
+/**
+ * @brief State of an EWMA z-score detector. Treat the members as private.
+ */
+typedef struct {
+    htu21d_zscore_config_t config;
+    uint32_t count;     /**< Values seen so far, saturated at `warmup`. */
+    int32_t mean_q8;    /**< Moving mean, in 1/256ths. */
+    uint64_t var_q16;   /**< Moving variance, in 1/65536ths. */
+} htu21d_zscore_t;
+
+/**
+ * @brief Configuration of a two-sided CUSUM detector.
+ */
+typedef struct {
+    int32_t target;           /**< Expected value. Ignored when `warmup` is not 0. */
+    int32_t slack;            /**< Deviation from `target` tolerated without accumulating (often half the shift to detect). */
+    int32_t threshold;        /**< Cumulative deviation above which an event is raised. */
+    uint16_t warmup;          /**< When not 0, the target is learned as the mean of this many first values. */
+    htu21d_event_cb_t callback; /**< Called for each event, may be `NULL`. */
+    void *user_ctx;           /**< Passed to `callback`. */
+} htu21d_cusum_config_t;
+
+/**
+ * @brief State of a two-sided CUSUM detector. Treat the members as private.
+ */
+typedef struct {
+    htu21d_cusum_config_t config;
+    uint32_t count;     /**< Values seen so far, saturated at `warmup`. */
+    int64_t warmup_sum; /**< Sum of the warm-up values. */
+    int32_t target;     /**< Target in use. */
+    int32_t high;       /**< Upper cumulative sum. */
+    int32_t low;        /**< Lower cumulative sum. */
+} htu21d_cusum_t;
+
+/**
+ * @brief Configuration of a trend estimator.
+ */
+typedef struct {
+    uint8_t window;           /**< Values the line is fitted over, 3 to #HTU21D_TREND_WINDOW_MAX. */
+    int32_t threshold;        /**< Value whose crossing is predicted, e.g. 7000 for 70 %RH in hundredths. */
+    bool falling;             /**< Predict the values falling below `threshold` rather than rising above it. */
+    uint32_t horizon_s;       /**< An event is raised when the crossing is predicted within this many seconds. */
+    htu21d_event_cb_t callback; /**< Called for each event, may be `NULL`. */
+    void *user_ctx;           /**< Passed to `callback`. */
+} htu21d_trend_config_t;
+
+/**
+ * @brief Latest fit of a trend estimator, see #htu21d_trend_get.
+ */
+typedef struct {
+    int32_t value;            /**< Value of the fitted line at the latest value. */
+    int32_t slope_per_hour;   /**< Slope of the fitted line, in value units per hour. */
+    int32_t seconds_to_threshold; /**< Predicted time to the crossing, 0 if already crossed, `INT32_MAX` if the trend is moving away. */
+} htu21d_trend_estimate_t;
+
+/**
+ * @brief State of a trend estimator. Treat the members as private.
+ */
+typedef struct {
+    htu21d_trend_config_t config;
+    int64_t times[HTU21D_TREND_WINDOW_MAX];   /**< Time of each value of the window, in time units. */
+    int32_t values[HTU21D_TREND_WINDOW_MAX];  /**< The values of the window, a ring. */
+    uint8_t first;            /**< Index of the oldest value. */
+    uint8_t count;            /**< Values in the window. */
+    bool armed;               /**< An event can be raised, see #htu21d_trend_update. */
+    bool fitted;              /**< `estimate` is set. */
+    int64_t origin;           /**< Time the sums count from: that of the oldest value. */
+    int64_t sum_x;            /**< Sum of the times, from `origin`. */
+    int64_t sum_xx;           /**< Sum of the squared times. */
+    int64_t sum_y;            /**< Sum of the values. */
+    int64_t sum_xy;           /**< Sum of the products of times and values. */
+    htu21d_trend_estimate_t estimate; /**< Latest fit. */
+} htu21d_trend_t;
+
+/**
+ * @brief Quantity of a sample that a #htu21d_detectors_t feeds its detectors.
+ */
+typedef enum {
+    HTU21D_DETECT_HUMIDITY = 0,   /**< Relative humidity, in hundredths of %RH. */
+    HTU21D_DETECT_TEMPERATURE,    /**< Temperature, in hundredths of a degree Celsius. */
+    HTU21D_DETECT_RAW_HUMIDITY,   /**< Raw 16-bit humidity reading. */
+    HTU21D_DETECT_RAW_TEMPERATURE, /**< Raw 16-bit temperature reading. */
+} htu21d_detect_quantity_t;
+
+/**
+ * @brief Detectors run on each sample, see #htu21d_detectors_update. The
+ * detectors are initialized by the caller; leave the unused ones `NULL`.
+ */
+typedef struct {
+    htu21d_detect_quantity_t quantity; /**< The value given to the detectors. */
+    htu21d_zscore_t *zscore;  /**< A z-score detector, or `NULL`. */
+    htu21d_cusum_t *cusum;    /**< A CUSUM detector, or `NULL`. */
+    htu21d_trend_t *trend;    /**< A trend estimator, or `NULL`. */
+} htu21d_detectors_t;
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_DETECT
+int htu21d_zscore_init(htu21d_zscore_t *detector, const htu21d_zscore_config_t *config);
+bool htu21d_zscore_update(htu21d_zscore_t *detector, int32_t value, int64_t timestamp_us);
+int htu21d_cusum_init(htu21d_cusum_t *detector, const htu21d_cusum_config_t *config);
+bool htu21d_cusum_update(htu21d_cusum_t *detector, int32_t value, int64_t timestamp_us);
+int htu21d_trend_init(htu21d_trend_t *trend, const htu21d_trend_config_t *config);
+bool htu21d_trend_update(htu21d_trend_t *trend, int32_t value, int64_t timestamp_us);
+bool htu21d_trend_get(const htu21d_trend_t *trend, htu21d_trend_estimate_t *estimate);
+bool htu21d_detectors_update(const htu21d_detectors_t *detectors, const htu21d_sample_t *sample);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_DETECT_H__
@@ -0,0 +1,95 @@
+/**
+ * @file htu21d_filter.c
+ * @brief Filters that run on the HTU21D sample stream.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include "htu21d.h"
+#include "htu21d_filter.h"
+
+/**
+ * @brief Initializes a lead compensator.
+ *
+ * The humidity element of the HTU21D behaves like a first-order low-pass with
+ * a time constant of about 5 seconds, so a step in ambient humidity only
+ * reaches 63% of its size in the readings after `tau_s`. The lead compensator
+ * applies the inverse transfer function `(1 + tau_s * s)`, which cancels that
+ * lag. A pure inverse would amplify noise without bound, so it is combined
+ * with a low-pass of time constant `noise_tau_s`:
+ *
+ *     H(s) = (1 + tau_s * s) / (1 + noise_tau_s * s)
+ *
+ * In series with the sensor, a step is then followed with time constant
+ * `noise_tau_s` instead of `tau_s`. For example, with `tau_s = 5` and
+ * `noise_tau_s = 1`, the 63% response time drops from 5 s to about 1 s, and
+ * the noise of the raw readings is amplified by at most `tau_s / noise_tau_s`
+ * (5x here). Choose `noise_tau_s` as a compromise between response and noise.
+ * Use `max_correction` to bound the effect of glitches.
+ * @param[out] lead The compensator to initialize.
+ * @param[in] config Its configuration.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_lead_init(htu21d_lead_t *lead, const htu21d_lead_config_t *config)
+{
+    if (lead == NULL || config == NULL || config->tau_s < 0.0F ||
+            config->noise_tau_s <= 0.0F || config->max_correction < 0.0F) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *lead = (htu21d_lead_t) {
+        .config = *config,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Runs the compensator on the next value of the stream.
+ *
+ * Values may come at irregular intervals; the filter uses the actual time
+ * between them, so pass the sample timestamps (e.g.
+ * htu21d_sample_t::timestamp_us).
+ * @param lead An initialized compensator.
+ * @param value The raw value, e.g. the relative humidity in %RH.
+ * @param timestamp_us Time of the value, in microseconds.
+ * @return Returns the compensated value. The first value, and any value that
+ * is not newer than the previous one, is returned unchanged.
+ */
+float htu21d_lead_update(htu21d_lead_t *lead, float value, int64_t timestamp_us)
+{
+    const htu21d_lead_config_t *config = &lead->config;
+
+    if (!lead->primed) {
+        lead->primed = true;
+        lead->prev_us = timestamp_us;
+        lead->prev_value = value;
+        lead->smoothed = value;
+        lead->derivative = 0.0F;
+        return value;
+    }
+    if (timestamp_us <= lead->prev_us) {
+        return value;
+    }
+
+    float dt = (float)(timestamp_us - lead->prev_us) / 1000000.0F;
+    float alpha = dt / (config->noise_tau_s + dt);
+    float slope = (value - lead->prev_value) / dt;
+
+    lead->smoothed += alpha * (value - lead->smoothed);
+    lead->derivative += alpha * (slope - lead->derivative);
+    lead->prev_us = timestamp_us;
+    lead->prev_value = value;
+
+    float correction = (lead->smoothed - value) + config->tau_s * lead->derivative;
+    if (config->max_correction > 0.0F) {
+        if (correction > config->max_correction) {
+            correction = config->max_correction;
+        } else if (correction < -config->max_correction) {
+            correction = -config->max_correction;
+        }
+    }
+
+    return value + correction;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file htu21d_filter.h
+ * @brief Filters that run on the HTU21D sample stream.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_FILTER_H__
+#define __ESP_HTU21D_FILTER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#define HTU21D_RH_TIME_CONSTANT_S   (5.0F) /**< Time constant (63% response) of the HTU21D humidity element, per datasheet. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Configuration of a lead compensator.
+ */
+typedef struct {
+    float tau_s;          /**< Time constant of the sensor to cancel, in seconds, e.g. #HTU21D_RH_TIME_CONSTANT_S. */
+    float noise_tau_s;    /**< Time constant of the noise-limiting low-pass, in seconds. This is the effective response time after compensation. Must be greater than 0. */
+    float max_correction; /**< Largest correction added to the raw value, in its unit (e.g. %RH). `0` means no limit. */
+} htu21d_lead_config_t;
+
+/**
+ * @brief State of a lead compensator. Treat the members as private.
+ */
+typedef struct {
+    htu21d_lead_config_t config;
+    bool primed;         /**< `true` once the first value was seen. */
+    int64_t prev_us;     /**< Timestamp of the previous value. */
+    float prev_value;    /**< Previous raw value. */
+    float smoothed;      /**< Low-passed value. */
+    float derivative;    /**< Low-passed derivative, in units per second. */
+} htu21d_lead_t;
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_FILTER
+int htu21d_lead_init(htu21d_lead_t *lead, const htu21d_lead_config_t *config);
+float htu21d_lead_update(htu21d_lead_t *lead, float value, int64_t timestamp_us);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_FILTER_H__
@@ -0,0 +1,254 @@
+/**
+ * @file htu21d_fusion.c
+ * @brief Fusion of redundant HTU21D sensors with outlier voting.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <math.h>
+#include "htu21d_fusion.h"
+#include "htu21d_port.h"
+
+static const char* TAG = "htu21d_fusion";
+
+/**
+ * @brief Returns the median of `count` values, sorting them in place.
+ */
+static float median(float *values, int count)
+{
+    for (int i = 1; i < count; i++) {
+        float value = values[i];
+        int j = i;
+        for (; j > 0 && values[j - 1] > value; j--) {
+            values[j] = values[j - 1];
+        }
+        values[j] = value;
+    }
+
+    if (count % 2 == 1) {
+        return values[count / 2];
+    }
+    return (values[count / 2 - 1] + values[count / 2]) / 2.0F;
+}
+
+/**
+ * @brief Median/MAD vote: clears `agrees[i]` for each value that is more than
+ * `threshold` MADs away from the median.
+ */
+static void vote(const float *values, bool *agrees, int count, float threshold, float min_mad)
+{
+    float sorted[HTU21D_FUSION_MAX_MEMBERS];
+    int valid = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (agrees[i]) {
+            sorted[valid++] = values[i];
+        }
+    }
+    if (valid < 3) {
+        // With one or two readings there is no majority to vote with.
+        return;
+    }
+
+    float center = median(sorted, valid);
+    for (int i = 0; i < valid; i++) {
+        sorted[i] = fabsf(sorted[i] - center);
+    }
+    float mad = median(sorted, valid);
+    float limit = threshold * (mad > min_mad ? mad : min_mad);
+
+    for (int i = 0; i < count; i++) {
+        if (agrees[i] && fabsf(values[i] - center) > limit) {
+            agrees[i] = false;
+        }
+    }
+}
+
+/**
+ * @brief Triggers the same conversion on all the given members, waits once for
+ * all of them, then reads the results back.
+ */
+static void sample_channel(htu21d_fusion_t *fusion, uint8_t command, bool *ok)
+{
+    bool temperature = (command == TRIGGER_TEMP_MEASURE_NOHOLD);
+
+    for (int i = 0; i < fusion->count; i++) {
+        htu21d_fusion_member_t *member = &fusion->members[i];
+        htu21d_timing_t *timing = temperature ?
+                                  &member->sample.temperature_timing : &member->sample.humidity_timing;
+        if (ok[i]) {
+            ok[i] = htu21d_dev_trigger(member->dev, command, timing) == HTU21D_ERR_OK;
+        }
+    }
+
+    htu21d_port_delay_ms(HTU21D_CONVERSION_TIME_MS);
+
+    for (int i = 0; i < fusion->count; i++) {
+        htu21d_fusion_member_t *member = &fusion->members[i];
+        htu21d_timing_t *timing = temperature ?
+                                  &member->sample.temperature_timing : &member->sample.humidity_timing;
+        uint16_t *raw_value = temperature ?
+                              &member->sample.raw_temperature : &member->sample.raw_humidity;
+        if (ok[i]) {
+            ok[i] = htu21d_dev_fetch(member->dev, raw_value, timing) == HTU21D_ERR_OK;
+        }
+    }
+}
+
+/**
+ * @brief Initializes an empty fusion group.
+ * @param[out] fusion The group to initialize.
+ * @param[in] config Voting and demotion settings.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_fusion_init(htu21d_fusion_t *fusion, const htu21d_fusion_config_t *config)
+{
+    if (fusion == NULL || config == NULL || config->mad_threshold <= 0.0F ||
+            config->min_mad_temperature < 0.0F || config->min_mad_humidity < 0.0F) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *fusion = (htu21d_fusion_t) {
+        .config = *config,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Adds an initialized sensor to a fusion group.
+ * @param fusion The group.
+ * @param dev The sensor, see #htu21d_dev_init. It must outlive the group.
+ * @return Returns the index of the new member, or `-1` if the group is full or
+ * an argument is invalid.
+ */
+int htu21d_fusion_add_member(htu21d_fusion_t *fusion, htu21d_dev_t *dev)
+{
+    if (fusion == NULL || dev == NULL || fusion->count == HTU21D_FUSION_MAX_MEMBERS) {
+        return -1;
+    }
+
+    fusion->members[fusion->count] = (htu21d_fusion_member_t) {
+        .dev = dev,
+        .active = true,
+    };
+
+    return fusion->count++;
+}
+
+/**
+ * @brief Samples all active members together and publishes the fused reading.
+ *
+ * The temperature conversions of all members are started back to back and
+ * waited for once, then the same for humidity, so the readings are taken at
+ * (nearly) the same time and the whole group costs about as long as a single
+ * sensor. Each channel is then voted on separately: with at least three
+ * readings, those more than `mad_threshold` MADs away from the median are
+ * rejected. A member is used only if both its readings are kept; otherwise,
+ * or when its read fails, it gets a strike, and is demoted after
+ * `demote_after` consecutive strikes.
+ * @param fusion The group.
+ * @param[out] fused Receives the fused reading.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid, or #HTU21D_ERR_FAIL if no member could be used.
+ */
+int htu21d_fusion_read(htu21d_fusion_t *fusion, htu21d_fused_sample_t *fused)
+{
+    if (fusion == NULL || fused == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    bool temperature_ok[HTU21D_FUSION_MAX_MEMBERS];
+    bool humidity_ok[HTU21D_FUSION_MAX_MEMBERS];
+    float temperatures[HTU21D_FUSION_MAX_MEMBERS];
+    float humidities[HTU21D_FUSION_MAX_MEMBERS];
+
+    *fused = (htu21d_fused_sample_t) {
+        0
+    };
+    for (int i = 0; i < fusion->count; i++) {
+        temperature_ok[i] = fusion->members[i].active;
+        if (fusion->members[i].active) {
+            fused->sampled++;
+        }
+    }
+
+    sample_channel(fusion, TRIGGER_TEMP_MEASURE_NOHOLD, temperature_ok);
+    for (int i = 0; i < fusion->count; i++) {
+        humidity_ok[i] = temperature_ok[i];
+    }
+    sample_channel(fusion, TRIGGER_HUMD_MEASURE_NOHOLD, humidity_ok);
+
+    for (int i = 0; i < fusion->count; i++) {
+        htu21d_sample_t *sample = &fusion->members[i].sample;
+        temperature_ok[i] = humidity_ok[i];
+        if (humidity_ok[i]) {
+            htu21d_dev_convert_sample(fusion->members[i].dev, sample);
+        }
+        temperatures[i] = sample->temperature;
+        humidities[i] = sample->humidity;
+    }
+
+    vote(temperatures, temperature_ok, fusion->count,
+         fusion->config.mad_threshold, fusion->config.min_mad_temperature);
+    vote(humidities, humidity_ok, fusion->count,
+         fusion->config.mad_threshold, fusion->config.min_mad_humidity);
+
+    float temperature_sum = 0.0F;
+    float humidity_sum = 0.0F;
+    int64_t timestamp_sum = 0;
+    for (int i = 0; i < fusion->count; i++) {
+        htu21d_fusion_member_t *member = &fusion->members[i];
+        if (!member->active) {
+            continue;
+        }
+
+        member->agreed = temperature_ok[i] && humidity_ok[i];
+        if (member->agreed) {
+            member->strikes = 0;
+            temperature_sum += member->sample.temperature;
+            humidity_sum += member->sample.humidity;
+            timestamp_sum += member->sample.timestamp_us;
+            fused->used++;
+            continue;
+        }
+
+        member->disagreements++;
+        member->strikes++;
+        if (fusion->config.demote_after != 0 && member->strikes >= fusion->config.demote_after) {
+            member->active = false;
+            ESP_LOGW(TAG, "Member %d disagreed %d times in a row, demoted.", i, member->strikes);
+        }
+    }
+
+    if (fused->used == 0) {
+        return HTU21D_ERR_FAIL;
+    }
+    fused->temperature = temperature_sum / fused->used;
+    fused->humidity = humidity_sum / fused->used;
+    fused->timestamp_us = timestamp_sum / fused->used;
+    fused->confidence = (float) fused->used / (float) fusion->count;
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Puts a demoted member back into the group, e.g. after the sensor was
+ * replaced.
+ * @param fusion The group.
+ * @param index Index of the member, as returned by #htu21d_fusion_add_member.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if
+ * there is no such member.
+ */
+int htu21d_fusion_restore_member(htu21d_fusion_t *fusion, uint8_t index)
+{
+    if (fusion == NULL || index >= fusion->count) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    fusion->members[index].active = true;
+    fusion->members[index].strikes = 0;
+
+    return HTU21D_ERR_OK;
+}
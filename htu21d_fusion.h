@@ -0,0 +1,85 @@
+/**
+ * @file htu21d_fusion.h
+ * @brief Fusion of redundant HTU21D sensors with outlier voting.
+ *
+ * A fusion group samples its members together, rejects the readings that
+ * disagree with the others by median/MAD voting, and publishes the mean of
+ * the remaining ones with a confidence metric. A member that keeps
+ * disagreeing is demoted: it is no longer sampled, so a failed sensor stops
+ * costing bus time.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_FUSION_H__
+#define __ESP_HTU21D_FUSION_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "htu21d.h"
+
+#ifndef HTU21D_FUSION_MAX_MEMBERS
+#define HTU21D_FUSION_MAX_MEMBERS   5 /**< Maximum number of sensors in a fusion group. */
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Configuration of a fusion group.
+ */
+typedef struct {
+    float mad_threshold;        /**< A reading is an outlier when it is more than this many MADs away from the median, e.g. `3`. */
+    float min_mad_temperature;  /**< Floor of the temperature MAD in °C, so that identical readings do not make the vote too strict. */
+    float min_mad_humidity;     /**< Floor of the humidity MAD in %RH. */
+    uint8_t demote_after;       /**< Consecutive disagreements after which a member is demoted, `0` to never demote. */
+} htu21d_fusion_config_t;
+
+/**
+ * @brief State of one member of a fusion group.
+ */
+typedef struct {
+    htu21d_dev_t *dev;          /**< The sensor. */
+    bool active;                /**< `false` once the member was demoted. */
+    bool agreed;                /**< Whether the last reading of the member was used. */
+    uint8_t strikes;            /**< Consecutive disagreements. */
+    uint32_t disagreements;     /**< Total disagreements, including failed reads. */
+    htu21d_sample_t sample;     /**< Last reading of the member. */
+} htu21d_fusion_member_t;
+
+/**
+ * @brief A fusion group. Treat the members as private.
+ */
+typedef struct {
+    htu21d_fusion_config_t config;
+    uint8_t count;                                              /**< Number of members. */
+    htu21d_fusion_member_t members[HTU21D_FUSION_MAX_MEMBERS];  /**< The members. */
+} htu21d_fusion_t;
+
+/**
+ * @brief A fused reading.
+ */
+typedef struct {
+    float temperature;      /**< Mean of the agreeing temperatures, in °C. */
+    float humidity;         /**< Mean of the agreeing humidities, in %RH. */
+    int64_t timestamp_us;   /**< Mean of the timestamps of the agreeing members. */
+    float confidence;       /**< Share of all members (demoted ones included) whose readings were used, from 0 to 1. */
+    uint8_t used;           /**< Number of members whose readings were used. */
+    uint8_t sampled;        /**< Number of members that were sampled (the active ones). */
+} htu21d_fused_sample_t;
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_FUSION
+int htu21d_fusion_init(htu21d_fusion_t *fusion, const htu21d_fusion_config_t *config);
+int htu21d_fusion_add_member(htu21d_fusion_t *fusion, htu21d_dev_t *dev);
+int htu21d_fusion_read(htu21d_fusion_t *fusion, htu21d_fused_sample_t *fused);
+int htu21d_fusion_restore_member(htu21d_fusion_t *fusion, uint8_t index);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_FUSION_H__
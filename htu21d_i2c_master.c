@@ -0,0 +1,493 @@
+/**
+ * @file htu21d_i2c_master.c
+ * @brief HTU21D support for the ESP-IDF I2C master driver (`driver/i2c_master.h`).
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include "esp_attr.h"
+#include "esp_idf_version.h"
+#include "esp_log.h"
+#include "htu21d_i2c_master.h"
+
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 2, 0)
+#error "CONFIG_HTU21D_I2C_DRIVER_MASTER needs ESP-IDF 5.2 or later"
+#endif
+
+#define I2C_MASTER_TIMEOUT_MS   1000 /**< Timeout of a synchronous transaction, as for the legacy driver. */
+
+static const char* TAG = "htu21d_i2c_master";
+
+/**
+ * @brief Stages of an asynchronous measurement.
+ */
+enum {
+    STAGE_IDLE = 0,
+    STAGE_TRIGGER_TEMPERATURE,  /**< Temperature trigger queued. */
+    STAGE_WAIT_TEMPERATURE,     /**< Timer running for the temperature conversion. */
+    STAGE_READ_TEMPERATURE,     /**< Temperature read and humidity trigger queued. */
+    STAGE_WAIT_HUMIDITY,        /**< Timer running for the humidity conversion. */
+    STAGE_READ_HUMIDITY,        /**< Humidity read queued. */
+    STAGE_COMPLETE,             /**< Timer about to hand the result to the `esp_timer` task. */
+};
+
+/**
+ * @brief Maps an I2C master driver error to an `HTU21D_ERR_*` code.
+ *
+ * The driver reports a missing acknowledge as `ESP_ERR_INVALID_STATE` (5.2)
+ * or `ESP_ERR_INVALID_RESPONSE`, and a failed probe as `ESP_ERR_NOT_FOUND`;
+ * they all become #HTU21D_ERR_FAIL, as with the other transports.
+ */
+static int i2c_master_error_to_htu21d(esp_err_t ret)
+{
+    switch (ret) {
+
+    case ESP_OK:
+        return HTU21D_ERR_OK;
+
+    case ESP_ERR_INVALID_ARG:
+        return HTU21D_ERR_INVALID_ARG;
+
+    case ESP_ERR_TIMEOUT:
+        return HTU21D_ERR_TIMEOUT;
+    }
+    return HTU21D_ERR_FAIL;
+}
+
+/**
+ * @brief Returns the device handle of `address`, adding it to the bus if needed.
+ */
+static i2c_master_dev_handle_t bus_device(htu21d_i2c_master_bus_t *bus, uint8_t address)
+{
+    for (size_t i = 0; i < bus->device_count; i++) {
+        if (bus->devices[i].address == address) {
+            return bus->devices[i].handle;
+        }
+    }
+    if (bus->device_count == HTU21D_I2C_MASTER_MAX_DEVICES) {
+        ESP_LOGE(TAG, "Too many addresses on the bus, increase HTU21D_I2C_MASTER_MAX_DEVICES");
+        return NULL;
+    }
+
+    const i2c_device_config_t config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = address,
+        .scl_speed_hz = bus->scl_speed_hz,
+    };
+    i2c_master_dev_handle_t handle;
+    esp_err_t ret = i2c_master_bus_add_device(bus->handle, &config, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add device 0x%02X: %s", address, esp_err_to_name(ret));
+        return NULL;
+    }
+    bus->devices[bus->device_count].address = address;
+    bus->devices[bus->device_count].handle = handle;
+    bus->device_count++;
+
+    return handle;
+}
+
+static int master_write(void *bus, uint8_t address, const uint8_t *data, size_t len)
+{
+    htu21d_i2c_master_bus_t *master = (htu21d_i2c_master_bus_t *) bus;
+
+    if (len == 0) {
+        // The master driver cannot send an empty write, but it can probe.
+        return i2c_master_error_to_htu21d(i2c_master_probe(master->handle, address, I2C_MASTER_TIMEOUT_MS));
+    }
+
+    i2c_master_dev_handle_t device = bus_device(master, address);
+    if (device == NULL) {
+        return HTU21D_ERR_FAIL;
+    }
+    return i2c_master_error_to_htu21d(i2c_master_transmit(device, data, len, I2C_MASTER_TIMEOUT_MS));
+}
+
+static int master_read(void *bus, uint8_t address, uint8_t *data, size_t len)
+{
+    i2c_master_dev_handle_t device = bus_device((htu21d_i2c_master_bus_t *) bus, address);
+    if (device == NULL) {
+        return HTU21D_ERR_FAIL;
+    }
+    return i2c_master_error_to_htu21d(i2c_master_receive(device, data, len, I2C_MASTER_TIMEOUT_MS));
+}
+
+static int master_write_read(void *bus, uint8_t address, const uint8_t *write_data, size_t write_len,
+                             uint8_t *read_data, size_t read_len)
+{
+    i2c_master_dev_handle_t device = bus_device((htu21d_i2c_master_bus_t *) bus, address);
+    if (device == NULL) {
+        return HTU21D_ERR_FAIL;
+    }
+    return i2c_master_error_to_htu21d(i2c_master_transmit_receive(device, write_data, write_len,
+                                                                  read_data, read_len, I2C_MASTER_TIMEOUT_MS));
+}
+
+/**
+ * @brief Changes the SCL frequency of the sensors and multiplexers of a bus.
+ *
+ * The frequency of a device handle is fixed when it is added to the bus, so
+ * the handles are removed, and added again at the new frequency on their next
+ * transaction. Adding a handle allocates, so with
+ * `CONFIG_HTU21D_STATIC_ALLOCATION` this is only done by
+ * #htu21d_dev_probe_clock during initialization, see #HTU21D_CLOCK_DOWNSHIFT.
+ */
+static int master_set_clock(void *bus, uint32_t clock_hz)
+{
+    htu21d_i2c_master_bus_t *master = (htu21d_i2c_master_bus_t *) bus;
+
+    for (size_t i = 0; i < master->device_count; i++) {
+        esp_err_t ret = i2c_master_bus_rm_device(master->devices[i].handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to remove device 0x%02X: %s", master->devices[i].address, esp_err_to_name(ret));
+        }
+    }
+    master->device_count = 0;
+    master->scl_speed_hz = clock_hz;
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * Transport over the I2C master driver. The bus is a #htu21d_i2c_master_bus_t
+ * set up by #htu21d_i2c_master_bus_init; its bus must be synchronous
+ * (`trans_queue_depth = 0`).
+ */
+const htu21d_transport_t htu21d_i2c_master_transport = {
+    .write = master_write,
+    .read = master_read,
+    .write_read = master_write_read,
+    .set_clock = master_set_clock,
+};
+
+/**
+ * @brief Prepares a bus of the I2C master driver for #htu21d_i2c_master_transport.
+ * @param[out] bus The transport bus to initialize.
+ * @param handle The bus, created with `i2c_new_master_bus()`.
+ * @param scl_speed_hz SCL frequency used with the sensors, e.g. `100000`.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_i2c_master_bus_init(htu21d_i2c_master_bus_t *bus, i2c_master_bus_handle_t handle,
+                               uint32_t scl_speed_hz)
+{
+    if (bus == NULL || handle == NULL || scl_speed_hz == 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *bus = (htu21d_i2c_master_bus_t) {
+        .handle = handle,
+        .scl_speed_hz = scl_speed_hz,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Moves to the next stage once all the transactions of a stage are done.
+ *
+ * Called from the completion interrupt or from the `esp_timer` task; only uses
+ * `esp_timer_start_once()`, which is safe in both. If the timer cannot be
+ * started, nothing would move the measurement on: it is dropped, without a
+ * callback, and the sensor is idle again.
+ */
+static void IRAM_ATTR async_stage_done(htu21d_async_t *async)
+{
+    uint64_t wait_us = 0;
+
+    if (async->failed || async->stage == STAGE_READ_HUMIDITY) {
+        async->stage = STAGE_COMPLETE;
+    } else if (async->stage == STAGE_TRIGGER_TEMPERATURE) {
+        async->stage = STAGE_WAIT_TEMPERATURE;
+        wait_us = async->wait_us[0];
+    } else if (async->stage == STAGE_READ_TEMPERATURE) {
+        async->stage = STAGE_WAIT_HUMIDITY;
+        wait_us = async->wait_us[1];
+    }
+    if (esp_timer_start_once(async->timer, wait_us) != ESP_OK) {
+        async->failed = true;
+        async->stage = STAGE_IDLE;
+    }
+}
+
+/**
+ * @brief Completion callback of the I2C master driver, in interrupt context.
+ */
+static bool IRAM_ATTR async_on_trans_done(i2c_master_dev_handle_t device, const i2c_master_event_data_t *event,
+                                          void *user_ctx)
+{
+    htu21d_async_t *async = (htu21d_async_t *) user_ctx;
+
+    if (event->event != I2C_EVENT_DONE) {
+        async->failed = true;
+    }
+    if (atomic_fetch_sub(&async->pending, 1) == 1) {
+        async_stage_done(async);
+    }
+    return false;
+}
+
+/**
+ * @brief Queues the transactions of a stage; a transaction that cannot be
+ * queued counts as done and failed.
+ */
+static void async_submit(htu21d_async_t *async, uint8_t *read_data, const uint8_t *command)
+{
+    esp_err_t ret;
+    int submitted = (read_data != NULL) + (command != NULL);
+
+    atomic_store(&async->pending, submitted);
+    if (read_data != NULL) {
+        ret = i2c_master_receive(async->device, read_data, 3, -1);
+        if (ret != ESP_OK) {
+            async->failed = true;
+            if (atomic_fetch_sub(&async->pending, 1) == 1) {
+                async_stage_done(async);
+            }
+        }
+    }
+    if (command != NULL) {
+        ret = i2c_master_transmit(async->device, command, 1, -1);
+        if (ret != ESP_OK) {
+            async->failed = true;
+            if (atomic_fetch_sub(&async->pending, 1) == 1) {
+                async_stage_done(async);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Decodes a reading: CRC check, then status bits cleared.
+ */
+static int async_decode(const uint8_t *data, uint16_t *raw_value)
+{
+    uint16_t raw = ((uint16_t) data[0] << 8) | data[1];
+    if (!is_crc_valid(raw, data[2])) {
+        return HTU21D_ERR_CRC;
+    }
+    *raw_value = raw & 0xFFFC;
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief `esp_timer` callback: submits the reads once the conversions are
+ * done, and delivers the result.
+ */
+static void async_timer_callback(void *arg)
+{
+    htu21d_async_t *async = (htu21d_async_t *) arg;
+    htu21d_sample_t *sample = &async->sample;
+    int64_t now = esp_timer_get_time();
+
+    switch (async->stage) {
+
+    case STAGE_WAIT_TEMPERATURE:
+        async->stage = STAGE_READ_TEMPERATURE;
+        sample->temperature_timing.read_us = now;
+        sample->humidity_timing.trigger_us = now;
+        // The read and the next trigger go in the queue together.
+        async_submit(async, async->data[0], &async->commands[1]);
+        break;
+
+    case STAGE_WAIT_HUMIDITY:
+        async->stage = STAGE_READ_HUMIDITY;
+        sample->humidity_timing.read_us = now;
+        async_submit(async, async->data[1], NULL);
+        break;
+
+    case STAGE_COMPLETE: {
+        int result = HTU21D_ERR_FAIL;
+        if (!async->failed) {
+            result = async_decode(async->data[0], &sample->raw_temperature);
+            if (result == HTU21D_ERR_OK) {
+                result = async_decode(async->data[1], &sample->raw_humidity);
+            }
+        }
+        if (result == HTU21D_ERR_OK) {
+            sample->temperature = htu21d_raw_to_temperature(sample->raw_temperature);
+            sample->humidity = htu21d_raw_to_humidity(sample->raw_humidity);
+            sample->timestamp_us = (htu21d_timing_midpoint(&sample->temperature_timing) +
+                                    htu21d_timing_midpoint(&sample->humidity_timing)) / 2;
+        }
+        async->stage = STAGE_IDLE;
+        if (async->callback != NULL) {
+            async->callback(result, sample, async->user_ctx);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Sets up a sensor for asynchronous measurements.
+ *
+ * The sensor is added to the bus as a device of the master driver, with its
+ * own completion callback. The bus must have been created with
+ * `trans_queue_depth` of at least 2. The conversions are waited for as long
+ * as the datasheet gives at the power-on resolution, see
+ * #htu21d_async_set_conversion_times.
+ * @param[out] async The asynchronous sensor to initialize.
+ * @param bus The bus the sensor is on.
+ * @param scl_speed_hz SCL frequency used with the sensor, e.g. `100000`.
+ * @param callback Called with each completed measurement.
+ * @param user_ctx Passed to `callback`.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid, or #HTU21D_ERR_INSTALL if the device, its callback or
+ * its timer could not be set up.
+ */
+int htu21d_async_init(htu21d_async_t *async, i2c_master_bus_handle_t bus, uint32_t scl_speed_hz,
+                      htu21d_async_cb_t callback, void *user_ctx)
+{
+    esp_err_t ret;
+
+    if (async == NULL || bus == NULL || scl_speed_hz == 0 || callback == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *async = (htu21d_async_t) {
+        .callback = callback,
+        .user_ctx = user_ctx,
+        .commands = {TRIGGER_TEMP_MEASURE_NOHOLD, TRIGGER_HUMD_MEASURE_NOHOLD},
+    };
+    htu21d_async_set_conversion_times(async, 0, NULL);
+
+    const i2c_device_config_t device_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = HTU21D_ADDR,
+        .scl_speed_hz = scl_speed_hz,
+    };
+    ret = i2c_master_bus_add_device(bus, &device_config, &async->device);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add the sensor to the bus: %s", esp_err_to_name(ret));
+        return HTU21D_ERR_INSTALL;
+    }
+
+    const i2c_master_event_callbacks_t callbacks = {
+        .on_trans_done = async_on_trans_done,
+    };
+    ret = i2c_master_register_event_callbacks(async->device, &callbacks, async);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register the completion callback: %s", esp_err_to_name(ret));
+        i2c_master_bus_rm_device(async->device);
+        return HTU21D_ERR_INSTALL;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = async_timer_callback,
+        .arg = async,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "htu21d_async",
+    };
+    ret = esp_timer_create(&timer_args, &async->timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the conversion timer: %s", esp_err_to_name(ret));
+        i2c_master_bus_rm_device(async->device);
+        return HTU21D_ERR_INSTALL;
+    }
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Sets how long the conversions of an asynchronous sensor are waited
+ * for.
+ *
+ * The asynchronous measurements do not read the user register, so tell them
+ * the resolution the sensor was set to, and its calibration if there is one,
+ * e.g. from #htu21d_calibration_load_nvs.
+ * @param async An initialized asynchronous sensor.
+ * @param resolution Resolution bits of the user register of the sensor, `0`
+ * after power-on.
+ * @param calibration Calibration of the sensor, or `NULL` to wait for the
+ * datasheet maximum at `resolution`.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if
+ * `async` is `NULL`, or #HTU21D_ERR_INVALID_STATE if a measurement is running.
+ */
+int htu21d_async_set_conversion_times(htu21d_async_t *async, uint8_t resolution,
+                                      const htu21d_calibration_t *calibration)
+{
+    if (async == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+    if (async->stage != STAGE_IDLE) {
+        return HTU21D_ERR_INVALID_STATE;
+    }
+
+    async->wait_us[0] = htu21d_conversion_time_us(resolution, TRIGGER_TEMP_MEASURE_NOHOLD, calibration);
+    async->wait_us[1] = htu21d_conversion_time_us(resolution, TRIGGER_HUMD_MEASURE_NOHOLD, calibration);
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Starts a measurement of both channels and returns immediately.
+ *
+ * The callback given to #htu21d_async_init is called when it completes, after
+ * both conversion times (66 ms at the power-on resolution) and the bus
+ * transactions. In the rare case the timer of the sensor cannot be started,
+ * the measurement is dropped without a callback: #htu21d_async_is_busy then
+ * returns `false` again.
+ * @param async An initialized asynchronous sensor.
+ * @return Returns #HTU21D_ERR_OK if the measurement started,
+ * #HTU21D_ERR_INVALID_STATE if a measurement is already running, or
+ * #HTU21D_ERR_FAIL if the trigger could not be queued.
+ */
+int htu21d_async_start(htu21d_async_t *async)
+{
+    if (async == NULL || async->timer == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+    if (async->stage != STAGE_IDLE) {
+        return HTU21D_ERR_INVALID_STATE;
+    }
+
+    async->failed = false;
+    async->stage = STAGE_TRIGGER_TEMPERATURE;
+    async->sample.temperature_timing.trigger_us = esp_timer_get_time();
+    atomic_store(&async->pending, 1);
+
+    esp_err_t ret = i2c_master_transmit(async->device, &async->commands[0], 1, -1);
+    if (ret != ESP_OK) {
+        async->stage = STAGE_IDLE;
+        return i2c_master_error_to_htu21d(ret);
+    }
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Tells whether a measurement is running.
+ * @param async An initialized asynchronous sensor.
+ * @return Returns `true` from #htu21d_async_start until the callback returns.
+ */
+bool htu21d_async_is_busy(const htu21d_async_t *async)
+{
+    return async->stage != STAGE_IDLE;
+}
+
+/**
+ * @brief Removes an asynchronous sensor from its bus and frees its timer.
+ * @param async An initialized asynchronous sensor.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if it was
+ * not initialized, or #HTU21D_ERR_INVALID_STATE if a measurement is running.
+ */
+int htu21d_async_deinit(htu21d_async_t *async)
+{
+    if (async == NULL || async->timer == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+    if (async->stage != STAGE_IDLE) {
+        return HTU21D_ERR_INVALID_STATE;
+    }
+
+    esp_timer_delete(async->timer);
+    async->timer = NULL;
+    i2c_master_bus_rm_device(async->device);
+    async->device = NULL;
+
+    return HTU21D_ERR_OK;
+}
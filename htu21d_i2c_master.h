@@ -0,0 +1,108 @@
+/**
+ * @file htu21d_i2c_master.h
+ * @brief HTU21D support for the ESP-IDF I2C master driver (`driver/i2c_master.h`).
+ *
+ * Built when `CONFIG_HTU21D_I2C_DRIVER_MASTER` is selected (ESP-IDF 5.2 or
+ * later). ESP-IDF aborts at startup when the legacy driver and the master
+ * driver are linked together, so this option removes #htu21d_init,
+ * #htu21d_dev_init and #htu21d_i2c_transport. Sensors are then reached in one
+ * of two ways:
+ *
+ * - Synchronously, with the #htu21d_i2c_master_transport and the usual
+ *   `htu21d_dev_*` functions, on a bus created with `trans_queue_depth = 0`.
+ * - Asynchronously, with #htu21d_async_start, on a bus created with
+ *   `trans_queue_depth` of 2 or more. The transactions are queued to the
+ *   driver and chained from its completion interrupt and from an `esp_timer`,
+ *   so a whole measurement (trigger, wait, read, for both channels) runs with
+ *   no task blocked. The timer runs in the `esp_timer` task, not in
+ *   interrupt context (`ESP_TIMER_ISR`): queuing a transaction takes the bus
+ *   lock of the driver, which cannot be done from an interrupt. A
+ *   measurement therefore costs three switches to the `esp_timer` task, one
+ *   per read and one for the callback.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_I2C_MASTER_H__
+#define __ESP_HTU21D_I2C_MASTER_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "driver/i2c_master.h"
+#include "esp_timer.h"
+#include "htu21d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef HTU21D_I2C_MASTER_MAX_DEVICES
+#define HTU21D_I2C_MASTER_MAX_DEVICES   4 /**< Addresses reachable through one #htu21d_i2c_master_bus_t: the sensor and multiplexers. */
+#endif
+
+/**
+ * @brief A bus of the I2C master driver, as used by #htu21d_i2c_master_transport.
+ *
+ * The master driver needs a device handle per address; they are added to the
+ * bus the first time an address is used.
+ */
+typedef struct {
+    i2c_master_bus_handle_t handle; /**< The bus, created with `i2c_new_master_bus()`. */
+    uint32_t scl_speed_hz;          /**< SCL frequency of the devices added to the bus, see #htu21d_dev_probe_clock. */
+    size_t device_count;
+    struct {
+        uint16_t address;
+        i2c_master_dev_handle_t handle;
+    } devices[HTU21D_I2C_MASTER_MAX_DEVICES];
+} htu21d_i2c_master_bus_t;
+
+extern const htu21d_transport_t htu21d_i2c_master_transport;
+
+int htu21d_i2c_master_bus_init(htu21d_i2c_master_bus_t *bus, i2c_master_bus_handle_t handle,
+                               uint32_t scl_speed_hz);
+
+/**
+ * @brief Called when an asynchronous measurement completes.
+ *
+ * Runs in the `esp_timer` task: keep it short and do not block, e.g. copy the
+ * sample to a queue.
+ * @param result #HTU21D_ERR_OK, #HTU21D_ERR_CRC if a reading was corrupted, or
+ * #HTU21D_ERR_FAIL if a transaction failed.
+ * @param sample The measurement, valid when `result` is #HTU21D_ERR_OK.
+ * @param user_ctx The context given to #htu21d_async_init.
+ */
+typedef void (*htu21d_async_cb_t)(int result, const htu21d_sample_t *sample, void *user_ctx);
+
+/**
+ * @brief An HTU21D sensor measured asynchronously. Treat the members as private.
+ */
+typedef struct {
+    i2c_master_dev_handle_t device;
+    esp_timer_handle_t timer;       /**< Conversion wait, then hand-over to the `esp_timer` task. */
+    htu21d_async_cb_t callback;
+    void *user_ctx;
+    volatile uint8_t stage;         /**< Current stage of the measurement. */
+    atomic_uint_fast8_t pending;    /**< Transactions of the stage still in the driver queue. */
+    volatile bool failed;           /**< A transaction of the measurement failed. */
+    uint8_t commands[2];            /**< Trigger commands, must outlive the queued transactions. */
+    uint8_t data[2][3];             /**< Read buffers of the temperature and the humidity. */
+    uint32_t wait_us[2];            /**< Conversion times waited for the temperature and the humidity. */
+    htu21d_sample_t sample;
+} htu21d_async_t;
+
+int htu21d_async_init(htu21d_async_t *async, i2c_master_bus_handle_t bus, uint32_t scl_speed_hz,
+                      htu21d_async_cb_t callback, void *user_ctx);
+int htu21d_async_set_conversion_times(htu21d_async_t *async, uint8_t resolution,
+                                      const htu21d_calibration_t *calibration);
+int htu21d_async_start(htu21d_async_t *async);
+bool htu21d_async_is_busy(const htu21d_async_t *async);
+int htu21d_async_deinit(htu21d_async_t *async);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_I2C_MASTER_H__
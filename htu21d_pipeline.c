@@ -0,0 +1,446 @@
+/**
+ * @file htu21d_pipeline.c
+ * @brief Two-stage sampling pipeline for the HTU21D ESP-IDF Component.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "htu21d.h"
+#include "htu21d_pipeline.h"
+
+#if HTU21D_PIPELINE_DEPTH & (HTU21D_PIPELINE_DEPTH - 1)
+#error "HTU21D_PIPELINE_DEPTH must be a power of two."
+#endif
+
+static const char* TAG = "htu21d_pipeline";
+
+/**
+ * @brief Returns `core` if the chip has it, else core 0.
+ */
+static BaseType_t pipeline_core(int core)
+{
+    return (core < portNUM_PROCESSORS) ? core : 0;
+}
+
+/**
+ * @brief Ends a stage. The task suspends itself rather than being deleted,
+ * so that its handle stays valid until #htu21d_pipeline_stop deletes it.
+ */
+static void pipeline_task_exit(htu21d_pipeline_t *pipeline)
+{
+    atomic_fetch_sub(&pipeline->tasks, 1);
+    vTaskSuspend(NULL);
+}
+
+/**
+ * @brief Pushes a frame into the ring, or counts it as dropped if the ring is
+ * full. Only called by the acquisition stage.
+ * @return Returns `true` if the frame was pushed.
+ */
+static bool pipeline_push(htu21d_pipeline_t *pipeline, const htu21d_frame_t *frame)
+{
+    unsigned int head = atomic_load_explicit(&pipeline->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&pipeline->tail, memory_order_acquire);
+    unsigned int depth = head - tail;
+
+    if (depth >= HTU21D_PIPELINE_DEPTH) {
+        pipeline->stats.dropped++;
+        return false;
+    }
+    pipeline->frames[head & (HTU21D_PIPELINE_DEPTH - 1)] = *frame;
+    // Release: the frame is written before the consumer can see the new head.
+    atomic_store_explicit(&pipeline->head, head + 1, memory_order_release);
+
+    pipeline->stats.frames++;
+    if (depth + 1 > pipeline->stats.max_depth) {
+        pipeline->stats.max_depth = depth + 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Applies the settings published since the last sample, if any. If
+ * the resolution cannot be written, the other settings still apply, and the
+ * resolution is written again with the next publication.
+ */
+static void pipeline_apply_settings(htu21d_pipeline_t *pipeline)
+{
+    htu21d_settings_t settings;
+
+    if (pipeline->config.settings == NULL ||
+            !htu21d_settings_read(pipeline->config.settings, &pipeline->settings_generation, &settings)) {
+        return;
+    }
+    if (htu21d_dev_apply_settings(pipeline->config.dev, &settings) != HTU21D_ERR_OK) {
+        ESP_LOGW(TAG, "Failed to apply the resolution of the new settings.");
+    }
+    if (settings.period_ms != 0 && pipeline->config.period_ms != 0) {
+        htu21d_sampler_set_period(&pipeline->sampler, settings.period_ms);
+    }
+    pipeline->stats.reconfigurations++;
+}
+
+/**
+ * @brief Acquisition stage: applies new settings, waits for the next period,
+ * reads both raw values and pushes them. It does nothing else, so that the bus is never kept waiting
+ * by the processing.
+ */
+static void pipeline_acquisition_task(void *arg)
+{
+    htu21d_pipeline_t *pipeline = (htu21d_pipeline_t *) arg;
+    htu21d_dev_t *dev = pipeline->config.dev;
+
+    while (atomic_load(&pipeline->running)) {
+        pipeline_apply_settings(pipeline);
+        if (pipeline->config.period_ms != 0) {
+            int64_t deadline = htu21d_sampler_wait(&pipeline->sampler);
+            if (!atomic_load(&pipeline->running)) {
+                break;
+            }
+            if (deadline < 0) {
+                // Keeps the stage paced, if only to the tick, until the timer starts again.
+                vTaskDelay(pdMS_TO_TICKS(pipeline->config.period_ms));
+            }
+        }
+
+        int64_t start_us = esp_timer_get_time();
+        htu21d_sample_t sample = {0};
+        const htu21d_frame_t frame = {
+            .result = htu21d_dev_read_raw_sample(dev, &sample),
+            .raw_temperature = sample.raw_temperature,
+            .raw_humidity = sample.raw_humidity,
+            .temperature_timing = sample.temperature_timing,
+            .humidity_timing = sample.humidity_timing,
+        };
+
+        if (pipeline_push(pipeline, &frame)) {
+            xTaskNotifyGive(pipeline->processing_task);
+        }
+        pipeline->stats.acquisition_busy_us += esp_timer_get_time() - start_us;
+    }
+
+    pipeline_task_exit(pipeline);
+}
+
+/**
+ * @brief Counts the latency of a sample delivered at `now_us`.
+ */
+static void pipeline_count_latency(htu21d_pipeline_t *pipeline, const htu21d_sample_t *sample, int64_t now_us)
+{
+    int64_t latency_us = now_us - sample->humidity_timing.read_us;
+    size_t bin = 0;
+
+    while (latency_us > 1 && bin < HTU21D_PIPELINE_LATENCY_BINS - 1) {
+        latency_us >>= 1;
+        bin++;
+    }
+    pipeline->stats.latency_us[bin]++;
+}
+
+/**
+ * @brief Hands the pending batch to the callback.
+ */
+static void pipeline_deliver(htu21d_pipeline_t *pipeline)
+{
+    const htu21d_pipeline_config_t *config = &pipeline->config;
+    int64_t now_us = esp_timer_get_time();
+
+    for (size_t i = 0; i < pipeline->batch_count; i++) {
+        pipeline_count_latency(pipeline, &pipeline->batch[i], now_us);
+    }
+    config->deliver(pipeline->batch, pipeline->batch_count, config->ctx);
+
+    pipeline->stats.batches++;
+    pipeline->stats.batch_sizes[pipeline->batch_count - 1]++;
+    pipeline->batch_count = 0;
+}
+
+/**
+ * @brief Runs the detectors on a frame, then passes it to the callback,
+ * directly or through the batch.
+ */
+static void pipeline_process(htu21d_pipeline_t *pipeline, int result, const htu21d_sample_t *sample)
+{
+    const htu21d_pipeline_config_t *config = &pipeline->config;
+
+    if (result != HTU21D_ERR_OK) {
+        pipeline->stats.failed++;
+    }
+#if CONFIG_HTU21D_DETECT
+    if (result == HTU21D_ERR_OK && config->detectors != NULL) {
+        htu21d_detectors_update(config->detectors, sample);
+    }
+#endif
+    if (config->deliver == NULL) {
+        if (result == HTU21D_ERR_OK) {
+            pipeline_count_latency(pipeline, sample, esp_timer_get_time());
+        }
+        config->process(result, sample, config->ctx);
+        pipeline->stats.batches++;
+        pipeline->stats.batch_sizes[0]++;
+        return;
+    }
+
+    if (result != HTU21D_ERR_OK) {
+        return;
+    }
+    if (pipeline->batch_count == 0) {
+        pipeline->batch_deadline_us = sample->humidity_timing.read_us + (int64_t) config->batch_timeout_ms * 1000;
+    }
+    pipeline->batch[pipeline->batch_count++] = *sample;
+    if (pipeline->batch_count >= config->batch_size) {
+        pipeline_deliver(pipeline);
+    }
+}
+
+/**
+ * @brief Returns how long the processing stage can sleep before the pending
+ * batch is due, 0 if it is due now.
+ */
+static TickType_t pipeline_batch_wait(const htu21d_pipeline_t *pipeline)
+{
+    if (pipeline->batch_count == 0 || pipeline->config.batch_timeout_ms == 0) {
+        return portMAX_DELAY;
+    }
+    int64_t remaining_us = pipeline->batch_deadline_us - esp_timer_get_time();
+    if (remaining_us <= 0) {
+        return 0;
+    }
+    // Rounded up, so that the deadline has passed on wake-up.
+    return pdMS_TO_TICKS((remaining_us + 999) / 1000) + 1;
+}
+
+/**
+ * @brief Processing stage: converts the frames in the ring to samples and
+ * hands them to the callback, one by one or in batches. After a stop, the
+ * frames left are processed and the last batch delivered before the task
+ * exits.
+ */
+static void pipeline_processing_task(void *arg)
+{
+    htu21d_pipeline_t *pipeline = (htu21d_pipeline_t *) arg;
+
+    for (;;) {
+        // Checked before the head: once the acquisition stage has exited, its
+        // last frame is visible.
+        bool done = !atomic_load(&pipeline->running) && atomic_load(&pipeline->tasks) == 1;
+        unsigned int tail = atomic_load_explicit(&pipeline->tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&pipeline->head, memory_order_acquire);
+        TickType_t wait = pipeline_batch_wait(pipeline);
+
+        if (wait == 0) {
+            int64_t start_us = esp_timer_get_time();
+            pipeline_deliver(pipeline);
+            pipeline->stats.processing_busy_us += esp_timer_get_time() - start_us;
+            continue;
+        }
+        if (tail == head) {
+            if (done) {
+                break;
+            }
+            ulTaskNotifyTake(pdTRUE, wait);
+            continue;
+        }
+
+        int64_t start_us = esp_timer_get_time();
+        const htu21d_frame_t *frame = &pipeline->frames[tail & (HTU21D_PIPELINE_DEPTH - 1)];
+        htu21d_sample_t sample = {
+            .raw_temperature = frame->raw_temperature,
+            .raw_humidity = frame->raw_humidity,
+            .temperature_timing = frame->temperature_timing,
+            .humidity_timing = frame->humidity_timing,
+        };
+        int result = frame->result;
+        // Release: the frame is copied before the producer can overwrite it.
+        atomic_store_explicit(&pipeline->tail, tail + 1, memory_order_release);
+
+        if (result == HTU21D_ERR_OK) {
+            htu21d_dev_convert_sample(pipeline->config.dev, &sample);
+        }
+        pipeline_process(pipeline, result, &sample);
+
+        pipeline->stats.processed++;
+        pipeline->stats.processing_busy_us += esp_timer_get_time() - start_us;
+    }
+
+    if (pipeline->batch_count > 0) {
+        pipeline_deliver(pipeline);
+    }
+    pipeline_task_exit(pipeline);
+}
+
+/**
+ * @brief Creates a stage pinned to `core`, in the storage of the pipeline
+ * with static allocation.
+ * @return Returns the handle of the task, or `NULL` if it could not be
+ * created.
+ */
+static TaskHandle_t pipeline_create_task(htu21d_pipeline_t *pipeline, TaskFunction_t function, const char *name,
+                                         UBaseType_t priority, int core, bool acquisition)
+{
+#if CONFIG_HTU21D_STATIC_ALLOCATION
+    return xTaskCreateStaticPinnedToCore(function, name, HTU21D_PIPELINE_STACK_SIZE, pipeline, priority,
+                                         acquisition ? pipeline->acquisition_stack : pipeline->processing_stack,
+                                         acquisition ? &pipeline->acquisition_tcb : &pipeline->processing_tcb,
+                                         pipeline_core(core));
+#else
+    (void) acquisition;
+    TaskHandle_t task = NULL;
+    if (xTaskCreatePinnedToCore(function, name, HTU21D_PIPELINE_STACK_SIZE, pipeline, priority, &task,
+                                pipeline_core(core)) != pdPASS) {
+        return NULL;
+    }
+    return task;
+#endif
+}
+
+/**
+ * @brief Starts a pipeline: the acquisition stage on core
+ * #HTU21D_PIPELINE_ACQUISITION_CORE and the processing stage on core
+ * #HTU21D_PIPELINE_PROCESSING_CORE.
+ *
+ * The device must not be used by other tasks until the pipeline is stopped.
+ * A frame that arrives while the ring is full is dropped, so a slow callback
+ * loses samples rather than delaying the sampling.
+ * @param[out] pipeline The pipeline to start, in storage that outlives it.
+ * @param[in] config Device, period and callback of the pipeline.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid (e.g. both or none of `process` and `deliver` set), or #HTU21D_ERR_FAIL if the sampler or a task could not
+ * be created.
+ */
+int htu21d_pipeline_start(htu21d_pipeline_t *pipeline, const htu21d_pipeline_config_t *config)
+{
+    if (pipeline == NULL || config == NULL || config->dev == NULL ||
+            (config->process == NULL) == (config->deliver == NULL) || config->batch_size > HTU21D_PIPELINE_BATCH_MAX) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *pipeline = (htu21d_pipeline_t) {
+        .config = *config,
+    };
+    if (pipeline->config.batch_size == 0) {
+        pipeline->config.batch_size = HTU21D_PIPELINE_BATCH_MAX;
+    }
+    atomic_init(&pipeline->head, 0);
+    atomic_init(&pipeline->tail, 0);
+    atomic_init(&pipeline->running, true);
+    atomic_init(&pipeline->tasks, 0);
+
+    if (config->period_ms != 0) {
+        const htu21d_sampler_config_t sampler_config = {
+            .period_ms = config->period_ms,
+        };
+        if (htu21d_sampler_init(&pipeline->sampler, &sampler_config) != HTU21D_ERR_OK) {
+            return HTU21D_ERR_FAIL;
+        }
+    }
+
+    // The processing stage exists before the first frame is pushed.
+    pipeline->start_us = esp_timer_get_time();
+    pipeline->processing_task = pipeline_create_task(pipeline, pipeline_processing_task, "htu21d_process",
+                                                     config->priority, HTU21D_PIPELINE_PROCESSING_CORE, false);
+    if (pipeline->processing_task == NULL) {
+        ESP_LOGE(TAG, "Failed to create the processing task.");
+        htu21d_sampler_deinit(&pipeline->sampler);
+        return HTU21D_ERR_FAIL;
+    }
+    atomic_fetch_add(&pipeline->tasks, 1);
+
+    atomic_fetch_add(&pipeline->tasks, 1);
+    pipeline->acquisition_task = pipeline_create_task(pipeline, pipeline_acquisition_task, "htu21d_acquire",
+                                                      config->priority + 1, HTU21D_PIPELINE_ACQUISITION_CORE, true);
+    if (pipeline->acquisition_task == NULL) {
+        ESP_LOGE(TAG, "Failed to create the acquisition task.");
+        atomic_fetch_sub(&pipeline->tasks, 1);
+        htu21d_pipeline_stop(pipeline);
+        return HTU21D_ERR_FAIL;
+    }
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Stops a pipeline and waits for both stages to exit.
+ *
+ * The measurement in progress is completed, and the frames in the ring are
+ * processed before this function returns. Call it from a task other than the
+ * stages, e.g. not from the callback.
+ * @param pipeline A started pipeline.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if
+ * `pipeline` is not running.
+ */
+int htu21d_pipeline_stop(htu21d_pipeline_t *pipeline)
+{
+    if (pipeline == NULL || pipeline->processing_task == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    atomic_store(&pipeline->running, false);
+    if (pipeline->acquisition_task != NULL) {
+        // Cuts the wait for the next period short.
+        htu21d_sampler_cancel(&pipeline->sampler);
+    }
+    while (atomic_load(&pipeline->tasks) > 1) {
+        vTaskDelay(1);
+    }
+    xTaskNotifyGive(pipeline->processing_task);
+    while (atomic_load(&pipeline->tasks) > 0) {
+        vTaskDelay(1);
+    }
+
+    if (pipeline->acquisition_task != NULL) {
+        vTaskDelete(pipeline->acquisition_task);
+        pipeline->acquisition_task = NULL;
+    }
+    vTaskDelete(pipeline->processing_task);
+    pipeline->processing_task = NULL;
+    htu21d_sampler_deinit(&pipeline->sampler);
+    pipeline->stats.elapsed_us = esp_timer_get_time() - pipeline->start_us;
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Copies the load of the stages and of the ring of a pipeline.
+ *
+ * While the pipeline runs, the counters are read without stopping the stages,
+ * so they can be off by the frame in progress.
+ * @param[in] pipeline A started or stopped pipeline.
+ * @param[out] stats Where to copy the statistics.
+ */
+void htu21d_pipeline_get_stats(const htu21d_pipeline_t *pipeline, htu21d_pipeline_stats_t *stats)
+{
+    *stats = pipeline->stats;
+    stats->depth = atomic_load(&pipeline->head) - atomic_load(&pipeline->tail);
+    if (atomic_load(&pipeline->tasks) > 0) {
+        stats->elapsed_us = esp_timer_get_time() - pipeline->start_us;
+    }
+}
+
+/**
+ * @brief Returns an upper bound of a quantile of the latency of the samples.
+ * @param[in] stats Statistics of a pipeline.
+ * @param p The quantile, between 0 and 1, e.g. 0.99.
+ * @return Returns the upper end of the latency bin the quantile falls in, in
+ * microseconds, or -1 if no sample was delivered.
+ */
+int64_t htu21d_pipeline_latency_quantile_us(const htu21d_pipeline_stats_t *stats, float p)
+{
+    uint64_t total = 0;
+    for (size_t bin = 0; bin < HTU21D_PIPELINE_LATENCY_BINS; bin++) {
+        total += stats->latency_us[bin];
+    }
+    if (total == 0) {
+        return -1;
+    }
+
+    uint64_t rank = (uint64_t)(p * (float) total), seen = 0;
+    for (size_t bin = 0; bin < HTU21D_PIPELINE_LATENCY_BINS; bin++) {
+        seen += stats->latency_us[bin];
+        if (seen > rank) {
+            return (int64_t) 1 << (bin + 1);
+        }
+    }
+    return (int64_t) 1 << HTU21D_PIPELINE_LATENCY_BINS;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file htu21d_pipeline.h
+ * @brief Two-stage sampling pipeline for the HTU21D ESP-IDF Component, with
+ * bus acquisition and processing on different cores.
+ *
+ * A loop that reads the sensor and then filters, stores or logs the sample
+ * delays its next bus operation by all that work. The pipeline splits it in
+ * two tasks. The acquisition stage, pinned to one core, only triggers and
+ * reads the sensor and pushes the raw frames into a single-producer,
+ * single-consumer ring; it never waits for the other stage. The processing
+ * stage, pinned to the other core, converts the frames to samples and hands
+ * them to a callback, which runs the filters, statistics and storage.
+ *
+ * On a single-core chip, both stages run on core 0 and only the decoupling
+ * remains.
+ *
+ * The callback can take the samples one by one, or in batches of up to a
+ * number of samples or a time, whichever comes first: fewer calls cost fewer
+ * wake-ups of the consumer, at the price of a higher latency.
+ *
+ * Resolution, period and calibration can be changed while the pipeline runs
+ * by publishing to the #htu21d_settings_buffer_t of the configuration: the
+ * acquisition stage applies them between two samples.
+ *
+ * The detectors of htu21d_detect.h can run in the processing stage, on each
+ * sample before the callback, by setting `detectors` in the configuration.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_PIPELINE_H__
+#define __ESP_HTU21D_PIPELINE_H__
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "htu21d.h"
+#include "htu21d_sampler.h"
+#include "htu21d_settings.h"
+#if CONFIG_HTU21D_DETECT
+#include "htu21d_detect.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef HTU21D_PIPELINE_DEPTH
+#define HTU21D_PIPELINE_DEPTH               16   /**< Frames the ring holds, a power of two. */
+#endif
+#ifndef HTU21D_PIPELINE_STACK_SIZE
+#define HTU21D_PIPELINE_STACK_SIZE          4096 /**< Stack of each stage, in bytes. */
+#endif
+#ifndef HTU21D_PIPELINE_ACQUISITION_CORE
+#define HTU21D_PIPELINE_ACQUISITION_CORE    1    /**< Core of the acquisition stage, away from the Wi-Fi stack on core 0. */
+#endif
+#ifndef HTU21D_PIPELINE_PROCESSING_CORE
+#define HTU21D_PIPELINE_PROCESSING_CORE     0    /**< Core of the processing stage. */
+#endif
+#ifndef HTU21D_PIPELINE_BATCH_MAX
+#define HTU21D_PIPELINE_BATCH_MAX           16   /**< Most samples delivered in one batch. */
+#endif
+#ifndef HTU21D_PIPELINE_LATENCY_BINS
+#define HTU21D_PIPELINE_LATENCY_BINS        24   /**< Bins of the latency histogram, the last one up to 2^23 us (8.4 s) and above. */
+#endif
+
+/**
+ * @brief Called by the processing stage for each frame.
+ * @param result #HTU21D_ERR_OK, or #HTU21D_ERR_FAIL if a value could not be
+ * read, as returned by #htu21d_dev_read_sample.
+ * @param sample The sample, valid when `result` is #HTU21D_ERR_OK.
+ * @param ctx The `ctx` of the configuration.
+ */
+typedef void (*htu21d_pipeline_process_t)(int result, const htu21d_sample_t *sample, void *ctx);
+
+/**
+ * @brief Called by the processing stage with a batch of samples.
+ * @param samples The samples, oldest first. Failed measurements are not
+ * included, see `failed` in #htu21d_pipeline_stats_t.
+ * @param count Number of samples, from 1 to `batch_size`.
+ * @param ctx The `ctx` of the configuration.
+ */
+typedef void (*htu21d_pipeline_deliver_t)(const htu21d_sample_t *samples, size_t count, void *ctx);
+
+/**
+ * @brief Configuration of a pipeline.
+ */
+typedef struct {
+    htu21d_dev_t *dev;                  /**< The sensor, only used by the acquisition stage. */
+    uint32_t period_ms;                 /**< Sampling period, see htu21d_sampler.h. 0 samples back to back, and the settings cannot change it. */
+    htu21d_pipeline_process_t process;  /**< Runs on each frame, in the processing stage. Leave `NULL` to use `deliver`. */
+    htu21d_pipeline_deliver_t deliver;  /**< Runs on each batch, in the processing stage. */
+    size_t batch_size;                  /**< A batch is delivered when it has this many samples, at most #HTU21D_PIPELINE_BATCH_MAX; 0 for the maximum. */
+    uint32_t batch_timeout_ms;          /**< A batch is also delivered when its first sample was taken this long ago; 0 for no limit. */
+    void *ctx;                          /**< Passed to `process` or `deliver`. */
+    UBaseType_t priority;               /**< Priority of the processing stage; the acquisition stage runs one above. */
+    htu21d_settings_buffer_t *settings; /**< Settings applied between two samples by the acquisition stage, or `NULL`. */
+#if CONFIG_HTU21D_DETECT
+    const htu21d_detectors_t *detectors; /**< Detectors run by the processing stage on each sample read without error, before the callback, or `NULL`. */
+#endif
+} htu21d_pipeline_config_t;
+
+/**
+ * @brief Raw result of one acquisition, as it goes through the ring.
+ */
+typedef struct {
+    int result;                         /**< #HTU21D_ERR_OK or #HTU21D_ERR_FAIL. */
+    uint16_t raw_temperature;           /**< Raw temperature value, see #htu21d_dev_read_raw_sample. */
+    uint16_t raw_humidity;              /**< Raw relative humidity value. */
+    htu21d_timing_t temperature_timing; /**< Timing of the temperature conversion. */
+    htu21d_timing_t humidity_timing;    /**< Timing of the humidity conversion. */
+} htu21d_frame_t;
+
+/**
+ * @brief Load of the stages and of the ring of a pipeline.
+ *
+ * The utilization of a stage is its busy time divided by `elapsed_us`. The
+ * acquisition stage is busy from a trigger to the push of the frame, the
+ * conversion waits included, as the bus is held; the processing stage while
+ * it converts a frame and runs the callback.
+ *
+ * The latency of a sample goes from the read of its humidity to the call of
+ * the callback. Bin `i` of `latency_us` counts the latencies in
+ * `[2^i, 2^(i+1))` microseconds, bin 0 also the latencies under 1 us, and the
+ * last bin all the longer ones.
+ */
+typedef struct {
+    uint32_t frames;            /**< Frames pushed by the acquisition stage. */
+    uint32_t processed;         /**< Frames taken from the ring by the processing stage. */
+    uint32_t failed;            /**< Failed measurements, not delivered in batches. */
+    uint32_t batches;           /**< Calls to the callback. */
+    uint32_t batch_sizes[HTU21D_PIPELINE_BATCH_MAX]; /**< Calls to the callback with `i + 1` samples. */
+    uint32_t latency_us[HTU21D_PIPELINE_LATENCY_BINS]; /**< Latencies of the samples, see above. */
+    uint32_t dropped;           /**< Frames lost because the ring was full. */
+    uint32_t depth;             /**< Frames in the ring now. */
+    uint32_t max_depth;         /**< Most frames the ring held at once. */
+    uint32_t reconfigurations;  /**< Settings applied by the acquisition stage. */
+    int64_t acquisition_busy_us; /**< Time the acquisition stage was busy. */
+    int64_t processing_busy_us; /**< Time the processing stage was busy. */
+    int64_t elapsed_us;         /**< Time since the pipeline started. */
+} htu21d_pipeline_stats_t;
+
+/**
+ * @brief State of a pipeline, in storage owned by the caller. Treat the
+ * members as private.
+ */
+typedef struct {
+    htu21d_pipeline_config_t config;
+    htu21d_sampler_t sampler;
+    TaskHandle_t acquisition_task;
+    TaskHandle_t processing_task;
+    htu21d_frame_t frames[HTU21D_PIPELINE_DEPTH];
+    atomic_uint head;           /**< Next frame to write, only written by the acquisition stage. */
+    atomic_uint tail;           /**< Next frame to read, only written by the processing stage. */
+    atomic_bool running;
+    atomic_int tasks;           /**< Stages still running. */
+    htu21d_pipeline_stats_t stats;
+    int64_t start_us;
+    uint32_t settings_generation; /**< Generation of the settings applied. */
+    htu21d_sample_t batch[HTU21D_PIPELINE_BATCH_MAX]; /**< Samples not delivered yet. */
+    size_t batch_count;
+    int64_t batch_deadline_us;  /**< When the batch is delivered at the latest. */
+#if CONFIG_HTU21D_STATIC_ALLOCATION
+    StaticTask_t acquisition_tcb;
+    StaticTask_t processing_tcb;
+    StackType_t acquisition_stack[HTU21D_PIPELINE_STACK_SIZE];
+    StackType_t processing_stack[HTU21D_PIPELINE_STACK_SIZE];
+#endif
+} htu21d_pipeline_t;
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_PIPELINE
+int htu21d_pipeline_start(htu21d_pipeline_t *pipeline, const htu21d_pipeline_config_t *config);
+int htu21d_pipeline_stop(htu21d_pipeline_t *pipeline);
+void htu21d_pipeline_get_stats(const htu21d_pipeline_t *pipeline, htu21d_pipeline_stats_t *stats);
+int64_t htu21d_pipeline_latency_quantile_us(const htu21d_pipeline_stats_t *stats, float p);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_PIPELINE_H__
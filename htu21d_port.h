@@ -0,0 +1,82 @@
+/**
+ * @file htu21d_port.h
+ * @brief Platform glue used by the portable parts of the HTU21D component.
+ *
+ * On ESP-IDF this maps to `esp_log`, `esp_timer` (the host clock on the linux
+ * target) and FreeRTOS. Elsewhere (e.g. the Linux build in `linux/`), it
+ * provides the few equivalents the driver needs, so that htu21d.c builds
+ * unchanged.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_PORT_H__
+#define __ESP_HTU21D_PORT_H__
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * Blocks the calling task for at least `ms` milliseconds. `pdMS_TO_TICKS()`
+ * rounds down (at 100 Hz, a 9 ms wait would be no wait at all), and the tick
+ * in progress is already partly over, so the wait is rounded up to whole
+ * ticks plus one. Raise `CONFIG_FREERTOS_HZ` to get closer to short waits.
+ */
+static inline void htu21d_port_delay_ms(uint32_t ms)
+{
+    if (ms != 0) {
+        vTaskDelay((TickType_t)((ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS) + 1);
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_timer.h"
+
+/** Monotonic time in microseconds. */
+#define htu21d_port_time_us()       esp_timer_get_time()
+#endif
+
+#else
+
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#define ESP_LOGE(tag, format, ...)  fprintf(stderr, "E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  fprintf(stderr, "W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  fprintf(stderr, "I (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  do { } while (0)
+
+static inline void htu21d_port_delay_ms(uint32_t ms)
+{
+    struct timespec delay = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (long)(ms % 1000) * 1000000,
+    };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+#endif  // ESP_PLATFORM
+
+#if !defined(ESP_PLATFORM) || CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+
+// The ESP-IDF linux target has no esp_timer, the host clock is used instead.
+static inline int64_t htu21d_port_time_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+#endif
+
+#endif  // __ESP_HTU21D_PORT_H__
@@ -0,0 +1,164 @@
+/**
+ * @file htu21d_resample.c
+ * @brief Resampling of HTU21D sample streams onto a fixed time grid.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include "htu21d_resample.h"
+
+/**
+ * @brief Returns the first grid point at or after `timestamp_us`.
+ */
+static int64_t grid_ceil(const htu21d_resampler_config_t *config, int64_t timestamp_us)
+{
+    int64_t offset = timestamp_us - config->origin_us;
+    int64_t n = offset / config->period_us;
+    if (n * config->period_us < offset) {
+        n++;
+    }
+    return config->origin_us + n * config->period_us;
+}
+
+/**
+ * @brief Initializes a streaming resampler.
+ * @param[out] resampler The resampler to initialize.
+ * @param[in] config The grid and interpolation mode to use.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_resampler_init(htu21d_resampler_t *resampler, const htu21d_resampler_config_t *config)
+{
+    if (resampler == NULL || config == NULL || config->period_us <= 0 || config->max_gap_us < 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *resampler = (htu21d_resampler_t) {
+        .config = *config,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Pushes a sample into the resampler and emits the grid points that
+ * precede it.
+ *
+ * A grid point is emitted once the sample after it is known, so the output
+ * lags the input by at most one sample. Only the previous sample is kept, so
+ * memory use is constant. Samples must be pushed in time order; a sample that
+ * is not newer than the previous one is ignored.
+ * @param resampler An initialized resampler.
+ * @param[in] sample The new sample, placed in time by its `timestamp_us`.
+ * @param[out] out Where to store the emitted grid points.
+ * @param out_len Capacity of `out`. Grid points that do not fit are counted in
+ * `resampler->dropped`. Size it to at least `max_gap_us / period_us + 1`.
+ * @return Returns the number of grid points stored in `out`.
+ */
+size_t htu21d_resampler_push(htu21d_resampler_t *resampler, const htu21d_sample_t *sample,
+                             htu21d_grid_point_t *out, size_t out_len)
+{
+    const htu21d_resampler_config_t *config = &resampler->config;
+    int64_t timestamp_us = sample->timestamp_us;
+    size_t count = 0;
+
+    if (!resampler->primed) {
+        resampler->primed = true;
+        resampler->next_us = grid_ceil(config, timestamp_us);
+    } else if (timestamp_us <= resampler->prev_us) {
+        return 0;
+    } else if (config->max_gap_us != 0 && timestamp_us - resampler->prev_us > config->max_gap_us) {
+        // Do not invent values over a gap in the data.
+        resampler->next_us = grid_ceil(config, timestamp_us);
+    } else {
+        float span = (float)(timestamp_us - resampler->prev_us);
+        for (; resampler->next_us < timestamp_us; resampler->next_us += config->period_us) {
+            if (count == out_len) {
+                resampler->dropped++;
+                continue;
+            }
+
+            htu21d_grid_point_t *point = &out[count++];
+            point->timestamp_us = resampler->next_us;
+            point->temperature = resampler->prev_temperature;
+            point->humidity = resampler->prev_humidity;
+            if (config->mode == HTU21D_RESAMPLE_LINEAR) {
+                float fraction = (float)(resampler->next_us - resampler->prev_us) / span;
+                point->temperature += (sample->temperature - resampler->prev_temperature) * fraction;
+                point->humidity += (sample->humidity - resampler->prev_humidity) * fraction;
+            }
+        }
+    }
+
+    resampler->prev_us = timestamp_us;
+    resampler->prev_temperature = sample->temperature;
+    resampler->prev_humidity = sample->humidity;
+
+    return count;
+}
+
+/**
+ * @brief Resamples a whole log of one channel onto the grid.
+ *
+ * The log is given as two parallel arrays, sorted by time. Between each pair
+ * of samples, all grid points are computed by one branch-free loop that
+ * compilers turn into SIMD code, which makes this fast on large host-side
+ * logs. Memory use is only the output arrays.
+ * @param[in] config The grid and interpolation mode to use.
+ * @param[in] timestamps_us Sample times, in increasing order.
+ * @param[in] values Sample values, e.g. temperatures or humidities.
+ * @param count Number of samples.
+ * @param[out] out_timestamps_us Where to store the grid times, may be `NULL`.
+ * @param[out] out_values Where to store the resampled values.
+ * @param out_len Capacity of the output arrays; resampling stops when full.
+ * @return Returns the number of grid points written.
+ */
+size_t htu21d_resample_bulk(const htu21d_resampler_config_t *config,
+                            const int64_t *timestamps_us, const float *values, size_t count,
+                            int64_t *out_timestamps_us, float *out_values, size_t out_len)
+{
+    if (config == NULL || config->period_us <= 0 || count == 0) {
+        return 0;
+    }
+
+    const int64_t period_us = config->period_us;
+    const float period = (float) period_us;
+    int64_t next_us = grid_ceil(config, timestamps_us[0]);
+    size_t written = 0;
+
+    for (size_t i = 1; i < count && written < out_len; i++) {
+        int64_t t0 = timestamps_us[i - 1];
+        int64_t t1 = timestamps_us[i];
+        if (t1 <= t0 || next_us >= t1) {
+            continue;
+        }
+        if (config->max_gap_us != 0 && t1 - t0 > config->max_gap_us) {
+            next_us = grid_ceil(config, t1);
+            continue;
+        }
+
+        size_t points = (size_t)((t1 - next_us + period_us - 1) / period_us);
+        if (points > out_len - written) {
+            points = out_len - written;
+        }
+
+        const float v0 = values[i - 1];
+        const float slope = (config->mode == HTU21D_RESAMPLE_LINEAR) ?
+                            (values[i] - v0) / (float)(t1 - t0) : 0.0F;
+        const float offset = (float)(next_us - t0);
+        float *dst = out_values + written;
+        for (size_t j = 0; j < points; j++) {
+            dst[j] = v0 + slope * (offset + (float) j * period);
+        }
+        if (out_timestamps_us != NULL) {
+            for (size_t j = 0; j < points; j++) {
+                out_timestamps_us[written + j] = next_us + (int64_t) j * period_us;
+            }
+        }
+
+        written += points;
+        next_us += (int64_t) points * period_us;
+    }
+
+    return written;
+}
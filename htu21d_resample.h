@@ -0,0 +1,85 @@
+/**
+ * @file htu21d_resample.h
+ * @brief Resampling of HTU21D sample streams onto a fixed time grid.
+ *
+ * Samples of different sensors, or of one sensor at an adaptive rate, arrive
+ * at irregular times. The resampler maps them onto a common grid
+ * (`origin_us + n * period_us`) by linear interpolation or by holding the last
+ * value, so that streams can be compared point by point.
+ *
+ * #htu21d_resampler_push works on a live stream in constant memory.
+ * #htu21d_resample_bulk processes a whole log stored as arrays and is written
+ * so the compiler can vectorize its inner loop; it has no dependency on the
+ * sensor and can be built on a host to post-process logs.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_RESAMPLE_H__
+#define __ESP_HTU21D_RESAMPLE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "htu21d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief How values between two samples are computed.
+ */
+typedef enum {
+    HTU21D_RESAMPLE_LINEAR = 0, /**< Linear interpolation between the two surrounding samples. */
+    HTU21D_RESAMPLE_HOLD,       /**< Zero-order hold of the previous sample. */
+} htu21d_resample_mode_t;
+
+/**
+ * @brief Configuration of the resampling grid.
+ */
+typedef struct {
+    int64_t period_us;           /**< Spacing of the grid. Must be greater than 0. */
+    int64_t origin_us;           /**< Any point of the grid, e.g. `0` for a grid aligned on multiples of `period_us`. */
+    int64_t max_gap_us;          /**< Grid points between two samples further apart than this are not emitted. `0` means no limit. */
+    htu21d_resample_mode_t mode; /**< Interpolation mode. */
+} htu21d_resampler_config_t;
+
+/**
+ * @brief A sample placed on the grid.
+ */
+typedef struct {
+    int64_t timestamp_us; /**< Grid time of the point. */
+    float temperature;    /**< Temperature in degrees Celsius. */
+    float humidity;       /**< Relative humidity in %RH. */
+} htu21d_grid_point_t;
+
+/**
+ * @brief State of a streaming resampler. Treat the members as private.
+ */
+typedef struct {
+    htu21d_resampler_config_t config;
+    bool primed;            /**< `true` once the first sample was pushed. */
+    int64_t prev_us;        /**< Timestamp of the previous sample. */
+    float prev_temperature; /**< Temperature of the previous sample. */
+    float prev_humidity;    /**< Humidity of the previous sample. */
+    int64_t next_us;        /**< Next grid point to emit. */
+    uint32_t dropped;       /**< Grid points lost because the output buffer was too small. */
+} htu21d_resampler_t;
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_RESAMPLE
+int htu21d_resampler_init(htu21d_resampler_t *resampler, const htu21d_resampler_config_t *config);
+size_t htu21d_resampler_push(htu21d_resampler_t *resampler, const htu21d_sample_t *sample,
+                             htu21d_grid_point_t *out, size_t out_len);
+size_t htu21d_resample_bulk(const htu21d_resampler_config_t *config,
+                            const int64_t *timestamps_us, const float *values, size_t count,
+                            int64_t *out_timestamps_us, float *out_values, size_t out_len);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_RESAMPLE_H__
@@ -0,0 +1,242 @@
+/**
+ * @file htu21d_sampler.c
+ * @brief Drift-free periodic sampling clock for the HTU21D ESP-IDF Component.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <sys/time.h>
+#include "esp_log.h"
+#include "htu21d.h"
+#include "htu21d_sampler.h"
+
+static const char* TAG = "htu21d_sampler";
+
+/**
+ * @brief `esp_timer` callback, wakes up the task blocked in
+ * #htu21d_sampler_wait.
+ */
+static void sampler_timer_callback(void *arg)
+{
+    htu21d_sampler_t *sampler = (htu21d_sampler_t *) arg;
+    if (sampler->waiting_task != NULL) {
+        xTaskNotifyGiveIndexed(sampler->waiting_task, HTU21D_SAMPLER_NOTIFY_INDEX);
+    }
+}
+
+/**
+ * @brief Initializes a periodic sampler.
+ *
+ * Without alignment the first deadline is "now", so the first call to
+ * #htu21d_sampler_wait returns immediately. With `align_ms` set, the first
+ * deadline is the next wall-clock multiple of `align_ms`, as reported by
+ * `gettimeofday()`. Alignment is only computed here: set the system time (e.g.
+ * via SNTP) before initializing the sampler.
+ * @param[out] sampler The sampler to initialize.
+ * @param[in] config Period and alignment of the sampler.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid, or #HTU21D_ERR_FAIL if the `esp_timer` could not be
+ * created.
+ */
+int htu21d_sampler_init(htu21d_sampler_t *sampler, const htu21d_sampler_config_t *config)
+{
+    if (sampler == NULL || config == NULL || config->period_ms == 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *sampler = (htu21d_sampler_t) {
+        0
+    };
+    sampler->config = *config;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = sampler_timer_callback,
+        .arg = sampler,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "htu21d_sampler",
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &sampler->timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the sampler timer: %s", esp_err_to_name(ret));
+        return HTU21D_ERR_FAIL;
+    }
+
+    sampler->start_us = esp_timer_get_time();
+    if (config->align_ms != 0) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        int64_t wall_us = (int64_t) now.tv_sec * 1000000 + now.tv_usec;
+        int64_t align_us = (int64_t) config->align_ms * 1000;
+        sampler->start_us += align_us - (wall_us % align_us);
+    }
+    htu21d_sampler_reset_stats(sampler);
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Stops and deletes the timer of a sampler.
+ * @param sampler The sampler to deinitialize.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if
+ * `sampler` was not initialized.
+ */
+int htu21d_sampler_deinit(htu21d_sampler_t *sampler)
+{
+    if (sampler == NULL || sampler->timer == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    esp_timer_stop(sampler->timer);
+    esp_timer_delete(sampler->timer);
+    sampler->timer = NULL;
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Blocks the calling task until the next deadline of the sampler.
+ *
+ * Use it in place of `vTaskDelay()` at the top of a sampling loop. Deadlines
+ * are absolute, so however long the measurement took, the next wake-up still
+ * happens at `start + n * period_ms`.
+ *
+ * If the caller is already later than a whole period, the deadlines that
+ * passed are skipped and counted as missed rather than being fired back to
+ * back.
+ *
+ * The wake-up is a task notification on #HTU21D_SAMPLER_NOTIFY_INDEX, and
+ * nothing else may use that index for the calling task. With the default
+ * single notification entry it is also the index of `xTaskNotifyGive()`:
+ * raise `CONFIG_FREERTOS_TASK_NOTIFICATION_ARRAY_ENTRIES` to 2 or more to
+ * give the sampler an index of its own. A notification from elsewhere does
+ * not end the wait early, as the task blocks again until the deadline, but it
+ * is consumed and lost to whoever expected it. To end a wait early, call
+ * #htu21d_sampler_cancel.
+ * @param sampler An initialized sampler.
+ * @return Returns the deadline that was waited for, in `esp_timer_get_time()`
+ * microseconds, or `-1` if `sampler` was not initialized, its timer could not
+ * be started or the wait was cancelled. On `-1` the caller was not paced, and
+ * the same deadline is waited for by the next call.
+ */
+int64_t htu21d_sampler_wait(htu21d_sampler_t *sampler)
+{
+    if (sampler == NULL || sampler->timer == NULL) {
+        return -1;
+    }
+
+    int64_t period_us = (int64_t) sampler->config.period_ms * 1000;
+    int64_t deadline = sampler->start_us + (int64_t) sampler->index * period_us;
+    int64_t now = esp_timer_get_time();
+
+    if (now - deadline >= period_us) {
+        uint64_t skipped = (now - deadline) / period_us;
+        sampler->index += skipped;
+        sampler->stats.missed += skipped;
+        deadline += (int64_t) skipped * period_us;
+    }
+
+    if (deadline > now) {
+        sampler->waiting_task = xTaskGetCurrentTaskHandle();
+        esp_err_t ret = esp_timer_start_once(sampler->timer, deadline - now);
+        if (ret != ESP_OK) {
+            sampler->waiting_task = NULL;
+            ESP_LOGE(TAG, "Failed to start the sampler timer: %s", esp_err_to_name(ret));
+            return -1;
+        }
+        // Another notification on the index wakes the task early: block again
+        // until the deadline, bounded by the tick in case the timer already
+        // fired and its notification was taken with the other one.
+        while (now < deadline && !atomic_load(&sampler->cancelled)) {
+            ulTaskNotifyTakeIndexed(HTU21D_SAMPLER_NOTIFY_INDEX, pdTRUE,
+                                    pdMS_TO_TICKS((deadline - now + 999) / 1000) + 1);
+            now = esp_timer_get_time();
+        }
+        // Disarms the timer if the wait ended before it fired, so that the
+        // next call can start it again.
+        esp_timer_stop(sampler->timer);
+        sampler->waiting_task = NULL;
+    }
+    if (atomic_exchange(&sampler->cancelled, false)) {
+        return -1;
+    }
+    sampler->index++;
+
+    int64_t jitter = now - deadline;
+    htu21d_sampler_stats_t *stats = &sampler->stats;
+    stats->periods++;
+    stats->last_jitter_us = jitter;
+    stats->jitter_sum_us += jitter;
+    if (jitter < stats->jitter_min_us) {
+        stats->jitter_min_us = jitter;
+    }
+    if (jitter > stats->jitter_max_us) {
+        stats->jitter_max_us = jitter;
+    }
+
+    return deadline;
+}
+
+/**
+ * @brief Ends the wait in progress in #htu21d_sampler_wait, or the next one if
+ * no task is waiting, which then returns `-1`. Call it from another task,
+ * e.g. to stop a sampling loop without waiting for the next deadline.
+ * @param sampler An initialized sampler; ignored if it is not.
+ */
+void htu21d_sampler_cancel(htu21d_sampler_t *sampler)
+{
+    if (sampler == NULL || sampler->timer == NULL) {
+        return;
+    }
+
+    atomic_store(&sampler->cancelled, true);
+    TaskHandle_t task = sampler->waiting_task;
+    if (task != NULL) {
+        xTaskNotifyGiveIndexed(task, HTU21D_SAMPLER_NOTIFY_INDEX);
+    }
+}
+
+/**
+ * @brief Changes the period of a sampler. The next deadline is one new period
+ * after the last one, so the schedule does not jump.
+ * @param sampler An initialized sampler, not being waited on.
+ * @param period_ms The new period, greater than 0.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_sampler_set_period(htu21d_sampler_t *sampler, uint32_t period_ms)
+{
+    if (sampler == NULL || sampler->timer == NULL || period_ms == 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    if (sampler->index > 0) {
+        // Anchors the schedule on the last deadline.
+        sampler->start_us += (int64_t)(sampler->index - 1) * sampler->config.period_ms * 1000;
+        sampler->index = 1;
+    }
+    sampler->config.period_ms = period_ms;
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Copies the jitter and missed-deadline statistics of a sampler.
+ * @param[in] sampler The sampler to read the statistics from.
+ * @param[out] stats Where to copy the statistics.
+ */
+void htu21d_sampler_get_stats(const htu21d_sampler_t *sampler, htu21d_sampler_stats_t *stats)
+{
+    *stats = sampler->stats;
+}
+
+/**
+ * @brief Clears the statistics of a sampler, without touching its schedule.
+ * @param sampler The sampler to reset the statistics of.
+ */
+void htu21d_sampler_reset_stats(htu21d_sampler_t *sampler)
+{
+    sampler->stats = (htu21d_sampler_stats_t) {
+        .jitter_min_us = INT64_MAX,
+        .jitter_max_us = INT64_MIN,
+    };
+}
@@ -0,0 +1,88 @@
+/**
+ * @file htu21d_sampler.h
+ * @brief Drift-free periodic sampling clock for the HTU21D ESP-IDF Component.
+ *
+ * A loop that reads the sensor and then calls `vTaskDelay()` drifts by the
+ * duration of the read on every cycle. The sampler instead keeps an absolute
+ * schedule of deadlines (`start + n * period`) on the monotonic `esp_timer`
+ * clock, so the time spent measuring is compensated automatically and the
+ * samples stay locked to the chosen period.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_SAMPLER_H__
+#define __ESP_HTU21D_SAMPLER_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef HTU21D_SAMPLER_NOTIFY_INDEX
+#define HTU21D_SAMPLER_NOTIFY_INDEX (configTASK_NOTIFICATION_ARRAY_ENTRIES - 1) /**< Task notification index the sampler wakes the waiting task on. Nothing else may use it for that task, see #htu21d_sampler_wait. */
+#endif
+
+/**
+ * @brief Configuration of a periodic sampler.
+ */
+typedef struct {
+    uint32_t period_ms; /**< Time between two consecutive deadlines, in milliseconds. Must be greater than 0. */
+    uint32_t align_ms;  /**< When not 0, the first deadline is placed on the next wall-clock multiple of this many milliseconds (e.g. `60000` samples on each :00 second). */
+} htu21d_sampler_config_t;
+
+/**
+ * @brief Jitter and missed-deadline statistics of a periodic sampler.
+ *
+ * Jitter is the lateness of the wake-up compared to its deadline, in
+ * microseconds.
+ */
+typedef struct {
+    uint32_t periods;         /**< Number of deadlines the caller was woken up for. */
+    uint32_t missed;          /**< Number of deadlines skipped because the caller was already late when it asked for them. */
+    int64_t jitter_min_us;    /**< Smallest observed jitter. */
+    int64_t jitter_max_us;    /**< Largest observed jitter. */
+    int64_t jitter_sum_us;    /**< Sum of all jitters, divide by `periods` for the mean. */
+    int64_t last_jitter_us;   /**< Jitter of the most recent period. */
+} htu21d_sampler_stats_t;
+
+/**
+ * @brief State of a periodic sampler. Treat the members as private.
+ */
+typedef struct {
+    htu21d_sampler_config_t config;
+    esp_timer_handle_t timer;   /**< One-shot timer armed for the next deadline. */
+    TaskHandle_t waiting_task;  /**< Task blocked in #htu21d_sampler_wait. */
+    atomic_bool cancelled;      /**< Set by #htu21d_sampler_cancel, cleared by the wait it ends. */
+    int64_t start_us;           /**< Monotonic time of the first deadline. */
+    uint64_t index;             /**< Index of the next deadline since `start_us`. */
+    htu21d_sampler_stats_t stats;
+} htu21d_sampler_t;
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_SAMPLER
+int htu21d_sampler_init(htu21d_sampler_t *sampler, const htu21d_sampler_config_t *config);
+int htu21d_sampler_deinit(htu21d_sampler_t *sampler);
+int64_t htu21d_sampler_wait(htu21d_sampler_t *sampler);
+void htu21d_sampler_cancel(htu21d_sampler_t *sampler);
+int htu21d_sampler_set_period(htu21d_sampler_t *sampler, uint32_t period_ms);
+void htu21d_sampler_get_stats(const htu21d_sampler_t *sampler, htu21d_sampler_stats_t *stats);
+void htu21d_sampler_reset_stats(htu21d_sampler_t *sampler);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_SAMPLER_H__
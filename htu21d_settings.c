@@ -0,0 +1,104 @@
+/**
+ * @file htu21d_settings.c
+ * @brief Settings of a sensor that can be changed while it is being sampled,
+ * for the HTU21D ESP-IDF Component.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include "htu21d.h"
+#include "htu21d_settings.h"
+
+/**
+ * @brief Initializes a settings buffer with its first generation.
+ * @param[out] buffer The buffer to initialize.
+ * @param[in] settings The initial settings.
+ */
+void htu21d_settings_init(htu21d_settings_buffer_t *buffer, const htu21d_settings_t *settings)
+{
+    buffer->slots[1] = *settings;
+    atomic_init(&buffer->generation, 1);
+    atomic_init(&buffer->started, 1);
+}
+
+/**
+ * @brief Publishes new settings. Readers pick them up at their next call to
+ * #htu21d_settings_read.
+ *
+ * Never blocks: if another writer is publishing at the same time, this
+ * function fails rather than waiting for it.
+ * @param buffer An initialized buffer.
+ * @param[in] settings The settings to publish, copied.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_STATE if
+ * another writer is publishing; publish again later.
+ */
+int htu21d_settings_publish(htu21d_settings_buffer_t *buffer, const htu21d_settings_t *settings)
+{
+    unsigned int generation = atomic_load_explicit(&buffer->generation, memory_order_relaxed);
+    unsigned int expected = generation;
+
+    if (!atomic_compare_exchange_strong(&buffer->started, &expected, generation + 1)) {
+        return HTU21D_ERR_INVALID_STATE;
+    }
+    // Readers that see the slot being written also see `started` moved on.
+    atomic_thread_fence(memory_order_release);
+    buffer->slots[(generation + 1) & 1] = *settings;
+    atomic_store_explicit(&buffer->generation, generation + 1, memory_order_release);
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Copies the current settings, if they changed since the reader's
+ * last copy. Call it at a sample boundary.
+ *
+ * A copy overwritten while it was made is retried, at most
+ * #HTU21D_SETTINGS_READ_ATTEMPTS times, so that writers publishing without a
+ * pause cannot hold up the sampling: the settings are then picked up at a
+ * later boundary.
+ * @param buffer An initialized buffer.
+ * @param[in,out] generation The generation the reader last copied, 0 before
+ * the first call. Updated on a copy.
+ * @param[out] settings Receives the settings when they changed, left
+ * untouched otherwise.
+ * @return Returns `true` if newer settings were copied.
+ */
+bool htu21d_settings_read(htu21d_settings_buffer_t *buffer, uint32_t *generation, htu21d_settings_t *settings)
+{
+    for (int attempt = 0; attempt < HTU21D_SETTINGS_READ_ATTEMPTS; attempt++) {
+        unsigned int current = atomic_load_explicit(&buffer->generation, memory_order_acquire);
+        if (current == *generation) {
+            return false;
+        }
+
+        htu21d_settings_t copy = buffer->slots[current & 1];
+        atomic_thread_fence(memory_order_acquire);
+        // The slot is only rewritten by the second publication after `current`.
+        if (atomic_load_explicit(&buffer->started, memory_order_relaxed) - current < 2) {
+            *settings = copy;
+            *generation = current;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Applies the resolution and calibration of settings to a device.
+ *
+ * The user register is only written when the resolution changes.
+ * @param dev The device, not measuring.
+ * @param[in] settings The settings to apply.
+ * @return Returns #HTU21D_ERR_OK on success, or the error of the user
+ * register access.
+ */
+int htu21d_dev_apply_settings(htu21d_dev_t *dev, const htu21d_settings_t *settings)
+{
+    if (settings->calibrated) {
+        htu21d_dev_set_calibration(dev, &settings->calibration);
+    }
+    if ((settings->resolution & 0b10000001) != dev->resolution) {
+        return htu21d_dev_set_resolution(dev, settings->resolution);
+    }
+    return HTU21D_ERR_OK;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file htu21d_settings.h
+ * @brief Settings of a sensor that can be changed while it is being sampled,
+ * for the HTU21D ESP-IDF Component.
+ *
+ * A #htu21d_settings_buffer_t holds the current settings of a sensor in two
+ * slots. A writer fills the slot that is not current and then publishes it
+ * with a single atomic store; it never waits for the readers. A reader, i.e.
+ * the sampling loop, copies the current slot at a sample boundary, between
+ * two measurements, and works on its copy until the next boundary, so a
+ * change never affects a measurement in progress. In the rare case a reader
+ * was copying a slot that two later publications reused, it sees it and
+ * copies again.
+ *
+ * Every reader keeps the generation it last copied, so several loops (e.g.
+ * the acquisition and processing stages of htu21d_pipeline.h) can follow the
+ * same buffer.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_SETTINGS_H__
+#define __ESP_HTU21D_SETTINGS_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "htu21d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef HTU21D_SETTINGS_READ_ATTEMPTS
+#define HTU21D_SETTINGS_READ_ATTEMPTS   4 /**< Copies tried by #htu21d_settings_read before it leaves the settings for the next boundary. */
+#endif
+
+/**
+ * @brief Settings of a sensor, published as a whole.
+ */
+typedef struct {
+    uint8_t resolution;                 /**< Resolution bits of the user register, see #htu21d_dev_set_resolution. */
+    uint32_t period_ms;                 /**< Sampling period; 0 keeps the period of the loop. */
+    bool calibrated;                    /**< `calibration` is set. */
+    htu21d_calibration_t calibration;   /**< Conversion times to wait, see #htu21d_dev_set_calibration. */
+    const void *user;                   /**< Settings of the application, e.g. detector thresholds. Must not change once published. */
+} htu21d_settings_t;
+
+/**
+ * @brief Double buffer of the settings of a sensor. Treat the members as
+ * private.
+ */
+typedef struct {
+    htu21d_settings_t slots[2]; /**< Generation `n` is in `slots[n & 1]`. */
+    atomic_uint generation;     /**< Last published generation. */
+    atomic_uint started;        /**< Last generation a writer started, `generation + 1` while one writes. */
+} htu21d_settings_buffer_t;
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_SETTINGS
+void htu21d_settings_init(htu21d_settings_buffer_t *buffer, const htu21d_settings_t *settings);
+int htu21d_settings_publish(htu21d_settings_buffer_t *buffer, const htu21d_settings_t *settings);
+bool htu21d_settings_read(htu21d_settings_buffer_t *buffer, uint32_t *generation, htu21d_settings_t *settings);
+int htu21d_dev_apply_settings(htu21d_dev_t *dev, const htu21d_settings_t *settings);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_SETTINGS_H__
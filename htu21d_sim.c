@@ -0,0 +1,455 @@
+/**
+ * @file htu21d_sim.c
+ * @brief Simulated HTU21D sensor, usable as an I2C transport.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include "htu21d_port.h"
+#include "htu21d_sim.h"
+
+#define SIM_USER_REGISTER_DEFAULT   0x02 /**< User register after a reset: 14-bit temperature, 12-bit RH, OTP reload disabled. */
+#define SIM_OVERCLOCK_PERMILLE      200  /**< Share of the transactions, and of the CRCs, that fail above `max_clock_hz`. */
+
+/**
+ * @brief Typical conversion times in microseconds, indexed by the resolution
+ * bits (bit 7 and bit 0 of the user register, as `b7 << 1 | b0`), per
+ * datasheet.
+ */
+static const uint32_t temperature_times_us[4] = {44000, 11000, 22000, 6000};
+static const uint32_t humidity_times_us[4] = {14000, 2000, 4000, 7000};
+
+/**
+ * @brief Typical HTU31D conversion times in microseconds, temperature and
+ * humidity together, indexed by the OSR.
+ */
+static const uint32_t htu31d_times_us[4] = {2300, 4300, 8200, 15900};
+
+static uint32_t sim_random(htu21d_sim_t *sim)
+{
+    sim->random = sim->random * 1664525U + 1013904223U;
+    return sim->random >> 8;
+}
+
+static bool sim_fails(htu21d_sim_t *sim, uint16_t permille)
+{
+    return permille != 0 && sim_random(sim) % 1000 < permille;
+}
+
+/**
+ * @brief Draws whether a transaction fails, at the configured rate plus, above
+ * the maximum SCL frequency, #SIM_OVERCLOCK_PERMILLE.
+ */
+static bool sim_transaction_fails(htu21d_sim_t *sim, uint16_t permille)
+{
+    if (sim->max_clock_hz != 0 && sim->clock_hz > sim->max_clock_hz && sim_fails(sim, SIM_OVERCLOCK_PERMILLE)) {
+        return true;
+    }
+    return sim_fails(sim, permille);
+}
+
+/**
+ * @brief Adds the configured noise to a raw value, clamped to 16 bits.
+ */
+static uint16_t sim_noisy(htu21d_sim_t *sim, float raw)
+{
+    if (sim->noise_raw != 0) {
+        raw += (float)((int32_t)(sim_random(sim) % (2U * sim->noise_raw + 1)) - sim->noise_raw);
+    }
+    if (raw < 0.0F) {
+        raw = 0.0F;
+    } else if (raw > 65535.0F) {
+        raw = 65535.0F;
+    }
+    return (uint16_t) raw;
+}
+
+static uint8_t sim_crc_bytes(const uint8_t *bytes, size_t len)
+{
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint8_t sim_crc(uint16_t value)
+{
+    const uint8_t bytes[2] = {value >> 8, value & 0xFF};
+    return sim_crc_bytes(bytes, sizeof(bytes));
+}
+
+/**
+ * @brief Returns how long a conversion takes on the simulated sensor.
+ * @param user_register The user register, which selects the resolution.
+ * @param command The trigger command.
+ * @return Returns the conversion time in microseconds.
+ */
+uint32_t htu21d_sim_conversion_time_us(uint8_t user_register, uint8_t command)
+{
+    int resolution = ((user_register >> 6) & 0x02) | (user_register & 0x01);
+
+    if (command == TRIGGER_HUMD_MEASURE_NOHOLD || command == TRIGGER_HUMD_MEASURE_HOLD) {
+        return humidity_times_us[resolution];
+    }
+    return temperature_times_us[resolution];
+}
+
+/**
+ * @brief Handles a command written to a simulated HTU31D.
+ */
+static int sim_htu31d_write(htu21d_sim_t *sim, uint8_t command)
+{
+    if ((command & 0xE1) == HTU31D_CONVERSION) {
+        // The result of a conversion becomes readable once it is done.
+        if (htu21d_port_time_us() >= sim->ready_us) {
+            sim->results[0] = sim->converting[0];
+            sim->results[1] = sim->converting[1];
+        }
+        sim->converting[0] = sim_noisy(sim, (sim->temperature + 40.0F) * 65535.0F / 165.0F);
+        sim->converting[1] = sim_noisy(sim, sim->humidity * 65535.0F / 100.0F);
+        sim->ready_us = htu21d_port_time_us() + htu31d_times_us[(command >> 1) & 0x03];
+        return HTU21D_ERR_OK;
+    }
+    if (command == HTU31D_RESET) {
+        return HTU21D_ERR_OK;
+    }
+    return HTU21D_ERR_FAIL;
+}
+
+/**
+ * @brief Answers a read command of a simulated HTU31D.
+ */
+static int sim_htu31d_read(htu21d_sim_t *sim, uint8_t command, uint8_t *data, size_t len)
+{
+    uint8_t frame[6];
+    size_t frame_len = 6;
+
+    if (htu21d_port_time_us() >= sim->ready_us) {
+        sim->results[0] = sim->converting[0];
+        sim->results[1] = sim->converting[1];
+    }
+    switch (command) {
+
+    case HTU31D_READ_T_RH:
+        for (int i = 0; i < 2; i++) {
+            frame[3 * i] = sim->results[i] >> 8;
+            frame[3 * i + 1] = sim->results[i] & 0xFF;
+            frame[3 * i + 2] = sim_crc(sim->results[i]);
+        }
+        break;
+
+    case HTU31D_READ_RH:
+        frame[0] = sim->results[1] >> 8;
+        frame[1] = sim->results[1] & 0xFF;
+        frame[2] = sim_crc(sim->results[1]);
+        frame_len = 3;
+        break;
+
+    case HTU31D_READ_SERIAL:
+        frame[0] = (sim->serial >> 16) & 0xFF;
+        frame[1] = (sim->serial >> 8) & 0xFF;
+        frame[2] = sim->serial & 0xFF;
+        frame[3] = sim_crc_bytes(frame, 3);
+        frame_len = 4;
+        break;
+
+    default:
+        return HTU21D_ERR_FAIL;
+    }
+
+    if (command != HTU31D_READ_SERIAL && sim_transaction_fails(sim, sim->crc_error_permille)) {
+        frame[2] ^= 0x01;
+    }
+    for (size_t i = 0; i < len; i++) {
+        data[i] = i < frame_len ? frame[i] : 0xFF;
+    }
+    return HTU21D_ERR_OK;
+}
+
+static int sim_write(void *bus, uint8_t address, const uint8_t *data, size_t len)
+{
+    htu21d_sim_t *sim = (htu21d_sim_t *) bus;
+
+    sim->transactions++;
+    if (address != HTU21D_ADDR || sim_transaction_fails(sim, sim->nack_permille)) {
+        return HTU21D_ERR_FAIL;
+    }
+    if (len == 0) {
+        return HTU21D_ERR_OK;
+    }
+    if (sim->model == HTU21D_MODEL_HTU31D) {
+        return sim_htu31d_write(sim, data[0]);
+    }
+
+    sim->command = data[0];
+    switch (sim->command) {
+
+    case TRIGGER_TEMP_MEASURE_NOHOLD:
+    case TRIGGER_HUMD_MEASURE_NOHOLD:
+        sim->ready_us = htu21d_port_time_us() + htu21d_sim_conversion_time_us(sim->user_register, sim->command);
+        break;
+
+    case WRITE_USER_REG:
+        if (len < 2) {
+            return HTU21D_ERR_FAIL;
+        }
+        sim->user_register = data[1];
+        break;
+
+    case SOFT_RESET:
+        sim->user_register = SIM_USER_REGISTER_DEFAULT;
+        break;
+    }
+
+    return HTU21D_ERR_OK;
+}
+
+static int sim_read(void *bus, uint8_t address, uint8_t *data, size_t len)
+{
+    htu21d_sim_t *sim = (htu21d_sim_t *) bus;
+
+    sim->transactions++;
+    if (address != HTU21D_ADDR || sim_transaction_fails(sim, sim->nack_permille)) {
+        return HTU21D_ERR_FAIL;
+    }
+    // The HTU31D is only read after a read command.
+    if (sim->model == HTU21D_MODEL_HTU31D) {
+        return HTU21D_ERR_FAIL;
+    }
+    if (sim->command != TRIGGER_TEMP_MEASURE_NOHOLD && sim->command != TRIGGER_HUMD_MEASURE_NOHOLD) {
+        return HTU21D_ERR_FAIL;
+    }
+    if (htu21d_port_time_us() < sim->ready_us) {
+        // Still converting: the sensor does not acknowledge its address.
+        return HTU21D_ERR_FAIL;
+    }
+
+    float raw;
+    uint16_t status;
+    if (sim->command == TRIGGER_TEMP_MEASURE_NOHOLD) {
+        raw = (sim->temperature + 46.85F) * 65536.0F / 175.72F;
+        status = 0x0;
+    } else {
+        raw = (sim->humidity + 6.0F) * 65536.0F / 125.0F;
+        status = 0x2;
+    }
+    uint16_t value = (sim_noisy(sim, raw) & 0xFFFC) | status;
+    uint8_t frame[3] = {value >> 8, value & 0xFF, sim_crc(value)};
+    if (sim_transaction_fails(sim, sim->crc_error_permille)) {
+        frame[2] ^= 0x01;
+    }
+    for (size_t i = 0; i < len; i++) {
+        data[i] = i < sizeof(frame) ? frame[i] : 0xFF;
+    }
+    // The result can only be read once.
+    sim->command = 0;
+
+    return HTU21D_ERR_OK;
+}
+
+static int sim_write_read(void *bus, uint8_t address, const uint8_t *write_data, size_t write_len,
+                          uint8_t *read_data, size_t read_len)
+{
+    htu21d_sim_t *sim = (htu21d_sim_t *) bus;
+
+    sim->transactions++;
+    if (address != HTU21D_ADDR || sim_transaction_fails(sim, sim->nack_permille)) {
+        return HTU21D_ERR_FAIL;
+    }
+    if (sim->model == HTU21D_MODEL_HTU31D) {
+        return (write_len == 1) ? sim_htu31d_read(sim, write_data[0], read_data, read_len) : HTU21D_ERR_FAIL;
+    }
+    if (write_len != 1 || write_data[0] != READ_USER_REG || read_len < 1) {
+        return HTU21D_ERR_FAIL;
+    }
+    read_data[0] = sim->user_register;
+
+    return HTU21D_ERR_OK;
+}
+
+static int sim_set_clock(void *bus, uint32_t clock_hz)
+{
+    ((htu21d_sim_t *) bus)->clock_hz = clock_hz;
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * Transport to a simulated sensor. The bus is a #htu21d_sim_t, which
+ * simulates one sensor at #HTU21D_ADDR.
+ */
+const htu21d_transport_t htu21d_sim_transport = {
+    .write = sim_write,
+    .read = sim_read,
+    .write_read = sim_write_read,
+    .set_clock = sim_set_clock,
+};
+
+/**
+ * @brief Starts a submission on a simulated bus, charging its cost.
+ */
+static void sim_bus_begin(htu21d_sim_bus_t *bus)
+{
+    bus->submissions++;
+    if (bus->submission_cost_us != 0) {
+        int64_t end_us = htu21d_port_time_us() + bus->submission_cost_us;
+        while (htu21d_port_time_us() < end_us) {
+        }
+    }
+}
+
+/**
+ * @brief Ends a submission: the multiplexer switches channels at the stop
+ * condition.
+ */
+static int sim_bus_end(htu21d_sim_bus_t *bus, int ret)
+{
+    bus->selected = bus->pending;
+    return ret;
+}
+
+static int sim_bus_transfer(htu21d_sim_bus_t *bus, const htu21d_transfer_t *transfer)
+{
+    if (transfer->address == HTU21D_SIM_MUX_ADDR) {
+        if (transfer->write_len != 0) {
+            bus->pending = transfer->write_data[0];
+        }
+        if (transfer->read_len != 0) {
+            transfer->read_data[0] = bus->pending;
+        }
+        return HTU21D_ERR_OK;
+    }
+
+    // A sensor answers only if its channel is the only one enabled, as they
+    // all have the same address.
+    uint8_t selected = bus->selected;
+    if (selected == 0 || (selected & (selected - 1)) != 0) {
+        return HTU21D_ERR_FAIL;
+    }
+    htu21d_sim_t *sim = bus->channels[__builtin_ctz(selected)];
+    if (sim == NULL) {
+        return HTU21D_ERR_FAIL;
+    }
+
+    if (transfer->read_len == 0) {
+        return sim_write(sim, transfer->address, transfer->write_data, transfer->write_len);
+    }
+    if (transfer->write_len == 0) {
+        return sim_read(sim, transfer->address, transfer->read_data, transfer->read_len);
+    }
+    return sim_write_read(sim, transfer->address, transfer->write_data, transfer->write_len,
+                          transfer->read_data, transfer->read_len);
+}
+
+static int sim_bus_write(void *bus, uint8_t address, const uint8_t *data, size_t len)
+{
+    const htu21d_transfer_t transfer = {
+        .address = address,
+        .write_data = data,
+        .write_len = len,
+    };
+
+    sim_bus_begin((htu21d_sim_bus_t *) bus);
+    return sim_bus_end((htu21d_sim_bus_t *) bus, sim_bus_transfer((htu21d_sim_bus_t *) bus, &transfer));
+}
+
+static int sim_bus_read(void *bus, uint8_t address, uint8_t *data, size_t len)
+{
+    const htu21d_transfer_t transfer = {
+        .address = address,
+        .read_data = data,
+        .read_len = len,
+    };
+
+    sim_bus_begin((htu21d_sim_bus_t *) bus);
+    return sim_bus_end((htu21d_sim_bus_t *) bus, sim_bus_transfer((htu21d_sim_bus_t *) bus, &transfer));
+}
+
+static int sim_bus_write_read(void *bus, uint8_t address, const uint8_t *write_data, size_t write_len,
+                              uint8_t *read_data, size_t read_len)
+{
+    const htu21d_transfer_t transfer = {
+        .address = address,
+        .write_data = write_data,
+        .write_len = write_len,
+        .read_data = read_data,
+        .read_len = read_len,
+    };
+
+    sim_bus_begin((htu21d_sim_bus_t *) bus);
+    return sim_bus_end((htu21d_sim_bus_t *) bus, sim_bus_transfer((htu21d_sim_bus_t *) bus, &transfer));
+}
+
+static int sim_bus_batch(void *bus, const htu21d_transfer_t *transfers, size_t count)
+{
+    htu21d_sim_bus_t *sim_bus = (htu21d_sim_bus_t *) bus;
+
+    sim_bus_begin(sim_bus);
+    for (size_t i = 0; i < count; i++) {
+        int ret = sim_bus_transfer(sim_bus, &transfers[i]);
+        if (ret != HTU21D_ERR_OK) {
+            // Like a real controller, stop at the first missing acknowledge.
+            return sim_bus_end(sim_bus, ret);
+        }
+    }
+    return sim_bus_end(sim_bus, HTU21D_ERR_OK);
+}
+
+static int sim_bus_set_clock(void *bus, uint32_t clock_hz)
+{
+    htu21d_sim_bus_t *sim_bus = (htu21d_sim_bus_t *) bus;
+
+    for (size_t i = 0; i < 8; i++) {
+        if (sim_bus->channels[i] != NULL) {
+            sim_bus->channels[i]->clock_hz = clock_hz;
+        }
+    }
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * Transport to a simulated bus. The bus is a #htu21d_sim_bus_t; attach the
+ * sensors with #htu21d_dev_attach_mux and a multiplexer at
+ * #HTU21D_SIM_MUX_ADDR.
+ */
+const htu21d_transport_t htu21d_sim_bus_transport = {
+    .write = sim_bus_write,
+    .read = sim_bus_read,
+    .write_read = sim_bus_write_read,
+    .batch = sim_bus_batch,
+    .set_clock = sim_bus_set_clock,
+};
+
+/**
+ * @brief Initializes a simulated bus, with no sensors and no submission cost.
+ * @param[out] bus The simulated bus.
+ */
+void htu21d_sim_bus_init(htu21d_sim_bus_t *bus)
+{
+    *bus = (htu21d_sim_bus_t) {
+        0
+    };
+}
+
+/**
+ * @brief Initializes a simulated HTU21D, without noise or faults. Set
+ * `model` afterwards to simulate an HTU31D.
+ * @param[out] sim The simulated sensor.
+ * @param temperature Simulated ambient temperature, in °C.
+ * @param humidity Simulated relative humidity, in %RH.
+ */
+void htu21d_sim_init(htu21d_sim_t *sim, float temperature, float humidity)
+{
+    *sim = (htu21d_sim_t) {
+        .temperature = temperature,
+        .humidity = humidity,
+        .clock_hz = 100000,
+        .user_register = SIM_USER_REGISTER_DEFAULT,
+        .serial = 0x31D0A5,
+        .random = 1,
+    };
+}
@@ -0,0 +1,88 @@
+/**
+ * @file htu21d_sim.h
+ * @brief Simulated HTU21D sensor, usable as an I2C transport.
+ *
+ * The simulator answers the commands of the driver like a real sensor: it
+ * keeps a user register, converts in the time the datasheet gives for the
+ * selected resolution (a read before the end of the conversion is not
+ * acknowledged), and returns values with a valid CRC. With `model` set to
+ * #HTU21D_MODEL_HTU31D, it answers the HTU31D commands instead: one
+ * conversion of both quantities, read back with a read command, the previous
+ * result being returned until the conversion is done. Optional noise and
+ * fault injection (NACKs, corrupted CRCs, a maximum SCL frequency) make it
+ * suitable for benchmarks and error-path testing without hardware, on ESP-IDF
+ * or on a host.
+ *
+ * #htu21d_sim_bus_t puts several simulated sensors behind a simulated PCA9548A
+ * multiplexer on one bus. It can charge a fixed time to every submission, to
+ * model the driver entry and bus locking that a real I2C driver costs per
+ * call, e.g. to measure what batching saves.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_SIM_H__
+#define __ESP_HTU21D_SIM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "htu21d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief State of a simulated sensor. Set the public members directly.
+ */
+typedef struct {
+    float temperature;          /**< Simulated ambient temperature, in °C. */
+    float humidity;             /**< Simulated relative humidity, in %RH. */
+    uint16_t noise_raw;         /**< Amplitude of the uniform noise added to each conversion, in raw counts. */
+    uint16_t nack_permille;     /**< Share of transactions that are not acknowledged, in 1/1000. */
+    uint16_t crc_error_permille; /**< Share of results returned with a corrupted CRC, in 1/1000. */
+    uint32_t max_clock_hz;      /**< Above this SCL frequency, as on a long cable, many transactions fail; 0 for no limit. */
+    uint32_t transactions;      /**< Number of transactions seen. */
+    uint8_t model;              /**< Simulated model, `HTU21D_MODEL_*`. */
+    uint32_t serial;            /**< Serial number of a simulated HTU31D, 24 bits. */
+    // private
+    uint32_t clock_hz;          /**< SCL frequency set through the transport. */
+    uint8_t user_register;      /**< Current user register. */
+    uint8_t command;            /**< Last command received. */
+    int64_t ready_us;           /**< When the conversion in progress is done. */
+    uint16_t results[2];        /**< HTU31D: temperature and humidity readable. */
+    uint16_t converting[2];     /**< HTU31D: temperature and humidity of the conversion in progress. */
+    uint32_t random;            /**< State of the pseudo-random generator. */
+} htu21d_sim_t;
+
+#define HTU21D_SIM_MUX_ADDR     0x70 /**< Address of the multiplexer of a #htu21d_sim_bus_t. */
+
+/**
+ * @brief A simulated bus: up to eight simulated sensors behind a PCA9548A
+ * multiplexer. Set the public members directly.
+ */
+typedef struct {
+    htu21d_sim_t *channels[8];      /**< Sensor on each multiplexer channel, or `NULL`. */
+    uint32_t submission_cost_us;    /**< Time spent (busy waiting) in each call to the transport. */
+    uint32_t submissions;           /**< Number of calls to the transport. */
+    // private
+    uint8_t selected;               /**< Channels enabled on the multiplexer. */
+    uint8_t pending;                /**< Channel mask written, enabled at the next stop condition. */
+} htu21d_sim_bus_t;
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_SIM
+extern const htu21d_transport_t htu21d_sim_transport;
+extern const htu21d_transport_t htu21d_sim_bus_transport;
+
+void htu21d_sim_init(htu21d_sim_t *sim, float temperature, float humidity);
+void htu21d_sim_bus_init(htu21d_sim_bus_t *bus);
+uint32_t htu21d_sim_conversion_time_us(uint8_t user_register, uint8_t command);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_SIM_H__
@@ -0,0 +1,302 @@
+/**
+ * @file htu21d_stats.c
+ * @brief Streaming statistics on the HTU21D sample stream.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <stddef.h>
+#include "htu21d.h"
+#include "htu21d_stats.h"
+
+/**
+ * @brief Sets the desired marker positions of a P² estimator for `count`
+ * values.
+ */
+static void p2_set_desired(htu21d_p2_t *estimator, uint32_t count)
+{
+    const float p = estimator->p;
+    const float fractions[5] = {0.0F, p / 2.0F, p, (1.0F + p) / 2.0F, 1.0F};
+
+    for (int i = 0; i < 5; i++) {
+        estimator->desired[i] = 1.0F + (float)(count - 1) * fractions[i];
+    }
+}
+
+/**
+ * @brief Initializes a P² quantile estimator.
+ *
+ * The P² algorithm (Jain & Chlamtac, 1985) tracks a quantile with five
+ * markers whose heights are adjusted by piecewise-parabolic interpolation as
+ * values are added, so it needs neither the values nor a sorted buffer.
+ * @param[out] estimator The estimator to initialize.
+ * @param p The quantile to estimate, in (0, 1), e.g. `0.95` for P95.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_p2_init(htu21d_p2_t *estimator, float p)
+{
+    if (estimator == NULL || !(p > 0.0F && p < 1.0F)) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *estimator = (htu21d_p2_t) {
+        .p = p,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Adds a value to a P² quantile estimator.
+ * @param estimator An initialized estimator.
+ * @param value The value, raw or converted.
+ */
+void htu21d_p2_add(htu21d_p2_t *estimator, float value)
+{
+    float *q = estimator->heights;
+    int32_t *n = estimator->positions;
+
+    if (estimator->count < 5) {
+        // Keep the first values sorted until the markers can be placed.
+        int i = estimator->count++;
+        for (; i > 0 && q[i - 1] > value; i--) {
+            q[i] = q[i - 1];
+        }
+        q[i] = value;
+        if (estimator->count == 5) {
+            // The markers start on the five sorted values, whatever `p`.
+            p2_set_desired(estimator, 5);
+            for (int j = 0; j < 5; j++) {
+                estimator->positions[j] = j + 1;
+            }
+        }
+        return;
+    }
+
+    // Find the cell of the value, stretching the extreme markers if needed.
+    int k;
+    if (value < q[0]) {
+        q[0] = value;
+        k = 0;
+    } else if (value >= q[4]) {
+        q[4] = value;
+        k = 3;
+    } else {
+        for (k = 0; k < 3 && value >= q[k + 1]; k++) {
+        }
+    }
+
+    estimator->count++;
+    for (int i = k + 1; i < 5; i++) {
+        n[i]++;
+    }
+    const float p = estimator->p;
+    const float increments[5] = {0.0F, p / 2.0F, p, (1.0F + p) / 2.0F, 1.0F};
+    for (int i = 0; i < 5; i++) {
+        estimator->desired[i] += increments[i];
+    }
+
+    // Move the middle markers towards their desired positions.
+    for (int i = 1; i < 4; i++) {
+        float d = estimator->desired[i] - (float) n[i];
+        if ((d >= 1.0F && n[i + 1] - n[i] > 1) || (d <= -1.0F && n[i - 1] - n[i] < -1)) {
+            int ds = d > 0.0F ? 1 : -1;
+            float parabolic = q[i] + (float) ds / (float)(n[i + 1] - n[i - 1]) *
+                              ((float)(n[i] - n[i - 1] + ds) * (q[i + 1] - q[i]) / (float)(n[i + 1] - n[i]) +
+                               (float)(n[i + 1] - n[i] - ds) * (q[i] - q[i - 1]) / (float)(n[i] - n[i - 1]));
+            if (q[i - 1] < parabolic && parabolic < q[i + 1]) {
+                q[i] = parabolic;
+            } else {
+                q[i] += (float) ds * (q[i + ds] - q[i]) / (float)(n[i + ds] - n[i]);
+            }
+            n[i] += ds;
+        }
+    }
+}
+
+/**
+ * @brief Returns the current estimate of the quantile.
+ * @param estimator An initialized estimator.
+ * @return Returns the estimated quantile, or `0` if no value was added.
+ */
+float htu21d_p2_get(const htu21d_p2_t *estimator)
+{
+    if (estimator->count == 0) {
+        return 0.0F;
+    }
+    if (estimator->count < 5) {
+        return estimator->heights[(int)(estimator->p * (float)(estimator->count - 1) + 0.5F)];
+    }
+
+    return estimator->heights[2];
+}
+
+/**
+ * @brief Merges the values summarized by `src` into `dst`.
+ *
+ * P² keeps no values, so the merge is an approximation: the marker heights
+ * are averaged, weighted by the number of values of each side, the extremes
+ * are the overall minimum and maximum, and the markers are repositioned for
+ * the combined count. The merged estimate is close to the true quantile when
+ * both sides come from similar distributions (e.g. consecutive hours, or
+ * sensors in the same zone). Use #htu21d_histogram_merge when an exact merge
+ * is needed.
+ * @param dst The estimator to merge into.
+ * @param[in] src The estimator to merge from, left untouched.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if the
+ * estimators do not track the same quantile.
+ */
+int htu21d_p2_merge(htu21d_p2_t *dst, const htu21d_p2_t *src)
+{
+    if (dst == NULL || src == NULL || dst->p != src->p) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    if (src->count < 5) {
+        for (uint32_t i = 0; i < src->count; i++) {
+            htu21d_p2_add(dst, src->heights[i]);
+        }
+        return HTU21D_ERR_OK;
+    }
+    if (dst->count < 5) {
+        htu21d_p2_t small = *dst;
+        *dst = *src;
+        for (uint32_t i = 0; i < small.count; i++) {
+            htu21d_p2_add(dst, small.heights[i]);
+        }
+        return HTU21D_ERR_OK;
+    }
+
+    float weight_dst = (float) dst->count;
+    float weight_src = (float) src->count;
+    for (int i = 1; i < 4; i++) {
+        dst->heights[i] = (dst->heights[i] * weight_dst + src->heights[i] * weight_src) /
+                          (weight_dst + weight_src);
+    }
+    if (src->heights[0] < dst->heights[0]) {
+        dst->heights[0] = src->heights[0];
+    }
+    if (src->heights[4] > dst->heights[4]) {
+        dst->heights[4] = src->heights[4];
+    }
+    dst->count += src->count;
+    // The merged markers are placed where their quantiles should be, but P²
+    // needs strictly increasing positions: at small counts and extreme `p`,
+    // rounding alone would put several markers on the same position.
+    p2_set_desired(dst, dst->count);
+    int32_t total = (int32_t) dst->count;
+    for (int i = 0; i < 5; i++) {
+        int32_t position = (int32_t)(dst->desired[i] + 0.5F);
+        int32_t lowest = (i == 0) ? 1 : dst->positions[i - 1] + 1;
+        int32_t highest = total - (4 - i);
+        position = (position < highest) ? position : highest;
+        dst->positions[i] = (position > lowest) ? position : lowest;
+    }
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Initializes a fixed-bin histogram of raw readings.
+ *
+ * For example, `min_raw = 0` and `bin_shift = 10` spreads the 64 default
+ * bins over the whole 16-bit raw range, about 2 %RH or 2.7 °C per bin.
+ * @param[out] histogram The histogram to initialize.
+ * @param min_raw Lower bound of the first bin.
+ * @param bin_shift Bin width is `1 << bin_shift` raw counts, at most 15.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid.
+ */
+int htu21d_histogram_init(htu21d_histogram_t *histogram, uint16_t min_raw, uint8_t bin_shift)
+{
+    if (histogram == NULL || bin_shift > 15) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    *histogram = (htu21d_histogram_t) {
+        .min_raw = min_raw,
+        .bin_shift = bin_shift,
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Counts a raw reading in the histogram.
+ * @param histogram An initialized histogram.
+ * @param raw The raw reading.
+ */
+void htu21d_histogram_add(htu21d_histogram_t *histogram, uint16_t raw)
+{
+    histogram->total++;
+    if (raw < histogram->min_raw) {
+        histogram->underflow++;
+        return;
+    }
+
+    uint32_t bin = (uint32_t)(raw - histogram->min_raw) >> histogram->bin_shift;
+    if (bin >= HTU21D_HISTOGRAM_BINS) {
+        histogram->overflow++;
+        return;
+    }
+    histogram->counts[bin]++;
+}
+
+/**
+ * @brief Adds the counts of `src` to `dst`. The merge is exact.
+ * @param dst The histogram to merge into.
+ * @param[in] src The histogram to merge from, left untouched.
+ * @return Returns #HTU21D_ERR_OK on success, or #HTU21D_ERR_INVALID_ARG if the
+ * histograms do not have the same bins.
+ */
+int htu21d_histogram_merge(htu21d_histogram_t *dst, const htu21d_histogram_t *src)
+{
+    if (dst == NULL || src == NULL || dst->min_raw != src->min_raw || dst->bin_shift != src->bin_shift) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < HTU21D_HISTOGRAM_BINS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->underflow += src->underflow;
+    dst->overflow += src->overflow;
+    dst->total += src->total;
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Estimates a quantile from the histogram.
+ *
+ * Values are assumed to be spread evenly within their bin, so the error is at
+ * most one bin width.
+ * @param histogram An initialized histogram.
+ * @param p The quantile, in [0, 1].
+ * @return Returns the estimated quantile as a raw value. Under- and overflows
+ * are reported at the lower and upper bound of the histogram. Returns `0` if
+ * the histogram is empty.
+ */
+float htu21d_histogram_quantile(const htu21d_histogram_t *histogram, float p)
+{
+    if (histogram->total == 0) {
+        return 0.0F;
+    }
+
+    float rank = p * (float) histogram->total;
+    float seen = (float) histogram->underflow;
+    if (rank <= seen) {
+        return (float) histogram->min_raw;
+    }
+
+    float width = (float)(1U << histogram->bin_shift);
+    for (int i = 0; i < HTU21D_HISTOGRAM_BINS; i++) {
+        float count = (float) histogram->counts[i];
+        if (count > 0.0F && rank <= seen + count) {
+            return (float) histogram->min_raw + width * ((float) i + (rank - seen) / count);
+        }
+        seen += count;
+    }
+
+    return (float) histogram->min_raw + width * HTU21D_HISTOGRAM_BINS;
+}
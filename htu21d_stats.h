@@ -0,0 +1,76 @@
+/**
+ * @file htu21d_stats.h
+ * @brief Streaming statistics on the HTU21D sample stream.
+ *
+ * Both estimators use a fixed amount of memory per metric, whatever the
+ * number of samples, and can be merged: e.g. hourly estimators into a daily
+ * one, or the estimators of several sensors into a zone-wide one.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __ESP_HTU21D_STATS_H__
+#define __ESP_HTU21D_STATS_H__
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#ifndef HTU21D_HISTOGRAM_BINS
+#define HTU21D_HISTOGRAM_BINS   64 /**< Number of bins of a #htu21d_histogram_t. */
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief P² (piecewise-parabolic) estimator of a single quantile.
+ *
+ * Treat the members as private.
+ */
+typedef struct {
+    float p;              /**< The quantile estimated, in (0, 1), e.g. `0.95`. */
+    uint32_t count;       /**< Number of values added. */
+    float heights[5];     /**< Marker heights (the first values while `count < 5`). */
+    int32_t positions[5]; /**< Marker positions, 1-based. */
+    float desired[5];     /**< Desired marker positions. */
+} htu21d_p2_t;
+
+/**
+ * @brief Histogram of raw readings with fixed, power-of-two sized bins.
+ *
+ * Bin `i` counts the raw values in
+ * `[min_raw + (i << bin_shift), min_raw + ((i + 1) << bin_shift))`.
+ * Treat the members as private.
+ */
+typedef struct {
+    uint16_t min_raw;                         /**< Lower bound of the first bin. */
+    uint8_t bin_shift;                        /**< Bin width is `1 << bin_shift` raw counts. */
+    uint32_t underflow;                       /**< Values below `min_raw`. */
+    uint32_t overflow;                        /**< Values above the last bin. */
+    uint32_t total;                           /**< Number of values added, including under/overflow. */
+    uint32_t counts[HTU21D_HISTOGRAM_BINS];   /**< Per-bin counts. */
+} htu21d_histogram_t;
+
+#if !defined(ESP_PLATFORM) || CONFIG_HTU21D_STATS
+int htu21d_p2_init(htu21d_p2_t *estimator, float p);
+void htu21d_p2_add(htu21d_p2_t *estimator, float value);
+float htu21d_p2_get(const htu21d_p2_t *estimator);
+int htu21d_p2_merge(htu21d_p2_t *dst, const htu21d_p2_t *src);
+
+int htu21d_histogram_init(htu21d_histogram_t *histogram, uint16_t min_raw, uint8_t bin_shift);
+void htu21d_histogram_add(htu21d_histogram_t *histogram, uint16_t raw);
+int htu21d_histogram_merge(htu21d_histogram_t *dst, const htu21d_histogram_t *src);
+float htu21d_histogram_quantile(const htu21d_histogram_t *histogram, float p);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ESP_HTU21D_STATS_H__
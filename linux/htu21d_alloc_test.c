@@ -0,0 +1,203 @@
+/**
+ * @file htu21d_alloc_test.c
+ * @brief Checks that the component does not allocate after initialization,
+ * as `CONFIG_HTU21D_STATIC_ALLOCATION` promises. Run with `ctest`.
+ *
+ * `malloc()`, `calloc()` and `realloc()` are interposed. Once the sensors,
+ * buses and stream processors are set up, the interposer is armed, and the
+ * measurement paths run on simulated sensors (see htu21d_sim.h): single
+ * reads of an HTU21D and an HTU31D, batches behind a multiplexer, the i2c-dev
+ * transport on the `ioctl()` mock of htu21d_linux_mock.h, settings updates,
+ * fusion, and the filters, detectors, statistics and resampler. Any
+ * allocation while armed fails the test.
+ *
+ * It is built twice: against the default library, and against one compiled
+ * with `CONFIG_HTU21D_STATIC_ALLOCATION` (`htu21d-alloc-test-static`), where
+ * the batch of three sensors behind the multiplexer no longer fits one
+ * submission of #HTU21D_BATCH_MAX_TRANSFERS and is split.
+ *
+ * The FreeRTOS parts (sampler, pipeline) and the ESP-IDF I2C drivers, with
+ * their static command links, do not build on a host and are not covered.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "htu21d_detect.h"
+#include "htu21d_filter.h"
+#include "htu21d_fusion.h"
+#include "htu21d_linux.h"
+#include "htu21d_linux_mock.h"
+#include "htu21d_port.h"
+#include "htu21d_resample.h"
+#include "htu21d_settings.h"
+#include "htu21d_sim.h"
+#include "htu21d_stats.h"
+
+#define ROUNDS  3 /**< Passes over the measurement paths. */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static atomic_bool armed;
+static atomic_uint allocations;
+static void *first_caller;
+static size_t first_size;
+
+/**
+ * @brief Counts an allocation made while armed, and remembers the first one.
+ */
+static void count_allocation(void *caller, size_t size)
+{
+    if (atomic_load(&armed) && atomic_fetch_add(&allocations, 1) == 0) {
+        first_caller = caller;
+        first_size = size;
+    }
+}
+
+void *malloc(size_t size)
+{
+    count_allocation(__builtin_return_address(0), size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    count_allocation(__builtin_return_address(0), count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count_allocation(__builtin_return_address(0), size);
+    return __libc_realloc(ptr, size);
+}
+
+int main(void)
+{
+    enum { SENSORS = 3 };
+    htu21d_sim_t sim, sim31, bus_sims[SENSORS];
+    htu21d_sim_bus_t sim_bus;
+    htu21d_mux_t mux;
+    htu21d_dev_t dev, dev31, bus_devs[SENSORS], linux_dev;
+    htu21d_dev_t *bus_list[SENSORS];
+    htu21d_linux_bus_t linux_bus;
+
+    // Initialization: allocations are allowed.
+    htu21d_sim_init(&sim, 21.0F, 45.0F);
+    htu21d_sim_init(&sim31, 22.0F, 50.0F);
+    sim31.model = HTU21D_MODEL_HTU31D;
+    htu21d_sim_bus_init(&sim_bus);
+    htu21d_mux_init(&mux, &htu21d_sim_bus_transport, &sim_bus, HTU21D_SIM_MUX_ADDR);
+    if (htu21d_dev_attach(&dev, &htu21d_sim_transport, &sim) != HTU21D_ERR_OK ||
+            htu21d_dev_attach(&dev31, &htu21d_sim_transport, &sim31) != HTU21D_ERR_OK) {
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < SENSORS; i++) {
+        htu21d_sim_init(&bus_sims[i], 20.0F + (float) i, 50.0F);
+        sim_bus.channels[i] = &bus_sims[i];
+        if (htu21d_dev_attach_mux(&bus_devs[i], &mux, (uint8_t) i) != HTU21D_ERR_OK) {
+            return EXIT_FAILURE;
+        }
+        bus_list[i] = &bus_devs[i];
+    }
+    htu21d_sim_t linux_sim;
+    htu21d_sim_init(&linux_sim, 23.0F, 55.0F);
+    htu21d_linux_mock_init(&htu21d_sim_transport, &linux_sim);
+    if (htu21d_linux_bus_open(&linux_bus, "/dev/null") != HTU21D_ERR_OK ||
+            htu21d_dev_attach(&linux_dev, &htu21d_linux_transport, &linux_bus) != HTU21D_ERR_OK) {
+        return EXIT_FAILURE;
+    }
+
+    htu21d_settings_buffer_t settings_buffer;
+    htu21d_settings_t settings = {0};
+    uint32_t generation = 0;
+    htu21d_settings_init(&settings_buffer, &settings);
+
+    htu21d_fusion_t fusion;
+    const htu21d_fusion_config_t fusion_config = {
+        .mad_threshold = 3.0F,
+        .min_mad_temperature = 0.2F,
+        .min_mad_humidity = 1.0F,
+        .demote_after = 3,
+    };
+    htu21d_fusion_init(&fusion, &fusion_config);
+    for (int i = 0; i < SENSORS; i++) {
+        htu21d_fusion_add_member(&fusion, bus_list[i]);
+    }
+
+    htu21d_lead_t lead;
+    const htu21d_lead_config_t lead_config = {.tau_s = HTU21D_RH_TIME_CONSTANT_S, .noise_tau_s = 1.0F};
+    htu21d_lead_init(&lead, &lead_config);
+    htu21d_zscore_t zscore;
+    const htu21d_zscore_config_t zscore_config = {.alpha_shift = 5, .threshold_q4 = 48, .warmup = 4};
+    htu21d_zscore_init(&zscore, &zscore_config);
+    htu21d_cusum_t cusum;
+    const htu21d_cusum_config_t cusum_config = {.slack = 25, .threshold = 200, .warmup = 4};
+    htu21d_cusum_init(&cusum, &cusum_config);
+    htu21d_trend_t trend;
+    const htu21d_trend_config_t trend_config = {.window = 3, .threshold = 7000, .horizon_s = 1800};
+    htu21d_trend_init(&trend, &trend_config);
+    htu21d_p2_t p2;
+    htu21d_p2_init(&p2, 0.95F);
+    htu21d_histogram_t histogram;
+    htu21d_histogram_init(&histogram, 0, 10);
+    htu21d_resampler_t resampler;
+    const htu21d_resampler_config_t resampler_config = {.period_us = 10000};
+    htu21d_resampler_init(&resampler, &resampler_config);
+
+    // Measurement: no allocation allowed.
+    atomic_store(&armed, true);
+    int errors = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        htu21d_sample_t sample;
+        errors += htu21d_dev_read_raw_sample(&dev, &sample) != HTU21D_ERR_OK;
+        htu21d_dev_convert_sample(&dev, &sample);
+        errors += htu21d_dev_read_raw_sample(&dev31, &sample) != HTU21D_ERR_OK;
+        errors += htu21d_dev_read_raw_sample(&linux_dev, &sample) != HTU21D_ERR_OK;
+
+        uint16_t raw_values[SENSORS];
+        int results[SENSORS];
+        errors += htu21d_batch_trigger(bus_list, SENSORS, TRIGGER_TEMP_MEASURE_NOHOLD, NULL, results) != HTU21D_ERR_OK;
+        htu21d_port_delay_ms(HTU21D_CONVERSION_TIME_MS);
+        errors += htu21d_batch_fetch(bus_list, SENSORS, raw_values, NULL, results) != HTU21D_ERR_OK;
+
+        htu21d_fused_sample_t fused;
+        errors += htu21d_fusion_read(&fusion, &fused) != HTU21D_ERR_OK;
+
+        settings.resolution = (round & 1) ? 0x81 : 0x00;
+        htu21d_settings_publish(&settings_buffer, &settings);
+        if (htu21d_settings_read(&settings_buffer, &generation, &settings)) {
+            errors += htu21d_dev_apply_settings(&dev, &settings) != HTU21D_ERR_OK;
+        }
+
+        htu21d_grid_point_t points[4];
+        int32_t humidity_centi = htu21d_raw_to_humidity_centi(raw_values[0]);
+        sample.timestamp_us = (int64_t) round * 1000000;
+        htu21d_lead_update(&lead, sample.humidity, sample.timestamp_us);
+        htu21d_zscore_update(&zscore, humidity_centi, sample.timestamp_us);
+        htu21d_cusum_update(&cusum, humidity_centi, sample.timestamp_us);
+        htu21d_trend_update(&trend, humidity_centi, sample.timestamp_us);
+        htu21d_p2_add(&p2, sample.temperature);
+        htu21d_histogram_add(&histogram, raw_values[0]);
+        htu21d_resampler_push(&resampler, &sample, points, 4);
+        htu21d_dev_log_errors(&dev, "alloc", 0);
+    }
+    atomic_store(&armed, false);
+
+    htu21d_linux_bus_close(&linux_bus);
+    if (errors != 0) {
+        fprintf(stderr, "%d measurements failed\n", errors);
+        return EXIT_FAILURE;
+    }
+    if (atomic_load(&allocations) != 0) {
+        fprintf(stderr, "%u allocations after initialization, the first of %zu bytes from %p\n",
+                atomic_load(&allocations), first_size, first_caller);
+        return EXIT_FAILURE;
+    }
+    printf("No allocation after initialization (HTU21D_BATCH_MAX_TRANSFERS %d)\n", HTU21D_BATCH_MAX_TRANSFERS);
+    return EXIT_SUCCESS;
+}
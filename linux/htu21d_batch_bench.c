@@ -0,0 +1,131 @@
+/**
+ * @file htu21d_batch_bench.c
+ * @brief Measures what batched transactions save per sensor, on the simulator.
+ *
+ * Usage:
+ *
+ *     htu21d-batch-bench [-n sensors] [-c cost_us] [-s scans]
+ *
+ * Up to eight simulated sensors sit behind a simulated PCA9548A on one bus
+ * (see htu21d_sim.h). Each transport call is charged `cost_us` of busy time,
+ * modelling the fixed cost of a driver call on a real bus (driver entry,
+ * locking, interrupt and wake-up). The sensors are scanned (temperature then
+ * humidity) `scans` times one by one with #htu21d_dev_trigger and
+ * #htu21d_dev_fetch, then with #htu21d_batch_trigger and #htu21d_batch_fetch.
+ * For each mode, the program prints the transport calls per scan and the time
+ * spent in them per sensor.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "htu21d_port.h"
+#include "htu21d_sim.h"
+
+typedef struct {
+    htu21d_dev_t *devs[8];
+    uint16_t raw_values[8];
+    int results[8];
+    size_t count;
+    bool batched;
+} scan_t;
+
+/**
+ * @brief Runs one conversion on all sensors, returns the time spent on the bus.
+ */
+static int64_t scan_channel(scan_t *scan, uint8_t command)
+{
+    int64_t start_us = htu21d_port_time_us();
+    if (scan->batched) {
+        htu21d_batch_trigger(scan->devs, scan->count, command, NULL, scan->results);
+    } else {
+        for (size_t i = 0; i < scan->count; i++) {
+            scan->results[i] = htu21d_dev_trigger(scan->devs[i], command, NULL);
+        }
+    }
+    int64_t busy_us = htu21d_port_time_us() - start_us;
+
+    htu21d_port_delay_ms(HTU21D_CONVERSION_TIME_MS);
+
+    start_us = htu21d_port_time_us();
+    if (scan->batched) {
+        htu21d_batch_fetch(scan->devs, scan->count, scan->raw_values, NULL, scan->results);
+    } else {
+        for (size_t i = 0; i < scan->count; i++) {
+            scan->results[i] = htu21d_dev_fetch(scan->devs[i], &scan->raw_values[i], NULL);
+        }
+    }
+    busy_us += htu21d_port_time_us() - start_us;
+
+    for (size_t i = 0; i < scan->count; i++) {
+        if (scan->results[i] != HTU21D_ERR_OK) {
+            fprintf(stderr, "Sensor %zu failed, error 0x%02X\n", i, scan->results[i]);
+        }
+    }
+    return busy_us;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int sensors = 8, cost_us = 100, scans = 20;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:c:s:")) != -1) {
+        switch (option) {
+        case 'n':
+            sensors = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            cost_us = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            scans = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n sensors] [-c cost_us] [-s scans]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (sensors == 0 || sensors > 8 || scans == 0) {
+        fprintf(stderr, "sensors must be 1 to 8, scans at least 1\n");
+        return EXIT_FAILURE;
+    }
+
+    htu21d_sim_t sims[8];
+    htu21d_sim_bus_t bus;
+    htu21d_mux_t mux;
+    htu21d_dev_t devs[8];
+    scan_t scan = {
+        .count = sensors,
+    };
+
+    htu21d_sim_bus_init(&bus);
+    htu21d_mux_init(&mux, &htu21d_sim_bus_transport, &bus, HTU21D_SIM_MUX_ADDR);
+    for (unsigned int i = 0; i < sensors; i++) {
+        htu21d_sim_init(&sims[i], 20.0F + (float) i, 50.0F);
+        bus.channels[i] = &sims[i];
+        if (htu21d_dev_attach_mux(&devs[i], &mux, (uint8_t) i) != HTU21D_ERR_OK) {
+            return EXIT_FAILURE;
+        }
+        scan.devs[i] = &devs[i];
+    }
+    bus.submission_cost_us = cost_us;
+
+    printf("%u sensors behind a multiplexer, %u us per transport call, %u scans\n", sensors, cost_us, scans);
+    printf("%-8s %16s %16s\n", "mode", "calls/scan", "us/sensor/scan");
+    for (int batched = 0; batched <= 1; batched++) {
+        scan.batched = batched;
+        bus.submissions = 0;
+        int64_t busy_us = 0;
+        for (unsigned int i = 0; i < scans; i++) {
+            busy_us += scan_channel(&scan, TRIGGER_TEMP_MEASURE_NOHOLD);
+            busy_us += scan_channel(&scan, TRIGGER_HUMD_MEASURE_NOHOLD);
+        }
+        printf("%-8s %16.1f %16.1f\n", batched ? "batched" : "single",
+               (double) bus.submissions / scans, (double) busy_us / scans / sensors);
+    }
+
+    return EXIT_SUCCESS;
+}
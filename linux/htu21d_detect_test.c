@@ -0,0 +1,178 @@
+/**
+ * @file htu21d_detect_test.c
+ * @brief Tests of the detectors of htu21d_detect.h run on samples, as the
+ * processing stage of the pipeline runs them through
+ * #htu21d_detectors_update. Run with `ctest`.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "htu21d.h"
+#include "htu21d_detect.h"
+
+#define PERIOD_US   1000000 /**< One sample per second. */
+
+static int failures;
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if (!(condition)) {                                                 \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+/**
+ * @brief Events received by `on_event`, per type, and the latest one.
+ */
+typedef struct {
+    int count[HTU21D_EVENT_TREND_FALLING + 1];
+    htu21d_event_t last;
+} events_t;
+
+static void on_event(const htu21d_event_t *event, void *user_ctx)
+{
+    events_t *events = (events_t *) user_ctx;
+
+    events->count[event->type]++;
+    events->last = *event;
+}
+
+/**
+ * @brief Feeds sample `index`, with the given humidity, and returns whether an
+ * event was raised.
+ */
+static bool feed(const htu21d_detectors_t *detectors, uint32_t index, float humidity)
+{
+    const htu21d_sample_t sample = {
+        .humidity = humidity,
+        .temperature = 21.5F,
+        .timestamp_us = (int64_t) index * PERIOD_US,
+    };
+    return htu21d_detectors_update(detectors, &sample);
+}
+
+static void test_step(void)
+{
+    events_t events = {0};
+    htu21d_zscore_t zscore;
+    htu21d_cusum_t cusum;
+    const htu21d_zscore_config_t zscore_config = {
+        .alpha_shift = 5, .threshold_q4 = 48, .warmup = 32, .min_deviation = 20,
+        .callback = on_event, .user_ctx = &events,
+    };
+    const htu21d_cusum_config_t cusum_config = {
+        .slack = 25, .threshold = 200, .warmup = 32,
+        .callback = on_event, .user_ctx = &events,
+    };
+    CHECK(htu21d_zscore_init(&zscore, &zscore_config) == HTU21D_ERR_OK);
+    CHECK(htu21d_cusum_init(&cusum, &cusum_config) == HTU21D_ERR_OK);
+    const htu21d_detectors_t detectors = {
+        .quantity = HTU21D_DETECT_HUMIDITY, .zscore = &zscore, .cusum = &cusum,
+    };
+
+    // 50 %RH with +-0.05 %RH of noise: nothing to report.
+    uint32_t index = 0;
+    for (; index < 200; index++) {
+        CHECK(!feed(&detectors, index, 50.0F + (float)((int)(index % 3) - 1) * 0.05F));
+    }
+
+    // A jump to 55 %RH: the z-score reacts at once, the CUSUM soon after.
+    CHECK(feed(&detectors, index, 55.0F));
+    CHECK(events.count[HTU21D_EVENT_ZSCORE_HIGH] == 1);
+    CHECK(events.last.timestamp_us == (int64_t) index * PERIOD_US);
+    CHECK(events.last.value == 5500);
+    for (index++; index < 210; index++) {
+        feed(&detectors, index, 55.0F);
+    }
+    CHECK(events.count[HTU21D_EVENT_CUSUM_UP] >= 1);
+    CHECK(events.count[HTU21D_EVENT_ZSCORE_LOW] == 0 && events.count[HTU21D_EVENT_CUSUM_DOWN] == 0);
+}
+
+static void test_trend(void)
+{
+    events_t events = {0};
+    htu21d_trend_t trend;
+    const htu21d_trend_config_t trend_config = {
+        .window = 16, .threshold = 7000, .horizon_s = 600,
+        .callback = on_event, .user_ctx = &events,
+    };
+    CHECK(htu21d_trend_init(&trend, &trend_config) == HTU21D_ERR_OK);
+    const htu21d_detectors_t detectors = {
+        .quantity = HTU21D_DETECT_HUMIDITY, .trend = &trend,
+    };
+
+    // Rising by 0.01 %RH a second from 50 %RH: 70 %RH is reached at 2000 s,
+    // so the warning is due at 1400 s, 600 s ahead.
+    uint32_t warned = 0;
+    for (uint32_t index = 0; index < 2000 && warned == 0; index++) {
+        if (feed(&detectors, index, 50.0F + (float) index / 100.0F)) {
+            warned = index;
+        }
+    }
+    CHECK(events.count[HTU21D_EVENT_TREND_RISING] == 1);
+    CHECK(warned >= 1395 && warned <= 1405);
+    CHECK(events.last.statistic <= 600);
+}
+
+static void test_quantity(void)
+{
+    events_t events = {0};
+    htu21d_cusum_t cusum;
+    // No slack and a target of 0: any other value raises an event that
+    // carries the value the detector was given.
+    const htu21d_cusum_config_t cusum_config = {
+        .target = 0, .slack = 0, .threshold = 1,
+        .callback = on_event, .user_ctx = &events,
+    };
+    htu21d_detectors_t detectors = {.cusum = &cusum};
+    const htu21d_sample_t sample = {
+        .raw_temperature = 0x6A4C,
+        .raw_humidity = 0x7C80,
+        .temperature = 26.04F,
+        .humidity = 54.63F,
+    };
+    const struct {
+        htu21d_detect_quantity_t quantity;
+        int32_t value;
+    } cases[] = {
+        {HTU21D_DETECT_HUMIDITY, 5463},
+        {HTU21D_DETECT_TEMPERATURE, 2604},
+        {HTU21D_DETECT_RAW_HUMIDITY, 0x7C80},
+        {HTU21D_DETECT_RAW_TEMPERATURE, 0x6A4C},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        CHECK(htu21d_cusum_init(&cusum, &cusum_config) == HTU21D_ERR_OK);
+        detectors.quantity = cases[i].quantity;
+        CHECK(htu21d_detectors_update(&detectors, &sample));
+        CHECK(events.last.value == cases[i].value);
+    }
+
+    // Negative temperatures round to the nearest hundredth too.
+    const htu21d_sample_t cold = {.temperature = -12.34F};
+    CHECK(htu21d_cusum_init(&cusum, &cusum_config) == HTU21D_ERR_OK);
+    detectors.quantity = HTU21D_DETECT_TEMPERATURE;
+    CHECK(htu21d_detectors_update(&detectors, &cold));
+    CHECK(events.last.type == HTU21D_EVENT_CUSUM_DOWN && events.last.value == -1234);
+
+    // No detectors set: nothing to do.
+    const htu21d_detectors_t none = {.quantity = HTU21D_DETECT_HUMIDITY};
+    CHECK(!htu21d_detectors_update(&none, &sample));
+}
+
+int main(void)
+{
+    test_step();
+    test_trend();
+    test_quantity();
+
+    if (failures != 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
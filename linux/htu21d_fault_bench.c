@@ -0,0 +1,163 @@
+/**
+ * @file htu21d_fault_bench.c
+ * @brief Measures the latency of measurements on a faulty bus, with errors
+ * logged one by one or summarized at a bounded rate.
+ *
+ * Usage:
+ *
+ *     htu21d-fault-bench [-n measurements] [-N nack_permille] [-C crc_permille]
+ *                        [-b baud] [-i interval_ms]
+ *
+ * A simulated sensor (see htu21d_sim.h) fails the given share of transactions
+ * and of CRCs. Each measurement triggers a conversion and reads it back with
+ * #htu21d_dev_trigger and #htu21d_dev_fetch; the conversion time itself is
+ * skipped, only the time spent in the driver is measured.
+ *
+ * The log output (stderr) goes to a simulated serial console, which prints
+ * `baud / 10` characters per second through a 4 KiB buffer: once the buffer is
+ * full, logging blocks like a console UART does. After each measurement,
+ * #htu21d_dev_log_errors is called with `interval_ms`. With `-i 0`, this
+ * prints a line after every failed measurement, as logging in the transaction
+ * path did. A last summary is logged after the measurements. The program
+ * prints the latency percentiles and the number of log lines.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "htu21d_port.h"
+#include "htu21d_sim.h"
+
+#define CONSOLE_BUFFER_SIZE 4096
+
+static unsigned int console_baud = 115200;
+
+/**
+ * @brief Drains the console pipe at the speed of the simulated UART.
+ */
+static void *console_thread(void *arg)
+{
+    int fd = *(int *) arg;
+    char buffer[64];
+    ssize_t len;
+
+    while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+        // 10 bits per character: start, 8 data bits, stop.
+        int64_t end_us = htu21d_port_time_us() + (int64_t) len * 10 * 1000000 / console_baud;
+        while (htu21d_port_time_us() < end_us) {
+            usleep(50);
+        }
+    }
+    return NULL;
+}
+
+static int compare_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int measurements = 20000, nack_permille = 50, crc_permille = 50, interval_ms = 1000;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:N:C:b:i:")) != -1) {
+        switch (option) {
+        case 'n':
+            measurements = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'N':
+            nack_permille = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'C':
+            crc_permille = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            console_baud = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'i':
+            interval_ms = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n measurements] [-N nack_permille] [-C crc_permille] [-b baud] "
+                    "[-i interval_ms]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (measurements == 0 || console_baud == 0 || nack_permille > 1000 || crc_permille > 1000) {
+        fprintf(stderr, "measurements and baud must be at least 1, permilles at most 1000\n");
+        return EXIT_FAILURE;
+    }
+
+    htu21d_sim_t sim;
+    htu21d_dev_t dev;
+    htu21d_sim_init(&sim, 21.0F, 45.0F);
+    if (htu21d_dev_attach(&dev, &htu21d_sim_transport, &sim) != HTU21D_ERR_OK) {
+        return EXIT_FAILURE;
+    }
+    sim.nack_permille = (uint16_t) nack_permille;
+    sim.crc_error_permille = (uint16_t) crc_permille;
+
+    int console[2];
+    pthread_t thread;
+    if (pipe(console) != 0) {
+        perror("pipe");
+        return EXIT_FAILURE;
+    }
+    fcntl(console[1], F_SETPIPE_SZ, CONSOLE_BUFFER_SIZE);
+    fflush(stderr);
+    dup2(console[1], STDERR_FILENO);
+    close(console[1]);
+    setvbuf(stderr, NULL, _IONBF, 0);
+    pthread_create(&thread, NULL, console_thread, &console[0]);
+
+    int64_t *latencies_us = malloc(measurements * sizeof(*latencies_us));
+    unsigned int failed = 0, lines = 0;
+    int64_t failed_us = 0;
+    if (latencies_us == NULL) {
+        return EXIT_FAILURE;
+    }
+    int64_t start_us = htu21d_port_time_us();
+    for (unsigned int i = 0; i < measurements; i++) {
+        uint8_t command = (i & 1) ? TRIGGER_HUMD_MEASURE_NOHOLD : TRIGGER_TEMP_MEASURE_NOHOLD;
+        uint16_t raw_value;
+        int64_t begin_us = htu21d_port_time_us();
+
+        int ret = htu21d_dev_trigger(&dev, command, NULL);
+        if (ret == HTU21D_ERR_OK) {
+            // Skip the conversion time, only the driver is measured.
+            sim.ready_us = 0;
+            ret = htu21d_dev_fetch(&dev, &raw_value, NULL);
+        }
+        lines += htu21d_dev_log_errors(&dev, "bench", interval_ms);
+        latencies_us[i] = htu21d_port_time_us() - begin_us;
+        if (ret != HTU21D_ERR_OK) {
+            failed++;
+            failed_us += latencies_us[i];
+        }
+    }
+    int64_t elapsed_us = htu21d_port_time_us() - start_us;
+    lines += htu21d_dev_log_errors(&dev, "bench", 0);
+
+    qsort(latencies_us, measurements, sizeof(*latencies_us), compare_int64);
+    int64_t total_us = 0;
+    for (unsigned int i = 0; i < measurements; i++) {
+        total_us += latencies_us[i];
+    }
+    printf("%u measurements, %u failed, %u log lines, %u baud, interval %u ms\n",
+           measurements, failed, lines, console_baud, interval_ms);
+    printf("latency us: mean %.1f p50 %lld p99 %lld max %lld, failed mean %.1f, total %.3f s\n",
+           (double) total_us / measurements, (long long) latencies_us[measurements / 2],
+           (long long) latencies_us[(size_t) measurements * 99 / 100],
+           (long long) latencies_us[measurements - 1], failed ? (double) failed_us / failed : 0.0,
+           elapsed_us / 1e6);
+
+    free(latencies_us);
+    return EXIT_SUCCESS;
+}
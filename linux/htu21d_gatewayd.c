@@ -0,0 +1,647 @@
+/**
+ * @file htu21d_gatewayd.c
+ * @brief Gateway daemon sampling many HTU21D sensors on Linux.
+ *
+ * Sensors are grouped by bus, and each bus is served by its own thread. A
+ * thread never sleeps: it waits in `epoll_wait()` on two `timerfd`s, one for
+ * the sampling period and one for the end of the conversions. On each period
+ * it triggers the temperature conversion of every sensor of the bus with
+ * #htu21d_batch_trigger, lets the conversion timer expire once for all of them,
+ * reads them back with #htu21d_batch_fetch and triggers humidity the same way. A bus of N sensors therefore samples
+ * all of them in about the time of one sensor.
+ *
+ * Usage:
+ *
+ *     htu21d-gatewayd -c sensors.conf [-p period_ms] [-d seconds] [-s name] [-a] [-q]
+ *     htu21d-gatewayd -S buses:sensors [-p period_ms] [-d seconds] [-s name] [-a] [-q]
+ *
+ * Each line of the configuration file describes one sensor:
+ *
+ *     # bus   adapter      [mux-address channel]
+ *     north   /dev/i2c-1   0x70 0
+ *     north   /dev/i2c-1   0x70 1
+ *     south   /dev/i2c-2
+ *
+ * `-S` replaces the configuration by simulated sensors (see htu21d_sim.h), to
+ * benchmark the daemon without hardware. Samples are printed to stdout as CSV
+ * unless `-q` is given. With `-s name`, they are also published in the
+ * shared-memory ring `name` (see htu21d_shm.h), where other processes can read
+ * them; the sensor identifier of a record is the position of the sensor in
+ * the configuration, counting from 0. With `-a`, the conversion times of every
+ * sensor are measured at startup (see #htu21d_dev_calibrate), and the
+ * conversion timer of a bus waits for its slowest sensor instead of
+ * #HTU21D_CONVERSION_TIME_MS. On exit, the samples per second and CPU time per
+ * sample of each bus are printed to stderr.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "htu21d_linux.h"
+#include "htu21d_shm.h"
+#include "htu21d_sim.h"
+
+#define MAX_MUXES_PER_BUS       8
+#define SHM_CAPACITY            4096
+#define ERROR_LOG_INTERVAL_MS   10000 /**< Minimum time between two error summaries of a sensor. */
+#define CALIBRATION_ROUNDS      3     /**< Conversions measured per resolution by `-a`. */
+
+typedef struct {
+    char name[48];          /**< Name of the sensor, `bus/index`. */
+    uint32_t id;            /**< Identifier of the sensor in the shared-memory ring. */
+    htu21d_dev_t dev;       /**< The sensor. */
+    htu21d_sample_t sample; /**< Sample being acquired. */
+    bool ok;                /**< Whether all steps of the current sample succeeded. */
+    int mux_address;        /**< Address of the multiplexer the sensor is behind, -1 if none. */
+    uint8_t channel;        /**< Channel of the multiplexer. */
+    int line_number;        /**< Line of the configuration file, for errors. */
+} sensor_t;
+
+typedef struct {
+    char name[32];                          /**< Name of the bus. */
+    char adapter[64];                       /**< Path of the I2C adapter. */
+    htu21d_linux_bus_t linux_bus;           /**< The opened adapter. */
+    htu21d_mux_t muxes[MAX_MUXES_PER_BUS];  /**< Multiplexers on the bus. */
+    size_t mux_count;
+    sensor_t *sensors;
+    htu21d_sim_t *sims;                     /**< Simulated sensors, one per sensor, when simulating. */
+    size_t count;
+    size_t capacity;
+    // scratch arrays of the batch operations, one entry per sensor
+    htu21d_dev_t **batch_devs;
+    size_t *batch_sensors;                  /**< Index in `sensors` of each batch entry. */
+    htu21d_timing_t *batch_timings;
+    uint16_t *batch_raw_values;
+    int *batch_results;
+    pthread_t thread;
+    int stop_fd;                            /**< eventfd written to stop the thread. */
+    uint32_t period_ms;
+    bool quiet;
+    // statistics
+    uint64_t samples;
+    uint64_t errors;
+    uint64_t overruns;
+    int64_t cpu_ns;
+    int64_t wall_ns;
+} bus_t;
+
+static bus_t **buses;    /**< Each bus is allocated on its own: sensors and multiplexers point into it. */
+static size_t bus_count;
+static uint32_t sensor_count;
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+static htu21d_shm_writer_t shm_writer;
+static bool shm_enabled;
+
+static int64_t clock_ns(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static struct timespec ms_to_timespec(uint32_t ms)
+{
+    return (struct timespec) {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (long)(ms % 1000) * 1000000,
+    };
+}
+
+/**
+ * @brief Returns the bus called `name`, adding it if needed, or `NULL` if out
+ * of memory.
+ */
+static bus_t *find_or_add_bus(const char *name, const char *adapter)
+{
+    for (size_t i = 0; i < bus_count; i++) {
+        if (strcmp(buses[i]->name, name) == 0) {
+            return buses[i];
+        }
+    }
+
+    bus_t **grown = realloc(buses, (bus_count + 1) * sizeof(*buses));
+    if (grown == NULL) {
+        return NULL;
+    }
+    buses = grown;
+    bus_t *bus = calloc(1, sizeof(*bus));
+    if (bus == NULL) {
+        return NULL;
+    }
+    bus->linux_bus.fd = -1;
+    snprintf(bus->name, sizeof(bus->name), "%s", name);
+    snprintf(bus->adapter, sizeof(bus->adapter), "%s", adapter);
+    buses[bus_count++] = bus;
+    return bus;
+}
+
+/**
+ * @brief Adds a sensor to a bus, without attaching it, or returns `NULL` if out
+ * of memory.
+ *
+ * The sensors of a bus are moved when it grows, so they are only attached by
+ * #attach_sensors, once the configuration is complete.
+ */
+static sensor_t *add_sensor(bus_t *bus)
+{
+    if (bus->count == bus->capacity) {
+        size_t capacity = bus->capacity ? bus->capacity * 2 : 8;
+        sensor_t *grown = realloc(bus->sensors, capacity * sizeof(*bus->sensors));
+        if (grown == NULL) {
+            return NULL;
+        }
+        bus->sensors = grown;
+        bus->capacity = capacity;
+    }
+    sensor_t *sensor = &bus->sensors[bus->count];
+    *sensor = (sensor_t) {
+        .mux_address = -1,
+    };
+    snprintf(sensor->name, sizeof(sensor->name), "%s/%zu", bus->name, bus->count);
+    sensor->id = sensor_count++;
+    bus->count++;
+    return sensor;
+}
+
+static htu21d_mux_t *find_or_add_mux(bus_t *bus, uint8_t address)
+{
+    for (size_t i = 0; i < bus->mux_count; i++) {
+        if (bus->muxes[i].address == address) {
+            return &bus->muxes[i];
+        }
+    }
+    if (bus->mux_count == MAX_MUXES_PER_BUS) {
+        return NULL;
+    }
+
+    htu21d_mux_t *mux = &bus->muxes[bus->mux_count++];
+    htu21d_mux_init(mux, &htu21d_linux_transport, &bus->linux_bus, address);
+    return mux;
+}
+
+/**
+ * @brief Reads the configuration file, adding the buses and sensors it lists.
+ */
+static int load_config(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char line[256];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char name[32], adapter[64];
+        unsigned int mux_address, channel;
+        line_number++;
+
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        int fields = sscanf(line, "%31s %63s %x %u", name, adapter, &mux_address, &channel);
+        if (fields <= 0) {
+            continue;
+        }
+        if (fields != 2 && fields != 4) {
+            fprintf(stderr, "%s:%d: expected 'bus adapter [mux-address channel]'\n", path, line_number);
+            fclose(file);
+            return -1;
+        }
+
+        bus_t *bus = find_or_add_bus(name, adapter);
+        sensor_t *sensor = (bus != NULL) ? add_sensor(bus) : NULL;
+        if (sensor == NULL) {
+            fprintf(stderr, "%s:%d: out of memory\n", path, line_number);
+            fclose(file);
+            return -1;
+        }
+        sensor->line_number = line_number;
+        if (fields == 4) {
+            sensor->mux_address = (uint8_t) mux_address;
+            sensor->channel = (uint8_t) channel;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief Opens the adapters and attaches the sensors of the configuration
+ * file, once all of them are added and none will move.
+ */
+static int attach_sensors(const char *path)
+{
+    for (size_t b = 0; b < bus_count; b++) {
+        bus_t *bus = buses[b];
+        if (htu21d_linux_bus_open(&bus->linux_bus, bus->adapter) != HTU21D_ERR_OK) {
+            return -1;
+        }
+        for (size_t s = 0; s < bus->count; s++) {
+            sensor_t *sensor = &bus->sensors[s];
+            int ret;
+            if (sensor->mux_address >= 0) {
+                htu21d_mux_t *mux = find_or_add_mux(bus, (uint8_t) sensor->mux_address);
+                ret = (mux == NULL) ? HTU21D_ERR_INVALID_ARG :
+                      htu21d_dev_attach_mux(&sensor->dev, mux, sensor->channel);
+            } else {
+                ret = htu21d_dev_attach(&sensor->dev, &htu21d_linux_transport, &bus->linux_bus);
+            }
+            if (ret != HTU21D_ERR_OK) {
+                fprintf(stderr, "%s:%d: sensor not usable, error 0x%02X\n", path, sensor->line_number, ret);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Creates `bus_total` buses of `sensors_per_bus` simulated sensors.
+ */
+static int load_simulation(unsigned int bus_total, unsigned int sensors_per_bus)
+{
+    for (unsigned int b = 0; b < bus_total; b++) {
+        char name[32];
+        snprintf(name, sizeof(name), "sim%u", b);
+        bus_t *bus = find_or_add_bus(name, "simulated");
+        if (bus == NULL || (bus->sims = calloc(sensors_per_bus, sizeof(*bus->sims))) == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return -1;
+        }
+
+        for (unsigned int s = 0; s < sensors_per_bus; s++) {
+            htu21d_sim_t *sim = &bus->sims[s];
+            htu21d_sim_init(sim, 20.0F + (float) s / 10.0F, 40.0F + (float) b);
+            sim->noise_raw = 20;
+            sim->random = b * sensors_per_bus + s + 1;
+            if (add_sensor(bus) == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                return -1;
+            }
+        }
+        for (unsigned int s = 0; s < sensors_per_bus; s++) {
+            if (htu21d_dev_attach(&bus->sensors[s].dev, &htu21d_sim_transport, &bus->sims[s]) != HTU21D_ERR_OK) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void publish(bus_t *bus, sensor_t *sensor)
+{
+    if (bus->quiet && !shm_enabled) {
+        return;
+    }
+
+    const htu21d_sample_t *sample = &sensor->sample;
+    pthread_mutex_lock(&output_lock);
+    if (shm_enabled) {
+        // The ring has a single writer, the lock serializes the bus threads.
+        htu21d_shm_write(&shm_writer, sensor->id, sample);
+    }
+    if (!bus->quiet) {
+        printf("%s,%" PRId64 ",%.2f,%.2f\n", sensor->name, sample->timestamp_us,
+               sample->temperature, sample->humidity);
+    }
+    pthread_mutex_unlock(&output_lock);
+}
+
+/**
+ * @brief Lists the sensors of the bus that are still ok in the batch arrays.
+ */
+static size_t batch_collect(bus_t *bus)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < bus->count; i++) {
+        if (bus->sensors[i].ok) {
+            bus->batch_devs[count] = &bus->sensors[i].dev;
+            bus->batch_sensors[count] = i;
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Sends the same trigger to every sensor of the bus that is still ok.
+ */
+static void trigger_all(bus_t *bus, uint8_t command)
+{
+    size_t count = batch_collect(bus);
+    htu21d_batch_trigger(bus->batch_devs, count, command, bus->batch_timings, bus->batch_results);
+
+    for (size_t i = 0; i < count; i++) {
+        sensor_t *sensor = &bus->sensors[bus->batch_sensors[i]];
+        htu21d_timing_t *timing = (command == TRIGGER_TEMP_MEASURE_NOHOLD) ?
+                                  &sensor->sample.temperature_timing : &sensor->sample.humidity_timing;
+        timing->trigger_us = bus->batch_timings[i].trigger_us;
+        sensor->ok = bus->batch_results[i] == HTU21D_ERR_OK;
+    }
+}
+
+/**
+ * @brief Reads back the conversion of every sensor of the bus that is still ok.
+ */
+static void fetch_all(bus_t *bus, bool temperature)
+{
+    size_t count = batch_collect(bus);
+    htu21d_batch_fetch(bus->batch_devs, count, bus->batch_raw_values, bus->batch_timings, bus->batch_results);
+
+    for (size_t i = 0; i < count; i++) {
+        sensor_t *sensor = &bus->sensors[bus->batch_sensors[i]];
+        htu21d_sample_t *sample = &sensor->sample;
+        if (temperature) {
+            sample->raw_temperature = bus->batch_raw_values[i];
+            sample->temperature_timing.read_us = bus->batch_timings[i].read_us;
+        } else {
+            sample->raw_humidity = bus->batch_raw_values[i];
+            sample->humidity_timing.read_us = bus->batch_timings[i].read_us;
+        }
+        sensor->ok = bus->batch_results[i] == HTU21D_ERR_OK;
+    }
+}
+
+static void publish_all(bus_t *bus)
+{
+    for (size_t i = 0; i < bus->count; i++) {
+        sensor_t *sensor = &bus->sensors[i];
+        htu21d_sample_t *sample = &sensor->sample;
+        htu21d_dev_log_errors(&sensor->dev, sensor->name, ERROR_LOG_INTERVAL_MS);
+        if (!sensor->ok) {
+            bus->errors++;
+            continue;
+        }
+        htu21d_dev_convert_sample(&sensor->dev, sample);
+        publish(bus, sensor);
+        bus->samples++;
+    }
+}
+
+/**
+ * @brief Returns the longest conversion time of the sensors of a bus, waited
+ * once for all of them.
+ */
+static uint32_t bus_conversion_time_ms(const bus_t *bus, uint8_t command)
+{
+    uint32_t longest_ms = 0;
+
+    for (size_t s = 0; s < bus->count; s++) {
+        uint32_t conversion_ms = htu21d_dev_conversion_time_ms(&bus->sensors[s].dev, command);
+        longest_ms = (conversion_ms > longest_ms) ? conversion_ms : longest_ms;
+    }
+    return longest_ms;
+}
+
+static void arm_once(int timer_fd, uint32_t ms)
+{
+    struct itimerspec spec = {
+        .it_value = ms_to_timespec(ms),
+    };
+    timerfd_settime(timer_fd, 0, &spec, NULL);
+}
+
+static void *bus_thread(void *arg)
+{
+    bus_t *bus = (bus_t *) arg;
+    enum {
+        IDLE,
+        WAIT_TEMPERATURE,
+        WAIT_HUMIDITY,
+    } state = IDLE;
+
+    bus->batch_devs = calloc(bus->count, sizeof(*bus->batch_devs));
+    bus->batch_sensors = calloc(bus->count, sizeof(*bus->batch_sensors));
+    bus->batch_timings = calloc(bus->count, sizeof(*bus->batch_timings));
+    bus->batch_raw_values = calloc(bus->count, sizeof(*bus->batch_raw_values));
+    bus->batch_results = calloc(bus->count, sizeof(*bus->batch_results));
+    if (bus->batch_devs == NULL || bus->batch_sensors == NULL || bus->batch_timings == NULL ||
+            bus->batch_raw_values == NULL || bus->batch_results == NULL) {
+        fprintf(stderr, "%s: out of memory\n", bus->name);
+        return NULL;
+    }
+    const uint32_t temperature_ms = bus_conversion_time_ms(bus, TRIGGER_TEMP_MEASURE_NOHOLD);
+    const uint32_t humidity_ms = bus_conversion_time_ms(bus, TRIGGER_HUMD_MEASURE_NOHOLD);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int period_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    int conversion_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    int fds[] = {period_fd, conversion_fd, bus->stop_fd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); i++) {
+        struct epoll_event event = {
+            .events = EPOLLIN,
+            .data.fd = fds[i],
+        };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[i], &event);
+    }
+
+    struct itimerspec period = {
+        .it_interval = ms_to_timespec(bus->period_ms),
+        .it_value = {.tv_nsec = 1},
+    };
+    timerfd_settime(period_fd, 0, &period, NULL);
+
+    int64_t cpu_start = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    int64_t wall_start = clock_ns(CLOCK_MONOTONIC);
+    bool running = true;
+    while (running) {
+        struct epoll_event events[3];
+        int ready = epoll_wait(epoll_fd, events, 3, -1);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            uint64_t expirations = 0;
+            int fd = events[i].data.fd;
+            if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                continue;
+            }
+
+            if (fd == bus->stop_fd) {
+                running = false;
+            } else if (fd == period_fd) {
+                if (state != IDLE) {
+                    bus->overruns += expirations;
+                    continue;
+                }
+                bus->overruns += expirations - 1;
+                for (size_t s = 0; s < bus->count; s++) {
+                    bus->sensors[s].ok = true;
+                }
+                trigger_all(bus, TRIGGER_TEMP_MEASURE_NOHOLD);
+                arm_once(conversion_fd, temperature_ms);
+                state = WAIT_TEMPERATURE;
+            } else if (state == WAIT_TEMPERATURE) {
+                fetch_all(bus, true);
+                trigger_all(bus, TRIGGER_HUMD_MEASURE_NOHOLD);
+                arm_once(conversion_fd, humidity_ms);
+                state = WAIT_HUMIDITY;
+            } else if (state == WAIT_HUMIDITY) {
+                fetch_all(bus, false);
+                publish_all(bus);
+                state = IDLE;
+            }
+        }
+    }
+    bus->cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+    bus->wall_ns = clock_ns(CLOCK_MONOTONIC) - wall_start;
+
+    close(period_fd);
+    close(conversion_fd);
+    close(epoll_fd);
+    return NULL;
+}
+
+static void print_stats(void)
+{
+    for (size_t i = 0; i < bus_count; i++) {
+        const bus_t *bus = buses[i];
+        double seconds = (double) bus->wall_ns / 1e9;
+        fprintf(stderr,
+                "%s: %zu sensors, %" PRIu64 " samples (%.1f samples/s), %" PRIu64 " errors, "
+                "%" PRIu64 " overruns, CPU %.2f us/sample\n",
+                bus->name, bus->count, bus->samples, seconds > 0 ? (double) bus->samples / seconds : 0.0,
+                bus->errors, bus->overruns,
+                bus->samples ? (double) bus->cpu_ns / 1e3 / (double) bus->samples : 0.0);
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s (-c config | -S buses:sensors) [-p period_ms] [-d seconds] [-s name] [-a] [-q]\n"
+            "  -c config          sensors to sample, one 'bus adapter [mux-address channel]' per line\n"
+            "  -S buses:sensors   sample simulated sensors instead\n"
+            "  -p period_ms       sampling period (default 1000)\n"
+            "  -d seconds         stop after this long (default: run until SIGINT/SIGTERM)\n"
+            "  -s name            also publish the samples in the shared-memory ring 'name'\n"
+            "  -a                 measure the conversion times of the sensors at startup\n"
+            "  -q                 do not print samples\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *config = NULL;
+    const char *shm_name = NULL;
+    unsigned int sim_buses = 0, sim_sensors = 0;
+    uint32_t period_ms = 1000;
+    unsigned int duration_s = 0;
+    bool quiet = false, calibrate = false;
+    int option;
+
+    while ((option = getopt(argc, argv, "c:S:p:d:s:aq")) != -1) {
+        switch (option) {
+        case 'c':
+            config = optarg;
+            break;
+        case 'S':
+            if (sscanf(optarg, "%u:%u", &sim_buses, &sim_sensors) != 2) {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'p':
+            period_ms = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            duration_s = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            shm_name = optarg;
+            break;
+        case 'a':
+            calibrate = true;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if ((config == NULL) == (sim_buses == 0) || period_ms == 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if ((config != NULL ? load_config(config) || attach_sensors(config) :
+            load_simulation(sim_buses, sim_sensors)) != 0) {
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; calibrate && i < bus_count; i++) {
+        for (size_t s = 0; s < buses[i]->count; s++) {
+            sensor_t *sensor = &buses[i]->sensors[s];
+            if (htu21d_dev_calibrate(&sensor->dev, CALIBRATION_ROUNDS) != HTU21D_ERR_OK) {
+                fprintf(stderr, "%s: calibration failed, waiting the datasheet times\n", sensor->name);
+            }
+        }
+    }
+    if (shm_name != NULL) {
+        if (htu21d_shm_writer_open(&shm_writer, shm_name, SHM_CAPACITY) != HTU21D_ERR_OK) {
+            return EXIT_FAILURE;
+        }
+        shm_enabled = true;
+    }
+
+    // Signals are only taken by the main thread, in sigtimedwait() below.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    for (size_t i = 0; i < bus_count; i++) {
+        bus_t *bus = buses[i];
+        bus->period_ms = period_ms;
+        bus->quiet = quiet;
+        bus->stop_fd = eventfd(0, EFD_CLOEXEC);
+        pthread_create(&bus->thread, NULL, bus_thread, bus);
+    }
+
+    if (duration_s != 0) {
+        struct timespec timeout = {.tv_sec = duration_s};
+        sigtimedwait(&signals, NULL, &timeout);
+    } else {
+        int signal_number;
+        sigwait(&signals, &signal_number);
+    }
+
+    for (size_t i = 0; i < bus_count; i++) {
+        uint64_t one = 1;
+        if (write(buses[i]->stop_fd, &one, sizeof(one)) != sizeof(one)) {
+            fprintf(stderr, "Failed to stop bus %s\n", buses[i]->name);
+        }
+    }
+    for (size_t i = 0; i < bus_count; i++) {
+        pthread_join(buses[i]->thread, NULL);
+        close(buses[i]->stop_fd);
+        htu21d_linux_bus_close(&buses[i]->linux_bus);
+    }
+    fflush(stdout);
+    print_stats();
+    if (shm_enabled) {
+        // Keep the segment, readers may still be draining it.
+        htu21d_shm_writer_close(&shm_writer, false);
+    }
+
+    return EXIT_SUCCESS;
+}
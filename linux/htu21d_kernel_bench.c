@@ -0,0 +1,418 @@
+/**
+ * @file htu21d_kernel_bench.c
+ * @brief Microbenchmarks of the pure functions of htu21d.c: CRC check, raw
+ * value conversions and derived quantities, and of the detectors of
+ * htu21d_detect.c.
+ *
+ * Usage:
+ *
+ *     htu21d-kernel-bench [-j] [-m min_time_s] [-f filter]
+ *
+ * Each function is measured on one input at a time (`scalar`) and over an
+ * array of #BATCH_SIZE inputs (`batch`), the iterations being doubled until a
+ * run lasts at least `min_time_s` (0.5 by default). Only the benchmarks whose
+ * name contains `filter` are run. The results are printed as a table, or with
+ * `-j` as JSON in the format of Google Benchmark (`--benchmark_format=json`),
+ * so that its tools (e.g. `compare.py`) can compare two runs.
+ *
+ * The detectors keep state, so each run starts from a fresh detector and
+ * feeds it one value per simulated second: the same value in `scalar`, a
+ * random walk of humidities in `batch`.
+ *
+ * The implementations selected in Kconfig on ESP-IDF (CRC, conversion) are
+ * fixed at compile time, so each variant is a separate executable, built by
+ * `htu21d_kernel_bench()` in CMakeLists.txt.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "htu21d.h"
+#include "htu21d_detect.h"
+
+#ifndef HTU21D_BENCH_VARIANT
+#define HTU21D_BENCH_VARIANT default
+#endif
+#define BENCH_STRINGIFY_(x) #x
+#define BENCH_STRINGIFY(x)  BENCH_STRINGIFY_(x)
+
+#define BATCH_SIZE  1024 /**< Inputs processed per iteration of a batch benchmark. */
+
+/** Inputs, generated once: raw values with their CRC, and physical values. */
+static uint16_t raw_values[BATCH_SIZE];
+static uint8_t crcs[BATCH_SIZE];
+static float temperatures[BATCH_SIZE];
+static float humidities[BATCH_SIZE];
+static htu21d_timing_t timings[BATCH_SIZE];
+static int32_t detector_values[BATCH_SIZE];
+static htu21d_sample_t detector_samples[BATCH_SIZE];
+
+/** Results are accumulated here so that the calls are not optimized out. */
+static volatile float float_sink;
+static volatile int64_t int_sink;
+
+typedef struct {
+    const char *name;
+    void (*run)(size_t iterations);
+    size_t items;       /**< Inputs processed per iteration. */
+} benchmark_t;
+
+typedef struct {
+    size_t iterations;
+    double real_ns;     /**< Per iteration. */
+    double cpu_ns;      /**< Per iteration. */
+} result_t;
+
+static uint8_t crc8(uint16_t value)
+{
+    uint8_t crc = 0;
+    uint8_t bytes[2] = {value >> 8, value & 0xFF};
+
+    for (int i = 0; i < 2; i++) {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static void inputs_init(void)
+{
+    uint32_t random = 12345;
+    int32_t walk = 5000;
+
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+        random = random * 1664525U + 1013904223U;
+        raw_values[i] = (uint16_t)(random >> 16) & 0xFFFC;
+        crcs[i] = crc8(raw_values[i]);
+        temperatures[i] = htu21d_raw_to_temperature(raw_values[i] | 0x4000);
+        humidities[i] = 5.0F + (float)(random % 9000) / 100.0F;
+        timings[i].trigger_us = random;
+        timings[i].read_us = random + 50000;
+        // Random walk of a humidity in hundredths, by up to 0.1 %RH a step.
+        walk += (int32_t)(random % 21) - 10;
+        detector_values[i] = walk;
+        detector_samples[i].humidity = (float) walk / 100.0F;
+    }
+}
+
+// Scalar benchmarks: the same input every iteration, so the time is the
+// latency of one call with warm caches and a predictable branch history.
+
+static void bm_crc_scalar(size_t iterations)
+{
+    int64_t valid = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        valid += is_crc_valid(raw_values[0], crcs[0]);
+    }
+    int_sink = valid;
+}
+
+static void bm_crc_batch(size_t iterations)
+{
+    int64_t valid = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            valid += is_crc_valid(raw_values[j], crcs[j]);
+        }
+    }
+    int_sink = valid;
+}
+
+#define BENCH_FLOAT_KERNEL(name, expression)                        \
+    static void bm_##name##_scalar(size_t iterations)               \
+    {                                                               \
+        float sum = 0.0F;                                           \
+        const size_t j = 0;                                         \
+        for (size_t i = 0; i < iterations; i++) {                   \
+            sum += (expression);                                    \
+        }                                                           \
+        float_sink = sum;                                           \
+    }                                                               \
+    static void bm_##name##_batch(size_t iterations)                \
+    {                                                               \
+        float sum = 0.0F;                                           \
+        for (size_t i = 0; i < iterations; i++) {                   \
+            for (size_t j = 0; j < BATCH_SIZE; j++) {               \
+                sum += (expression);                                \
+            }                                                       \
+        }                                                           \
+        float_sink = sum;                                           \
+    }
+
+#define BENCH_INT_KERNEL(name, expression)                          \
+    static void bm_##name##_scalar(size_t iterations)               \
+    {                                                               \
+        int64_t sum = 0;                                            \
+        const size_t j = 0;                                         \
+        for (size_t i = 0; i < iterations; i++) {                   \
+            sum += (expression);                                    \
+        }                                                           \
+        int_sink = sum;                                             \
+    }                                                               \
+    static void bm_##name##_batch(size_t iterations)                \
+    {                                                               \
+        int64_t sum = 0;                                            \
+        for (size_t i = 0; i < iterations; i++) {                   \
+            for (size_t j = 0; j < BATCH_SIZE; j++) {               \
+                sum += (expression);                                \
+            }                                                       \
+        }                                                           \
+        int_sink = sum;                                             \
+    }
+
+BENCH_FLOAT_KERNEL(raw_to_temperature, htu21d_raw_to_temperature(raw_values[j]))
+BENCH_FLOAT_KERNEL(raw_to_humidity, htu21d_raw_to_humidity(raw_values[j]))
+BENCH_INT_KERNEL(raw_to_temperature_centi, htu21d_raw_to_temperature_centi(raw_values[j]))
+BENCH_INT_KERNEL(raw_to_humidity_centi, htu21d_raw_to_humidity_centi(raw_values[j]))
+BENCH_FLOAT_KERNEL(htu31d_raw_to_temperature, htu31d_raw_to_temperature(raw_values[j]))
+BENCH_FLOAT_KERNEL(htu31d_raw_to_humidity, htu31d_raw_to_humidity(raw_values[j]))
+BENCH_INT_KERNEL(htu31d_raw_to_temperature_centi, htu31d_raw_to_temperature_centi(raw_values[j]))
+BENCH_INT_KERNEL(htu31d_raw_to_humidity_centi, htu31d_raw_to_humidity_centi(raw_values[j]))
+BENCH_INT_KERNEL(timing_midpoint, htu21d_timing_midpoint(&timings[j]))
+BENCH_FLOAT_KERNEL(celsius_to_fahrenheit, celsius_to_fahrenheit(temperatures[j]))
+BENCH_FLOAT_KERNEL(compensated_humidity, htu21_compute_compensated_humidity(temperatures[j], humidities[j]))
+BENCH_FLOAT_KERNEL(partial_pressure, htu21d_compute_partial_pressure(temperatures[j]))
+BENCH_FLOAT_KERNEL(dew_point, htu21d_compute_dew_point(temperatures[j], humidities[j]))
+
+static const htu21d_zscore_config_t zscore_config = {
+    .alpha_shift = 5,
+    .threshold_q4 = 48,
+    .warmup = 32,
+    .min_deviation = 20,
+};
+static const htu21d_cusum_config_t cusum_config = {
+    .slack = 25,
+    .threshold = 200,
+    .warmup = 32,
+};
+static const htu21d_trend_config_t trend_config = {
+    .window = 16,
+    .threshold = 7000,
+    .horizon_s = 1800,
+};
+
+#define BENCH_DETECTOR_KERNEL(name, type, config)                   \
+    static void bm_##name##_update_scalar(size_t iterations)        \
+    {                                                               \
+        type detector;                                              \
+        int64_t events = 0, timestamp_us = 0;                       \
+        htu21d_##name##_init(&detector, &config);                   \
+        for (size_t i = 0; i < iterations; i++) {                   \
+            timestamp_us += 1000000;                                \
+            events += htu21d_##name##_update(&detector, detector_values[0], timestamp_us); \
+        }                                                           \
+        int_sink = events;                                          \
+    }                                                               \
+    static void bm_##name##_update_batch(size_t iterations)         \
+    {                                                               \
+        type detector;                                              \
+        int64_t events = 0, timestamp_us = 0;                       \
+        htu21d_##name##_init(&detector, &config);                   \
+        for (size_t i = 0; i < iterations; i++) {                   \
+            for (size_t j = 0; j < BATCH_SIZE; j++) {               \
+                timestamp_us += 1000000;                            \
+                events += htu21d_##name##_update(&detector, detector_values[j], timestamp_us); \
+            }                                                       \
+        }                                                           \
+        int_sink = events;                                          \
+    }
+
+BENCH_DETECTOR_KERNEL(zscore, htu21d_zscore_t, zscore_config)
+BENCH_DETECTOR_KERNEL(cusum, htu21d_cusum_t, cusum_config)
+BENCH_DETECTOR_KERNEL(trend, htu21d_trend_t, trend_config)
+
+// The three detectors together, as the pipeline runs them on each sample.
+
+static void detectors_init(htu21d_detectors_t *detectors, htu21d_zscore_t *zscore, htu21d_cusum_t *cusum,
+                           htu21d_trend_t *trend)
+{
+    htu21d_zscore_init(zscore, &zscore_config);
+    htu21d_cusum_init(cusum, &cusum_config);
+    htu21d_trend_init(trend, &trend_config);
+    *detectors = (htu21d_detectors_t) {
+        .quantity = HTU21D_DETECT_HUMIDITY, .zscore = zscore, .cusum = cusum, .trend = trend,
+    };
+}
+
+static void bm_detectors_update_scalar(size_t iterations)
+{
+    htu21d_detectors_t detectors;
+    htu21d_zscore_t zscore;
+    htu21d_cusum_t cusum;
+    htu21d_trend_t trend;
+    htu21d_sample_t sample = detector_samples[0];
+    int64_t events = 0;
+
+    detectors_init(&detectors, &zscore, &cusum, &trend);
+    for (size_t i = 0; i < iterations; i++) {
+        sample.timestamp_us += 1000000;
+        events += htu21d_detectors_update(&detectors, &sample);
+    }
+    int_sink = events;
+}
+
+static void bm_detectors_update_batch(size_t iterations)
+{
+    htu21d_detectors_t detectors;
+    htu21d_zscore_t zscore;
+    htu21d_cusum_t cusum;
+    htu21d_trend_t trend;
+    int64_t events = 0, timestamp_us = 0;
+
+    detectors_init(&detectors, &zscore, &cusum, &trend);
+    for (size_t i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            timestamp_us += 1000000;
+            detector_samples[j].timestamp_us = timestamp_us;
+            events += htu21d_detectors_update(&detectors, &detector_samples[j]);
+        }
+    }
+    int_sink = events;
+}
+
+#define BENCH_ENTRIES(name)                                     \
+    {"BM_" #name "/scalar", bm_##name##_scalar, 1},             \
+    {"BM_" #name "/batch:1024", bm_##name##_batch, BATCH_SIZE}
+
+static const benchmark_t benchmarks[] = {
+    BENCH_ENTRIES(crc),
+    BENCH_ENTRIES(raw_to_temperature),
+    BENCH_ENTRIES(raw_to_humidity),
+    BENCH_ENTRIES(raw_to_temperature_centi),
+    BENCH_ENTRIES(raw_to_humidity_centi),
+    BENCH_ENTRIES(htu31d_raw_to_temperature),
+    BENCH_ENTRIES(htu31d_raw_to_humidity),
+    BENCH_ENTRIES(htu31d_raw_to_temperature_centi),
+    BENCH_ENTRIES(htu31d_raw_to_humidity_centi),
+    BENCH_ENTRIES(timing_midpoint),
+    BENCH_ENTRIES(celsius_to_fahrenheit),
+    BENCH_ENTRIES(compensated_humidity),
+    BENCH_ENTRIES(partial_pressure),
+    BENCH_ENTRIES(dew_point),
+    BENCH_ENTRIES(zscore_update),
+    BENCH_ENTRIES(cusum_update),
+    BENCH_ENTRIES(trend_update),
+    BENCH_ENTRIES(detectors_update),
+};
+
+static double clock_ns(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (double) now.tv_sec * 1e9 + (double) now.tv_nsec;
+}
+
+/**
+ * @brief Runs a benchmark with doubling iterations, until one run lasts at
+ * least `min_time_s`.
+ */
+static result_t measure(const benchmark_t *benchmark, double min_time_s)
+{
+    result_t result = {0};
+
+    for (size_t iterations = 1; ; iterations *= 2) {
+        double real_start = clock_ns(CLOCK_MONOTONIC);
+        double cpu_start = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+        benchmark->run(iterations);
+        double real_ns = clock_ns(CLOCK_MONOTONIC) - real_start;
+        double cpu_ns = clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+
+        if (real_ns >= min_time_s * 1e9 || iterations >= ((size_t) 1 << 40)) {
+            result.iterations = iterations;
+            result.real_ns = real_ns / (double) iterations;
+            result.cpu_ns = cpu_ns / (double) iterations;
+            return result;
+        }
+    }
+}
+
+static void print_json_context(const char *executable)
+{
+    char date[32];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+    printf("{\n");
+    printf("  \"context\": {\n");
+    printf("    \"date\": \"%s\",\n", date);
+    printf("    \"executable\": \"%s\",\n", executable);
+    printf("    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("    \"variant\": \"%s\",\n", BENCH_STRINGIFY(HTU21D_BENCH_VARIANT));
+    printf("    \"library_build_type\": \"release\"\n");
+    printf("  },\n");
+    printf("  \"benchmarks\": [");
+}
+
+static void print_json_result(const benchmark_t *benchmark, const result_t *result, bool first)
+{
+    printf("%s\n    {\n", first ? "" : ",");
+    printf("      \"name\": \"%s\",\n", benchmark->name);
+    printf("      \"run_name\": \"%s\",\n", benchmark->name);
+    printf("      \"run_type\": \"iteration\",\n");
+    printf("      \"iterations\": %zu,\n", result->iterations);
+    printf("      \"real_time\": %.4f,\n", result->real_ns);
+    printf("      \"cpu_time\": %.4f,\n", result->cpu_ns);
+    printf("      \"time_unit\": \"ns\",\n");
+    printf("      \"items_per_second\": %.6e\n", (double) benchmark->items * 1e9 / result->cpu_ns);
+    printf("    }");
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    double min_time_s = 0.5;
+    const char *filter = "";
+    int option;
+
+    while ((option = getopt(argc, argv, "jm:f:")) != -1) {
+        switch (option) {
+        case 'j':
+            json = true;
+            break;
+        case 'm':
+            min_time_s = strtod(optarg, NULL);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-j] [-m min_time_s] [-f filter]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    inputs_init();
+    if (json) {
+        print_json_context(argv[0]);
+    } else {
+        printf("variant: %s\n", BENCH_STRINGIFY(HTU21D_BENCH_VARIANT));
+        printf("%-48s %12s %12s %14s %14s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations", "items/s");
+    }
+
+    bool first = true;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        const benchmark_t *benchmark = &benchmarks[i];
+        if (strstr(benchmark->name, filter) == NULL) {
+            continue;
+        }
+        result_t result = measure(benchmark, min_time_s);
+        if (json) {
+            print_json_result(benchmark, &result, first);
+        } else {
+            printf("%-48s %12.2f %12.2f %14zu %14.4g\n", benchmark->name, result.real_ns, result.cpu_ns,
+                   result.iterations, (double) benchmark->items * 1e9 / result.cpu_ns);
+        }
+        first = false;
+    }
+
+    if (json) {
+        printf("\n  ]\n}\n");
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file htu21d_lead_bench.c
+ * @brief Measures the step response of the lead compensator of
+ * htu21d_filter.h on a simulated humidity step.
+ *
+ * Usage:
+ *
+ *     htu21d-lead-bench [-p period_ms] [-s step_rh] [-t tau_s] [-f noise_tau_s]
+ *                       [-m max_correction] [-N noise_raw]
+ *
+ * The simulated ambient humidity (see htu21d_sim.h) steps by `step_rh` after
+ * 60 seconds and stays there for 60 more. The simulator answers with the
+ * ambient value at once, so the bench models the humidity element in front of
+ * it: a first-order lag with the datasheet time constant
+ * #HTU21D_RH_TIME_CONSTANT_S. Every `period_ms` of simulated time, the
+ * humidity is measured through the driver (#htu21d_dev_trigger and
+ * #htu21d_dev_fetch, the conversion time skipped) and fed to the compensator
+ * configured with `tau_s`, `noise_tau_s` and `max_correction`.
+ *
+ * The program prints the 10-90% rise time and the overshoot of the raw and of
+ * the compensated readings, and their standard deviation before the step, to
+ * show what the faster response costs in noise (`-N` adds noise to the raw
+ * conversions).
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "htu21d_filter.h"
+#include "htu21d_sim.h"
+
+#define SETTLE_S    60  /**< Time before the step, and after it. */
+
+/**
+ * @brief Step response of a series of readings.
+ */
+typedef struct {
+    double t10_s;       /**< When the readings first crossed 10% of the step. */
+    double t90_s;       /**< When the readings first crossed 90% of the step. */
+    double peak;        /**< Largest reading after the step. */
+    double sum;         /**< Sum of the readings before the step. */
+    double sum_squares; /**< Sum of their squares. */
+    unsigned int count; /**< Number of readings before the step. */
+} response_t;
+
+/**
+ * @brief Accounts for the reading `value` at `t_s`, linearly interpolating the
+ * crossing times between it and the previous reading.
+ */
+static void response_add(response_t *response, double t_s, double period_s, double value,
+                         double previous, double low, double step)
+{
+    if (t_s < SETTLE_S) {
+        response->sum += value;
+        response->sum_squares += value * value;
+        response->count++;
+        return;
+    }
+    double level10 = low + 0.1 * step, level90 = low + 0.9 * step;
+    if (response->t10_s < 0.0 && value >= level10) {
+        response->t10_s = t_s - period_s * (value - level10) / (value - previous);
+    }
+    if (response->t90_s < 0.0 && value >= level90) {
+        response->t90_s = t_s - period_s * (value - level90) / (value - previous);
+    }
+    if (value > response->peak) {
+        response->peak = value;
+    }
+}
+
+static void response_print(const char *name, const response_t *response, double low, double step)
+{
+    double mean = response->sum / response->count;
+    double variance = response->sum_squares / response->count - mean * mean;
+
+    printf("%-12s rise 10-90%% %6.2f s  overshoot %5.1f%%  noise %.3f %%RH\n", name,
+           response->t90_s >= 0.0 ? response->t90_s - response->t10_s : NAN,
+           100.0 * (response->peak - (low + step)) / step, sqrt(variance > 0.0 ? variance : 0.0));
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int period_ms = 500, noise_raw = 0;
+    htu21d_lead_config_t config = {
+        .tau_s = HTU21D_RH_TIME_CONSTANT_S,
+        .noise_tau_s = 1.0F,
+        .max_correction = 0.0F,
+    };
+    double step = 30.0, low = 40.0;
+    int option;
+
+    while ((option = getopt(argc, argv, "p:s:t:f:m:N:")) != -1) {
+        switch (option) {
+        case 'p':
+            period_ms = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            step = strtod(optarg, NULL);
+            break;
+        case 't':
+            config.tau_s = strtof(optarg, NULL);
+            break;
+        case 'f':
+            config.noise_tau_s = strtof(optarg, NULL);
+            break;
+        case 'm':
+            config.max_correction = strtof(optarg, NULL);
+            break;
+        case 'N':
+            noise_raw = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p period_ms] [-s step_rh] [-t tau_s] [-f noise_tau_s] "
+                    "[-m max_correction] [-N noise_raw]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (period_ms == 0 || step <= 0.0 || low + step > 100.0) {
+        fprintf(stderr, "period must be at least 1 ms, the step between 0 and %.0f %%RH\n", 100.0 - low);
+        return EXIT_FAILURE;
+    }
+
+    htu21d_sim_t sim;
+    htu21d_dev_t dev;
+    htu21d_lead_t lead;
+    htu21d_sim_init(&sim, 21.0F, (float) low);
+    if (htu21d_dev_attach(&dev, &htu21d_sim_transport, &sim) != HTU21D_ERR_OK ||
+            htu21d_lead_init(&lead, &config) != HTU21D_ERR_OK) {
+        fprintf(stderr, "Invalid configuration\n");
+        return EXIT_FAILURE;
+    }
+    sim.noise_raw = (uint16_t) noise_raw;
+
+    response_t raw = {.t10_s = -1.0, .t90_s = -1.0, .peak = -INFINITY};
+    response_t compensated = raw;
+    double period_s = period_ms / 1000.0, element = low;
+    double previous_raw = low, previous_compensated = low;
+    unsigned int samples = (unsigned int)(2 * SETTLE_S * 1000 / period_ms), failed = 0;
+
+    for (unsigned int i = 1; i <= samples; i++) {
+        double t_s = i * period_s;
+        double ambient = t_s < SETTLE_S ? low : low + step;
+        element += (ambient - element) * (1.0 - exp(-period_s / HTU21D_RH_TIME_CONSTANT_S));
+        sim.humidity = (float) element;
+
+        uint16_t raw_value;
+        int ret = htu21d_dev_trigger(&dev, TRIGGER_HUMD_MEASURE_NOHOLD, NULL);
+        if (ret == HTU21D_ERR_OK) {
+            // Skip the conversion time, the time base is simulated.
+            sim.ready_us = 0;
+            ret = htu21d_dev_fetch(&dev, &raw_value, NULL);
+        }
+        if (ret != HTU21D_ERR_OK) {
+            failed++;
+            continue;
+        }
+
+        double value = htu21d_raw_to_humidity(raw_value);
+        double output = htu21d_lead_update(&lead, (float) value, (int64_t)(t_s * 1000000.0));
+        response_add(&raw, t_s, period_s, value, previous_raw, low, step);
+        response_add(&compensated, t_s, period_s, output, previous_compensated, low, step);
+        previous_raw = value;
+        previous_compensated = output;
+    }
+
+    printf("step %.1f -> %.1f %%RH, element tau %.1f s, period %u ms, noise %u raw, %u failed\n",
+           low, low + step, HTU21D_RH_TIME_CONSTANT_S, period_ms, noise_raw, failed);
+    printf("lead tau %.2f s, noise tau %.2f s, max correction %.1f\n",
+           config.tau_s, config.noise_tau_s, config.max_correction);
+    response_print("raw", &raw, low, step);
+    response_print("compensated", &compensated, low, step);
+
+    return EXIT_SUCCESS;
+}
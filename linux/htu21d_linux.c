@@ -0,0 +1,194 @@
+/**
+ * @file htu21d_linux.c
+ * @brief Linux i2c-dev transport for the HTU21D component.
+ *
+ * Every operation is a single `I2C_RDWR` ioctl, so each transaction costs
+ * exactly one system call and a write followed by a read is sent as one
+ * combined transaction with a repeated start. A full sample (trigger and
+ * read-back of both channels) is therefore four system calls.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "htu21d_linux.h"
+#include "htu21d_port.h"
+
+static const char* TAG = "htu21d_linux";
+
+/**
+ * @brief Maps the `errno` of a failed `I2C_RDWR` to an `HTU21D_ERR_*` code.
+ */
+static int errno_to_htu21d(int error)
+{
+    switch (error) {
+
+    case ENXIO:
+    case EREMOTEIO:
+        // The device did not acknowledge.
+        return HTU21D_ERR_FAIL;
+
+    case ETIMEDOUT:
+    case EAGAIN:
+        return HTU21D_ERR_TIMEOUT;
+
+    case EINVAL:
+    case EOPNOTSUPP:
+        return HTU21D_ERR_INVALID_ARG;
+
+    case EBADF:
+    case ENODEV:
+        return HTU21D_ERR_INVALID_STATE;
+    }
+    return HTU21D_ERR_FAIL;
+}
+
+static int transfer(void *bus, struct i2c_msg *messages, unsigned int count)
+{
+    struct i2c_rdwr_ioctl_data data = {
+        .msgs = messages,
+        .nmsgs = count,
+    };
+
+    if (ioctl(((htu21d_linux_bus_t *) bus)->fd, I2C_RDWR, &data) < 0) {
+        return errno_to_htu21d(errno);
+    }
+    return HTU21D_ERR_OK;
+}
+
+static int linux_write(void *bus, uint8_t address, const uint8_t *data, size_t len)
+{
+    struct i2c_msg message = {
+        .addr = address,
+        .flags = 0,
+        .len = (uint16_t) len,
+        .buf = (uint8_t *) data,
+    };
+
+    return transfer(bus, &message, 1);
+}
+
+static int linux_read(void *bus, uint8_t address, uint8_t *data, size_t len)
+{
+    struct i2c_msg message = {
+        .addr = address,
+        .flags = I2C_M_RD,
+        .len = (uint16_t) len,
+        .buf = data,
+    };
+
+    return transfer(bus, &message, 1);
+}
+
+static int linux_write_read(void *bus, uint8_t address, const uint8_t *write_data, size_t write_len,
+                            uint8_t *read_data, size_t read_len)
+{
+    struct i2c_msg messages[] = {
+        {
+            .addr = address,
+            .flags = 0,
+            .len = (uint16_t) write_len,
+            .buf = (uint8_t *) write_data,
+        },
+        {
+            .addr = address,
+            .flags = I2C_M_RD,
+            .len = (uint16_t) read_len,
+            .buf = read_data,
+        },
+    };
+
+    return transfer(bus, messages, 2);
+}
+
+static int linux_batch(void *bus, const htu21d_transfer_t *transfers, size_t count)
+{
+    struct i2c_msg messages[I2C_RDWR_IOCTL_MAX_MSGS];
+    unsigned int message_count = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const htu21d_transfer_t *item = &transfers[i];
+        if (message_count + 2 > I2C_RDWR_IOCTL_MAX_MSGS) {
+            return HTU21D_ERR_INVALID_ARG;
+        }
+        if (item->write_len != 0 || item->read_len == 0) {
+            messages[message_count++] = (struct i2c_msg) {
+                .addr = item->address,
+                .flags = 0,
+                .len = (uint16_t) item->write_len,
+                .buf = (uint8_t *) item->write_data,
+            };
+        }
+        if (item->read_len != 0) {
+            messages[message_count++] = (struct i2c_msg) {
+                .addr = item->address,
+                .flags = I2C_M_RD,
+                .len = (uint16_t) item->read_len,
+                .buf = item->read_data,
+            };
+        }
+    }
+
+    return transfer(bus, messages, message_count);
+}
+
+/**
+ * Transport over Linux i2c-dev. The bus is a #htu21d_linux_bus_t opened with
+ * #htu21d_linux_bus_open. A batch is a single `I2C_RDWR` ioctl with one message
+ * per write or read, so the kernel sends it with repeated starts. The SCL
+ * frequency is set by the device tree, not from user space, so there is no
+ * `set_clock`.
+ */
+const htu21d_transport_t htu21d_linux_transport = {
+    .write = linux_write,
+    .read = linux_read,
+    .write_read = linux_write_read,
+    .batch = linux_batch,
+};
+
+/**
+ * @brief Opens an I2C adapter.
+ * @param[out] bus The bus to open.
+ * @param path Path of the adapter, e.g. `/dev/i2c-1`.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if an
+ * argument is `NULL`, #HTU21D_ERR_CONFIG if the adapter cannot be opened, or
+ * #HTU21D_ERR_INVALID_STATE if it does not support combined transactions.
+ */
+int htu21d_linux_bus_open(htu21d_linux_bus_t *bus, const char *path)
+{
+    if (bus == NULL || path == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    bus->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (bus->fd < 0) {
+        ESP_LOGE(TAG, "Failed to open %s: errno %d", path, errno);
+        return HTU21D_ERR_CONFIG;
+    }
+
+    unsigned long functions = 0;
+    if (ioctl(bus->fd, I2C_FUNCS, &functions) < 0 || !(functions & I2C_FUNC_I2C)) {
+        ESP_LOGE(TAG, "%s does not support plain I2C (I2C_RDWR) transactions", path);
+        htu21d_linux_bus_close(bus);
+        return HTU21D_ERR_INVALID_STATE;
+    }
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Closes an I2C adapter.
+ * @param bus The bus to close.
+ */
+void htu21d_linux_bus_close(htu21d_linux_bus_t *bus)
+{
+    if (bus->fd >= 0) {
+        close(bus->fd);
+        bus->fd = -1;
+    }
+}
@@ -0,0 +1,38 @@
+/**
+ * @file htu21d_linux.h
+ * @brief Linux i2c-dev transport for the HTU21D component.
+ *
+ * Lets the driver run unchanged on Linux gateways, through the `/dev/i2c-N`
+ * character devices of the kernel's i2c-dev module.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __HTU21D_LINUX_H__
+#define __HTU21D_LINUX_H__
+
+#include "htu21d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief An opened I2C adapter.
+ */
+typedef struct {
+    int fd; /**< File descriptor of `/dev/i2c-N`. */
+} htu21d_linux_bus_t;
+
+extern const htu21d_transport_t htu21d_linux_transport;
+
+int htu21d_linux_bus_open(htu21d_linux_bus_t *bus, const char *path);
+void htu21d_linux_bus_close(htu21d_linux_bus_t *bus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HTU21D_LINUX_H__
@@ -0,0 +1,156 @@
+/**
+ * @file htu21d_linux_bench.c
+ * @brief Measures the system call overhead of a sample on the Linux i2c-dev
+ * transport.
+ *
+ * Usage:
+ *
+ *     htu21d-linux-bench [-n samples] [-s sensors]
+ *
+ * The transport runs against the `ioctl()` mock of htu21d_linux_mock.h, with
+ * simulated sensors behind a simulated multiplexer (see htu21d_sim.h). Every
+ * sensor is sampled (trigger and read-back of temperature and humidity)
+ * `samples` times, one by one with #htu21d_dev_trigger and #htu21d_dev_fetch,
+ * then all together with #htu21d_batch_trigger and #htu21d_batch_fetch; the
+ * conversion times are skipped. Each mode runs twice: with the mock alone,
+ * then with a real `ioctl()` on `/dev/null` for every `I2C_RDWR`, which costs
+ * the kernel entry and exit of the system call without a bus. The difference
+ * is the system call overhead of a sample, printed with the number of
+ * `I2C_RDWR` per sample.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "htu21d_linux.h"
+#include "htu21d_linux_mock.h"
+#include "htu21d_port.h"
+#include "htu21d_sim.h"
+
+typedef struct {
+    htu21d_sim_t *sims;
+    htu21d_dev_t **devs;
+    size_t count;
+    bool batched;
+} bench_t;
+
+/**
+ * @brief Samples one channel of all the sensors, skipping the conversion time.
+ */
+static void sample_channel(const bench_t *bench, uint8_t command)
+{
+    uint16_t raw_values[8];
+    int results[8];
+
+    if (bench->batched) {
+        htu21d_batch_trigger(bench->devs, bench->count, command, NULL, results);
+    } else {
+        for (size_t i = 0; i < bench->count; i++) {
+            htu21d_dev_trigger(bench->devs[i], command, NULL);
+        }
+    }
+    for (size_t i = 0; i < bench->count; i++) {
+        bench->sims[i].ready_us = 0;
+    }
+    if (bench->batched) {
+        htu21d_batch_fetch(bench->devs, bench->count, raw_values, NULL, results);
+    } else {
+        for (size_t i = 0; i < bench->count; i++) {
+            results[i] = htu21d_dev_fetch(bench->devs[i], &raw_values[i], NULL);
+        }
+    }
+    for (size_t i = 0; i < bench->count; i++) {
+        if (results[i] != HTU21D_ERR_OK) {
+            fprintf(stderr, "Sensor %zu failed, error 0x%02X\n", i, results[i]);
+        }
+    }
+}
+
+/**
+ * @brief Samples all the sensors `samples` times, returns the time per sample
+ * of one sensor in nanoseconds.
+ */
+static double run(const bench_t *bench, unsigned int samples)
+{
+    int64_t start_us = htu21d_port_time_us();
+    for (unsigned int i = 0; i < samples; i++) {
+        sample_channel(bench, TRIGGER_TEMP_MEASURE_NOHOLD);
+        sample_channel(bench, TRIGGER_HUMD_MEASURE_NOHOLD);
+    }
+    return (double)(htu21d_port_time_us() - start_us) * 1000.0 / samples / bench->count;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int samples = 100000, sensors = 4;
+    int option;
+
+    while ((option = getopt(argc, argv, "n:s:")) != -1) {
+        switch (option) {
+        case 'n':
+            samples = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            sensors = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n samples] [-s sensors]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (samples == 0 || sensors == 0 || sensors > 8) {
+        fprintf(stderr, "samples must be at least 1, sensors 1 to 8\n");
+        return EXIT_FAILURE;
+    }
+
+    htu21d_sim_t sims[8];
+    htu21d_sim_bus_t sim_bus;
+    htu21d_linux_bus_t bus;
+    htu21d_mux_t mux;
+    htu21d_dev_t devs[8];
+    htu21d_dev_t *dev_list[8];
+    bench_t bench = {
+        .sims = sims,
+        .devs = dev_list,
+        .count = sensors,
+    };
+
+    htu21d_sim_bus_init(&sim_bus);
+    htu21d_linux_mock_init(&htu21d_sim_bus_transport, &sim_bus);
+    int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    if (null_fd < 0 || htu21d_linux_bus_open(&bus, "/dev/null") != HTU21D_ERR_OK) {
+        return EXIT_FAILURE;
+    }
+    htu21d_mux_init(&mux, &htu21d_linux_transport, &bus, HTU21D_SIM_MUX_ADDR);
+    for (unsigned int i = 0; i < sensors; i++) {
+        htu21d_sim_init(&sims[i], 20.0F + (float) i, 50.0F);
+        sim_bus.channels[i] = &sims[i];
+        if (htu21d_dev_attach_mux(&devs[i], &mux, (uint8_t) i) != HTU21D_ERR_OK) {
+            return EXIT_FAILURE;
+        }
+        dev_list[i] = &devs[i];
+    }
+
+    printf("%u sensors behind a multiplexer, %u samples each\n", sensors, samples);
+    printf("%-8s %14s %16s %16s %16s\n", "mode", "ioctls/sample", "ns/sample mock", "ns/sample kernel",
+           "syscall ns/sample");
+    for (int batched = 0; batched <= 1; batched++) {
+        bench.batched = batched;
+        htu21d_linux_mock.syscall_fd = -1;
+        htu21d_linux_mock.ioctls = 0;
+        double mock_ns = run(&bench, samples);
+        double ioctls = (double) htu21d_linux_mock.ioctls / samples / sensors;
+
+        htu21d_linux_mock.syscall_fd = null_fd;
+        double kernel_ns = run(&bench, samples);
+        printf("%-8s %14.2f %16.1f %16.1f %16.1f\n", batched ? "batched" : "single", ioctls, mock_ns,
+               kernel_ns, kernel_ns - mock_ns);
+    }
+
+    htu21d_linux_bus_close(&bus);
+    close(null_fd);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file htu21d_linux_mock.c
+ * @brief User-space mock of the i2c-dev `ioctl()`s.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "htu21d_linux_mock.h"
+
+htu21d_linux_mock_t htu21d_linux_mock = {
+    .syscall_fd = -1,
+};
+
+/**
+ * @brief Resets the mock, with the backend the `I2C_RDWR` messages go to. The
+ * adapter reports plain I2C support.
+ * @param transport Backend transport.
+ * @param bus Passed to `transport`.
+ */
+void htu21d_linux_mock_init(const htu21d_transport_t *transport, void *bus)
+{
+    htu21d_linux_mock = (htu21d_linux_mock_t) {
+        .transport = transport,
+        .bus = bus,
+        .functions = I2C_FUNC_I2C,
+        .syscall_fd = -1,
+    };
+}
+
+/**
+ * @brief Maps an `HTU21D_ERR_*` code of the backend to the `errno` i2c-dev
+ * sets for it.
+ */
+static int htu21d_to_errno(int ret)
+{
+    switch (ret) {
+
+    case HTU21D_ERR_FAIL:
+        return ENXIO;
+
+    case HTU21D_ERR_TIMEOUT:
+        return ETIMEDOUT;
+
+    case HTU21D_ERR_INVALID_ARG:
+        return EINVAL;
+    }
+    return EIO;
+}
+
+/**
+ * @brief Passes the messages of an `I2C_RDWR` to the backend: a write followed
+ * by a read of the same address is one transfer, with a repeated start.
+ */
+static int mock_rdwr(const struct i2c_rdwr_ioctl_data *data)
+{
+    htu21d_linux_mock_t *mock = &htu21d_linux_mock;
+    htu21d_transfer_t transfers[I2C_RDWR_IOCTL_MAX_MSGS];
+    size_t count = 0;
+
+    mock->ioctls++;
+    if (data->nmsgs == 0 || data->nmsgs > I2C_RDWR_IOCTL_MAX_MSGS) {
+        return EINVAL;
+    }
+    mock->messages += data->nmsgs;
+    mock->last_count = data->nmsgs;
+    memcpy(mock->last, data->msgs, data->nmsgs * sizeof(data->msgs[0]));
+    if (mock->syscall_fd >= 0) {
+        syscall(SYS_ioctl, mock->syscall_fd, I2C_RDWR, data);
+    }
+    if (mock->fail_errno != 0) {
+        return mock->fail_errno;
+    }
+
+    for (uint32_t i = 0; i < data->nmsgs; i++) {
+        const struct i2c_msg *message = &data->msgs[i];
+        htu21d_transfer_t *transfer = &transfers[count++];
+        *transfer = (htu21d_transfer_t) {
+            .address = (uint8_t) message->addr,
+        };
+        if (message->flags & I2C_M_RD) {
+            transfer->read_data = message->buf;
+            transfer->read_len = message->len;
+            continue;
+        }
+        transfer->write_data = message->buf;
+        transfer->write_len = message->len;
+        if (i + 1 < data->nmsgs && (data->msgs[i + 1].flags & I2C_M_RD) &&
+                data->msgs[i + 1].addr == message->addr) {
+            transfer->read_data = data->msgs[i + 1].buf;
+            transfer->read_len = data->msgs[i + 1].len;
+            i++;
+        }
+    }
+
+    const htu21d_transport_t *transport = mock->transport;
+    const htu21d_transfer_t *transfer = &transfers[0];
+    int ret;
+    if (count > 1) {
+        if (transport->batch == NULL) {
+            return EOPNOTSUPP;
+        }
+        ret = transport->batch(mock->bus, transfers, count);
+    } else if (transfer->read_len == 0) {
+        ret = transport->write(mock->bus, transfer->address, transfer->write_data, transfer->write_len);
+    } else if (transfer->write_len == 0) {
+        ret = transport->read(mock->bus, transfer->address, transfer->read_data, transfer->read_len);
+    } else {
+        ret = transport->write_read(mock->bus, transfer->address, transfer->write_data, transfer->write_len,
+                                    transfer->read_data, transfer->read_len);
+    }
+    return ret == HTU21D_ERR_OK ? 0 : htu21d_to_errno(ret);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    va_list args;
+    va_start(args, request);
+    void *arg = va_arg(args, void *);
+    va_end(args);
+
+    int error;
+    switch (request) {
+
+    case I2C_FUNCS:
+        *(unsigned long *) arg = htu21d_linux_mock.functions;
+        return 0;
+
+    case I2C_RDWR:
+        error = mock_rdwr(arg);
+        break;
+
+    default:
+        return (int) syscall(SYS_ioctl, fd, request, arg);
+    }
+
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
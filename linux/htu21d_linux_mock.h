@@ -0,0 +1,51 @@
+/**
+ * @file htu21d_linux_mock.h
+ * @brief User-space mock of the i2c-dev `ioctl()`s, for testing and
+ * benchmarking htu21d_linux.c without an adapter.
+ *
+ * Linking htu21d_linux_mock.c into an executable replaces `ioctl()`:
+ * `I2C_FUNCS` reports #htu21d_linux_mock_t::functions, and each `I2C_RDWR` is
+ * recorded, then passed as one submission to a backend transport, usually a
+ * simulated sensor or bus (see htu21d_sim.h). Any other request goes to the
+ * kernel. Open the bus on any file, e.g. `/dev/null`.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __HTU21D_LINUX_MOCK_H__
+#define __HTU21D_LINUX_MOCK_H__
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "htu21d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief State of the mock. Set the public members directly.
+ */
+typedef struct {
+    const htu21d_transport_t *transport; /**< Backend the messages of an `I2C_RDWR` are passed to. */
+    void *bus;                /**< Passed to `transport`. */
+    unsigned long functions;  /**< Reported by `I2C_FUNCS`. */
+    int fail_errno;           /**< When not 0, every `I2C_RDWR` fails with this `errno` without reaching the backend. */
+    int syscall_fd;           /**< When not negative, every `I2C_RDWR` also makes a real `ioctl()` on this descriptor, to cost one system call. */
+    uint32_t ioctls;          /**< `I2C_RDWR` calls seen. */
+    uint32_t messages;        /**< Messages seen in them. */
+    uint32_t last_count;      /**< Messages of the last `I2C_RDWR`. */
+    struct i2c_msg last[I2C_RDWR_IOCTL_MAX_MSGS]; /**< Messages of the last `I2C_RDWR`; the buffers are only valid during the call. */
+} htu21d_linux_mock_t;
+
+extern htu21d_linux_mock_t htu21d_linux_mock;
+
+void htu21d_linux_mock_init(const htu21d_transport_t *transport, void *bus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HTU21D_LINUX_MOCK_H__
@@ -0,0 +1,310 @@
+/**
+ * @file htu21d_linux_test.c
+ * @brief Tests of the Linux i2c-dev transport, against the `ioctl()` mock of
+ * htu21d_linux_mock.h and simulated sensors. Run with `ctest`.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "htu21d_linux.h"
+#include "htu21d_linux_mock.h"
+#include "htu21d_sim.h"
+
+static int failures;
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if (!(condition)) {                                                 \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static void test_bus_open(void)
+{
+    htu21d_linux_bus_t bus;
+    htu21d_sim_t sim;
+
+    htu21d_sim_init(&sim, 21.0F, 45.0F);
+    htu21d_linux_mock_init(&htu21d_sim_transport, &sim);
+    CHECK(htu21d_linux_bus_open(&bus, "/dev/null") == HTU21D_ERR_OK);
+    CHECK(bus.fd >= 0);
+    htu21d_linux_bus_close(&bus);
+    CHECK(bus.fd == -1);
+
+    CHECK(htu21d_linux_bus_open(&bus, "/nonexistent/i2c-1") == HTU21D_ERR_CONFIG);
+    CHECK(htu21d_linux_bus_open(NULL, "/dev/null") == HTU21D_ERR_INVALID_ARG);
+
+    // An SMBus-only adapter cannot send combined transactions.
+    htu21d_linux_mock.functions = 0;
+    CHECK(htu21d_linux_bus_open(&bus, "/dev/null") == HTU21D_ERR_INVALID_STATE);
+    CHECK(bus.fd == -1);
+}
+
+static void test_messages(void)
+{
+    htu21d_linux_bus_t bus;
+    htu21d_sim_t sim;
+    const struct i2c_msg *last = htu21d_linux_mock.last;
+
+    htu21d_sim_init(&sim, 21.0F, 45.0F);
+    htu21d_linux_mock_init(&htu21d_sim_transport, &sim);
+    CHECK(htu21d_linux_bus_open(&bus, "/dev/null") == HTU21D_ERR_OK);
+
+    const uint8_t trigger = TRIGGER_TEMP_MEASURE_NOHOLD;
+    const uint8_t command = READ_USER_REG;
+    uint8_t data[3];
+    CHECK(htu21d_linux_transport.write(&bus, HTU21D_ADDR, &trigger, 1) == HTU21D_ERR_OK);
+    CHECK(htu21d_linux_mock.ioctls == 1 && htu21d_linux_mock.last_count == 1);
+    CHECK(last[0].addr == HTU21D_ADDR && last[0].flags == 0 && last[0].len == 1);
+
+    sim.ready_us = 0;
+    CHECK(htu21d_linux_transport.read(&bus, HTU21D_ADDR, data, 3) == HTU21D_ERR_OK);
+    CHECK(htu21d_linux_mock.ioctls == 2 && htu21d_linux_mock.last_count == 1);
+    CHECK(last[0].flags == I2C_M_RD && last[0].len == 3);
+
+    // A write then read is one ioctl, sent with a repeated start.
+    data[0] = 0;
+    CHECK(htu21d_linux_transport.write_read(&bus, HTU21D_ADDR, &command, 1, data, 1) == HTU21D_ERR_OK);
+    CHECK(htu21d_linux_mock.ioctls == 3 && htu21d_linux_mock.last_count == 2);
+    CHECK(last[0].flags == 0 && last[0].len == 1 && last[1].flags == I2C_M_RD && last[1].len == 1);
+    CHECK(data[0] == sim.user_register);
+
+    // A batch is one ioctl, with one message per write and per read.
+    const htu21d_transfer_t transfers[] = {
+        {.address = HTU21D_ADDR, .write_data = &command, .write_len = 1},
+        {.address = HTU21D_ADDR, .write_data = &command, .write_len = 1, .read_data = data, .read_len = 1},
+        {.address = HTU21D_ADDR, .read_data = data, .read_len = 1},
+    };
+    htu21d_linux_mock.fail_errno = EIO;
+    CHECK(htu21d_linux_transport.batch(&bus, transfers, 3) == HTU21D_ERR_FAIL);
+    CHECK(htu21d_linux_mock.ioctls == 4 && htu21d_linux_mock.last_count == 4);
+    CHECK(last[0].flags == 0 && last[1].flags == 0 && last[2].flags == I2C_M_RD && last[3].flags == I2C_M_RD);
+
+    // More messages than one ioctl takes are refused before the system call.
+    htu21d_transfer_t many[I2C_RDWR_IOCTL_MAX_MSGS / 2 + 1];
+    for (size_t i = 0; i < sizeof(many) / sizeof(many[0]); i++) {
+        many[i] = transfers[1];
+    }
+    CHECK(htu21d_linux_transport.batch(&bus, many, sizeof(many) / sizeof(many[0])) == HTU21D_ERR_INVALID_ARG);
+    CHECK(htu21d_linux_mock.ioctls == 4);
+
+    htu21d_linux_bus_close(&bus);
+}
+
+static void test_errors(void)
+{
+    static const struct {
+        int error;
+        int expected;
+    } cases[] = {
+        {ENXIO, HTU21D_ERR_FAIL},
+        {EREMOTEIO, HTU21D_ERR_FAIL},
+        {ETIMEDOUT, HTU21D_ERR_TIMEOUT},
+        {EAGAIN, HTU21D_ERR_TIMEOUT},
+        {EINVAL, HTU21D_ERR_INVALID_ARG},
+        {EOPNOTSUPP, HTU21D_ERR_INVALID_ARG},
+        {EBADF, HTU21D_ERR_INVALID_STATE},
+        {ENODEV, HTU21D_ERR_INVALID_STATE},
+        {EIO, HTU21D_ERR_FAIL},
+    };
+    htu21d_linux_bus_t bus;
+    htu21d_sim_t sim;
+    uint8_t data[3];
+
+    htu21d_sim_init(&sim, 21.0F, 45.0F);
+    htu21d_linux_mock_init(&htu21d_sim_transport, &sim);
+    CHECK(htu21d_linux_bus_open(&bus, "/dev/null") == HTU21D_ERR_OK);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        htu21d_linux_mock.fail_errno = cases[i].error;
+        CHECK(htu21d_linux_transport.read(&bus, HTU21D_ADDR, data, 3) == cases[i].expected);
+    }
+
+    // A NACK of the simulated sensor comes back as ENXIO.
+    htu21d_linux_mock.fail_errno = 0;
+    CHECK(htu21d_linux_transport.read(&bus, HTU21D_ADDR + 1, data, 3) == HTU21D_ERR_FAIL);
+
+    htu21d_linux_bus_close(&bus);
+}
+
+static void test_sample(void)
+{
+    htu21d_linux_bus_t bus;
+    htu21d_sim_t sim;
+    htu21d_dev_t dev;
+    htu21d_sample_t sample;
+
+    htu21d_sim_init(&sim, 21.5F, 45.0F);
+    htu21d_linux_mock_init(&htu21d_sim_transport, &sim);
+    CHECK(htu21d_linux_bus_open(&bus, "/dev/null") == HTU21D_ERR_OK);
+    CHECK(htu21d_dev_attach(&dev, &htu21d_linux_transport, &bus) == HTU21D_ERR_OK);
+
+    // Trigger and read back of both channels: four system calls.
+    uint32_t ioctls = htu21d_linux_mock.ioctls;
+    CHECK(htu21d_dev_read_raw_sample(&dev, &sample) == HTU21D_ERR_OK);
+    CHECK(htu21d_linux_mock.ioctls - ioctls == 4);
+    CHECK(fabsf(htu21d_raw_to_temperature(sample.raw_temperature) - 21.5F) < 0.1F);
+    CHECK(fabsf(htu21d_raw_to_humidity(sample.raw_humidity) - 45.0F) < 0.2F);
+
+    htu21d_linux_bus_close(&bus);
+}
+
+static void test_batch(void)
+{
+    enum { SENSORS = 4 };
+    htu21d_linux_bus_t bus;
+    htu21d_sim_t sims[SENSORS];
+    htu21d_sim_bus_t sim_bus;
+    htu21d_mux_t mux;
+    htu21d_dev_t devs[SENSORS];
+    htu21d_dev_t *dev_list[SENSORS];
+    uint16_t raw_values[SENSORS];
+    int results[SENSORS];
+
+    htu21d_sim_bus_init(&sim_bus);
+    htu21d_linux_mock_init(&htu21d_sim_bus_transport, &sim_bus);
+    CHECK(htu21d_linux_bus_open(&bus, "/dev/null") == HTU21D_ERR_OK);
+    CHECK(htu21d_mux_init(&mux, &htu21d_linux_transport, &bus, HTU21D_SIM_MUX_ADDR) == HTU21D_ERR_OK);
+    for (int i = 0; i < SENSORS; i++) {
+        htu21d_sim_init(&sims[i], 20.0F + (float) i, 50.0F);
+        sim_bus.channels[i] = &sims[i];
+        CHECK(htu21d_dev_attach_mux(&devs[i], &mux, (uint8_t) i) == HTU21D_ERR_OK);
+        dev_list[i] = &devs[i];
+    }
+
+    // A channel select ends its submission, so each ioctl carries the
+    // transaction of a sensor and the select of the next channel: one more
+    // ioctl than sensors, instead of two per sensor.
+    uint32_t ioctls = htu21d_linux_mock.ioctls;
+    CHECK(htu21d_batch_trigger(dev_list, SENSORS, TRIGGER_TEMP_MEASURE_NOHOLD, NULL, results) == HTU21D_ERR_OK);
+    CHECK(htu21d_linux_mock.ioctls - ioctls == SENSORS + 1);
+    usleep(HTU21D_CONVERSION_TIME_MS * 1000);
+    ioctls = htu21d_linux_mock.ioctls;
+    CHECK(htu21d_batch_fetch(dev_list, SENSORS, raw_values, NULL, results) == HTU21D_ERR_OK);
+    CHECK(htu21d_linux_mock.ioctls - ioctls == SENSORS + 1);
+    for (int i = 0; i < SENSORS; i++) {
+        CHECK(results[i] == HTU21D_ERR_OK);
+        CHECK(fabsf(htu21d_raw_to_temperature(raw_values[i]) - (20.0F + (float) i)) < 0.1F);
+    }
+
+    htu21d_linux_bus_close(&bus);
+}
+
+/**
+ * @brief A simulated bus whose multiplexer does not acknowledge the next
+ * channel select of a multi-transaction submission, after the transactions
+ * before it ran.
+ */
+typedef struct {
+    htu21d_sim_bus_t sim_bus;
+    bool fail_select;
+} flaky_bus_t;
+
+static int flaky_write(void *bus, uint8_t address, const uint8_t *data, size_t len)
+{
+    return htu21d_sim_bus_transport.write(&((flaky_bus_t *) bus)->sim_bus, address, data, len);
+}
+
+static int flaky_read(void *bus, uint8_t address, uint8_t *data, size_t len)
+{
+    return htu21d_sim_bus_transport.read(&((flaky_bus_t *) bus)->sim_bus, address, data, len);
+}
+
+static int flaky_write_read(void *bus, uint8_t address, const uint8_t *write_data, size_t write_len,
+                            uint8_t *read_data, size_t read_len)
+{
+    return htu21d_sim_bus_transport.write_read(&((flaky_bus_t *) bus)->sim_bus, address, write_data, write_len,
+                                               read_data, read_len);
+}
+
+static int flaky_batch(void *bus, const htu21d_transfer_t *transfers, size_t count)
+{
+    flaky_bus_t *flaky = (flaky_bus_t *) bus;
+
+    for (size_t i = 0; i < count; i++) {
+        if (flaky->fail_select && transfers[i].address == HTU21D_SIM_MUX_ADDR) {
+            flaky->fail_select = false;
+            if (i > 0) {
+                htu21d_sim_bus_transport.batch(&flaky->sim_bus, transfers, i);
+            }
+            return HTU21D_ERR_FAIL;
+        }
+    }
+    return htu21d_sim_bus_transport.batch(&flaky->sim_bus, transfers, count);
+}
+
+static const htu21d_transport_t flaky_transport = {
+    .write = flaky_write,
+    .read = flaky_read,
+    .write_read = flaky_write_read,
+    .batch = flaky_batch,
+};
+
+static void test_batch_failure(void)
+{
+    enum { SENSORS = 2 };
+    htu21d_linux_bus_t bus;
+    htu21d_sim_t sims[SENSORS];
+    flaky_bus_t flaky = {0};
+    htu21d_mux_t mux;
+    htu21d_dev_t devs[SENSORS];
+    htu21d_dev_t *dev_list[SENSORS];
+    uint16_t raw_values[SENSORS];
+    int results[SENSORS];
+
+    htu21d_sim_bus_init(&flaky.sim_bus);
+    htu21d_linux_mock_init(&flaky_transport, &flaky);
+    CHECK(htu21d_linux_bus_open(&bus, "/dev/null") == HTU21D_ERR_OK);
+    CHECK(htu21d_mux_init(&mux, &htu21d_linux_transport, &bus, HTU21D_SIM_MUX_ADDR) == HTU21D_ERR_OK);
+    for (int i = 0; i < SENSORS; i++) {
+        htu21d_sim_init(&sims[i], 20.0F + (float) i, 50.0F);
+        flaky.sim_bus.channels[i] = &sims[i];
+        CHECK(htu21d_dev_attach_mux(&devs[i], &mux, (uint8_t) i) == HTU21D_ERR_OK);
+        dev_list[i] = &devs[i];
+    }
+
+    CHECK(htu21d_batch_trigger(dev_list, SENSORS, TRIGGER_TEMP_MEASURE_NOHOLD, NULL, results) == HTU21D_ERR_OK);
+    usleep(HTU21D_CONVERSION_TIME_MS * 1000);
+
+    // The read-back of sensor 0 goes through, then the select of channel 1
+    // fails its submission. The sensor hands a result out once, so resending
+    // the read would lose it: it is kept, and only the select is resent.
+    flaky.fail_select = true;
+    CHECK(htu21d_batch_fetch(dev_list, SENSORS, raw_values, NULL, results) == HTU21D_ERR_OK);
+    CHECK(!flaky.fail_select);
+    for (int i = 0; i < SENSORS; i++) {
+        CHECK(results[i] == HTU21D_ERR_OK);
+        CHECK(fabsf(htu21d_raw_to_temperature(raw_values[i]) - (20.0F + (float) i)) < 0.1F);
+        CHECK(devs[i].errors.resent == 0);
+    }
+
+    // A trigger that went through cannot be told from one that did not: it is
+    // resent, and counted.
+    flaky.fail_select = true;
+    CHECK(htu21d_batch_trigger(dev_list, SENSORS, TRIGGER_TEMP_MEASURE_NOHOLD, NULL, results) == HTU21D_ERR_OK);
+    CHECK(devs[0].errors.resent == 1 && devs[1].errors.resent == 0);
+
+    htu21d_linux_bus_close(&bus);
+}
+
+int main(void)
+{
+    test_bus_open();
+    test_messages();
+    test_errors();
+    test_sample();
+    test_batch();
+    test_batch_failure();
+
+    if (failures != 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,655 @@
+/**
+ * @file htu21d_noise.c
+ * @brief Noise analysis of raw captures, per resolution: variance, noise floor
+ * histogram and overlapping Allan deviation, and the sampling configurations
+ * that meet a target noise and output rate.
+ *
+ * Usage:
+ *
+ *     htu21d-noise [-j threads] [-T target_c] [-H target_rh] [-r rate_hz] capture.csv
+ *
+ * The capture is the output of examples/noise_htu21d: the lines
+ * `N,<resolution>,<timestamp_us>,<raw_temperature>,<raw_humidity>`, in
+ * time order, and the gap markers `G,<resolution>,<timestamp_us>` of the
+ * samples that failed, other lines (e.g. the log) being ignored. Every
+ * resolution found makes one series per quantity.
+ *
+ * The Allan deviation needs evenly spaced samples. A series is split into
+ * segments at each gap marker, and wherever the time between two samples is
+ * more than #MAX_JUMP_PERIODS times its median (a capture without markers,
+ * lost log lines, a reset), and averages never span two segments.
+ *
+ * For each series, the program prints the standard deviation, the histogram
+ * of the deviations from the mean in steps of the resolution (the noise
+ * floor), and the overlapping Allan deviation for averages of m = 1, 2, 4, ...
+ * samples. For white noise, the Allan deviation at m is the noise left after
+ * averaging m samples, so the last table gives, per resolution, the smallest
+ * power-of-two oversampling that brings both quantities under `target_c` and
+ * `target_rh`, and the output rate it leaves. Among the configurations that
+ * reach `rate_hz`, the one that keeps the sensor converting for the shortest
+ * time per output sample is recommended.
+ *
+ * Captures of several days have tens of millions of lines: the file is
+ * parsed in `threads` chunks (the number of CPUs by default), and the Allan
+ * deviations of all series and averaging lengths are spread over the same
+ * number of threads, using prefix sums so that each one is a single pass.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_THREADS         64
+#define MAX_SERIES          8   /**< Four resolutions, two quantities each. */
+#define MAX_TAUS            40
+#define MIN_DIFFERENCES     16  /**< Fewest differences of averages an Allan deviation is computed from. */
+#define HISTOGRAM_HALF      4   /**< The noise floor histogram spans +/- this many steps. */
+#define HISTOGRAM_BINS      (2 * HISTOGRAM_HALF + 1)
+#define PERIOD_SAMPLES      1024 /**< Intervals the median period of a resolution is taken from. */
+#define MAX_JUMP_PERIODS    3   /**< Intervals longer than this many median periods split a series. */
+
+enum {
+    QUANTITY_TEMPERATURE,
+    QUANTITY_HUMIDITY,
+    QUANTITY_COUNT,
+};
+
+static const char *const quantity_names[QUANTITY_COUNT] = {"temperature", "humidity"};
+static const char *const quantity_units[QUANTITY_COUNT] = {"C", "%RH"};
+/** Physical units per raw count, from the conversion formulas of the datasheet. */
+static const double quantity_scales[QUANTITY_COUNT] = {175.72 / 65536.0, 125.0 / 65536.0};
+static const double quantity_offsets[QUANTITY_COUNT] = {-46.85, -6.0};
+
+/** Bits of each quantity, and maximum conversion times, indexed by `b7 << 1 | b0`. */
+static const unsigned int resolution_bits[QUANTITY_COUNT][4] = {{14, 12, 13, 11}, {12, 8, 10, 11}};
+static const double conversion_ms[QUANTITY_COUNT][4] = {{50, 13, 25, 7}, {16, 3, 5, 8}};
+
+typedef struct {
+    int64_t timestamp_us;
+    uint16_t raw[QUANTITY_COUNT];
+    uint8_t resolution;
+    bool gap;               /**< A gap marker: the sample at `timestamp_us` failed. */
+} record_t;
+
+/** Records of one chunk of the file, in file order. */
+typedef struct {
+    const char *start;
+    const char *end;
+    record_t *records;
+    size_t count;
+    size_t capacity;
+} chunk_t;
+
+/** One quantity at one resolution. */
+typedef struct {
+    uint8_t resolution;
+    int quantity;
+    size_t count;
+    double *values;         /**< Raw values, minus the first one for precision. */
+    double *prefix;         /**< `prefix[i]` is the sum of the first `i` values. */
+    size_t *starts;         /**< First value of each segment, then `count`. */
+    size_t segments;        /**< Runs of evenly spaced values, see #MAX_JUMP_PERIODS. */
+    size_t capacity;        /**< Entries allocated in `starts`. */
+    double period_s;        /**< Mean time between two samples of a segment. */
+    double mean;            /**< In raw counts, first value included. */
+    double variance;        /**< In raw counts squared. */
+    uint64_t histogram[HISTOGRAM_BINS];
+    uint64_t outliers;      /**< Deviations beyond the histogram. */
+    size_t taus;
+    size_t m[MAX_TAUS];
+    double adev[MAX_TAUS];  /**< In raw counts. */
+} series_t;
+
+static series_t series[MAX_SERIES];
+static size_t series_count;
+
+/** Next work item of the Allan deviation threads. */
+static atomic_size_t next_item;
+
+static size_t resolution_index(uint8_t resolution)
+{
+    return ((resolution >> 6) & 0x02) | (resolution & 0x01);
+}
+
+/**
+ * @brief Parses an unsigned decimal or `0x` hexadecimal number.
+ * @return Returns a pointer past the number and its trailing comma, or `NULL`
+ * if there is no number.
+ */
+static const char *parse_number(const char *p, const char *end, int64_t *value)
+{
+    int base = 10;
+    const char *digits;
+
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    }
+    *value = 0;
+    for (digits = p; p < end; p++) {
+        int digit;
+        if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+        } else if (base == 16 && *p >= 'a' && *p <= 'f') {
+            digit = *p - 'a' + 10;
+        } else if (base == 16 && *p >= 'A' && *p <= 'F') {
+            digit = *p - 'A' + 10;
+        } else {
+            break;
+        }
+        *value = *value * base + digit;
+    }
+    if (p == digits) {
+        return NULL;
+    }
+    return (p < end && *p == ',') ? p + 1 : p;
+}
+
+static void *parse_thread(void *arg)
+{
+    chunk_t *chunk = (chunk_t *) arg;
+    const char *line = chunk->start;
+
+    while (line < chunk->end) {
+        const char *eol = memchr(line, '\n', (size_t)(chunk->end - line));
+        if (eol == NULL) {
+            eol = chunk->end;
+        }
+
+        int64_t fields[4] = {0};
+        const char *p = line + 2;
+        int parsed = 0, expected = 0;
+        if (eol - line > 2 && (line[0] == 'N' || line[0] == 'G') && line[1] == ',') {
+            expected = (line[0] == 'N') ? 4 : 2;
+            while (parsed < expected && p != NULL && p < eol) {
+                p = parse_number(p, eol, &fields[parsed]);
+                parsed += (p != NULL);
+            }
+        }
+        if (expected != 0 && parsed == expected) {
+            if (chunk->count == chunk->capacity) {
+                chunk->capacity = chunk->capacity ? 2 * chunk->capacity : 4096;
+                chunk->records = realloc(chunk->records, chunk->capacity * sizeof(record_t));
+                if (chunk->records == NULL) {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            chunk->records[chunk->count++] = (record_t) {
+                .resolution = (uint8_t) fields[0],
+                .timestamp_us = fields[1],
+                .raw = {(uint16_t) fields[2], (uint16_t) fields[3]},
+                .gap = (line[0] == 'G'),
+            };
+        }
+        line = eol + 1;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Splits the file into chunks on line boundaries, and parses them in
+ * parallel.
+ */
+static void parse(const char *data, size_t size, chunk_t *chunks, unsigned int threads)
+{
+    pthread_t ids[MAX_THREADS];
+    const char *start = data;
+
+    for (unsigned int i = 0; i < threads; i++) {
+        const char *end = data + size * (i + 1) / threads;
+        if (end < start) {
+            end = start;
+        }
+        if (i + 1 < threads) {
+            const char *eol = memchr(end, '\n', (size_t)(data + size - end));
+            end = eol ? eol + 1 : data + size;
+        }
+        chunks[i] = (chunk_t) {
+            .start = start,
+            .end = end,
+        };
+        start = end;
+        pthread_create(&ids[i], NULL, parse_thread, &chunks[i]);
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+    }
+}
+
+static series_t *find_series(uint8_t resolution, int quantity)
+{
+    for (size_t i = 0; i < series_count; i++) {
+        if (series[i].resolution == resolution && series[i].quantity == quantity) {
+            return &series[i];
+        }
+    }
+    if (series_count == MAX_SERIES) {
+        return NULL;
+    }
+    series[series_count] = (series_t) {
+        .resolution = resolution,
+        .quantity = quantity,
+    };
+    return &series[series_count++];
+}
+
+static int compare_intervals(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Estimates the period of each resolution: the median of its first
+ * #PERIOD_SAMPLES intervals between samples, gap markers excluded.
+ * @param[out] period_us Periods indexed by `b7 << 1 | b0`, 0 when unknown.
+ */
+static void estimate_periods(const chunk_t *chunks, unsigned int threads, int64_t period_us[4])
+{
+    static int64_t intervals[4][PERIOD_SAMPLES];
+    size_t counts[4] = {0};
+    int64_t previous_us[4];
+    bool previous[4] = {false};
+
+    for (unsigned int c = 0; c < threads; c++) {
+        for (size_t i = 0; i < chunks[c].count; i++) {
+            const record_t *record = &chunks[c].records[i];
+            size_t r = resolution_index(record->resolution);
+            if (!record->gap && previous[r] && counts[r] < PERIOD_SAMPLES) {
+                intervals[r][counts[r]++] = record->timestamp_us - previous_us[r];
+            }
+            previous[r] = !record->gap;
+            previous_us[r] = record->timestamp_us;
+        }
+    }
+    for (size_t r = 0; r < 4; r++) {
+        qsort(intervals[r], counts[r], sizeof(intervals[r][0]), compare_intervals);
+        period_us[r] = (counts[r] > 0) ? intervals[r][counts[r] / 2] : 0;
+    }
+}
+
+/**
+ * @brief Starts a segment of a series at its next value.
+ */
+static void start_segment(series_t *s)
+{
+    if (s->segments + 1 >= s->capacity) {
+        s->capacity = s->capacity ? 2 * s->capacity : 16;
+        s->starts = realloc(s->starts, s->capacity * sizeof(size_t));
+        if (s->starts == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    s->starts[s->segments++] = s->count;
+}
+
+/**
+ * @brief Gathers the records of all chunks into one series per resolution
+ * and quantity, in file order, split into segments at the gaps.
+ */
+static void build_series(const chunk_t *chunks, unsigned int threads)
+{
+    // First pass: sizes.
+    for (unsigned int c = 0; c < threads; c++) {
+        for (size_t i = 0; i < chunks[c].count; i++) {
+            for (int q = 0; q < QUANTITY_COUNT && !chunks[c].records[i].gap; q++) {
+                series_t *s = find_series(chunks[c].records[i].resolution & 0x81, q);
+                if (s != NULL) {
+                    s->count++;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < series_count; i++) {
+        series[i].values = malloc(series[i].count * sizeof(double));
+        series[i].prefix = malloc((series[i].count + 1) * sizeof(double));
+        if (series[i].values == NULL || series[i].prefix == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        series[i].count = 0;
+    }
+
+    // Second pass: values, segments, and the time spanned by the segments.
+    int64_t period_us[4];
+    estimate_periods(chunks, threads, period_us);
+    int64_t previous_us[4] = {0};
+    bool split[4] = {true, true, true, true};
+    int64_t segment_us[MAX_SERIES], last_us[MAX_SERIES], span_us[MAX_SERIES] = {0};
+    double first_raw[MAX_SERIES];
+    for (unsigned int c = 0; c < threads; c++) {
+        for (size_t i = 0; i < chunks[c].count; i++) {
+            const record_t *record = &chunks[c].records[i];
+            size_t r = resolution_index(record->resolution);
+            if (record->gap) {
+                split[r] = true;
+                continue;
+            }
+            int64_t interval_us = record->timestamp_us - previous_us[r];
+            if (interval_us <= 0 || interval_us > MAX_JUMP_PERIODS * period_us[r]) {
+                split[r] = true;
+            }
+            previous_us[r] = record->timestamp_us;
+
+            for (int q = 0; q < QUANTITY_COUNT; q++) {
+                series_t *s = find_series(record->resolution & 0x81, q);
+                if (s == NULL) {
+                    continue;
+                }
+                size_t index = (size_t)(s - series);
+                if (s->count == 0) {
+                    first_raw[index] = record->raw[q];
+                }
+                if (split[r] || s->count == 0) {
+                    if (s->count != 0) {
+                        span_us[index] += last_us[index] - segment_us[index];
+                    }
+                    segment_us[index] = record->timestamp_us;
+                    start_segment(s);
+                }
+                last_us[index] = record->timestamp_us;
+                s->values[s->count++] = record->raw[q] - first_raw[index];
+            }
+            split[r] = false;
+        }
+    }
+    for (size_t i = 0; i < series_count; i++) {
+        series[i].mean = first_raw[i];
+        series[i].starts[series[i].segments] = series[i].count;
+        span_us[i] += last_us[i] - segment_us[i];
+        if (series[i].count > series[i].segments) {
+            series[i].period_s = (double) span_us[i] / 1e6 / (double)(series[i].count - series[i].segments);
+        }
+    }
+}
+
+/**
+ * @brief Returns the differences of averages of `m` samples an Allan
+ * deviation of a series is computed from, summed over its segments.
+ */
+static size_t differences(const series_t *s, size_t m)
+{
+    size_t count = 0;
+
+    for (size_t segment = 0; segment < s->segments; segment++) {
+        size_t length = s->starts[segment + 1] - s->starts[segment];
+        if (length >= 2 * m) {
+            count += length - 2 * m + 1;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Mean, variance, noise floor histogram and prefix sums of a series.
+ */
+static void describe_series(series_t *s)
+{
+    double sum = 0.0, squares = 0.0;
+    double step = (double)(1U << (16 - resolution_bits[s->quantity][resolution_index(s->resolution)]));
+
+    s->prefix[0] = 0.0;
+    for (size_t i = 0; i < s->count; i++) {
+        sum += s->values[i];
+        s->prefix[i + 1] = sum;
+    }
+    double mean = (s->count > 0) ? sum / (double) s->count : 0.0;
+    for (size_t i = 0; i < s->count; i++) {
+        double deviation = s->values[i] - mean;
+        squares += deviation * deviation;
+
+        long bin = lround(deviation / step) + HISTOGRAM_HALF;
+        if (bin < 0 || bin >= HISTOGRAM_BINS) {
+            s->outliers++;
+        } else {
+            s->histogram[bin]++;
+        }
+    }
+    s->mean += mean;
+    s->variance = (s->count > 1) ? squares / (double)(s->count - 1) : 0.0;
+
+    for (size_t m = 1; s->taus < MAX_TAUS && differences(s, m) >= MIN_DIFFERENCES; m *= 2) {
+        s->m[s->taus++] = m;
+    }
+}
+
+/**
+ * @brief Overlapping Allan deviation of a series for averages of `m`
+ * samples, in one pass over its prefix sums. Both averages of a difference
+ * are taken from the same segment.
+ */
+static double allan_deviation(const series_t *s, size_t m)
+{
+    double sum = 0.0;
+
+    for (size_t segment = 0; segment < s->segments; segment++) {
+        size_t end = s->starts[segment + 1];
+        for (size_t i = s->starts[segment]; i + 2 * m <= end; i++) {
+            double first = s->prefix[i + m] - s->prefix[i];
+            double second = s->prefix[i + 2 * m] - s->prefix[i + m];
+            double difference = (second - first) / (double) m;
+            sum += difference * difference;
+        }
+    }
+    return sqrt(sum / (2.0 * (double) differences(s, m)));
+}
+
+/**
+ * @brief Computes Allan deviations, taking the (series, averaging length)
+ * work items from a shared counter.
+ */
+static void *allan_thread(void *arg)
+{
+    (void) arg;
+    size_t item;
+
+    while ((item = atomic_fetch_add(&next_item, 1)) < series_count * MAX_TAUS) {
+        series_t *s = &series[item % series_count];
+        size_t tau = item / series_count;
+        if (tau < s->taus) {
+            s->adev[tau] = allan_deviation(s, s->m[tau]);
+        }
+    }
+    return NULL;
+}
+
+static void analyze(unsigned int threads)
+{
+    pthread_t ids[MAX_THREADS];
+
+    for (size_t i = 0; i < series_count; i++) {
+        describe_series(&series[i]);
+    }
+    // Items are ordered by tau, so the long passes (small m) start first.
+    atomic_store(&next_item, 0);
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_create(&ids[i], NULL, allan_thread, NULL);
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_join(ids[i], NULL);
+    }
+}
+
+static int compare_series(const void *a, const void *b)
+{
+    const series_t *x = a, *y = b;
+    if (x->quantity != y->quantity) {
+        return x->quantity - y->quantity;
+    }
+    return (int) resolution_index(x->resolution) - (int) resolution_index(y->resolution);
+}
+
+static void print_series(const series_t *s)
+{
+    double scale = quantity_scales[s->quantity];
+
+    printf("%s, resolution 0x%02x (%u bits): %zu samples in %zu segments, every %.2f ms\n",
+           quantity_names[s->quantity], s->resolution, resolution_bits[s->quantity][resolution_index(s->resolution)],
+           s->count, s->segments, s->period_s * 1e3);
+    printf("  mean %.4f %s, standard deviation %.5f %s (%.2f raw)\n", s->mean * scale + quantity_offsets[s->quantity],
+           quantity_units[s->quantity], sqrt(s->variance) * scale, quantity_units[s->quantity], sqrt(s->variance));
+    printf("  noise floor, deviation from the mean in steps:");
+    for (int bin = 0; bin < HISTOGRAM_BINS; bin++) {
+        printf(" %+d:%llu", bin - HISTOGRAM_HALF, (unsigned long long) s->histogram[bin]);
+    }
+    printf(" beyond:%llu\n", (unsigned long long) s->outliers);
+    printf("  %10s %12s %14s\n", "m", "tau (s)", "adev");
+    for (size_t tau = 0; tau < s->taus; tau++) {
+        printf("  %10zu %12.3f %14.6f\n", s->m[tau], (double) s->m[tau] * s->period_s, s->adev[tau] * scale);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Returns the smallest averaging length whose Allan deviation is
+ * within `target`, or 0 if none is.
+ */
+static size_t oversampling_for(const series_t *s, double target)
+{
+    for (size_t tau = 0; tau < s->taus; tau++) {
+        if (s->adev[tau] * quantity_scales[s->quantity] <= target) {
+            return s->m[tau];
+        }
+    }
+    return 0;
+}
+
+static void recommend(double target_c, double target_rh, double rate_hz)
+{
+    int best = -1;
+    size_t best_m = 0;
+    double best_busy_ms = 0.0;
+
+    printf("Target: %.4f C and %.4f %%RH at %.2f Hz\n", target_c, target_rh, rate_hz);
+    printf("%12s %14s %14s %16s %10s\n", "resolution", "oversampling", "output (Hz)", "converting (ms)", "");
+    for (uint8_t index = 0; index < 4; index++) {
+        uint8_t resolution = (uint8_t)(((index & 0x02) << 6) | (index & 0x01));
+        const series_t *temperature = NULL, *humidity = NULL;
+        for (size_t i = 0; i < series_count; i++) {
+            if (series[i].resolution == resolution) {
+                if (series[i].quantity == QUANTITY_TEMPERATURE) {
+                    temperature = &series[i];
+                } else {
+                    humidity = &series[i];
+                }
+            }
+        }
+        if (temperature == NULL || humidity == NULL) {
+            continue;
+        }
+
+        size_t m_temperature = oversampling_for(temperature, target_c);
+        size_t m_humidity = oversampling_for(humidity, target_rh);
+        if (m_temperature == 0 || m_humidity == 0) {
+            printf("        0x%02x %14s %14s %16s %10s\n", resolution, "-", "-", "-", "too noisy or too short");
+            continue;
+        }
+        size_t m = (m_temperature > m_humidity) ? m_temperature : m_humidity;
+        double output_hz = 1.0 / ((double) m * temperature->period_s);
+        double busy_ms = (double) m * (conversion_ms[QUANTITY_TEMPERATURE][index] +
+                                       conversion_ms[QUANTITY_HUMIDITY][index]);
+        bool reaches_rate = output_hz >= rate_hz;
+        printf("        0x%02x %14zu %14.2f %16.1f %10s\n", resolution, m, output_hz, busy_ms,
+               reaches_rate ? "" : "too slow");
+        if (reaches_rate && (best < 0 || busy_ms < best_busy_ms)) {
+            best = resolution;
+            best_m = m;
+            best_busy_ms = busy_ms;
+        }
+    }
+
+    if (best < 0) {
+        printf("No resolution meets the target: relax the noise or the rate, or filter (htu21d_filter.h).\n");
+    } else {
+        printf("Recommended: resolution 0x%02x, averaging %zu samples.\n", best, best_m);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int threads = (cpus > 0) ? (unsigned int) cpus : 1;
+    double target_c = 0.01, target_rh = 0.04, rate_hz = 1.0;
+    int option;
+
+    while ((option = getopt(argc, argv, "j:T:H:r:")) != -1) {
+        switch (option) {
+        case 'j':
+            threads = (unsigned int) strtoul(optarg, NULL, 10);
+            break;
+        case 'T':
+            target_c = strtod(optarg, NULL);
+            break;
+        case 'H':
+            target_rh = strtod(optarg, NULL);
+            break;
+        case 'r':
+            rate_hz = strtod(optarg, NULL);
+            break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-j threads] [-T target_c] [-H target_rh] [-r rate_hz] capture.csv\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+    if (st.st_size == 0) {
+        fprintf(stderr, "%s: empty capture\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    const char *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    static chunk_t chunks[MAX_THREADS];
+    parse(data, (size_t) st.st_size, chunks, threads);
+    build_series(chunks, threads);
+    for (unsigned int i = 0; i < threads; i++) {
+        free(chunks[i].records);
+    }
+    munmap((void *) data, (size_t) st.st_size);
+    close(fd);
+
+    if (series_count == 0) {
+        fprintf(stderr, "%s: no capture lines (N,...) found\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+    analyze(threads);
+
+    qsort(series, series_count, sizeof(series[0]), compare_series);
+    for (size_t i = 0; i < series_count; i++) {
+        print_series(&series[i]);
+    }
+    recommend(target_c, target_rh, rate_hz);
+
+    return EXIT_SUCCESS;
+}
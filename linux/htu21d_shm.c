@@ -0,0 +1,306 @@
+/**
+ * @file htu21d_shm.c
+ * @brief Shared-memory broadcast ring of HTU21D samples, for Linux gateways.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "htu21d_port.h"
+#include "htu21d_shm.h"
+
+static const char* TAG = "htu21d_shm";
+
+_Static_assert(sizeof(htu21d_shm_header_t) == 64, "the header is part of the segment format");
+_Static_assert(sizeof(htu21d_shm_slot_t) == 32, "the slot is part of the segment format");
+
+static size_t segment_size(uint32_t capacity)
+{
+    return sizeof(htu21d_shm_header_t) + (size_t) capacity * sizeof(htu21d_shm_slot_t);
+}
+
+static bool is_valid_header(const htu21d_shm_header_t *header, size_t size)
+{
+    return header->magic == HTU21D_SHM_MAGIC &&
+           header->version == HTU21D_SHM_VERSION &&
+           header->slot_size == sizeof(htu21d_shm_slot_t) &&
+           header->capacity != 0 && (header->capacity & (header->capacity - 1)) == 0 &&
+           segment_size(header->capacity) == size;
+}
+
+/**
+ * @brief Marks a segment as no longer in use, so that the readers still
+ * attached to it stop reading and reopen it by name.
+ */
+static void retire_segment(int fd, size_t size)
+{
+    if (size < sizeof(htu21d_shm_header_t)) {
+        return;
+    }
+    htu21d_shm_header_t *header = mmap(NULL, sizeof(*header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        return;
+    }
+    atomic_thread_fence(memory_order_release);
+    header->magic = 0;
+    munmap(header, sizeof(*header));
+}
+
+/**
+ * @brief Creates the shared-memory segment of a ring, or reuses it.
+ *
+ * If a segment of the same capacity already exists, e.g. because the writer
+ * restarted, it is kept as is and the writer continues after its last record,
+ * so readers still attached are not disturbed. A segment of another size is
+ * never resized, as the readers that have it mapped would fault: it is
+ * retired (see #htu21d_shm_read) and unlinked, and a new one is created.
+ * @param[out] writer The writer to initialize.
+ * @param name Name of the segment, e.g. `"/htu21d"` (see `shm_open(3)`).
+ * @param capacity Number of records kept, a power of 2. Readers that fall
+ * further behind lose records.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_INVALID_ARG if an
+ * argument is invalid, or #HTU21D_ERR_FAIL if the segment could not be created.
+ */
+int htu21d_shm_writer_open(htu21d_shm_writer_t *writer, const char *name, uint32_t capacity)
+{
+    if (writer == NULL || name == NULL || strlen(name) >= sizeof(writer->name) ||
+            capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Cannot open %s: %s", name, strerror(errno));
+        return HTU21D_ERR_FAIL;
+    }
+
+    struct stat st;
+    size_t size = segment_size(capacity);
+    if (fstat(fd, &st) != 0) {
+        ESP_LOGE(TAG, "Cannot stat %s: %s", name, strerror(errno));
+        close(fd);
+        return HTU21D_ERR_FAIL;
+    }
+    bool reuse = (size_t) st.st_size == size;
+    if (!reuse && st.st_size != 0) {
+        retire_segment(fd, (size_t) st.st_size);
+        close(fd);
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) {
+            ESP_LOGE(TAG, "Cannot create %s: %s", name, strerror(errno));
+            return HTU21D_ERR_FAIL;
+        }
+    }
+    if (!reuse && ftruncate(fd, (off_t) size) != 0) {
+        ESP_LOGE(TAG, "Cannot size %s: %s", name, strerror(errno));
+        close(fd);
+        return HTU21D_ERR_FAIL;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        ESP_LOGE(TAG, "Cannot map %s: %s", name, strerror(errno));
+        return HTU21D_ERR_FAIL;
+    }
+
+    *writer = (htu21d_shm_writer_t) {
+        .header = (htu21d_shm_header_t *) map,
+        .slots = (htu21d_shm_slot_t *)((uint8_t *) map + sizeof(htu21d_shm_header_t)),
+        .size = size,
+    };
+    strcpy(writer->name, name);
+
+    if (!reuse || !is_valid_header(writer->header, size)) {
+        htu21d_shm_header_t *header = writer->header;
+        header->magic = 0;
+        atomic_thread_fence(memory_order_release);
+        memset(writer->slots, 0, size - sizeof(*header));
+        atomic_store_explicit(&header->head, 0, memory_order_relaxed);
+        header->version = HTU21D_SHM_VERSION;
+        header->capacity = capacity;
+        header->slot_size = sizeof(htu21d_shm_slot_t);
+        // Readers only accept the segment once the magic is there.
+        atomic_thread_fence(memory_order_release);
+        header->magic = HTU21D_SHM_MAGIC;
+    }
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Appends a sample to the ring, overwriting the oldest record when full.
+ *
+ * Never blocks and makes no system call. There must be a single writer: when
+ * several threads publish, serialize the calls.
+ * @param writer An opened writer.
+ * @param sensor_id Identifier of the sensor, stored with the sample.
+ * @param[in] sample The sample to publish.
+ */
+void htu21d_shm_write(htu21d_shm_writer_t *writer, uint32_t sensor_id, const htu21d_sample_t *sample)
+{
+    htu21d_shm_header_t *header = writer->header;
+    uint64_t index = atomic_load_explicit(&header->head, memory_order_relaxed);
+    htu21d_shm_slot_t *slot = &writer->slots[index & (header->capacity - 1)];
+
+    atomic_store_explicit(&slot->sequence, 2 * index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->record = (htu21d_shm_record_t) {
+        .sensor_id = sensor_id,
+        .raw_temperature = sample->raw_temperature,
+        .raw_humidity = sample->raw_humidity,
+        .temperature = sample->temperature,
+        .humidity = sample->humidity,
+        .timestamp_us = sample->timestamp_us,
+    };
+    atomic_store_explicit(&slot->sequence, 2 * index + 2, memory_order_release);
+    atomic_store_explicit(&header->head, index + 1, memory_order_release);
+}
+
+/**
+ * @brief Unmaps the ring of a writer.
+ * @param writer An opened writer.
+ * @param unlink If `true`, also removes the segment. Readers still attached
+ * keep their mapping, but receive nothing more.
+ */
+void htu21d_shm_writer_close(htu21d_shm_writer_t *writer, bool unlink)
+{
+    if (writer->header == NULL) {
+        return;
+    }
+    munmap(writer->header, writer->size);
+    if (unlink) {
+        shm_unlink(writer->name);
+    }
+    writer->header = NULL;
+    writer->slots = NULL;
+}
+
+/**
+ * @brief Attaches to the ring of a writer, read-only.
+ *
+ * The reader starts at the current end of the ring, so it receives the
+ * records published from now on. There is no coordination with the writer or
+ * other readers; any number of readers can attach.
+ * @param[out] reader The reader to initialize.
+ * @param name Name of the segment, as given to the writer.
+ * @return Returns #HTU21D_ERR_OK on success, #HTU21D_ERR_NOTFOUND if the segment
+ * does not exist, #HTU21D_ERR_INVALID_STATE if it is not (yet) a valid ring, or
+ * #HTU21D_ERR_FAIL if it could not be mapped.
+ */
+int htu21d_shm_reader_open(htu21d_shm_reader_t *reader, const char *name)
+{
+    if (reader == NULL || name == NULL) {
+        return HTU21D_ERR_INVALID_ARG;
+    }
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return (errno == ENOENT) ? HTU21D_ERR_NOTFOUND : HTU21D_ERR_FAIL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(htu21d_shm_header_t)) {
+        close(fd);
+        return HTU21D_ERR_INVALID_STATE;
+    }
+    size_t size = (size_t) st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        ESP_LOGE(TAG, "Cannot map %s: %s", name, strerror(errno));
+        return HTU21D_ERR_FAIL;
+    }
+
+    const htu21d_shm_header_t *header = (const htu21d_shm_header_t *) map;
+    bool initialized = header->magic == HTU21D_SHM_MAGIC;
+    atomic_thread_fence(memory_order_acquire);
+    if (!initialized || !is_valid_header(header, size)) {
+        munmap(map, size);
+        return HTU21D_ERR_INVALID_STATE;
+    }
+
+    *reader = (htu21d_shm_reader_t) {
+        .header = header,
+        .slots = (const htu21d_shm_slot_t *)((const uint8_t *) map + sizeof(htu21d_shm_header_t)),
+        .size = size,
+        .capacity = header->capacity,
+        .cursor = atomic_load_explicit(&header->head, memory_order_acquire),
+    };
+
+    return HTU21D_ERR_OK;
+}
+
+/**
+ * @brief Reads the next record of the ring, if there is one.
+ *
+ * Never blocks and makes no system call. When the reader was lapped by the
+ * writer, the overwritten records are skipped and added to `reader->lost`.
+ *
+ * The ring is only indexed with the capacity found at
+ * #htu21d_shm_reader_open. When a writer retired the segment (it restarted
+ * with another capacity) or reinitialized it, the reader stops there: close
+ * it and open it again.
+ * @param reader An opened reader.
+ * @param[out] record Where to copy the record.
+ * @return Returns #HTU21D_ERR_OK if a record was read, #HTU21D_ERR_NOTFOUND if
+ * the reader is caught up with the writer, or #HTU21D_ERR_INVALID_STATE if the
+ * segment is no longer the ring the reader attached to.
+ */
+int htu21d_shm_read(htu21d_shm_reader_t *reader, htu21d_shm_record_t *record)
+{
+    const htu21d_shm_header_t *header = reader->header;
+    const uint32_t capacity = reader->capacity;
+
+    for (;;) {
+        if (header->magic != HTU21D_SHM_MAGIC || header->capacity != capacity) {
+            return HTU21D_ERR_INVALID_STATE;
+        }
+        uint64_t head = atomic_load_explicit(&header->head, memory_order_acquire);
+        if (reader->cursor >= head) {
+            // Also covers a writer that recreated the segment from scratch.
+            reader->cursor = head;
+            return HTU21D_ERR_NOTFOUND;
+        }
+        if (head - reader->cursor > capacity) {
+            reader->lost += head - capacity - reader->cursor;
+            reader->cursor = head - capacity;
+        }
+
+        const htu21d_shm_slot_t *slot = &reader->slots[reader->cursor & (capacity - 1)];
+        const uint64_t expected = 2 * reader->cursor + 2;
+
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) == expected) {
+            htu21d_shm_record_t copy = slot->record;
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == expected) {
+                *record = copy;
+                reader->cursor++;
+                return HTU21D_ERR_OK;
+            }
+        }
+
+        // The slot was rewritten for a later record while we got to it.
+        reader->lost++;
+        reader->cursor++;
+    }
+}
+
+/**
+ * @brief Detaches a reader from the ring.
+ * @param reader An opened reader.
+ */
+void htu21d_shm_reader_close(htu21d_shm_reader_t *reader)
+{
+    if (reader->header == NULL) {
+        return;
+    }
+    munmap((void *) reader->header, reader->size);
+    reader->header = NULL;
+    reader->slots = NULL;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file htu21d_shm.h
+ * @brief Shared-memory broadcast ring of HTU21D samples, for Linux gateways.
+ *
+ * One writer (e.g. `htu21d-gatewayd`) publishes samples into a POSIX
+ * shared-memory segment; any number of reader processes map it read-only and
+ * follow the stream with their own cursor. Readers never block the writer and
+ * never make a system call to read: each slot is protected by a seqlock, so a
+ * reader copies the record and checks that the slot was not rewritten
+ * meanwhile. A reader that falls more than a ring behind skips the records it
+ * lost and counts them. A writer restarted with another capacity creates a
+ * new segment and retires the old one: the readers attached to it get
+ * #HTU21D_ERR_INVALID_STATE and reopen the ring.
+ *
+ * Segment layout (all fields native-endian):
+ *
+ *     htu21d_shm_header_t                      64 bytes
+ *     htu21d_shm_slot_t[capacity]              32 bytes each
+ *
+ * Record `i` lives in slot `i % capacity`. Its sequence is `2 * i + 1` while it
+ * is being written and `2 * i + 2` once it is complete.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#pragma once
+
+#ifndef __HTU21D_SHM_H__
+#define __HTU21D_SHM_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "htu21d.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTU21D_SHM_MAGIC    0x31325548  /**< "HU21" read as little-endian bytes. */
+#define HTU21D_SHM_VERSION  1
+
+/**
+ * @brief One sample, as stored in the ring.
+ */
+typedef struct {
+    uint32_t sensor_id;      /**< Identifier of the sensor, chosen by the writer. */
+    uint16_t raw_temperature; /**< Raw temperature reading. */
+    uint16_t raw_humidity;   /**< Raw humidity reading. */
+    float temperature;       /**< Temperature in degrees Celsius. */
+    float humidity;          /**< Relative humidity in %RH. */
+    int64_t timestamp_us;    /**< Monotonic time of the sample, see #htu21d_sample_t. */
+} htu21d_shm_record_t;
+
+/**
+ * @brief A slot of the ring: a record and its seqlock.
+ */
+typedef struct {
+    _Atomic uint64_t sequence;  /**< Odd while the record is written, see the file description. */
+    htu21d_shm_record_t record;
+} htu21d_shm_slot_t;
+
+/**
+ * @brief Header at the start of the segment.
+ */
+typedef struct {
+    uint32_t magic;         /**< #HTU21D_SHM_MAGIC once the segment is initialized. */
+    uint32_t version;       /**< #HTU21D_SHM_VERSION. */
+    uint32_t capacity;      /**< Number of slots, a power of 2. */
+    uint32_t slot_size;     /**< `sizeof(htu21d_shm_slot_t)`. */
+    uint8_t reserved1[16];
+    _Atomic uint64_t head;  /**< Number of records written since the segment was created. */
+    uint8_t reserved2[24];  /**< Keeps `head` alone on its cache line. */
+} htu21d_shm_header_t;
+
+/**
+ * @brief Writer side of a ring. Treat the members as private.
+ */
+typedef struct {
+    htu21d_shm_header_t *header;
+    htu21d_shm_slot_t *slots;
+    size_t size;                /**< Size of the mapping. */
+    char name[64];              /**< Name of the segment. */
+} htu21d_shm_writer_t;
+
+/**
+ * @brief Reader side of a ring. Treat the members as private, except `lost`.
+ */
+typedef struct {
+    const htu21d_shm_header_t *header;
+    const htu21d_shm_slot_t *slots;
+    size_t size;                /**< Size of the mapping. */
+    uint32_t capacity;          /**< Number of slots when the reader attached; the ring is never indexed past it. */
+    uint64_t cursor;            /**< Index of the next record to read. */
+    uint64_t lost;              /**< Records overwritten before this reader got to them. */
+} htu21d_shm_reader_t;
+
+int htu21d_shm_writer_open(htu21d_shm_writer_t *writer, const char *name, uint32_t capacity);
+void htu21d_shm_write(htu21d_shm_writer_t *writer, uint32_t sensor_id, const htu21d_sample_t *sample);
+void htu21d_shm_writer_close(htu21d_shm_writer_t *writer, bool unlink);
+
+int htu21d_shm_reader_open(htu21d_shm_reader_t *reader, const char *name);
+int htu21d_shm_read(htu21d_shm_reader_t *reader, htu21d_shm_record_t *record);
+void htu21d_shm_reader_close(htu21d_shm_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __HTU21D_SHM_H__
@@ -0,0 +1,94 @@
+/**
+ * @file htu21d_shm_cat.c
+ * @brief Prints the samples published in an HTU21D shared-memory ring.
+ *
+ * Usage:
+ *
+ *     htu21d-shm-cat [-d seconds] name
+ *
+ * Attaches to the ring `name` (as given to `htu21d-gatewayd -s`) and prints
+ * every new record as CSV until interrupted. Records are read without system
+ * calls; the process only sleeps when it has caught up with the writer. On
+ * exit, the number of records read and lost is printed to stderr.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "htu21d_shm.h"
+
+#define IDLE_SLEEP_MS   10
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int signal_number)
+{
+    (void) signal_number;
+    stop = 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int duration_s = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "d:")) != -1) {
+        if (option != 'd') {
+            break;
+        }
+        duration_s = (unsigned int) strtoul(optarg, NULL, 10);
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-d seconds] name\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    htu21d_shm_reader_t reader;
+    int ret = htu21d_shm_reader_open(&reader, argv[optind]);
+    if (ret != HTU21D_ERR_OK) {
+        fprintf(stderr, "Cannot attach to %s, error 0x%02X\n", argv[optind], ret);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    if (duration_s != 0) {
+        signal(SIGALRM, on_signal);
+        alarm(duration_s);
+    }
+
+    uint64_t count = 0;
+    const struct timespec idle = {.tv_nsec = IDLE_SLEEP_MS * 1000000L};
+    while (!stop) {
+        htu21d_shm_record_t record;
+        ret = htu21d_shm_read(&reader, &record);
+        if (ret == HTU21D_ERR_INVALID_STATE) {
+            // The writer restarted with another capacity: follow it to the new segment.
+            uint64_t lost = reader.lost;
+            htu21d_shm_reader_close(&reader);
+            while (!stop && htu21d_shm_reader_open(&reader, argv[optind]) != HTU21D_ERR_OK) {
+                nanosleep(&idle, NULL);
+            }
+            reader.lost += lost;
+            continue;
+        }
+        if (ret != HTU21D_ERR_OK) {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        printf("%" PRIu32 ",%" PRId64 ",%.2f,%.2f\n", record.sensor_id, record.timestamp_us,
+               record.temperature, record.humidity);
+        count++;
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "%" PRIu64 " records read, %" PRIu64 " lost\n", count, reader.lost);
+    htu21d_shm_reader_close(&reader);
+
+    return EXIT_SUCCESS;
+}
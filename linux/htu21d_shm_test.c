@@ -0,0 +1,222 @@
+/**
+ * @file htu21d_shm_test.c
+ * @brief Tests of the shared-memory sample ring of htu21d_shm.h. Run with
+ * `ctest`.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "htu21d_shm.h"
+
+#define CAPACITY        8
+#define STRESS_RECORDS  2000000 /**< Records written while a reader follows, in the torn read test. */
+
+static int failures;
+static char name[64];
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if (!(condition)) {                                                 \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+/**
+ * @brief Writes record `index`: every field is derived from it, so that a
+ * reader can tell a torn copy.
+ */
+static void write_record(htu21d_shm_writer_t *writer, uint32_t index)
+{
+    const htu21d_sample_t sample = {
+        .raw_temperature = (uint16_t) index,
+        .raw_humidity = (uint16_t) ~index,
+        .temperature = (float)(index & 0xFFFF),
+        .humidity = (float)(index & 0xFF),
+        .timestamp_us = (int64_t) index * 1000,
+    };
+    htu21d_shm_write(writer, index, &sample);
+}
+
+static bool is_record(const htu21d_shm_record_t *record, uint32_t index)
+{
+    return record->sensor_id == index && record->raw_temperature == (uint16_t) index &&
+           record->raw_humidity == (uint16_t) ~index && record->temperature == (float)(index & 0xFFFF) &&
+           record->humidity == (float)(index & 0xFF) && record->timestamp_us == (int64_t) index * 1000;
+}
+
+static void test_wrap_around(void)
+{
+    htu21d_shm_writer_t writer;
+    htu21d_shm_reader_t reader;
+    htu21d_shm_record_t record;
+
+    CHECK(htu21d_shm_writer_open(&writer, name, CAPACITY) == HTU21D_ERR_OK);
+    CHECK(htu21d_shm_reader_open(&reader, name) == HTU21D_ERR_OK);
+    CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_NOTFOUND);
+
+    // Three times around the ring, the reader keeping up.
+    for (uint32_t i = 0; i < 3 * CAPACITY; i++) {
+        write_record(&writer, i);
+        CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_OK && is_record(&record, i));
+    }
+    CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_NOTFOUND);
+    CHECK(reader.lost == 0);
+
+    htu21d_shm_reader_close(&reader);
+    htu21d_shm_writer_close(&writer, true);
+}
+
+static void test_overrun(void)
+{
+    htu21d_shm_writer_t writer;
+    htu21d_shm_reader_t reader;
+    htu21d_shm_record_t record;
+
+    CHECK(htu21d_shm_writer_open(&writer, name, CAPACITY) == HTU21D_ERR_OK);
+    CHECK(htu21d_shm_reader_open(&reader, name) == HTU21D_ERR_OK);
+
+    // The writer laps the reader: only the last ring of records is left.
+    const uint32_t written = 2 * CAPACITY + 3;
+    for (uint32_t i = 0; i < written; i++) {
+        write_record(&writer, i);
+    }
+    for (uint32_t i = written - CAPACITY; i < written; i++) {
+        CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_OK && is_record(&record, i));
+    }
+    CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_NOTFOUND);
+    CHECK(reader.lost == written - CAPACITY);
+
+    htu21d_shm_reader_close(&reader);
+    htu21d_shm_writer_close(&writer, true);
+}
+
+static void test_torn_slot(void)
+{
+    htu21d_shm_writer_t writer;
+    htu21d_shm_reader_t reader;
+    htu21d_shm_record_t record;
+
+    CHECK(htu21d_shm_writer_open(&writer, name, CAPACITY) == HTU21D_ERR_OK);
+    CHECK(htu21d_shm_reader_open(&reader, name) == HTU21D_ERR_OK);
+    for (uint32_t i = 0; i < CAPACITY; i++) {
+        write_record(&writer, i);
+    }
+
+    // The writer is rewriting slot 0 for record CAPACITY, not published yet:
+    // record 0 is gone, the reader skips it and counts it.
+    atomic_store(&writer.slots[0].sequence, 2 * (uint64_t) CAPACITY + 1);
+    for (uint32_t i = 1; i < CAPACITY; i++) {
+        CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_OK && is_record(&record, i));
+    }
+    CHECK(reader.lost == 1);
+
+    htu21d_shm_reader_close(&reader);
+    htu21d_shm_writer_close(&writer, true);
+}
+
+static void *stress_writer(void *arg)
+{
+    htu21d_shm_writer_t *writer = (htu21d_shm_writer_t *) arg;
+
+    for (uint32_t i = 0; i < STRESS_RECORDS; i++) {
+        write_record(writer, i);
+    }
+    return NULL;
+}
+
+static void test_torn_reads(void)
+{
+    htu21d_shm_writer_t writer;
+    htu21d_shm_reader_t reader;
+    htu21d_shm_record_t record;
+    pthread_t thread;
+
+    // A small ring and a fast writer: the reader is lapped all the time, and
+    // every record it returns must still be whole and in order. Copies torn
+    // by a concurrent write need several CPUs; test_torn_slot covers the
+    // same path deterministically.
+    CHECK(htu21d_shm_writer_open(&writer, name, CAPACITY) == HTU21D_ERR_OK);
+    CHECK(htu21d_shm_reader_open(&reader, name) == HTU21D_ERR_OK);
+    pthread_create(&thread, NULL, stress_writer, &writer);
+
+    uint64_t read = 0, torn = 0;
+    int64_t previous = -1;
+    while (reader.cursor < STRESS_RECORDS) {
+        if (htu21d_shm_read(&reader, &record) != HTU21D_ERR_OK) {
+            continue;
+        }
+        torn += !is_record(&record, record.sensor_id) || (int64_t) record.sensor_id <= previous;
+        previous = record.sensor_id;
+        read++;
+    }
+    pthread_join(thread, NULL);
+    CHECK(torn == 0);
+    CHECK(read + reader.lost == STRESS_RECORDS);
+
+    htu21d_shm_reader_close(&reader);
+    htu21d_shm_writer_close(&writer, true);
+}
+
+static void test_writer_restart(void)
+{
+    htu21d_shm_writer_t writer;
+    htu21d_shm_reader_t reader;
+    htu21d_shm_record_t record;
+
+    CHECK(htu21d_shm_writer_open(&writer, name, CAPACITY) == HTU21D_ERR_OK);
+    CHECK(htu21d_shm_reader_open(&reader, name) == HTU21D_ERR_OK);
+    write_record(&writer, 0);
+    htu21d_shm_writer_close(&writer, false);
+
+    // Same capacity: the segment is kept and the reader goes on.
+    CHECK(htu21d_shm_writer_open(&writer, name, CAPACITY) == HTU21D_ERR_OK);
+    write_record(&writer, 1);
+    CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_OK && is_record(&record, 0));
+    CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_OK && is_record(&record, 1));
+    htu21d_shm_writer_close(&writer, false);
+
+    // Larger, then smaller: the reader is told, never indexes past its
+    // mapping, and follows by reopening.
+    const uint32_t capacities[] = {8 * CAPACITY, CAPACITY / 2};
+    for (size_t i = 0; i < sizeof(capacities) / sizeof(capacities[0]); i++) {
+        CHECK(htu21d_shm_writer_open(&writer, name, capacities[i]) == HTU21D_ERR_OK);
+        for (uint32_t j = 0; j < 2 * CAPACITY; j++) {
+            write_record(&writer, j);
+        }
+        CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_INVALID_STATE);
+        htu21d_shm_reader_close(&reader);
+        CHECK(htu21d_shm_reader_open(&reader, name) == HTU21D_ERR_OK);
+        CHECK(reader.capacity == capacities[i]);
+        write_record(&writer, 100);
+        CHECK(htu21d_shm_read(&reader, &record) == HTU21D_ERR_OK && is_record(&record, 100));
+        htu21d_shm_writer_close(&writer, false);
+    }
+
+    htu21d_shm_reader_close(&reader);
+    CHECK(htu21d_shm_writer_open(&writer, name, CAPACITY) == HTU21D_ERR_OK);
+    htu21d_shm_writer_close(&writer, true);
+}
+
+int main(void)
+{
+    snprintf(name, sizeof(name), "/htu21d-shm-test-%d", (int) getpid());
+
+    test_wrap_around();
+    test_overrun();
+    test_torn_slot();
+    test_torn_reads();
+    test_writer_restart();
+
+    if (failures != 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file htu21d_stats_test.c
+ * @brief Tests of the P² quantile estimator and of the raw histogram of
+ * htu21d_stats.h. Run with `ctest`.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "htu21d.h"
+#include "htu21d_stats.h"
+
+#define VALUES  10000 /**< Values of the known distribution: a shuffle of 0 .. VALUES - 1. */
+
+static int failures;
+
+#define CHECK(condition)                                                    \
+    do {                                                                    \
+        if (!(condition)) {                                                 \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                     \
+        }                                                                   \
+    } while (0)
+
+static uint32_t values[VALUES];
+
+/**
+ * @brief Fills `values` with a deterministic shuffle of 0 .. VALUES - 1, whose
+ * quantile p is `p * (VALUES - 1)`.
+ */
+static void shuffle_values(void)
+{
+    uint32_t random = 12345;
+
+    for (uint32_t i = 0; i < VALUES; i++) {
+        values[i] = i;
+    }
+    for (uint32_t i = VALUES - 1; i > 0; i--) {
+        random = random * 1664525U + 1013904223U;
+        uint32_t j = (random >> 8) % (i + 1);
+        uint32_t swap = values[i];
+        values[i] = values[j];
+        values[j] = swap;
+    }
+}
+
+/**
+ * @brief Checks the invariants P² relies on: positions strictly increasing
+ * from 1 to the count, heights sorted.
+ */
+static bool p2_is_consistent(const htu21d_p2_t *estimator)
+{
+    if (estimator->count < 5) {
+        return true;
+    }
+    if (estimator->positions[0] != 1 || estimator->positions[4] != (int32_t) estimator->count) {
+        return false;
+    }
+    for (int i = 1; i < 5; i++) {
+        if (estimator->positions[i] <= estimator->positions[i - 1] ||
+                !(estimator->heights[i] >= estimator->heights[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_p2_quantile(void)
+{
+    const float quantiles[] = {0.05F, 0.5F, 0.95F, 0.99F};
+
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+        htu21d_p2_t estimator;
+        CHECK(htu21d_p2_init(&estimator, quantiles[q]) == HTU21D_ERR_OK);
+        for (uint32_t i = 0; i < VALUES; i++) {
+            htu21d_p2_add(&estimator, (float) values[i]);
+        }
+        CHECK(p2_is_consistent(&estimator));
+        // Within 1 % of the range of the true quantile.
+        CHECK(fabsf(htu21d_p2_get(&estimator) - quantiles[q] * (VALUES - 1)) < VALUES / 100);
+    }
+
+    htu21d_p2_t estimator;
+    CHECK(htu21d_p2_init(&estimator, 0.0F) == HTU21D_ERR_INVALID_ARG);
+    CHECK(htu21d_p2_init(&estimator, 1.0F) == HTU21D_ERR_INVALID_ARG);
+}
+
+static void test_p2_merge(void)
+{
+    htu21d_p2_t first, second, other;
+
+    // Two halves of the same distribution merge to the quantile of the whole.
+    htu21d_p2_init(&first, 0.9F);
+    htu21d_p2_init(&second, 0.9F);
+    for (uint32_t i = 0; i < VALUES; i++) {
+        htu21d_p2_add(i < VALUES / 2 ? &first : &second, (float) values[i]);
+    }
+    CHECK(htu21d_p2_merge(&first, &second) == HTU21D_ERR_OK);
+    CHECK(first.count == VALUES);
+    CHECK(p2_is_consistent(&first));
+    CHECK(fabsf(htu21d_p2_get(&first) - 0.9F * (VALUES - 1)) < VALUES / 100);
+
+    // The merged estimator keeps estimating.
+    for (uint32_t i = 0; i < VALUES; i++) {
+        htu21d_p2_add(&first, (float) values[i]);
+    }
+    CHECK(p2_is_consistent(&first));
+    CHECK(fabsf(htu21d_p2_get(&first) - 0.9F * (VALUES - 1)) < VALUES / 100);
+
+    htu21d_p2_init(&other, 0.5F);
+    CHECK(htu21d_p2_merge(&first, &other) == HTU21D_ERR_INVALID_ARG);
+}
+
+static void test_p2_small_merge(void)
+{
+    htu21d_p2_t first, second;
+
+    // 5 + 5 values at p = 0.95: rounding the desired positions gives
+    // 1 5 10 10 10, which the next update would divide by zero with.
+    htu21d_p2_init(&first, 0.95F);
+    htu21d_p2_init(&second, 0.95F);
+    for (int i = 0; i < 5; i++) {
+        htu21d_p2_add(&first, (float) i);
+        htu21d_p2_add(&second, (float)(i + 5));
+    }
+    CHECK(htu21d_p2_merge(&first, &second) == HTU21D_ERR_OK);
+    CHECK(first.count == 10);
+    CHECK(p2_is_consistent(&first));
+
+    for (int i = 0; i < 100; i++) {
+        htu21d_p2_add(&first, (float)(i % 10));
+        CHECK(p2_is_consistent(&first));
+        CHECK(isfinite(htu21d_p2_get(&first)));
+    }
+    CHECK(htu21d_p2_get(&first) >= 0.0F && htu21d_p2_get(&first) <= 9.0F);
+}
+
+static void test_histogram(void)
+{
+    htu21d_histogram_t first, second, other;
+
+    // 64 bins of 256 counts: 0 .. 16383, the values beyond overflow.
+    CHECK(htu21d_histogram_init(&first, 0, 8) == HTU21D_ERR_OK);
+    CHECK(htu21d_histogram_init(&second, 0, 8) == HTU21D_ERR_OK);
+    for (uint32_t i = 0; i < VALUES; i++) {
+        htu21d_histogram_add(i < VALUES / 2 ? &first : &second, (uint16_t) values[i]);
+    }
+    CHECK(htu21d_histogram_merge(&first, &second) == HTU21D_ERR_OK);
+    CHECK(first.total == VALUES && first.underflow == 0 && first.overflow == 0);
+
+    // Exact within one bin width.
+    const float quantiles[] = {0.01F, 0.5F, 0.95F};
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+        CHECK(fabsf(htu21d_histogram_quantile(&first, quantiles[q]) - quantiles[q] * VALUES) <= 256.0F);
+    }
+
+    htu21d_histogram_add(&first, 20000);
+    CHECK(first.overflow == 1);
+    CHECK(htu21d_histogram_quantile(&first, 1.0F) == 16384.0F);
+
+    CHECK(htu21d_histogram_init(&other, 100, 8) == HTU21D_ERR_OK);
+    htu21d_histogram_add(&other, 50);
+    CHECK(other.underflow == 1);
+    CHECK(htu21d_histogram_merge(&first, &other) == HTU21D_ERR_INVALID_ARG);
+    CHECK(htu21d_histogram_init(&other, 0, 16) == HTU21D_ERR_INVALID_ARG);
+}
+
+int main(void)
+{
+    shuffle_values();
+    test_p2_quantile();
+    test_p2_merge();
+    test_p2_small_merge();
+    test_histogram();
+
+    if (failures != 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Reports the flash and RAM cost of each HTU21D Kconfig option.
+
+Builds the application in tools/size_report once with the default options,
+then once per option with only that option changed, and prints the size
+differences. The application calls into every enabled feature, so a
+difference is what the option costs an application that uses it.
+
+Usage, from an ESP-IDF environment (export.sh sourced):
+
+    tools/size_report.py [--target esp32c2] [--build-dir DIR] [--json]
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+PROJECT = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'size_report')
+
+# (label, sdkconfig lines applied on top of the defaults)
+VARIANTS = [
+    ('default', []),
+    ('-derived math', ['CONFIG_HTU21D_DERIVED_MATH=n']),
+    ('-sampler', ['CONFIG_HTU21D_SAMPLER=n']),
+    ('-pipeline', ['CONFIG_HTU21D_PIPELINE=n']),
+    ('-resample', ['CONFIG_HTU21D_RESAMPLE=n']),
+    ('-filter', ['CONFIG_HTU21D_FILTER=n']),
+    ('-detect', ['CONFIG_HTU21D_DETECT=n']),
+    ('-stats', ['CONFIG_HTU21D_STATS=n']),
+    ('-fusion', ['CONFIG_HTU21D_FUSION=n']),
+    ('-settings', ['CONFIG_HTU21D_PIPELINE=n', 'CONFIG_HTU21D_SETTINGS=n']),
+    ('-sim', ['CONFIG_HTU21D_SIM=n']),
+    ('crc table', ['CONFIG_HTU21D_CRC_TABLE=y']),
+    ('fixed point', ['CONFIG_HTU21D_CONVERSION_FIXED=y']),
+    ('log none', ['CONFIG_HTU21D_LOG_LEVEL_NONE=y']),
+    ('log debug', ['CONFIG_HTU21D_LOG_LEVEL_DEBUG=y']),
+    ('calibration nvs', ['CONFIG_HTU21D_CALIBRATION_NVS=y']),
+    ('static alloc', ['CONFIG_HTU21D_STATIC_ALLOCATION=y']),
+    ('master driver', ['CONFIG_HTU21D_I2C_DRIVER_MASTER=y']),
+    ('minimal', [
+        'CONFIG_HTU21D_DERIVED_MATH=n',
+        'CONFIG_HTU21D_SAMPLER=n',
+        'CONFIG_HTU21D_RESAMPLE=n',
+        'CONFIG_HTU21D_FILTER=n',
+        'CONFIG_HTU21D_DETECT=n',
+        'CONFIG_HTU21D_STATS=n',
+        'CONFIG_HTU21D_FUSION=n',
+        'CONFIG_HTU21D_SETTINGS=n',
+        'CONFIG_HTU21D_SIM=n',
+        'CONFIG_HTU21D_CONVERSION_FIXED=y',
+        'CONFIG_HTU21D_LOG_LEVEL_NONE=y',
+    ]),
+]
+
+# Keys of "idf.py size --format json" the report is computed from.
+SIZE_KEYS = ['flash_code', 'flash_rodata', 'dram_data', 'dram_bss', 'used_iram', 'total_size']
+
+
+def idf_py(build_dir, *args):
+    command = ['idf.py', '-C', PROJECT, '-B', build_dir,
+               '-D', 'SDKCONFIG=' + os.path.join(build_dir, 'sdkconfig'),
+               '-D', 'SDKCONFIG_DEFAULTS=' + os.path.join(build_dir, 'sdkconfig.defaults')]
+    return subprocess.run(command + list(args), check=True, stdout=subprocess.PIPE,
+                          universal_newlines=True).stdout
+
+
+def measure(build_root, target, label, lines):
+    build_dir = os.path.join(build_root, label.strip('-').replace(' ', '_'))
+    os.makedirs(build_dir, exist_ok=True)
+    with open(os.path.join(build_dir, 'sdkconfig.defaults'), 'w') as defaults:
+        defaults.write(''.join(line + '\n' for line in lines))
+    # set-target regenerates sdkconfig from the defaults written above.
+    idf_py(build_dir, 'set-target', target)
+    idf_py(build_dir, 'build')
+    output = idf_py(build_dir, 'size', '--format', 'json')
+    size = json.loads(output[output.index('{'):])
+    # A key renamed by another ESP-IDF version must not read as 0 bytes.
+    missing = [key for key in SIZE_KEYS if key not in size]
+    if missing:
+        sys.exit('"idf.py size" of "{}" has no {} (keys: {})'.format(
+            label, ', '.join(missing), ', '.join(sorted(size))))
+    flash = size['flash_code'] + size['flash_rodata'] + size['dram_data']
+    ram = size['dram_data'] + size['dram_bss'] + size['used_iram']
+    return {'flash': flash, 'ram': ram, 'total': size['total_size']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--target', default='esp32c2')
+    parser.add_argument('--build-dir', default=os.path.join(PROJECT, 'build'))
+    parser.add_argument('--json', action='store_true', help='print the results as JSON')
+    args = parser.parse_args()
+
+    results = {}
+    for label, lines in VARIANTS:
+        print('Building "{}"...'.format(label), file=sys.stderr)
+        results[label] = measure(args.build_dir, args.target, label, lines)
+
+    if args.json:
+        print(json.dumps({'target': args.target, 'results': results}, indent=2))
+        return
+
+    base = results['default']
+    print('{:<16} {:>10} {:>8} {:>10} {:>8}'.format('option', 'flash', 'ram', 'd flash', 'd ram'))
+    for label, size in results.items():
+        print('{:<16} {:>10} {:>8} {:>+10} {:>+8}'.format(label, size['flash'], size['ram'],
+                                                          size['flash'] - base['flash'],
+                                                          size['ram'] - base['ram']))
+
+
+if __name__ == '__main__':
+    main()
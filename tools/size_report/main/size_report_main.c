@@ -0,0 +1,175 @@
+/**
+ * @file size_report_main.c
+ * @brief Application measured by tools/size_report.py.
+ *
+ * Calls into every feature of the component that is enabled in Kconfig, so
+ * that the linker keeps it, and the size difference between two builds is the
+ * cost of the options that differ. The program is never meant to be run.
+ *
+ * @author rob4226 <rob4226@yahoo.com>
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "htu21d.h"
+#if CONFIG_HTU21D_DETECT
+#include "htu21d_detect.h"
+#endif
+#if CONFIG_HTU21D_FILTER
+#include "htu21d_filter.h"
+#endif
+#if CONFIG_HTU21D_FUSION
+#include "htu21d_fusion.h"
+#endif
+#if CONFIG_HTU21D_I2C_DRIVER_MASTER
+#include "htu21d_i2c_master.h"
+#endif
+#if CONFIG_HTU21D_PIPELINE
+#include "htu21d_pipeline.h"
+#endif
+#if CONFIG_HTU21D_RESAMPLE
+#include "htu21d_resample.h"
+#endif
+#if CONFIG_HTU21D_SAMPLER
+#include "htu21d_sampler.h"
+#endif
+#if CONFIG_HTU21D_SETTINGS
+#include "htu21d_settings.h"
+#endif
+#if CONFIG_HTU21D_SIM
+#include "htu21d_sim.h"
+#endif
+#if CONFIG_HTU21D_STATS
+#include "htu21d_stats.h"
+#endif
+
+static htu21d_dev_t dev;
+static htu21d_sample_t sample;
+
+#if CONFIG_HTU21D_PIPELINE
+static void on_sample(int result, const htu21d_sample_t *pipeline_sample, void *ctx)
+{
+    printf("%d %.2f\n", result, pipeline_sample->temperature);
+}
+#endif
+
+void app_main(void)
+{
+#ifdef HTU21D_I2C_LEGACY
+    htu21d_init(I2C_NUM_0, 1, 2, GPIO_PULLUP_ENABLE, GPIO_PULLUP_ENABLE);
+    htu21d_dev_init(&dev, I2C_NUM_0);
+#else
+    static htu21d_i2c_master_bus_t bus;
+    htu21d_i2c_master_bus_init(&bus, NULL, 100000);
+    htu21d_dev_attach(&dev, &htu21d_i2c_master_transport, &bus);
+#endif
+    htu21d_dev_calibrate(&dev, 3);
+    htu21d_dev_probe_clock(&dev, 400000, 4);
+#if CONFIG_HTU21D_CALIBRATION_NVS
+    static htu21d_calibration_t calibration;
+    if (htu21d_calibration_load_nvs(&calibration, "size") == HTU21D_ERR_OK) {
+        htu21d_dev_set_calibration(&dev, &calibration);
+    }
+    htu21d_calibration_save_nvs(&calibration, "size");
+#endif
+    htu21d_dev_read_sample(&dev, &sample);
+    printf("%.2f %.2f\n", sample.temperature, sample.humidity);
+
+#ifdef HTU21D_DERIVED_MATH
+    printf("%.2f %.2f\n", htu21d_compute_dew_point(sample.temperature, sample.humidity),
+           htu21_compute_compensated_humidity(sample.temperature, sample.humidity));
+#endif
+
+#if CONFIG_HTU21D_SAMPLER
+    static htu21d_sampler_t sampler;
+    static const htu21d_sampler_config_t sampler_config = {
+        .period_ms = 1000,
+    };
+    htu21d_sampler_init(&sampler, &sampler_config);
+    htu21d_sampler_wait(&sampler);
+#endif
+
+#if CONFIG_HTU21D_SETTINGS
+    static htu21d_settings_buffer_t settings_buffer;
+    static htu21d_settings_t settings;
+    uint32_t generation = 0;
+    htu21d_settings_init(&settings_buffer, &settings);
+    settings.resolution = 0x81;
+    htu21d_settings_publish(&settings_buffer, &settings);
+    if (htu21d_settings_read(&settings_buffer, &generation, &settings)) {
+        htu21d_dev_apply_settings(&dev, &settings);
+    }
+#endif
+
+#if CONFIG_HTU21D_PIPELINE
+    static htu21d_pipeline_t pipeline;
+    static htu21d_pipeline_stats_t pipeline_stats;
+    static const htu21d_pipeline_config_t pipeline_config = {
+        .dev = &dev,
+        .period_ms = 1000,
+        .process = on_sample,
+        .priority = 5,
+    };
+    htu21d_pipeline_start(&pipeline, &pipeline_config);
+    htu21d_pipeline_stop(&pipeline);
+    htu21d_pipeline_get_stats(&pipeline, &pipeline_stats);
+    printf("%" PRIu32 "\n", pipeline_stats.dropped);
+#endif
+
+#if CONFIG_HTU21D_RESAMPLE
+    static htu21d_resampler_t resampler;
+    static htu21d_resampler_config_t resampler_config;
+    htu21d_grid_point_t points[4];
+    htu21d_resampler_init(&resampler, &resampler_config);
+    htu21d_resampler_push(&resampler, &sample, points, 4);
+#endif
+
+#if CONFIG_HTU21D_FILTER
+    static htu21d_lead_t lead;
+    static htu21d_lead_config_t lead_config;
+    htu21d_lead_init(&lead, &lead_config);
+    printf("%.2f\n", htu21d_lead_update(&lead, sample.humidity, 0));
+#endif
+
+#if CONFIG_HTU21D_DETECT
+    static htu21d_zscore_t zscore;
+    static htu21d_zscore_config_t zscore_config;
+    static htu21d_cusum_t cusum;
+    static htu21d_cusum_config_t cusum_config;
+    static htu21d_trend_t trend;
+    static htu21d_trend_config_t trend_config;
+    htu21d_zscore_init(&zscore, &zscore_config);
+    htu21d_cusum_init(&cusum, &cusum_config);
+    htu21d_trend_init(&trend, &trend_config);
+    printf("%d %d %d\n", htu21d_zscore_update(&zscore, sample.raw_temperature, 0),
+           htu21d_cusum_update(&cusum, sample.raw_temperature, 0),
+           htu21d_trend_update(&trend, sample.raw_humidity, sample.timestamp_us));
+#endif
+
+#if CONFIG_HTU21D_STATS
+    static htu21d_p2_t p2;
+    static htu21d_histogram_t histogram;
+    htu21d_p2_init(&p2, 0.5F);
+    htu21d_p2_add(&p2, sample.temperature);
+    htu21d_histogram_init(&histogram, 0, 8);
+    htu21d_histogram_add(&histogram, sample.raw_temperature);
+    printf("%.2f %.2f\n", htu21d_p2_get(&p2), htu21d_histogram_quantile(&histogram, 0.5F));
+#endif
+
+#if CONFIG_HTU21D_FUSION
+    static htu21d_fusion_t fusion;
+    static htu21d_fusion_config_t fusion_config;
+    static htu21d_fused_sample_t fused;
+    htu21d_fusion_init(&fusion, &fusion_config);
+    htu21d_fusion_add_member(&fusion, &dev);
+    htu21d_fusion_read(&fusion, &fused);
+#endif
+
+#if CONFIG_HTU21D_SIM
+    static htu21d_sim_t sim;
+    static htu21d_dev_t sim_dev;
+    htu21d_sim_init(&sim, 20.0F, 50.0F);
+    htu21d_dev_attach(&sim_dev, &htu21d_sim_transport, &sim);
+    htu21d_dev_read_sample(&sim_dev, &sample);
+#endif
+}